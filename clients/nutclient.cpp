@@ -818,6 +818,73 @@ int TcpClient::deviceGetNumLogins(const std::string& dev)
 	return atoi(num.c_str());
 }
 
+void TcpClient::watchDevice(const std::string& dev, const std::string& pattern)
+{
+	_socket->write("WATCH " + dev + " " + escape(pattern));
+	readWatchAnswer();
+}
+
+void TcpClient::unwatchDevice(const std::string& dev, const std::string& pattern)
+{
+	std::string req = "UNWATCH";
+
+	if (!dev.empty())
+	{
+		req += " " + dev;
+		if (!pattern.empty())
+		{
+			req += " " + escape(pattern);
+		}
+	}
+
+	_socket->write(req);
+	readWatchAnswer();
+}
+
+std::vector<std::string> TcpClient::readNotification()
+{
+	std::string res;
+
+	if (!_notifications.empty())
+	{
+		res = _notifications.front();
+		_notifications.erase(_notifications.begin());
+	}
+	else
+	{
+		res = _socket->read();
+	}
+
+	detectError(res);
+	if (res.substr(0, 7) != "NOTIFY ")
+	{
+		throw NutException("Invalid response");
+	}
+
+	return explode(res, 7);
+}
+
+void TcpClient::readWatchAnswer()
+{
+	// Notifications for earlier subscriptions may come first
+	while (true)
+	{
+		std::string res = _socket->read();
+		if (res.substr(0, 7) == "NOTIFY ")
+		{
+			_notifications.push_back(res);
+			continue;
+		}
+
+		detectError(res);
+		if (res != "OK")
+		{
+			throw NutException("Invalid response");
+		}
+		return;
+	}
+}
+
 TrackingResult TcpClient::getTrackingResult(const TrackingID& id)
 {
 	if (id.empty())
@@ -426,8 +426,29 @@ public:
 	virtual bool isFeatureEnabled(const Feature& feature);
 	virtual void setFeature(const Feature& feature, bool status);
 
+	/**
+	 * Subscribe to the changes of the variables of a device (WATCH).
+	 * The connection should then be used only for readNotification().
+	 * \param dev Device name, may be a shell-style pattern.
+	 * \param pattern Variable names to watch, as a shell-style pattern.
+	 */
+	void watchDevice(const std::string& dev, const std::string& pattern = "*");
+	/**
+	 * Drop subscriptions (UNWATCH), all of them by default.
+	 * \param dev Device name, as given to watchDevice().
+	 * \param pattern Variable pattern, as given to watchDevice().
+	 */
+	void unwatchDevice(const std::string& dev = "", const std::string& pattern = "");
+	/**
+	 * Wait for the next notification, up to the timeout.
+	 * \return The notification without its NOTIFY prefix, for instance
+	 * {"VAR", device, variable, value} or {"DATASTALE", device}.
+	 */
+	std::vector<std::string> readNotification();
+
 protected:
 	std::string sendQuery(const std::string& req);
+	void readWatchAnswer();
 	void sendAsyncQueries(const std::vector<std::string>& req);
 	static void detectError(const std::string& req);
 	TrackingID sendTrackingQuery(const std::string& req);
@@ -446,6 +467,7 @@ private:
 	int _port;
 	long _timeout;
 	internal::Socket* _socket;
+	std::vector<std::string> _notifications;
 };
 
 
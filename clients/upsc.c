@@ -35,7 +35,7 @@ static void usage(const char *prog)
 	printf("Network UPS Tools upsc %s\n\n", UPS_VERSION);
 
 	printf("usage: %s -l | -L [<hostname>[:port]]\n", prog);
-	printf("       %s <ups> [<variable>]\n", prog);
+	printf("       %s <ups> [<variable> ...]\n", prog);
 	printf("       %s -c <ups>\n", prog);
 
 	printf("\nDemo program to display UPS variables.\n\n");
@@ -47,7 +47,8 @@ static void usage(const char *prog)
 
 	printf("\nSecond form (lists variables and values):\n");
 	printf("  <ups>      - upsd server, <upsname>[@<hostname>[:<port>]] form\n");
-	printf("  <variable> - optional, display this variable only.\n");
+	printf("  <variable> - optional, display this variable only; several ones are\n");
+	printf("               shown as <variable>: <value>, one per line.\n");
 	printf("               Default: list all variables for <host>\n");
 
 	printf("\nThird form (lists clients connected to a device):\n");
@@ -55,41 +56,64 @@ static void usage(const char *prog)
 	printf("  <ups>      - upsd server, <upsname>[@<hostname>[:<port>]] form\n");
 }
 
-static void printvar(const char *var)
+/* one or more variables, asked for together; a single one is printed
+ * alone, several ones like the full list */
+static int printvars(int numvars, char **vars)
 {
-	int		ret;
+	int		i, failed = 0;
 	unsigned int	numq, numa;
 	const char	*query[4];
 	char		**answer;
 
 	/* old-style variable name? */
-	if (!strchr(var, '.')) {
-		fatalx(EXIT_FAILURE, "Error: old-style variable names are not supported");
+	for (i = 0; i < numvars; i++) {
+		if (!strchr(vars[i], '.')) {
+			fatalx(EXIT_FAILURE, "Error: old-style variable names are not supported");
+		}
 	}
 
 	query[0] = "VAR";
 	query[1] = upsname;
-	query[2] = var;
-
 	numq = 3;
 
-	ret = upscli_get(ups, numq, query, &numa, &answer);
+	for (i = 0; i < numvars; i++) {
+		query[2] = vars[i];
+		upscli_pipeline_get(ups, numq, query);
+	}
+
+	upscli_pipeline_send(ups);
 
-	if (ret < 0) {
+	for (i = 0; i < numvars; i++) {
+		query[2] = vars[i];
 
-		/* new var and old upsd?  try to explain the situation */
-		if (upscli_upserror(ups) == UPSCLI_ERR_UNKCOMMAND) {
-			fatalx(EXIT_FAILURE, "Error: variable unknown (old upsd detected)");
+		if (upscli_pipeline_next(ups, numq, query, &numa, &answer) < 0) {
+
+			/* new var and old upsd?  try to explain the situation */
+			if (upscli_upserror(ups) == UPSCLI_ERR_UNKCOMMAND) {
+				fatalx(EXIT_FAILURE, "Error: variable unknown (old upsd detected)");
+			}
+
+			if (numvars == 1) {
+				fatalx(EXIT_FAILURE, "Error: %s", upscli_strerror(ups));
+			}
+
+			fprintf(stderr, "Error: %s: %s\n", vars[i], upscli_strerror(ups));
+			failed++;
+			continue;
 		}
 
-		fatalx(EXIT_FAILURE, "Error: %s", upscli_strerror(ups));
-	}
+		if (numa < numq + 1) {
+			fatalx(EXIT_FAILURE, "Error: insufficient data (got %d args, need at least %d)", numa, numq + 1);
+		}
 
-	if (numa < numq) {
-		fatalx(EXIT_FAILURE, "Error: insufficient data (got %d args, need at least %d)", numa, numq);
+		if (numvars == 1) {
+			printf("%s\n", answer[3]);
+		} else {
+			printf("%s: %s\n", answer[2], answer[3]);
+		}
 	}
 
-	printf("%s\n", answer[3]);
+	return failed;
 }
 
 static void list_vars(void)
@@ -273,7 +297,9 @@ int main(int argc, char **argv)
 	}
 
 	if (argc > 1) {
-		printvar(argv[1]);
+		if (printvars(argc - 1, &argv[1])) {
+			exit(EXIT_FAILURE);
+		}
 	} else {
 		list_vars();
 	}
@@ -647,6 +647,94 @@ static ssize_t net_read(UPSCONN_t *ups, char *buf, size_t buflen, unsigned int t
 	return ret;
 }
 
+/* internal: whether fd can be read from without waiting */
+static int fd_readable(const int fd)
+{
+	fd_set		fds;
+	struct timeval	tv;
+
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+
+	return select(fd + 1, &fds, NULL, NULL, &tv) > 0;
+}
+
+/* internal: like net_read, but return 0 at once if nothing has arrived
+   yet; server disconnections and errors are reported as -1 */
+static ssize_t net_read_nb(UPSCONN_t *ups, char *buf, size_t buflen)
+{
+	ssize_t	ret = -1;
+
+#ifdef WITH_SSL
+	if (ups->ssl) {
+#ifdef WITH_OPENSSL
+		long	fd_flags;
+		int	e;
+
+		if ((SSL_pending(ups->ssl) < 1) && (!fd_readable(ups->fd))) {
+			return 0;
+		}
+
+		/* part of a record may have arrived: don't wait for the rest */
+		fd_flags = fcntl(ups->fd, F_GETFL);
+		fcntl(ups->fd, F_SETFL, fd_flags | O_NONBLOCK);
+
+		ret = SSL_read(ups->ssl, buf, buflen);
+
+		if (ret < 1) {
+			e = SSL_get_error(ups->ssl, ret);
+
+			if ((e == SSL_ERROR_WANT_READ) || (e == SSL_ERROR_WANT_WRITE)) {
+				ret = 0;
+			} else {
+				ups->upserror = UPSCLI_ERR_SSLERR;
+				ret = -1;
+			}
+		}
+
+		fcntl(ups->fd, F_SETFL, fd_flags);
+#elif defined(WITH_NSS) /* WITH_OPENSSL */
+		/* NSPR keeps its own idea of the blocking mode, so only read
+		 * once something is there; upsd sends each answer as a whole */
+		if ((PR_Available(ups->ssl) < 1) && (!fd_readable(ups->fd))) {
+			return 0;
+		}
+
+		assert(buflen <= PR_INT32_MAX);
+		ret = PR_Read(ups->ssl, buf, (PRInt32)buflen);
+
+		if (ret < 1) {
+			ups->upserror = UPSCLI_ERR_SSLERR;
+			ret = -1;
+		}
+#endif	/* WITH_OPENSSL | WITH_NSS*/
+
+		return ret;
+	}
+#endif
+
+	if (!fd_readable(ups->fd)) {
+		return 0;
+	}
+
+	ret = read(ups->fd, buf, buflen);
+
+	if (ret < 0) {
+		ups->upserror = UPSCLI_ERR_READ;
+		ups->syserrno = errno;
+	}
+
+	if (ret == 0) {
+		ups->upserror = UPSCLI_ERR_SRVDISC;
+		ret = -1;
+	}
+
+	return ret;
+}
+
 /* Write up to buflen bytes to fd and return the number of bytes
    written. If no data is available within d_sec + d_usec, return 0.
    On error, a value < 0 is returned (errno indicates error). */
@@ -996,8 +1084,7 @@ int upscli_tryconnect(UPSCONN_t *ups, const char *host, int port, int flags,stru
 				}
 				else {
 					/* Timeout */
-					v = -1;
-					break;
+					errno = ETIMEDOUT;
 				}
 			}
 
@@ -1225,10 +1312,57 @@ static int verify_resp(int num, const char **q, char **a)
 	return 1;	/* OK */
 }
 
+/* internal: check and split the answer to a GET */
+static int get_answer(UPSCONN_t *ups, unsigned int numq, const char **query,
+		char *line, unsigned int *numa, char ***answer)
+{
+	if (upscli_errcheck(ups, line) != 0) {
+		return -1;
+	}
+
+	if (!pconf_line(&ups->pc_ctx, line)) {
+		ups->upserror = UPSCLI_ERR_PARSE;
+		return -1;
+	}
+
+	/* q: [GET] VAR <ups> <var>   *
+	 * a: VAR <ups> <var> <val> */
+
+	if (ups->pc_ctx.numargs < numq) {
+		ups->upserror = UPSCLI_ERR_PROTOCOL;
+		return -1;
+	}
+
+	if (!verify_resp(numq, query, ups->pc_ctx.arglist)) {
+		ups->upserror = UPSCLI_ERR_PROTOCOL;
+		return -1;
+	}
+
+	*numa = ups->pc_ctx.numargs;
+	*answer = ups->pc_ctx.arglist;
+
+	return 0;
+}
+
 int upscli_get(UPSCONN_t *ups, unsigned int numq, const char **query,
 		unsigned int *numa, char ***answer)
 {
-	char	cmd[UPSCLI_NETBUF_LEN], tmp[UPSCLI_NETBUF_LEN];
+	char	tmp[UPSCLI_NETBUF_LEN];
+
+	if (upscli_get_request(ups, numq, query) != 0) {
+		return -1;
+	}
+
+	if (upscli_readline(ups, tmp, sizeof(tmp)) != 0) {
+		return -1;
+	}
+
+	return get_answer(ups, numq, query, tmp, numa, answer);
+}
+
+int upscli_get_request(UPSCONN_t *ups, unsigned int numq, const char **query)
+{
+	char	cmd[UPSCLI_NETBUF_LEN];
 
 	if (!ups) {
 		return -1;
@@ -1246,38 +1380,222 @@ int upscli_get(UPSCONN_t *ups, unsigned int numq, const char **query,
 		return -1;
 	}
 
-	if (upscli_readline(ups, tmp, sizeof(tmp)) != 0) {
+	return 0;
+}
+
+/* 1: answer in numa/answer, 0: not complete yet, -1: error */
+int upscli_get_response(UPSCONN_t *ups, unsigned int numq, const char **query,
+		unsigned int *numa, char ***answer)
+{
+	char	tmp[UPSCLI_NETBUF_LEN];
+	int	ret;
+
+	ret = upscli_readline_async(ups, tmp, sizeof(tmp));
+
+	if (ret < 1) {
+		return ret;
+	}
+
+	if (get_answer(ups, numq, query, tmp, numa, answer) != 0) {
 		return -1;
 	}
 
-	if (upscli_errcheck(ups, tmp) != 0) {
+	return 1;
+}
+
+int upscli_pipeline_get(UPSCONN_t *ups, unsigned int numq, const char **query)
+{
+	char	cmd[UPSCLI_NETBUF_LEN], *buf;
+	size_t	len, size;
+
+	if (!ups) {
 		return -1;
 	}
 
-	if (!pconf_line(&ups->pc_ctx, tmp)) {
-		ups->upserror = UPSCLI_ERR_PARSE;
+	if (numq < 1) {
+		ups->upserror = UPSCLI_ERR_INVALIDARG;
 		return -1;
 	}
 
-	/* q: [GET] VAR <ups> <var>   *
-	 * a: VAR <ups> <var> <val> */
+	build_cmd(cmd, sizeof(cmd), "GET", numq, query);
+	len = strlen(cmd);
 
-	if (ups->pc_ctx.numargs < numq) {
-		ups->upserror = UPSCLI_ERR_PROTOCOL;
+	if (ups->pipelen + len > ups->pipesize) {
+		size = ups->pipesize ? ups->pipesize : UPSCLI_NETBUF_LEN;
+
+		while (ups->pipelen + len > size) {
+			size *= 2;
+		}
+
+		buf = realloc(ups->pipebuf, size);
+
+		if (!buf) {
+			ups->upserror = UPSCLI_ERR_NOMEM;
+			return -1;
+		}
+
+		ups->pipebuf = buf;
+		ups->pipesize = size;
+	}
+
+	memcpy(ups->pipebuf + ups->pipelen, cmd, len);
+	ups->pipelen += len;
+	ups->pipequeued++;
+
+	return 0;
+}
+
+/* Send the queued requests with one write. Their answers are due even if
+ * this fails: upscli_pipeline_next() then fails each of them in turn. */
+int upscli_pipeline_send(UPSCONN_t *ups)
+{
+	ssize_t	ret = 0;
+
+	if (!ups) {
 		return -1;
 	}
 
-	if (!verify_resp(numq, query, ups->pc_ctx.arglist)) {
-		ups->upserror = UPSCLI_ERR_PROTOCOL;
+	if (ups->pipelen > 0) {
+		ret = upscli_sendline(ups, ups->pipebuf, ups->pipelen);
+	}
+
+	ups->pipepending += ups->pipequeued;
+	ups->pipequeued = 0;
+	ups->pipelen = 0;
+
+	return (ret == 0) ? 0 : -1;
+}
+
+/* 0: answer in numa/answer, -1: this query failed (see upscli_upserror())
+ *
+ * An ERR answer only fails its own query. Once the connection is lost,
+ * the queries still pending fail with the error that ended it. */
+int upscli_pipeline_next(UPSCONN_t *ups, unsigned int numq, const char **query,
+		unsigned int *numa, char ***answer)
+{
+	char	tmp[UPSCLI_NETBUF_LEN];
+
+	if (!ups) {
 		return -1;
 	}
 
-	*numa = ups->pc_ctx.numargs;
-	*answer = ups->pc_ctx.arglist;
+	if (ups->pipepending < 1) {
+		ups->upserror = UPSCLI_ERR_INVALIDARG;
+		return -1;
+	}
+
+	ups->pipepending--;
+
+	if (ups->fd < 0) {
+		return -1;
+	}
+
+	if (upscli_readline(ups, tmp, sizeof(tmp)) != 0) {
+		return -1;
+	}
+
+	if (get_answer(ups, numq, query, tmp, numa, answer) != 0) {
+
+		/* not the answer to this query: the ones after it can not be
+		 * matched to their queries either */
+		if (ups->upserror == UPSCLI_ERR_PROTOCOL) {
+			upscli_disconnect(ups);
+		}
+
+		return -1;
+	}
+
+	return 0;
+}
+
+static int watch_cmd(UPSCONN_t *ups, const char *cmdname, const char *upsname,
+	const char *pattern)
+{
+	char	cmd[UPSCLI_NETBUF_LEN];
+	const char	*arg[2];
+	size_t	numarg = 0;
+
+	if (!ups) {
+		return -1;
+	}
+
+	if (upsname) {
+		arg[numarg++] = upsname;
+
+		if (pattern) {
+			arg[numarg++] = pattern;
+		}
+	}
+
+	build_cmd(cmd, sizeof(cmd), cmdname, numarg, arg);
+
+	if (upscli_sendline(ups, cmd, strlen(cmd)) != 0) {
+		return -1;
+	}
 
 	return 0;
 }
 
+int upscli_watch(UPSCONN_t *ups, const char *upsname, const char *pattern)
+{
+	if ((!ups) || (!upsname)) {
+		if (ups) {
+			ups->upserror = UPSCLI_ERR_INVALIDARG;
+		}
+		return -1;
+	}
+
+	return watch_cmd(ups, "WATCH", upsname, pattern);
+}
+
+int upscli_unwatch(UPSCONN_t *ups, const char *upsname, const char *pattern)
+{
+	return watch_cmd(ups, "UNWATCH", upsname, pattern);
+}
+
+/* 1: notification in numa/answer, 0: nothing yet, -1: error
+ *
+ * The OK answers to WATCH and UNWATCH are consumed here, so an ERR may
+ * also be the late answer to one of those. */
+int upscli_watch_next(UPSCONN_t *ups, unsigned int *numa, char ***answer)
+{
+	char	tmp[UPSCLI_NETBUF_LEN];
+	int	ret;
+
+	for (;;) {
+		ret = upscli_readline_async(ups, tmp, sizeof(tmp));
+
+		if (ret < 1) {
+			return ret;
+		}
+
+		if (!strcmp(tmp, "OK")) {
+			continue;
+		}
+
+		if (upscli_errcheck(ups, tmp) != 0) {
+			return -1;
+		}
+
+		if (!pconf_line(&ups->pc_ctx, tmp)) {
+			ups->upserror = UPSCLI_ERR_PARSE;
+			return -1;
+		}
+
+		/* NOTIFY VAR <ups> <var> <val> | NOTIFY <event> <ups> ... */
+		if ((ups->pc_ctx.numargs < 3) ||
+			(strcmp(ups->pc_ctx.arglist[0], "NOTIFY") != 0)) {
+			ups->upserror = UPSCLI_ERR_PROTOCOL;
+			return -1;
+		}
+
+		*numa = ups->pc_ctx.numargs - 1;
+		*answer = &ups->pc_ctx.arglist[1];
+
+		return 1;
+	}
+}
+
 int upscli_list_start(UPSCONN_t *ups, unsigned int numq, const char **query)
 {
 	char	cmd[UPSCLI_NETBUF_LEN], tmp[UPSCLI_NETBUF_LEN];
@@ -1478,6 +1796,73 @@ ssize_t upscli_readline(UPSCONN_t *ups, char *buf, size_t buflen)
 	return upscli_readline_timeout(ups, buf, buflen, DEFAULT_NETWORK_TIMEOUT);
 }
 
+/* Collect a line from whatever has arrived so far, without waiting.
+ * Returns 1 with the line in buf, 0 if it is not complete yet (call again
+ * once upscli_fd() is readable), -1 on error. Partial lines are kept in
+ * the connection until the rest arrives. */
+int upscli_readline_async(UPSCONN_t *ups, char *buf, size_t buflen)
+{
+	ssize_t	ret;
+	char	ch;
+
+	if (!ups) {
+		return -1;
+	}
+
+	if (ups->fd < 0) {
+		ups->upserror = UPSCLI_ERR_DRVNOTCONN;
+		return -1;
+	}
+
+	if ((!buf) || (buflen < 1)) {
+		ups->upserror = UPSCLI_ERR_INVALIDARG;
+		return -1;
+	}
+
+	if (ups->upsclient_magic != UPSCLIENT_MAGIC) {
+		ups->upserror = UPSCLI_ERR_INVALIDARG;
+		return -1;
+	}
+
+	for (;;) {
+		while (ups->readidx < ups->readlen) {
+
+			ch = ups->readbuf[ups->readidx++];
+
+			if (ch == '\n') {
+				if (ups->linelen > buflen - 1) {
+					ups->linelen = buflen - 1;
+				}
+
+				memcpy(buf, ups->linebuf, ups->linelen);
+				buf[ups->linelen] = '\0';
+				ups->linelen = 0;
+
+				return 1;
+			}
+
+			/* overlong lines are cut, like upscli_readline() does */
+			if (ups->linelen < sizeof(ups->linebuf) - 1) {
+				ups->linebuf[ups->linelen++] = ch;
+			}
+		}
+
+		ret = net_read_nb(ups, ups->readbuf, sizeof(ups->readbuf));
+
+		if (ret == 0) {
+			return 0;
+		}
+
+		if (ret < 0) {
+			upscli_disconnect(ups);
+			return -1;
+		}
+
+		ups->readlen = ret;
+		ups->readidx = 0;
+	}
+}
+
 /* split upsname[@hostname[:port]] into separate components */
 int upscli_splitname(const char *buf, char **upsname, char **hostname, int *port)
 {
@@ -1583,6 +1968,15 @@ int upscli_disconnect(UPSCONN_t *ups)
 	free(ups->host);
 	ups->host = NULL;
 
+	ups->readlen = ups->readidx = 0;
+	ups->linelen = 0;
+
+	/* answers still pending fail from now on, see upscli_pipeline_next() */
+	free(ups->pipebuf);
+	ups->pipebuf = NULL;
+	ups->pipelen = ups->pipesize = 0;
+	ups->pipequeued = 0;
+
 	if (ups->fd < 0) {
 		return 0;
 	}
@@ -64,6 +64,15 @@ typedef struct {
 	size_t	readlen;
 	size_t	readidx;
 
+	char	linebuf[UPSCLI_NETBUF_LEN];	/* see upscli_readline_async() */
+	size_t	linelen;
+
+	char	*pipebuf;	/* see upscli_pipeline_get() */
+	size_t	pipelen;
+	size_t	pipesize;
+	unsigned int	pipequeued;	/* requests not sent yet */
+	unsigned int	pipepending;	/* answers not read yet */
+
 }	UPSCONN_t;
 
 const char *upscli_strerror(UPSCONN_t *ups);
@@ -81,6 +90,32 @@ void upscli_add_host_cert(const char* hostname, const char* certname, int certve
 int upscli_get(UPSCONN_t *ups, unsigned int numq, const char **query,
 		unsigned int *numa, char ***answer);
 
+/* upscli_get() in two steps, for callers waiting on several connections
+ * at once: send the request, then call upscli_get_response() whenever
+ * upscli_fd() is readable until it no longer returns 0 */
+int upscli_get_request(UPSCONN_t *ups, unsigned int numq, const char **query);
+
+int upscli_get_response(UPSCONN_t *ups, unsigned int numq, const char **query,
+		unsigned int *numa, char ***answer);
+
+/* several GETs in one round trip: queue them, send them all at once,
+ * then read each answer in the order the requests were queued, passing
+ * the same query again; a failed query does not fail the others */
+int upscli_pipeline_get(UPSCONN_t *ups, unsigned int numq, const char **query);
+
+int upscli_pipeline_send(UPSCONN_t *ups);
+
+int upscli_pipeline_next(UPSCONN_t *ups, unsigned int numq, const char **query,
+		unsigned int *numa, char ***answer);
+
+/* subscriptions: after upscli_watch(), upsd sends a notification for
+ * every change of a matching variable, picked up with upscli_watch_next()
+ * whenever upscli_fd() is readable; keep such a connection for that only */
+int upscli_watch(UPSCONN_t *ups, const char *upsname, const char *pattern);
+int upscli_unwatch(UPSCONN_t *ups, const char *upsname, const char *pattern);
+
+int upscli_watch_next(UPSCONN_t *ups, unsigned int *numa, char ***answer);
+
 int upscli_list_start(UPSCONN_t *ups, unsigned int numq, const char **query);
 
 int upscli_list_next(UPSCONN_t *ups, unsigned int numq, const char **query,
@@ -92,6 +127,8 @@ ssize_t upscli_sendline(UPSCONN_t *ups, const char *buf, size_t buflen);
 ssize_t upscli_readline_timeout(UPSCONN_t *ups, char *buf, size_t buflen, unsigned int timeout);
 ssize_t upscli_readline(UPSCONN_t *ups, char *buf, size_t buflen);
 
+int upscli_readline_async(UPSCONN_t *ups, char *buf, size_t buflen);
+
 int upscli_splitname(const char *buf, char **upsname, char **hostname,
 			int *port);
 
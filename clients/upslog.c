@@ -199,6 +199,7 @@ static void do_time(const char *arg)
 	free(format);
 }
 
+/* the answers were requested by run_flist(), in the order of the format */
 static void getvar(const char *var)
 {
 	int	ret;
@@ -211,9 +212,9 @@ static void getvar(const char *var)
 	query[2] = var;
 	numq = 3;
 
-	ret = upscli_get(&ups, numq, query, &numa, &answer);
+	ret = upscli_pipeline_next(&ups, numq, query, &numa, &answer);
 
-	if ((ret < 0) || (numa < numq)) {
+	if ((ret < 0) || (numa <= numq)) {
 		snprintfcat(logbuffer, sizeof(logbuffer), "NA");
 		return;
 	}
@@ -221,21 +222,28 @@ static void getvar(const char *var)
 	snprintfcat(logbuffer, sizeof(logbuffer), "%s", answer[3]);
 }
 
-static void do_var(const char *arg)
+static int valid_var(const char *arg)
 {
 	if ((!arg) || (strlen(arg) < 1)) {
-		snprintfcat(logbuffer, sizeof(logbuffer), "INVALID");
-		return;
+		return 0;
 	}
 
 	/* old variable names are no longer supported */
 	if (!strchr(arg, '.')) {
-		snprintfcat(logbuffer, sizeof(logbuffer), "INVALID");
-		return;
+		return 0;
 	}
 
 	/* a UPS name is now required */
 	if (!upsname) {
+		return 0;
+	}
+
+	return 1;
+}
+
+static void do_var(const char *arg)
+{
+	if (!valid_var(arg)) {
 		snprintfcat(logbuffer, sizeof(logbuffer), "INVALID");
 		return;
 	}
@@ -366,6 +374,20 @@ static void compile_format(void)
 static void run_flist(void)
 {
 	flist_t	*tmp;
+	const	char	*query[4];
+
+	/* ask for all the variables of the line in one go */
+	query[0] = "VAR";
+	query[1] = upsname;
+
+	for (tmp = fhead; tmp; tmp = tmp->next) {
+		if ((tmp->fptr == do_var) && valid_var(tmp->arg)) {
+			query[2] = tmp->arg;
+			upscli_pipeline_get(&ups, 3, query);
+		}
+	}
+
+	upscli_pipeline_send(&ups);
 
 	tmp = fhead;
 
@@ -26,6 +26,7 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 
 #include "upsclient.h"
 #include "upsmon.h"
@@ -78,6 +79,7 @@ static	int	forcessl = 0;		/* don't require ssl by default */
 static	int	userfsd = 0, use_pipe = 1, pipefd[2];
 
 static	utype_t	*firstups = NULL;
+static	upslink_t	*firstlink = NULL;
 
 static int 	opt_af = AF_UNSPEC;
 
@@ -217,13 +219,13 @@ static int checkmaster(utype_t *ups)
 
 	snprintf(buf, sizeof(buf), "MASTER %s\n", ups->upsname);
 
-	if (upscli_sendline(&ups->conn, buf, strlen(buf)) < 0) {
+	if (upscli_sendline(&ups->link->conn, buf, strlen(buf)) < 0) {
 		upslogx(LOG_ALERT, "Can't set master mode on UPS [%s] - %s",
-			ups->sys, upscli_strerror(&ups->conn));
+			ups->sys, upscli_strerror(&ups->link->conn));
 		return 0;
 	}
 
-	if (upscli_readline(&ups->conn, buf, sizeof(buf)) == 0) {
+	if (upscli_readline(&ups->link->conn, buf, sizeof(buf)) == 0) {
 		if (!strncmp(buf, "OK", 2))
 			return 1;
 
@@ -236,16 +238,19 @@ static int checkmaster(utype_t *ups)
 	else {	/* something caught by readraw's parsing call */
 		upslogx(LOG_ALERT, "Master privileges unavailable on UPS [%s]",
 			ups->sys);
-		upslogx(LOG_ALERT, "Reason: %s", upscli_strerror(&ups->conn));
+		upslogx(LOG_ALERT, "Reason: %s", upscli_strerror(&ups->link->conn));
 	}
 
 	return 0;
 }
 
-/* authenticate to upsd, plus do LOGIN and MASTER if applicable */
-static int do_upsd_auth(utype_t *ups)
+/* authenticate to upsd on a new connection, and find out if the UPSes
+ * of this server can share it */
+static int do_link_auth(utype_t *ups)
 {
+	UPSCONN_t	*conn = &ups->link->conn;
 	char	buf[SMALLBUF];
+	int	major, minor;
 
 	if (!ups->un) {
 		upslogx(LOG_ERR, "UPS [%s]: no username defined!", ups->sys);
@@ -253,30 +258,30 @@ static int do_upsd_auth(utype_t *ups)
 	}
 
 	snprintf(buf, sizeof(buf), "USERNAME %s\n", ups->un);
-	if (upscli_sendline(&ups->conn, buf, strlen(buf)) < 0) {
+	if (upscli_sendline(conn, buf, strlen(buf)) < 0) {
 		upslogx(LOG_ERR, "Can't set username on [%s]: %s",
-			ups->sys, upscli_strerror(&ups->conn));
+			ups->sys, upscli_strerror(conn));
 			return 0;
 	}
 
-	if (upscli_readline(&ups->conn, buf, sizeof(buf)) < 0) {
+	if (upscli_readline(conn, buf, sizeof(buf)) < 0) {
 		upslogx(LOG_ERR, "Set username on [%s] failed: %s",
-			ups->sys, upscli_strerror(&ups->conn));
+			ups->sys, upscli_strerror(conn));
 		return 0;
 	}
 
 	/* authenticate first */
 	snprintf(buf, sizeof(buf), "PASSWORD %s\n", ups->pw);
 
-	if (upscli_sendline(&ups->conn, buf, strlen(buf)) < 0) {
+	if (upscli_sendline(conn, buf, strlen(buf)) < 0) {
 		upslogx(LOG_ERR, "Can't set password on [%s]: %s",
-			ups->sys, upscli_strerror(&ups->conn));
+			ups->sys, upscli_strerror(conn));
 			return 0;
 	}
 
-	if (upscli_readline(&ups->conn, buf, sizeof(buf)) < 0) {
+	if (upscli_readline(conn, buf, sizeof(buf)) < 0) {
 		upslogx(LOG_ERR, "Set password on [%s] failed: %s",
-			ups->sys, upscli_strerror(&ups->conn));
+			ups->sys, upscli_strerror(conn));
 		return 0;
 	}
 
@@ -287,6 +292,38 @@ static int do_upsd_auth(utype_t *ups)
 		return 0;
 	}
 
+	/* protocol 1.5 allows LOGIN to several UPSes on one connection;
+	 * older servers don't know NETVER or answer a lower version */
+	if ((upscli_sendline(conn, "NETVER\n", 7) < 0) ||
+		(upscli_readline(conn, buf, sizeof(buf)) < 0)) {
+
+		/* ERR UNKNOWN-COMMAND leaves the connection usable */
+		if (upscli_fd(conn) == -1) {
+			upslogx(LOG_ERR, "Protocol version query on [%s] failed: %s",
+				ups->sys, upscli_strerror(conn));
+			return 0;
+		}
+
+		buf[0] = '\0';
+	}
+
+	if ((sscanf(buf, "%d.%d", &major, &minor) == 2) &&
+		((major > 1) || ((major == 1) && (minor >= 5)))) {
+		ups->link->shared = 1;
+	}
+
+	upsdebugx(2, "Connection to %s:%d: protocol [%s], %sshared", ups->hostname,
+		ups->port, buf, ups->link->shared ? "" : "not ");
+
+	return 1;
+}
+
+/* do LOGIN and MASTER if applicable, once authenticated */
+static int do_upsd_auth(utype_t *ups)
+{
+	UPSCONN_t	*conn = &ups->link->conn;
+	char	buf[SMALLBUF];
+
 	/* we require a upsname now */
 	if ((ups->upsname == NULL) || (strlen(ups->upsname) == 0)) {
 		upslogx(LOG_ERR, "Login to UPS [%s] failed: empty upsname",
@@ -297,15 +334,15 @@ static int do_upsd_auth(utype_t *ups)
 	/* password is set, let's login */
 	snprintf(buf, sizeof(buf), "LOGIN %s\n", ups->upsname);
 
-	if (upscli_sendline(&ups->conn, buf, strlen(buf)) < 0) {
+	if (upscli_sendline(conn, buf, strlen(buf)) < 0) {
 		upslogx(LOG_ERR, "Login to UPS [%s] failed: %s",
-			ups->sys, upscli_strerror(&ups->conn));
+			ups->sys, upscli_strerror(conn));
 		return 0;
 	}
 
-	if (upscli_readline(&ups->conn, buf, sizeof(buf)) < 0) {
+	if (upscli_readline(conn, buf, sizeof(buf)) < 0) {
 		upslogx(LOG_ERR, "Can't login to UPS [%s]: %s",
-			ups->sys, upscli_strerror(&ups->conn));
+			ups->sys, upscli_strerror(conn));
 		return 0;
 	}
 
@@ -485,21 +522,26 @@ static void setfsd(utype_t *ups)
 
 	upsdebugx(2, "Setting FSD on UPS %s", ups->sys);
 
+	if (!ups->link) {
+		upslogx(LOG_ERR, "FSD set on UPS %s failed: not connected", ups->sys);
+		return;
+	}
+
 	snprintf(buf, sizeof(buf), "FSD %s\n", ups->upsname);
 
-	ret = upscli_sendline(&ups->conn, buf, strlen(buf));
+	ret = upscli_sendline(&ups->link->conn, buf, strlen(buf));
 
 	if (ret < 0) {
 		upslogx(LOG_ERR, "FSD set on UPS %s failed: %s", ups->sys,
-			upscli_strerror(&ups->conn));
+			upscli_strerror(&ups->link->conn));
 		return;
 	}
 
-	ret = upscli_readline(&ups->conn, buf, sizeof(buf));
+	ret = upscli_readline(&ups->link->conn, buf, sizeof(buf));
 
 	if (ret < 0) {
 		upslogx(LOG_ERR, "FSD set on UPS %s failed: %s", ups->sys,
-			upscli_strerror(&ups->conn));
+			upscli_strerror(&ups->link->conn));
 		return;
 	}
 
@@ -510,116 +552,232 @@ static void setfsd(utype_t *ups)
 	upslogx(LOG_ERR, "FSD set on UPS %s failed: %s", ups->sys, buf);
 }
 
-static void set_alarm(void)
-{
-	alarm(NET_TIMEOUT);
-}
-
-static void clear_alarm(void)
+/* build the query for one of the variables upsmon asks for */
+static unsigned int get_query(utype_t *ups, const char *var, const char **query)
 {
-#if (defined HAVE_PRAGMA_GCC_DIAGNOSTIC_PUSH_POP) && (defined HAVE_PRAGMA_GCC_DIAGNOSTIC_IGNORED_STRICT_PROTOTYPES)
-# pragma GCC diagnostic push
-# pragma GCC diagnostic ignored "-Wstrict-prototypes"
-#endif
-	signal(SIGALRM, SIG_IGN);
-#if (defined HAVE_PRAGMA_GCC_DIAGNOSTIC_PUSH_POP) && (defined HAVE_PRAGMA_GCC_DIAGNOSTIC_IGNORED_STRICT_PROTOTYPES)
-# pragma GCC diagnostic pop
-#endif
-	alarm(0);
-}
-
-static int get_var(utype_t *ups, const char *var, char *buf, size_t bufsize)
-{
-	int	ret;
-	unsigned int	numq, numa;
-	const	char	*query[4];
-	char	**answer;
-
 	/* this shouldn't happen */
 	if (!ups->upsname) {
-		upslogx(LOG_ERR, "get_var: programming error: no UPS name set [%s]",
+		upslogx(LOG_ERR, "get_query: programming error: no UPS name set [%s]",
 			ups->sys);
-		return -1;
+		return 0;
 	}
 
-	numq = 0;
-
 	if (!strcmp(var, "numlogins")) {
 		query[0] = "NUMLOGINS";
 		query[1] = ups->upsname;
-		numq = 2;
+		return 2;
 	}
 
 	if (!strcmp(var, "status")) {
 		query[0] = "VAR";
 		query[1] = ups->upsname;
 		query[2] = "ups.status";
-		numq = 3;
+		return 3;
 	}
 
-	if (numq == 0) {
-		upslogx(LOG_ERR, "get_var: programming error: var=%s", var);
-		return -1;
-	}
+	upslogx(LOG_ERR, "get_query: programming error: var=%s", var);
+	return 0;
+}
 
-	upsdebugx(3, "%s: %s / %s", __func__, ups->sys, var);
+static int tv_before(const struct timeval *a, const struct timeval *b)
+{
+	return (a->tv_sec < b->tv_sec) ||
+		((a->tv_sec == b->tv_sec) && (a->tv_usec < b->tv_usec));
+}
 
-	ret = upscli_get(&ups->conn, numq, query, &numa, &answer);
+/* milliseconds from now until then, 0 if it has passed */
+static int ms_until(const struct timeval *then, const struct timeval *now)
+{
+	long	ms = (then->tv_sec - now->tv_sec) * 1000 +
+		(then->tv_usec - now->tv_usec) / 1000;
 
-	if (ret < 0) {
+	return (ms > 0) ? (int)ms : 0;
+}
+
+/* Ask every UPS flagged with ups->query for var, then wait for all the
+ * answers at once, each UPS against its own NET_TIMEOUT deadline, so a
+ * slow or unreachable upsd only delays itself. UPSes sharing a link have
+ * their queries pipelined on it, and upsd answers them in order. got()
+ * is handed each answer; failed(), if set, is called for the UPSes that
+ * did not give one. */
+static void get_var_all(const char *var, void (*got)(utype_t *, char *),
+	void (*failed)(utype_t *))
+{
+	utype_t	*ups, **waiting = NULL;
+	upslink_t	*link;
+	struct pollfd	*fds = NULL;
+	struct timeval	now, next;
+	const char	*query[4];
+	unsigned int	numq, numa;
+	char	**answer, val[SMALLBUF];
+	int	i, ret, count = 0, size = 0, progress, buffered;
 
-		/* detect old upsd */
-		if (upscli_upserror(&ups->conn) == UPSCLI_ERR_UNKCOMMAND) {
+	get_monotonic_time(&now);
 
-			upslogx(LOG_ERR, "UPS [%s]: Too old to monitor",
-				ups->sys);
-			return -1;
+	for (link = firstlink; link != NULL; link = link->next)
+		link->sent = link->answered = 0;
+
+	for (ups = firstups; ups != NULL; ups = ups->next) {
+
+		if (!ups->query)
+			continue;
+
+		ups->query = 0;
+
+		/* not connected: nothing to ask */
+		if (!ups->link)
+			continue;
+
+		upsdebugx(3, "%s: %s / %s", __func__, ups->sys, var);
+
+		numq = get_query(ups, var, query);
+
+		if ((numq == 0) || (upscli_get_request(&ups->link->conn, numq, query) < 0)) {
+			if (failed)
+				failed(ups);
+			continue;
+		}
+
+		if (count >= size) {
+			size = size ? size * 2 : 16;
+			waiting = xrealloc(waiting, size * sizeof(*waiting));
+			fds = xrealloc(fds, size * sizeof(*fds));
 		}
 
-		/* some other error */
-		return -1;
+		ups->seq = ups->link->sent++;
+		ups->deadline = now;
+		ups->deadline.tv_sec += NET_TIMEOUT;
+
+		waiting[count++] = ups;
 	}
 
-	if (numa < numq) {
-		upslogx(LOG_ERR, "%s: Error: insufficient data "
-			"(got %d args, need at least %d)",
-			var, numa, numq);
-		return -1;
+	while (count > 0) {
+
+		next = waiting[0]->deadline;
+		buffered = 0;
+
+		for (i = 0; i < count; i++) {
+			link = waiting[i]->link;
+
+			fds[i].fd = upscli_fd(&link->conn);
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+
+			if (tv_before(&waiting[i]->deadline, &next))
+				next = waiting[i]->deadline;
+
+			/* an answer may be there already, behind the last one */
+			if (link->conn.readidx < link->conn.readlen)
+				buffered = 1;
+		}
+
+		ret = poll(fds, count, buffered ? 0 : ms_until(&next, &now));
+
+		if ((ret < 0) && (errno != EINTR)) {
+			upslog_with_errno(LOG_ERR, "%s: poll", __func__);
+		}
+
+		get_monotonic_time(&now);
+
+		/* again while answers come in: the next one on a link may
+		 * be for a UPS already gone past */
+		do {
+			progress = 0;
+
+			for (i = 0; i < count; ) {
+				ups = waiting[i];
+				link = ups->link;
+				numq = get_query(ups, var, query);
+				ret = 0;
+
+				if (upscli_fd(&link->conn) == -1) {
+					/* lost while answering another UPS, whose
+					 * failure already set the error */
+					ret = -1;
+				} else if (ups->seq == link->answered) {
+					if ((fds[i].revents) || (link->conn.readidx < link->conn.readlen))
+						ret = upscli_get_response(&link->conn, numq, query, &numa, &answer);
+
+					if ((ret == 0) && (!tv_before(&now, &ups->deadline))) {
+						upsdebugx(2, "%s: %s: no answer in %d seconds",
+							__func__, ups->sys, NET_TIMEOUT);
+
+						/* a late answer would be taken for the next one */
+						upscli_disconnect(&link->conn);
+						link->conn.upserror = UPSCLI_ERR_READ;
+						link->conn.syserrno = ETIMEDOUT;
+						ret = -1;
+					}
+
+					if (ret != 0)
+						link->answered++;
+				}
+
+				if (ret == 0) {
+					i++;
+					continue;
+				}
+
+				if ((ret > 0) && (numa < numq)) {
+					upslogx(LOG_ERR, "%s: Error: insufficient data "
+						"(got %d args, need at least %d)",
+						var, numa, numq);
+					ret = -1;
+				}
+
+				/* detect old upsd */
+				if ((ret < 0) && (upscli_upserror(&link->conn) == UPSCLI_ERR_UNKCOMMAND)) {
+					upslogx(LOG_ERR, "UPS [%s]: Too old to monitor",
+						ups->sys);
+				}
+
+				if (ret > 0) {
+					snprintf(val, sizeof(val), "%s", answer[numq]);
+					got(ups, val);
+				} else if (failed) {
+					failed(ups);
+				}
+
+				/* done with this one */
+				progress = 1;
+				count--;
+				waiting[i] = waiting[count];
+				fds[i] = fds[count];
+			}
+		} while (progress && (count > 0));
 	}
 
-	snprintf(buf, bufsize, "%s", answer[numq]);
-	return 0;
+	free(waiting);
+	free(fds);
+}
+
+static	int	maxlogins;
+
+static void got_numlogins(utype_t *ups, char *val)
+{
+	int	logins = strtol(val, (char **)NULL, 10);
+
+	NUT_UNUSED_VARIABLE(ups);
+
+	if (logins > maxlogins)
+		maxlogins = logins;
 }
 
 static void slavesync(void)
 {
 	utype_t	*ups;
-	char	temp[SMALLBUF];
 	time_t	start, now;
-	int	maxlogins, logins;
 
 	time(&start);
 
 	for (;;) {
 		maxlogins = 0;
 
-		for (ups = firstups; ups != NULL; ups = ups->next) {
-
-			/* only check login count on our master(s) */
-			if (!flag_isset(ups->status, ST_MASTER))
-				continue;
-
-			set_alarm();
-
-			if (get_var(ups, "numlogins", temp, sizeof(temp)) >= 0) {
-				logins = strtol(temp, (char **)NULL, 10);
+		/* only check login count on our master(s) */
+		for (ups = firstups; ups != NULL; ups = ups->next)
+			ups->query = flag_isset(ups->status, ST_MASTER);
 
-				if (logins > maxlogins)
-					maxlogins = logins;
-			}
-
-			clear_alarm();
-		}
+		get_var_all("numlogins", got_numlogins, NULL);
 
 		/* if no UPS has more than 1 login (us), then slaves are gone */
 		if (maxlogins <= 1)
@@ -812,17 +970,102 @@ static void ups_fsd(utype_t *ups)
 	setflag(&ups->status, ST_FSD);
 }
 
+/* a link to upsd for this UPS, not connected yet */
+static upslink_t *new_link(const utype_t *ups)
+{
+	upslink_t	*link;
+
+	link = xcalloc(1, sizeof(*link));
+	link->hostname = xstrdup(ups->hostname);
+	link->port = ups->port;
+	link->un = xstrdup(ups->un);
+	link->pw = xstrdup(ups->pw);
+
+	link->next = firstlink;
+	firstlink = link;
+
+	return link;
+}
+
+static void free_link(upslink_t *target)
+{
+	upslink_t	**link;
+
+	for (link = &firstlink; *link != NULL; link = &(*link)->next) {
+		if (*link == target) {
+			*link = target->next;
+			break;
+		}
+	}
+
+	upscli_disconnect(&target->conn);
+
+	free(target->hostname);
+	free(target->un);
+	free(target->pw);
+	free(target);
+}
+
+/* a connected link this UPS can join, if any */
+static upslink_t *find_link(const utype_t *ups)
+{
+	upslink_t	*link;
+
+	for (link = firstlink; link != NULL; link = link->next) {
+
+		if ((!link->shared) || (upscli_fd(&link->conn) == -1))
+			continue;
+
+		if ((link->port != ups->port) || strcasecmp(link->hostname, ups->hostname))
+			continue;
+
+		if (strcmp(link->un, ups->un) || strcmp(link->pw, ups->pw))
+			continue;
+
+		return link;
+	}
+
+	return NULL;
+}
+
 /* cleanly close the connection to a given UPS */
 static void drop_connection(utype_t *ups)
 {
+	upslink_t	*link = ups->link;
+	char	buf[SMALLBUF];
+
 	upsdebugx(2, "Dropping connection to UPS [%s]", ups->sys);
 
 	ups->commstate = 0;
 	ups->linestate = 0;
+	ups->link = NULL;
+
+	if (!link) {
+		clearflag(&ups->status, ST_LOGIN);
+		clearflag(&ups->status, ST_CONNECTED);
+		return;
+	}
+
+	link->users--;
+
+	/* other UPSes still use it: only undo the LOGIN of this one */
+	if ((link->users > 0) && flag_isset(ups->status, ST_LOGIN) &&
+		(upscli_fd(&link->conn) != -1)) {
+
+		snprintf(buf, sizeof(buf), "LOGOUT %s\n", ups->upsname);
+
+		if ((upscli_sendline(&link->conn, buf, strlen(buf)) < 0) ||
+			(upscli_readline(&link->conn, buf, sizeof(buf)) < 0)) {
+			upslogx(LOG_ERR, "Logout from UPS [%s] failed: %s",
+				ups->sys, upscli_strerror(&link->conn));
+		}
+	}
+
 	clearflag(&ups->status, ST_LOGIN);
 	clearflag(&ups->status, ST_CONNECTED);
 
-	upscli_disconnect(&ups->conn);
+	if (link->users == 0)
+		free_link(link);
 }
 
 /* change some UPS parameters during reloading */
@@ -1349,8 +1592,12 @@ static void upsmon_cleanup(void)
 {
 	int	i;
 	utype_t	*utmp, *unext;
+	upslink_t	*link;
+
+	/* close all fds, without logging out of each UPS */
+	for (link = firstlink; link != NULL; link = link->next)
+		upscli_disconnect(&link->conn);
 
-	/* close all fds */
 	utmp = firstups;
 
 	while (utmp) {
@@ -1387,14 +1634,6 @@ static void set_reload_flag(int sig)
 	reload_flag = 1;
 }
 
-/* handler for alarm when getupsvarfd times out */
-static void read_timeout(int sig)
-{
-	NUT_UNUSED_VARIABLE(sig);
-
-	/* don't do anything here, just return */
-}
-
 /* install handlers for a few signals */
 static void setup_signals(void)
 {
@@ -1410,11 +1649,6 @@ static void setup_signals(void)
 	sigaction(SIGQUIT, &sa, NULL);
 	sigaction(SIGTERM, &sa, NULL);
 
-	/* handle timeouts */
-
-	sa.sa_handler = read_timeout;
-	sigaction(SIGALRM, &sa, NULL);
-
 	/* deal with the ones from userspace as well */
 
 	sa.sa_handler = user_fsd;
@@ -1439,15 +1673,37 @@ static void update_crittimer(utype_t *ups)
 	/* fallthrough: let the timer age */
 }
 
-/* handle connecting to upsd, plus get SSL going too if possible */
+/* handle connecting to upsd, plus get SSL going too if possible; UPSes
+ * of a server already connected to share its connection */
 static int try_connect(utype_t *ups)
 {
 	int	flags = 0, ret;
+	struct timeval	tv;
+	upslink_t	*link;
 
 	upsdebugx(1, "Trying to connect to UPS [%s]", ups->sys);
 
 	clearflag(&ups->status, ST_CONNECTED);
 
+	if (!ups->hostname) {
+		upslogx(LOG_ERR, "UPS [%s]: no hostname set", ups->sys);
+		ups_is_gone(ups);
+		return 0;
+	}
+
+	link = find_link(ups);
+
+	if (link) {
+		upsdebugx(1, "UPS [%s]: sharing the connection to %s:%d",
+			ups->sys, link->hostname, link->port);
+
+		ups->link = link;
+		link->users++;
+		setflag(&ups->status, ST_CONNECTED);
+
+		return do_upsd_auth(ups);
+	}
+
 	/* force it if configured that way, just try it otherwise */
 	if (forcessl == 1)
 		flags |= UPSCLI_CONN_REQSSL;
@@ -1478,24 +1734,33 @@ static int try_connect(utype_t *ups)
 		flags |= UPSCLI_CONN_CERTVERIF;
 	}
 
-	ret = upscli_connect(&ups->conn, ups->hostname, ups->port, flags);
+	/* don't let an unreachable host hold up the others for long */
+	tv.tv_sec = NET_TIMEOUT;
+	tv.tv_usec = 0;
+
+	link = new_link(ups);
+
+	ret = upscli_tryconnect(&link->conn, ups->hostname, ups->port, flags, &tv);
 
 	if (ret < 0) {
 		upslogx(LOG_ERR, "UPS [%s]: connect failed: %s",
-			ups->sys, upscli_strerror(&ups->conn));
+			ups->sys, upscli_strerror(&link->conn));
+		free_link(link);
 		ups_is_gone(ups);
 		return 0;
 	}
 
 	/* we're definitely connected now */
+	ups->link = link;
+	link->users++;
 	setflag(&ups->status, ST_CONNECTED);
 
 	/* prevent connection leaking to NOTIFYCMD */
-	fcntl(upscli_fd(&ups->conn), F_SETFD, FD_CLOEXEC);
+	fcntl(upscli_fd(&link->conn), F_SETFD, FD_CLOEXEC);
 
 	/* now try to authenticate to upsd */
 
-	ret = do_upsd_auth(ups);
+	ret = do_link_auth(ups) && do_upsd_auth(ups);
 
 	if (ret == 1)
 		return 1;		/* everything is happy */
@@ -1512,8 +1777,6 @@ static void parse_status(utype_t *ups, char *status)
 {
 	char	*statword, *ptr;
 
-	clear_alarm();
-
 	upsdebugx(2, "%s: [%s]", __func__, status);
 
 	/* empty response is the same as a dead ups */
@@ -1561,35 +1824,12 @@ static void parse_status(utype_t *ups, char *status)
 	}
 }
 
-/* see what the status of the UPS is and handle any changes */
-static void pollups(utype_t *ups)
+/* a status poll went unanswered */
+static void poll_failed(utype_t *ups)
 {
-	char	status[SMALLBUF];
-
-	/* try a reconnect here */
-	if (!flag_isset(ups->status, ST_CONNECTED))
-		if (try_connect(ups) != 1)
-			return;
-
-	if (upscli_ssl(&ups->conn) == 1)
-		upsdebugx(2, "%s: %s [SSL]", __func__, ups->sys);
-	else
-		upsdebugx(2, "%s: %s", __func__, ups->sys);
-
-	set_alarm();
-
-	if (get_var(ups, "status", status, sizeof(status)) == 0) {
-		clear_alarm();
-		parse_status(ups, status);
-		return;
-	}
-
-	/* fallthrough: no communications */
-	clear_alarm();
-
 	/* try to make some of these a little friendlier */
 
-	switch (upscli_upserror(&ups->conn)) {
+	switch (upscli_upserror(&ups->link->conn)) {
 
 		case UPSCLI_ERR_UNKNOWNUPS:
 			upslogx(LOG_ERR, "Poll UPS [%s] failed - [%s] "
@@ -1599,7 +1839,7 @@ static void pollups(utype_t *ups)
 			break;
 		default:
 			upslogx(LOG_ERR, "Poll UPS [%s] failed - %s",
-				ups->sys, upscli_strerror(&ups->conn));
+				ups->sys, upscli_strerror(&ups->link->conn));
 			break;
 	}
 
@@ -1607,12 +1847,47 @@ static void pollups(utype_t *ups)
 	ups_is_gone(ups);
 
 	/* if upsclient lost the connection, clean up things on our side */
-	if (upscli_fd(&ups->conn) == -1) {
+	if (upscli_fd(&ups->link->conn) == -1) {
 		drop_connection(ups);
 		return;
 	}
 }
 
+/* see what the status of the UPSes is and handle any changes */
+static void pollups(void)
+{
+	utype_t	*ups;
+	int	reconnect = 0;
+
+	/* the connected ones first, so that reconnection attempts (which may
+	 * wait for an unreachable host) don't delay their status checks */
+	for (ups = firstups; ups != NULL; ups = ups->next) {
+		ups->reconnect = !flag_isset(ups->status, ST_CONNECTED);
+		ups->query = !ups->reconnect;
+		reconnect |= ups->reconnect;
+
+		if ((ups->query) && (nut_debug_level >= 2)) {
+			if (upscli_ssl(&ups->link->conn) == 1)
+				upsdebugx(2, "%s: %s [SSL]", __func__, ups->sys);
+			else
+				upsdebugx(2, "%s: %s", __func__, ups->sys);
+		}
+	}
+
+	get_var_all("status", parse_status, poll_failed);
+
+	if (!reconnect)
+		return;
+
+	/* try a reconnect here */
+	for (ups = firstups; ups != NULL; ups = ups->next) {
+		if (ups->reconnect)
+			ups->query = (try_connect(ups) == 1);
+	}
+
+	get_var_all("status", parse_status, poll_failed);
+}
+
 /* see if the powerdownflag file is there and proper */
 static int pdflag_status(void)
 {
@@ -2082,8 +2357,6 @@ int main(int argc, char *argv[])
 	open_syslog(prog);
 
 	while (exit_flag == 0) {
-		utype_t	*ups;
-
 		/* check flags from signal handlers */
 		if (userfsd)
 			forceshutdown();
@@ -2091,8 +2364,7 @@ int main(int argc, char *argv[])
 		if (reload_flag)
 			reload_conf();
 
-		for (ups = firstups; ups != NULL; ups = ups->next)
-			pollups(ups);
+		pollups();
 
 		recalc();
 
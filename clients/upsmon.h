@@ -40,10 +40,30 @@ extern "C" {
 /* *INDENT-ON* */
 #endif
 
+/* connection to upsd, shared by the UPSes monitored on the same server
+ * with the same credentials if it allows several LOGINs per connection */
+
+typedef struct upslink_s {
+	UPSCONN_t	conn;			/* upsclient state descriptor	*/
+
+	char	*hostname;		/* what it was opened with	*/
+	int	port;
+	char	*un;
+	char	*pw;
+
+	int	shared;			/* other UPSes may join it	*/
+	int	users;			/* UPSes using it		*/
+
+	/* pipelined queries, answered in the order they were sent */
+	unsigned int	sent;
+	unsigned int	answered;
+	struct upslink_s	*next;
+}	upslink_t;
+
 /* UPS tracking structure */
 
 typedef struct {
-	UPSCONN_t	conn;			/* upsclient state descriptor	*/
+	upslink_t	*link;			/* connection to upsd, if any	*/
 
 	char	*sys;			/* raw system name from .conf	*/
 	char	*upsname;		/* just upsname			*/
@@ -64,6 +84,12 @@ typedef struct {
 	time_t  lastnoncrit;		/* time of last non-crit poll	*/
 	time_t	lastrbwarn;		/* time of last REPLBATT warning*/
 	time_t	lastncwarn;		/* time of last NOCOMM warning	*/
+
+	/* state of the query in progress, see get_var_all() */
+	int	query;			/* to be sent			*/
+	unsigned int	seq;		/* its position on the link	*/
+	int	reconnect;		/* was not connected at the start */
+	struct timeval	deadline;	/* when to give up waiting	*/
 	void	*next;
 }	utype_t;
 
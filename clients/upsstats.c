@@ -48,6 +48,12 @@ static ulist_t	*ulhead = NULL, *currups = NULL;
 
 static int	skip_clause = 0, skip_block = 0;
 
+/* the variables of the template, all read in one round trip whenever a
+ * UPS becomes current, see prefetch_vars() */
+static vcache_t	*vcache = NULL;
+static size_t	numvcache = 0;
+static int	vcache_valid = 0;
+
 void parsearg(char *var, char *value)
 {
 	/* avoid bogus junk from evil people */
@@ -69,12 +75,17 @@ void parsearg(char *var, char *value)
 	}
 }
 
-static void report_error(void)
+static void print_error(int upserror, const char *errmsg)
 {
-	if (upscli_upserror(&ups) == UPSCLI_ERR_VARNOTSUPP)
+	if (upserror == UPSCLI_ERR_VARNOTSUPP)
 		printf("Not supported\n");
 	else
-		printf("[error: %s]\n", upscli_strerror(&ups));
+		printf("[error: %s]\n", errmsg);
+}
+
+static void report_error(void)
+{
+	print_error(upscli_upserror(&ups), upscli_strerror(&ups));
 }
 
 /* make sure we're actually connected to upsd */
@@ -100,12 +111,95 @@ static int check_ups_fd(int do_report)
 	return 1;
 }
 
+static vcache_t *find_vcache(const char *var)
+{
+	size_t	i;
+
+	for (i = 0; i < numvcache; i++) {
+		if (!strcmp(vcache[i].name, var)) {
+			return &vcache[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* remember that the template uses this variable */
+static void want_var(const char *var, size_t len)
+{
+	char	name[SMALLBUF];
+
+	snprintf(name, sizeof(name), "%.*s", (int)len, var);
+
+	if ((strlen(name) < 1) || find_vcache(name)) {
+		return;
+	}
+
+	vcache = xrealloc(vcache, (numvcache + 1) * sizeof(*vcache));
+	memset(&vcache[numvcache], 0, sizeof(*vcache));
+	vcache[numvcache++].name = xstrdup(name);
+}
+
+/* read all the variables of the template for the current UPS at once */
+static void prefetch_vars(void)
+{
+	unsigned int	numq, numa;
+	const	char	*query[4];
+	char	**answer;
+	size_t	i;
+
+	for (i = 0; i < numvcache; i++) {
+		free(vcache[i].value);
+		free(vcache[i].errmsg);
+		vcache[i].value = vcache[i].errmsg = NULL;
+	}
+
+	vcache_valid = 0;
+
+	/* get_var() reports these without the cache */
+	if ((numvcache == 0) || !check_ups_fd(0) || !upsname) {
+		return;
+	}
+
+	query[0] = "VAR";
+	query[1] = upsname;
+	numq = 3;
+
+	for (i = 0; i < numvcache; i++) {
+		query[2] = vcache[i].name;
+		upscli_pipeline_get(&ups, numq, query);
+	}
+
+	upscli_pipeline_send(&ups);
+
+	for (i = 0; i < numvcache; i++) {
+		query[2] = vcache[i].name;
+
+		if (upscli_pipeline_next(&ups, numq, query, &numa, &answer) < 0) {
+			vcache[i].upserror = upscli_upserror(&ups);
+			vcache[i].errmsg = xstrdup(upscli_strerror(&ups));
+			continue;
+		}
+
+		if (numa <= numq) {
+			vcache[i].upserror = UPSCLI_ERR_INVRESP;
+			vcache[i].errmsg = xstrdup("Invalid response");
+			continue;
+		}
+
+		vcache[i].value = xstrdup(answer[3]);
+	}
+
+	vcache_valid = 1;
+}
+
 static int get_var(const char *var, char *buf, size_t buflen, int verbose)
 {
 	int	ret;
 	unsigned int	numq, numa;
 	const	char	*query[4];
 	char	**answer;
+	vcache_t	*cached;
 
 	if (!check_ups_fd(1))
 		return 0;
@@ -117,6 +211,19 @@ static int get_var(const char *var, char *buf, size_t buflen, int verbose)
 		return 0;
 	}
 
+	cached = vcache_valid ? find_vcache(var) : NULL;
+
+	if (cached) {
+		if (!cached->value) {
+			if (verbose)
+				print_error(cached->upserror, cached->errmsg);
+			return 0;
+		}
+
+		snprintf(buf, buflen, "%s", cached->value);
+		return 1;
+	}
+
 	query[0] = "VAR";
 	query[1] = upsname;
 	query[2] = var;
@@ -727,6 +834,7 @@ static int do_command(char *cmd)
 
 		currups = ulhead;
 		ups_connect();
+		prefetch_vars();
 		return 1;
 	}
 
@@ -742,6 +850,7 @@ static int do_command(char *cmd)
 		if (currups) {
 			fseek(tf, forofs, SEEK_SET);
 			ups_connect();
+			prefetch_vars();
 		}
 
 		return 1;
@@ -841,6 +950,88 @@ static void parse_line(const char *buf)
 	}
 }
 
+/* the variables a template command asks for: the first 'words' words
+ * after 'cmd', or 'var' for commands without arguments */
+static const struct {
+	const char	*cmd;
+	int	words;
+	const char	*var;
+} cmdvars[] = {
+	{ "VAR ",	1,	NULL },
+	{ "IFSUPP ",	1,	NULL },
+	{ "IFEQ ",	1,	NULL },
+	{ "IFBETWEEN ",	3,	NULL },
+	{ "IMG ",	1,	NULL },
+	{ "STATUS",	0,	"ups.status" },
+	{ "STATUSCOLOR",	0,	"ups.status" },
+	{ "RUNTIME",	0,	"battery.runtime" },
+	{ "UPSTEMP",	0,	"ups.temperature" },
+	{ "BATTTEMP",	0,	"battery.temperature" },
+	{ "AMBTEMP",	0,	"ambient.temperature" },
+	{ NULL,	0,	NULL }
+};
+
+static void want_cmd_vars(const char *cmd)
+{
+	const char	*ptr;
+	size_t	len;
+	int	i, j;
+
+	for (i = 0; cmdvars[i].cmd != NULL; i++) {
+
+		if (cmdvars[i].var) {
+			if (!strcmp(cmd, cmdvars[i].cmd)) {
+				want_var(cmdvars[i].var, strlen(cmdvars[i].var));
+			}
+			continue;
+		}
+
+		if (strncmp(cmd, cmdvars[i].cmd, strlen(cmdvars[i].cmd)) != 0) {
+			continue;
+		}
+
+		ptr = &cmd[strlen(cmdvars[i].cmd)];
+
+		for (j = 0; (j < cmdvars[i].words) && *ptr; j++) {
+			len = strcspn(ptr, " ");
+			want_var(ptr, len);
+
+			ptr += len;
+			ptr += strspn(ptr, " ");
+		}
+	}
+}
+
+/* find the variables of the template, commands being between @ like
+ * parse_line() sees them */
+static void scan_template(void)
+{
+	char	buf[LARGEBUF], cmd[SMALLBUF];
+	int	i, len, do_cmd;
+
+	while (fgets(buf, sizeof(buf), tf)) {
+		do_cmd = 0;
+
+		for (i = 0; buf[i]; i += len) {
+
+			len = strcspn(&buf[i], "@");
+
+			if (len == 0) {
+				do_cmd = !do_cmd;
+				i++;
+				continue;
+			}
+
+			if (do_cmd) {
+				snprintf(cmd, sizeof(cmd), "%.*s", len, &buf[i]);
+				want_cmd_vars(cmd);
+			}
+		}
+	}
+
+	rewind(tf);
+}
+
 static void display_template(const char *tfn)
 {
 	char	fn[SMALLBUF], buf[LARGEBUF];
@@ -857,6 +1048,9 @@ static void display_template(const char *tfn)
 		exit(EXIT_FAILURE);
 	}
 
+	scan_template();
+	prefetch_vars();
+
 	while (fgets(buf, sizeof(buf), tf)) {
 		parse_line(buf);
 	}
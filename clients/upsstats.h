@@ -32,6 +32,14 @@ typedef struct {
 	void	*next;
 }	ulist_t;
 
+/* a variable used by the template, as read for the current UPS */
+typedef struct {
+	char	*name;
+	char	*value;		/* NULL if it could not be read */
+	int	upserror;
+	char	*errmsg;
+}	vcache_t;
+
 #ifdef __cplusplus
 /* *INDENT-OFF* */
 }
@@ -823,6 +823,24 @@ ssize_t select_write(const int fd, const void *buf, const size_t buflen, const l
 	return write(fd, buf, buflen);
 }
 
+/* Get the current time from a clock that only moves forward (the
+   monotonic clock where available, the time of day otherwise), for
+   computing deadlines that must not jump when the system time is set.
+   Values are only meaningful compared with each other. */
+void get_monotonic_time(struct timeval *tv)
+{
+#if (defined HAVE_CLOCK_GETTIME) && (defined CLOCK_MONOTONIC)
+	struct timespec	ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+		tv->tv_sec = ts.tv_sec;
+		tv->tv_usec = ts.tv_nsec / 1000;
+		return;
+	}
+#endif
+	gettimeofday(tv, NULL);
+}
+
 
 /* FIXME: would be good to get more from /etc/ld.so.conf[.d] and/or
  * LD_LIBRARY_PATH and a smarter dependency on build bitness; also
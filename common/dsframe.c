@@ -0,0 +1,233 @@
+/* dsframe.c - binary framing for the driver to server socket protocol
+
+   With the text protocol, every change is a line that upsd tokenizes
+   byte by byte with parseconf. Once negotiated (see sock-protocol.txt),
+   a driver may instead batch its updates into length-prefixed frames,
+   referring to variables by a small id instead of by name. Strings are
+   NUL terminated on the wire so that the receiver can use them in place.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "common.h"
+#include "dsframe.h"
+
+/* indexed by dsframe_op_t */
+static const char	*dsframe_opnames[DSF_COUNT] = {
+	NULL,
+	"DEFVAR",
+	"SETINFO",
+	"DELINFO",
+	"ADDENUM",
+	"DELENUM",
+	"ADDRANGE",
+	"DELRANGE",
+	"SETAUX",
+	"SETFLAGS",
+	"ADDCMD",
+	"DELCMD",
+	"DATAOK",
+	"DATASTALE",
+	"DUMPDONE",
+	"PONG",
+	"TRACKING"
+};
+
+static void put16(unsigned char *p, size_t val)
+{
+	p[0] = (unsigned char)((val >> 8) & 0xff);
+	p[1] = (unsigned char)(val & 0xff);
+}
+
+static size_t get16(const unsigned char *p)
+{
+	return ((size_t)p[0] << 8) | (size_t)p[1];
+}
+
+const char *dsframe_opname(int op)
+{
+	if ((op < DSF_DEFVAR) || (op >= DSF_COUNT)) {
+		return NULL;
+	}
+
+	return dsframe_opnames[op];
+}
+
+void dsframe_init(dsframe_t *frame)
+{
+	frame->buf = NULL;
+	frame->len = DSFRAME_HDRLEN;
+	frame->size = 0;
+}
+
+void dsframe_free(dsframe_t *frame)
+{
+	free(frame->buf);
+	dsframe_init(frame);
+}
+
+/* append a record, return 0 if it can't be encoded */
+int dsframe_add(dsframe_t *frame, int op, unsigned int varid, size_t argc, const char **argv)
+{
+	size_t	i, need, slen;
+	unsigned char	*p;
+
+	if ((op < DSF_DEFVAR) || (op >= DSF_COUNT) || (argc > DSFRAME_MAXARGS) ||
+		(varid > DSFRAME_MAXVARID)) {
+		return 0;
+	}
+
+	need = 2 + (DSFRAME_HAS_VAR(op) ? 2 : 0);
+
+	for (i = 0; i < argc; i++) {
+		slen = strlen(argv[i]);
+
+		if (slen > 0xffff) {
+			return 0;
+		}
+
+		need += 2 + slen + 1;
+	}
+
+	if (frame->len + need > frame->size) {
+		size_t	size = frame->size ? frame->size : DSFRAME_FLUSH;
+
+		while (frame->len + need > size) {
+			size *= 2;
+		}
+
+		frame->buf = xrealloc(frame->buf, size);
+		frame->size = size;
+	}
+
+	p = frame->buf + frame->len;
+
+	*p++ = (unsigned char)op;
+	*p++ = (unsigned char)argc;
+
+	if (DSFRAME_HAS_VAR(op)) {
+		put16(p, varid);
+		p += 2;
+	}
+
+	for (i = 0; i < argc; i++) {
+		slen = strlen(argv[i]);
+		put16(p, slen);
+		memcpy(p + 2, argv[i], slen + 1);
+		p += 2 + slen + 1;
+	}
+
+	frame->len += need;
+
+	return 1;
+}
+
+/* is there anything to send? */
+int dsframe_pending(const dsframe_t *frame)
+{
+	return frame->len > DSFRAME_HDRLEN;
+}
+
+/* fill in the header, return the number of bytes to send */
+size_t dsframe_seal(dsframe_t *frame)
+{
+	size_t	plen = frame->len - DSFRAME_HDRLEN;
+
+	if (!dsframe_pending(frame)) {
+		return 0;
+	}
+
+	frame->buf[0] = (unsigned char)((plen >> 24) & 0xff);
+	frame->buf[1] = (unsigned char)((plen >> 16) & 0xff);
+	frame->buf[2] = (unsigned char)((plen >> 8) & 0xff);
+	frame->buf[3] = (unsigned char)(plen & 0xff);
+
+	return frame->len;
+}
+
+/* start over, keeping the buffer */
+void dsframe_reset(dsframe_t *frame)
+{
+	frame->len = DSFRAME_HDRLEN;
+}
+
+long dsframe_length(const unsigned char *buf, size_t len)
+{
+	size_t	plen;
+
+	if (len < DSFRAME_HDRLEN) {
+		return 0;
+	}
+
+	plen = ((size_t)buf[0] << 24) | ((size_t)buf[1] << 16) |
+		((size_t)buf[2] << 8) | (size_t)buf[3];
+
+	if ((plen < 2) || (plen > DSFRAME_MAXLEN)) {
+		return -1;
+	}
+
+	return (long)(DSFRAME_HDRLEN + plen);
+}
+
+int dsframe_next(unsigned char *payload, size_t len, size_t *pos, dsframe_rec_t *rec)
+{
+	size_t	i, p = *pos, slen;
+
+	if (p >= len) {
+		return 0;
+	}
+
+	if (len - p < 2) {
+		return -1;
+	}
+
+	rec->op = payload[p];
+	rec->argc = payload[p + 1];
+	rec->varid = 0;
+	p += 2;
+
+	if ((rec->op < DSF_DEFVAR) || (rec->op >= DSF_COUNT) || (rec->argc > DSFRAME_MAXARGS)) {
+		return -1;
+	}
+
+	if (DSFRAME_HAS_VAR(rec->op)) {
+		if (len - p < 2) {
+			return -1;
+		}
+
+		rec->varid = (unsigned int)get16(payload + p);
+		p += 2;
+	}
+
+	for (i = 0; i < rec->argc; i++) {
+		if (len - p < 2) {
+			return -1;
+		}
+
+		slen = get16(payload + p);
+		p += 2;
+
+		if ((len - p < slen + 1) || (payload[p + slen] != '\0')) {
+			return -1;
+		}
+
+		rec->argv[i] = (char *)(payload + p);
+		p += slen + 1;
+	}
+
+	*pos = p;
+
+	return 1;
+}
@@ -27,8 +27,9 @@
  * All subsequent calls must have it as the first argument.  There are
  * two entry points for parsing lines.  You can have it read a file
  * (pconf_file_begin and pconf_file_next), take lines directly from
- * the caller (pconf_line), or go along a character at a time (pconf_char).
- * The parsing is identical no matter how you feed it.
+ * the caller (pconf_line), go along a character at a time (pconf_char),
+ * or hand it whatever a socket read returned (pconf_buf).  The parsing
+ * is identical no matter how you feed it.
  *
  * Since there are no more callbacks, you take the successful return
  * from the function and access ctx->arglist and ctx->numargs yourself.
@@ -62,17 +63,19 @@
  *
  * Design:
  *
- * Characters are read one at a time to drive the state machine.
- * As words are completed (by hitting whitespace or ending a "" item),
- * they are committed to the next buffer in the arglist.  realloc is
- * used, so the buffer can grow to handle bigger words.
- *
- * The arglist also grows as necessary with a similar approach.  As a
- * result, you can parse extremely long words and lines with an insane
- * number of elements.
+ * Characters drive the state machine one at a time, except for runs
+ * of plain characters inside a word, which are copied in one go, and
+ * comments, which are skipped up to the newline with memchr.  Anything
+ * else, including the characters that are filtered out, takes the same
+ * path as before.
  *
- * Finally, there is argsize, which remembers how long each of the
- * arglist elements are.  This is how we know when to expand them.
+ * The words of a line are collected one after the other in wordbuf,
+ * each with its trailing NULL, and the arglist entries point into it.
+ * As words are completed (by hitting whitespace or ending a "" item),
+ * argofs remembers where they start, so the pointers can be set again
+ * when wordbuf has to grow.  Both wordbuf and the arglist double in size
+ * when needed.  As a result, you can parse extremely long words and
+ * lines with an insane number of elements.
  *
  */
 
@@ -114,10 +117,38 @@ static void pconf_fatal(PCONF_CTX_t *ctx, const char *errtxt)
 	exit(EXIT_FAILURE);
 }
 
+/* length of the word being collected */
+static size_t wordlen(const PCONF_CTX_t *ctx)
+{
+	return (size_t)(ctx->wordptr - ctx->wordbuf) - ctx->wordstart;
+}
+
+/* make room for 'need' more characters and a trailing NULL */
+static void wordbuf_reserve(PCONF_CTX_t *ctx, size_t need)
+{
+	size_t	i, used = ctx->wordptr - ctx->wordbuf;
+
+	if (used + need < ctx->wordbufsize)
+		return;
+
+	while (used + need >= ctx->wordbufsize)
+		ctx->wordbufsize *= 2;
+
+	ctx->wordbuf = realloc(ctx->wordbuf, ctx->wordbufsize);
+
+	if (!ctx->wordbuf)
+		pconf_fatal(ctx, "realloc wordbuf failed");
+
+	/* repoint as wordbuf may have moved */
+	ctx->wordptr = &ctx->wordbuf[used];
+
+	for (i = 0; i < ctx->numargs; i++)
+		ctx->arglist[i] = &ctx->wordbuf[ctx->argofs[i]];
+}
+
 static void add_arg_word(PCONF_CTX_t *ctx)
 {
 	size_t	argpos;
-	size_t	wbuflen;
 
 	/* this is where the new value goes */
 	argpos = ctx->numargs;
@@ -126,87 +157,78 @@ static void add_arg_word(PCONF_CTX_t *ctx)
 
 	/* when facing more args than ever before, expand the list */
 	if (ctx->numargs > ctx->maxargs) {
-		ctx->maxargs = ctx->numargs;
+		ctx->maxargs = (ctx->maxargs < 8) ? 8 : ctx->maxargs * 2;
 
 		/* resize the lists */
 		ctx->arglist = realloc(ctx->arglist,
-			sizeof(char *) * ctx->numargs);
+			sizeof(char *) * ctx->maxargs);
 
 		if (!ctx->arglist)
 			pconf_fatal(ctx, "realloc arglist failed");
 
-		ctx->argsize = realloc(ctx->argsize,
-			sizeof(size_t) * ctx->numargs);
-
-		if (!ctx->argsize)
-			pconf_fatal(ctx, "realloc argsize failed");
+		ctx->argofs = realloc(ctx->argofs,
+			sizeof(size_t) * ctx->maxargs);
 
-		/* ensure sane starting values */
-		ctx->arglist[argpos] = NULL;
-		ctx->argsize[argpos] = 0;
+		if (!ctx->argofs)
+			pconf_fatal(ctx, "realloc argofs failed");
 	}
 
-	wbuflen = strlen(ctx->wordbuf);
-
-	/* now see if the string itself grew compared to last time */
-	if (wbuflen >= ctx->argsize[argpos]) {
-		size_t	newlen;
+	/* the word stays where it was collected, with its NULL */
+	ctx->argofs[argpos] = ctx->wordstart;
+	ctx->arglist[argpos] = &ctx->wordbuf[ctx->wordstart];
 
-		/* allow for the trailing NULL */
-		newlen = wbuflen + 1;
+	/* and the next one goes after it */
+	ctx->wordptr++;
+	wordbuf_reserve(ctx, 0);
 
-		/* expand the string storage */
-		ctx->arglist[argpos] = realloc(ctx->arglist[argpos], newlen);
-
-		if (!ctx->arglist[argpos])
-			pconf_fatal(ctx, "realloc arglist member failed");
-
-		/* remember the new size */
-		ctx->argsize[argpos] = newlen;
-	}
-
-	/* strncpy doesn't give us a trailing NULL, so prep the space */
-	memset(ctx->arglist[argpos], '\0', ctx->argsize[argpos]);
+	ctx->wordstart = ctx->wordptr - ctx->wordbuf;
+	*ctx->wordptr = '\0';
+}
 
-	/* finally copy the new value into the provided space */
-	strncpy(ctx->arglist[argpos], ctx->wordbuf, wbuflen);
+/* CVE-2012-2944: only allow the subset of ASCII charset from Space to ~ */
+static int valid_char(int ch)
+{
+	return (ch >= 0x20) && (ch <= 0x7f);
 }
 
 static void addchar(PCONF_CTX_t *ctx)
 {
-	size_t	wbuflen;
-
-	wbuflen = strlen(ctx->wordbuf);
-
-	/* CVE-2012-2944: only allow the subset of ASCII charset from Space to ~ */
-	if ((ctx->ch < 0x20) || (ctx->ch > 0x7f)) {
+	if (!valid_char(ctx->ch)) {
 		fprintf(stderr, "addchar: discarding invalid character (0x%02x)!\n",
 				ctx->ch);
 		return;
 	}
 
 	if (ctx->wordlen_limit != 0) {
-		if (wbuflen >= ctx->wordlen_limit) {
+		if (wordlen(ctx) >= ctx->wordlen_limit) {
 
 			/* limit reached: don't append any more */
 			return;
 		}
 	}
 
-	/* allow for the null */
-	if (wbuflen >= (ctx->wordbufsize - 1)) {
-		ctx->wordbufsize += 8;
+	wordbuf_reserve(ctx, 1);
 
-		ctx->wordbuf = realloc(ctx->wordbuf, ctx->wordbufsize);
+	*ctx->wordptr++ = (char)ctx->ch;
+	*ctx->wordptr = '\0';
+}
 
-		if (!ctx->wordbuf)
-			pconf_fatal(ctx, "realloc wordbuf failed");
+/* addchar() for a run of characters known to be valid */
+static void addchars(PCONF_CTX_t *ctx, const char *run, size_t len)
+{
+	if (ctx->wordlen_limit != 0) {
+		if (wordlen(ctx) + len > ctx->wordlen_limit) {
 
-		/* repoint as wordbuf may have moved */
-		ctx->wordptr = &ctx->wordbuf[wbuflen];
+			/* limit reached: only take what fits */
+			len = (wordlen(ctx) < ctx->wordlen_limit) ?
+				ctx->wordlen_limit - wordlen(ctx) : 0;
+		}
 	}
 
-	*ctx->wordptr++ = (char)ctx->ch;
+	wordbuf_reserve(ctx, len);
+
+	memcpy(ctx->wordptr, run, len);
+	ctx->wordptr += len;
 	*ctx->wordptr = '\0';
 }
 
@@ -216,7 +238,7 @@ static void endofword(PCONF_CTX_t *ctx)
 		if (ctx->numargs >= ctx->arg_limit) {
 
 			/* don't accept this word - just drop it */
-			ctx->wordptr = ctx->wordbuf;
+			ctx->wordptr = &ctx->wordbuf[ctx->wordstart];
 			*ctx->wordptr = '\0';
 
 			return;
@@ -224,8 +246,16 @@ static void endofword(PCONF_CTX_t *ctx)
 	}
 
 	add_arg_word(ctx);
+}
+
+/* forget the previous line */
+static void newline(PCONF_CTX_t *ctx)
+{
+	ctx->numargs = 0;
+	ctx->state = STATE_FINDWORDSTART;
 
 	ctx->wordptr = ctx->wordbuf;
+	ctx->wordstart = 0;
 	*ctx->wordptr = '\0';
 }
 
@@ -378,20 +408,14 @@ static int collectliteral(PCONF_CTX_t *ctx)
 /* clean up memory before going back to the user */
 static void free_storage(PCONF_CTX_t *ctx)
 {
-	unsigned int	i;
-
 	free(ctx->wordbuf);
 
-	/* clear out the individual words first */
-	for (i = 0; i < ctx->maxargs; i++)
-		free(ctx->arglist[i]);
-
 	free(ctx->arglist);
-	free(ctx->argsize);
+	free(ctx->argofs);
 
 	/* put things back to the initial state */
 	ctx->arglist = NULL;
-	ctx->argsize = NULL;
+	ctx->argofs = NULL;
 	ctx->numargs = 0;
 	ctx->maxargs = 0;
 }
@@ -409,14 +433,15 @@ int pconf_init(PCONF_CTX_t *ctx, void errhandler(const char *))
 	ctx->linenum = 0;
 	ctx->error = 0;
 	ctx->arglist = NULL;
-	ctx->argsize = NULL;
+	ctx->argofs = NULL;
 
-	ctx->wordbufsize = 16;
+	ctx->wordbufsize = 64;
 	ctx->wordbuf = calloc(1, ctx->wordbufsize);
 
 	if (!ctx->wordbuf)
 		pconf_fatal(ctx, "malloc wordbuf failed");
 	ctx->wordptr = ctx->wordbuf;
+	ctx->wordstart = 0;
 
 	ctx->errhandler = errhandler;
 	ctx->magic = PCONF_CTX_t_MAGIC;
@@ -522,8 +547,7 @@ int pconf_file_next(PCONF_CTX_t *ctx)
 	ctx->linenum++;
 
 	/* start over for the new line */
-	ctx->numargs = 0;
-	ctx->state = STATE_FINDWORDSTART;
+	newline(ctx);
 
 	while ((ctx->ch = fgetc(ctx->f)) != EOF) {
 		parse_char(ctx);
@@ -540,7 +564,7 @@ int pconf_file_next(PCONF_CTX_t *ctx)
 	if (ctx->numargs != 0) {
 
 		/* still building a word? */
-		if (ctx->wordptr != ctx->wordbuf)
+		if (wordlen(ctx) > 0)
 			endofword(ctx);
 
 		return 1;
@@ -550,10 +574,72 @@ int pconf_file_next(PCONF_CTX_t *ctx)
 	return 0;
 }
 
+/* characters that can be copied as they are while collecting a word in
+ * that state, see collect() and quotecollect() */
+static int plain_char(int state, unsigned char ch)
+{
+	if ((ch == '#') || (ch == '\\') || !valid_char(ch))
+		return 0;
+
+	if (state == STATE_COLLECT)
+		return (ch != ' ') && (ch != '=');
+
+	return (ch != '"');
+}
+
+/* feed characters until a line is complete or the buffer is used up */
+static int parse_buf(PCONF_CTX_t *ctx, const char *buf, size_t buflen, size_t *used)
+{
+	const char	*ptr = buf, *end = buf + buflen, *run;
+
+	while (ptr < end) {
+
+		switch (ctx->state) {
+			case STATE_COLLECT:
+			case STATE_QUOTECOLLECT:
+				for (run = ptr; (ptr < end) && plain_char(ctx->state, *ptr); ptr++)
+					;
+
+				if (ptr > run) {
+					addchars(ctx, run, ptr - run);
+					continue;
+				}
+				break;
+
+			case STATE_FINDEOL:
+				run = memchr(ptr, 10, end - ptr);
+
+				if (!run) {
+					ptr = end;
+					continue;
+				}
+
+				ptr = run;
+				break;
+		}
+
+		ctx->ch = *ptr++;
+		parse_char(ctx);
+
+		if ((ctx->state == STATE_ENDOFLINE) || (ctx->state == STATE_PARSEERR))
+			break;
+	}
+
+	*used = ptr - buf;
+
+	if (ctx->state == STATE_ENDOFLINE)
+		return 1;
+
+	if (ctx->state == STATE_PARSEERR)
+		return -1;
+
+	return 0;
+}
+
 /* parse a provided line */
 int pconf_line(PCONF_CTX_t *ctx, const char *line)
 {
-	size_t	i, linelen;
+	size_t	used;
 
 	if (!check_magic(ctx))
 		return 0;
@@ -561,27 +647,15 @@ int pconf_line(PCONF_CTX_t *ctx, const char *line)
 	ctx->linenum++;
 
 	/* start over for the new line */
-	ctx->numargs = 0;
-	ctx->state = STATE_FINDWORDSTART;
-
-	linelen = strlen(line);
-
-	for (i = 0; i < linelen; i++) {
-		ctx->ch = line[i];
-
-		parse_char(ctx);
-
-		if (ctx->state == STATE_PARSEERR)
-			return 1;
+	newline(ctx);
 
-		if (ctx->state == STATE_ENDOFLINE)
-			return 1;
-	}
+	if (parse_buf(ctx, line, strlen(line), &used) != 0)
+		return 1;
 
 	/* deal with any lingering characters */
 
 	/* still building a word? */
-	if (ctx->wordptr != ctx->wordbuf)
+	if (wordlen(ctx) > 0)
 		endofword(ctx);		/* tie it off */
 
 	return 1;
@@ -630,10 +704,8 @@ int pconf_char(PCONF_CTX_t *ctx, char ch)
 		return -1;
 
 	/* if the last call finished a line, clean stuff up for another */
-	if ((ctx->state == STATE_ENDOFLINE) || (ctx->state == STATE_PARSEERR)) {
-		ctx->numargs = 0;
-		ctx->state = STATE_FINDWORDSTART;
-	}
+	if ((ctx->state == STATE_ENDOFLINE) || (ctx->state == STATE_PARSEERR))
+		newline(ctx);
 
 	ctx->ch = ch;
 	parse_char(ctx);
@@ -646,3 +718,20 @@ int pconf_char(PCONF_CTX_t *ctx, char ch)
 
 	return 0;
 }
+
+/* parse input as it comes, stopping at the end of the first line in it:
+ * returns like pconf_char() for the last character used, and sets *used
+ * to the number of characters taken from buf */
+int pconf_buf(PCONF_CTX_t *ctx, const char *buf, size_t buflen, size_t *used)
+{
+	*used = 0;
+
+	if (!check_magic(ctx))
+		return -1;
+
+	/* if the last call finished a line, clean stuff up for another */
+	if ((ctx->state == STATE_ENDOFLINE) || (ctx->state == STATE_PARSEERR))
+		newline(ctx);
+
+	return parse_buf(ctx, buf, buflen, used);
+}
@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <ctype.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -81,6 +82,7 @@ static void st_tree_range_free(range_t *list)
 static void st_tree_node_free(st_tree_t *node)
 {
 	free(node->var);
+	free(node->key);
 	free(node->raw);
 	free(node->safe);
 
@@ -96,90 +98,194 @@ static void st_tree_node_free(st_tree_t *node)
 	free(node);
 }
 
-/* add a subtree to another subtree */
-static void st_tree_node_add(st_tree_t **nptr, st_tree_t *sptr)
+/* return the case-folded form of var, used as the search key; short
+ * names (the usual case) are folded into the caller's buffer */
+static char *st_tree_key(char *buf, size_t buflen, const char *var)
 {
-	if (!sptr) {
-		return;
+	size_t	i, len = strlen(var) + 1;
+	char	*key = (len > buflen) ? xmalloc(len) : buf;
+
+	for (i = 0; i < len; i++) {
+		key[i] = (char)tolower((unsigned char)var[i]);
 	}
 
-	while (*nptr) {
+	return key;
+}
 
-		st_tree_t	*node = *nptr;
+static void st_tree_key_free(char *key, const char *buf)
+{
+	if (key != buf) {
+		free(key);
+	}
+}
 
-		if (strcasecmp(node->var, sptr->var) > 0) {
-			nptr = &node->left;
-			continue;
+static int st_tree_height(const st_tree_t *node)
+{
+	return node ? node->height : 0;
+}
+
+static void st_tree_update_height(st_tree_t *node)
+{
+	int	lh = st_tree_height(node->left);
+	int	rh = st_tree_height(node->right);
+
+	node->height = ((lh > rh) ? lh : rh) + 1;
+}
+
+static st_tree_t *st_tree_rotate_right(st_tree_t *node)
+{
+	st_tree_t	*pivot = node->left;
+
+	node->left = pivot->right;
+	pivot->right = node;
+
+	st_tree_update_height(node);
+	st_tree_update_height(pivot);
+
+	return pivot;
+}
+
+static st_tree_t *st_tree_rotate_left(st_tree_t *node)
+{
+	st_tree_t	*pivot = node->right;
+
+	node->right = pivot->left;
+	pivot->left = node;
+
+	st_tree_update_height(node);
+	st_tree_update_height(pivot);
+
+	return pivot;
+}
+
+/* restore the AVL property at node after one of its subtrees changed
+ * height by at most one, and return the new root of this subtree */
+static st_tree_t *st_tree_balance(st_tree_t *node)
+{
+	int	bal;
+
+	st_tree_update_height(node);
+
+	bal = st_tree_height(node->left) - st_tree_height(node->right);
+
+	if (bal > 1) {
+		if (st_tree_height(node->left->left) < st_tree_height(node->left->right)) {
+			node->left = st_tree_rotate_left(node->left);
 		}
+		return st_tree_rotate_right(node);
+	}
 
-		if (strcasecmp(node->var, sptr->var) < 0) {
-			nptr = &node->right;
-			continue;
+	if (bal < -1) {
+		if (st_tree_height(node->right->right) < st_tree_height(node->right->left)) {
+			node->right = st_tree_rotate_right(node->right);
 		}
+		return st_tree_rotate_left(node);
+	}
 
-		upsdebugx(1, "%s: duplicate value (shouldn't happen)", __func__);
-		return;
+	return node;
+}
+
+/* unlink the leftmost node of a subtree into *min */
+static st_tree_t *st_tree_remove_min(st_tree_t *node, st_tree_t **min)
+{
+	if (!node->left) {
+		*min = node;
+		return node->right;
 	}
 
-	*nptr = sptr;
+	node->left = st_tree_remove_min(node->left, min);
+
+	return st_tree_balance(node);
 }
 
-/* remove a variable from a tree
- * except for variables with ST_FLAG_IMMUTABLE
- * (for override.* to survive) per issue #737
- */
-int state_delinfo(st_tree_t **nptr, const char *var)
+static int st_tree_delete(st_tree_t **nptr, const char *key)
 {
-	while (*nptr) {
+	st_tree_t	*node = *nptr;
+	int	cmp, ret;
 
-		st_tree_t	*node = *nptr;
+	if (!node) {
+		return 0;	/* not found */
+	}
 
-		if (strcasecmp(node->var, var) > 0) {
-			nptr = &node->left;
-			continue;
-		}
+	cmp = strcmp(node->key, key);
 
-		if (strcasecmp(node->var, var) < 0) {
-			nptr = &node->right;
-			continue;
-		}
+	if (cmp > 0) {
+		ret = st_tree_delete(&node->left, key);
+	} else if (cmp < 0) {
+		ret = st_tree_delete(&node->right, key);
+	} else {
 
 		if (node->flags & ST_FLAG_IMMUTABLE) {
-			upsdebugx(6, "%s: not deleting immutable variable [%s]", __func__, var);
+			upsdebugx(6, "%s: not deleting immutable variable [%s]", __func__, node->var);
 			return 0;
 		}
 
-		/* whatever is on the left, hang it off current right */
-		st_tree_node_add(&node->right, node->left);
+		if (!node->right) {
+			*nptr = node->left;
+		} else {
+			st_tree_t	*min, *right;
 
-		/* now point the parent at the old right child */
-		*nptr = node->right;
+			/* the in-order successor takes the place of node */
+			right = st_tree_remove_min(node->right, &min);
+			min->left = node->left;
+			min->right = right;
+			*nptr = st_tree_balance(min);
+		}
 
 		st_tree_node_free(node);
 
 		return 1;
 	}
 
-	return 0;	/* not found */
+	if (ret) {
+		*nptr = st_tree_balance(node);
+	}
+
+	return ret;
 }
 
-/* interface */
+/* remove a variable from a tree
+ * except for variables with ST_FLAG_IMMUTABLE
+ * (for override.* to survive) per issue #737
+ */
+int state_delinfo(st_tree_t **nptr, const char *var)
+{
+	char	buf[SMALLBUF], *key = st_tree_key(buf, sizeof(buf), var);
+	int	ret = st_tree_delete(nptr, key);
 
-int state_setinfo(st_tree_t **nptr, const char *var, const char *val)
+	st_tree_key_free(key, buf);
+
+	return ret;
+}
+
+static int st_tree_set(st_tree_t **nptr, const char *key, const char *var, const char *val)
 {
-	while (*nptr) {
+	st_tree_t	*node = *nptr;
+	int	cmp, ret;
 
-		st_tree_t	*node = *nptr;
+	if (!node) {
+		node = xcalloc(1, sizeof(*node));
 
-		if (strcasecmp(node->var, var) > 0) {
-			nptr = &node->left;
-			continue;
-		}
+		node->var = xstrdup(var);
+		node->key = xstrdup(key);
+		node->raw = xstrdup(val);
+		node->rawsize = strlen(val) + 1;
+		node->height = 1;
 
-		if (strcasecmp(node->var, var) < 0) {
-			nptr = &node->right;
-			continue;
-		}
+		val_escape(node);
+
+		*nptr = node;
+
+		return 2;	/* added */
+	}
+
+	cmp = strcmp(node->key, key);
+
+	if (cmp > 0) {
+		ret = st_tree_set(&node->left, key, var, val);
+	} else if (cmp < 0) {
+		ret = st_tree_set(&node->right, key, var, val);
+	} else {
 
 		/* updating an existing entry */
 		if (!strcasecmp(node->raw, val)) {
@@ -205,15 +311,24 @@ int state_setinfo(st_tree_t **nptr, const char *var, const char *val)
 		return 1;	/* changed */
 	}
 
-	*nptr = xcalloc(1, sizeof(**nptr));
+	/* only a new node can change the shape of the tree */
+	if (ret == 2) {
+		*nptr = st_tree_balance(node);
+	}
 
-	(*nptr)->var = xstrdup(var);
-	(*nptr)->raw = xstrdup(val);
-	(*nptr)->rawsize = strlen(val) + 1;
+	return ret;
+}
 
-	val_escape(*nptr);
+/* interface */
 
-	return 1;	/* added */
+int state_setinfo(st_tree_t **nptr, const char *var, const char *val)
+{
+	char	buf[SMALLBUF], *key = st_tree_key(buf, sizeof(buf), var);
+	int	ret = st_tree_set(nptr, key, var, val);
+
+	st_tree_key_free(key, buf);
+
+	return (ret != 0);	/* added or changed */
 }
 
 static int st_tree_enum_add(enum_t **list, const char *enc)
@@ -600,14 +715,18 @@ int state_delrange(st_tree_t *root, const char *var, const int min, const int ma
 
 st_tree_t *state_tree_find(st_tree_t *node, const char *var)
 {
+	char	buf[SMALLBUF], *key = st_tree_key(buf, sizeof(buf), var);
+
 	while (node) {
 
-		if (strcasecmp(node->var, var) > 0) {
+		int	cmp = strcmp(node->key, key);
+
+		if (cmp > 0) {
 			node = node->left;
 			continue;
 		}
 
-		if (strcasecmp(node->var, var) < 0) {
+		if (cmp < 0) {
 			node = node->right;
 			continue;
 		}
@@ -615,5 +734,7 @@ st_tree_t *state_tree_find(st_tree_t *node, const char *var)
 		break;	/* found */
 	}
 
+	st_tree_key_free(key, buf);
+
 	return node;
 }
@@ -27,12 +27,23 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <limits.h>
+#include <poll.h>
 
 #include "common.h"
 #include "dstate.h"
 #include "state.h"
 #include "parseconf.h"
 #include "attribute.h"
+#include "dsframe.h"
+
+#if (defined HAVE_SYS_EPOLL_H) && (defined HAVE_EPOLL_CREATE1)
+#include <sys/epoll.h>
+#define USE_EPOLL 1
+#endif
+
+/* readiness events taken per epoll_wait() call */
+#define DS_POLL_EVENTS	16
 
 	static int	sockfd = -1, stale = 1, alarm_active = 0, ignorelb = 0;
 	static char	*sockfn = NULL;
@@ -43,6 +54,77 @@
 
 	struct ups_handler	upsh;
 
+	/* descriptors registered by the driver, see dstate_register_fd() */
+	static int	*wakefds = NULL;
+	static int	wakefds_used = 0, wakefds_size = 0;
+
+	/* extrafd as last passed to dstate_poll_fds() */
+	static int	polled_extrafd = -1;
+
+#ifdef USE_EPOLL
+	/* persistent readiness set: the listening socket, the connections
+	 * and the driver's own descriptors; -1 if poll() is used */
+	static int	epfd = -1;
+#endif
+
+	/* poll() fallback: the descriptors of one call, and their events by
+	 * fd number; unlike an fd_set, neither has an upper bound on it */
+	static struct pollfd	*pfds = NULL;
+	static int	pfds_used = 0, pfds_size = 0;
+	static short	*fd_revents = NULL;
+	static int	fd_revents_size = 0;
+
+	/* variable ids for the binary protocol, shared by all connections */
+	static char	**varid_names = NULL;		/* indexed by id, from 1 */
+	static unsigned int	*varid_hash = NULL;	/* open addressing, 0 is free */
+	static unsigned int	varid_count = 0, varid_names_size = 0, varid_hash_size = 0;
+
+	/* changes queued while a batch is open, see dstate_batch_begin() */
+	typedef struct {
+		int	op;
+		char	*var;
+		size_t	argc;
+		char	*argv[DSFRAME_MAXARGS];
+		char	*orig;		/* SETINFO: value before the batch, NULL if new */
+	} batch_change_t;
+
+	static batch_change_t	*batch = NULL;
+	static size_t	batch_len = 0, batch_size = 0;
+	static int	batch_depth = 0;
+	/* index + 1 of the queued SETINFO, SETFLAGS and SETAUX, by variable id */
+	static size_t	*batch_slot = NULL;
+	static unsigned int	batch_slot_size = 0;
+
+#define BATCH_KEYS	3
+
+	/* the devices of a driver serving several, see dstate_add_device():
+	 * the state above is the one of the selected device, and the others
+	 * keep theirs here; status_buf and alarm_buf are scratch space,
+	 * shared by all */
+	struct dstate_device_s {
+		int	sockfd, stale, alarm_active, ignorelb;
+		char	*sockfn;
+		st_tree_t	*dtree_root;
+		conn_t	*connhead;
+		cmdlist_t	*cmdhead;
+		batch_change_t	*batch;
+		size_t	batch_len, batch_size;
+		int	batch_depth;
+		size_t	*batch_slot;
+		unsigned int	batch_slot_size;
+		char	*devname;	/* for its socket, NULL for the first one */
+		struct dstate_device_s	*next;
+	};
+
+	static dstate_device_t	*devices = NULL, *devices_tail = NULL, *selected = NULL;
+
+	/* program name for the sockets, once dstate_init() opened its own */
+	static char	*listen_prog = NULL;
+
+	/* device of each descriptor in the readiness set, by fd */
+	static dstate_device_t	**fd_owner = NULL;
+	static int	fd_owner_size = 0;
+
 /* this may be a frequent stumbling point for new users, so be verbose here */
 static void sock_fail(const char *fn)
 	__attribute__((noreturn));
@@ -144,11 +226,192 @@ static int sock_open(const char *fn)
 	return fd;
 }
 
+#ifdef USE_EPOLL
+static void fd_owner_set(int fd, dstate_device_t *dev)
+{
+	if (fd >= fd_owner_size) {
+		int	size = fd_owner_size ? fd_owner_size : 64;
+
+		if (!dev) {
+			return;
+		}
+
+		while (size <= fd) {
+			size *= 2;
+		}
+
+		fd_owner = xrealloc(fd_owner, size * sizeof(*fd_owner));
+		memset(fd_owner + fd_owner_size, 0, (size - fd_owner_size) * sizeof(*fd_owner));
+		fd_owner_size = size;
+	}
+
+	fd_owner[fd] = dev;
+}
+#endif
+
+/* add a descriptor to the readiness set (no-op with poll) */
+static int poll_add(int fd)
+{
+#ifdef USE_EPOLL
+	struct epoll_event	ev;
+
+	if (epfd < 0) {
+		return 1;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+
+	if ((epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) && (errno != EEXIST)) {
+		upslog_with_errno(LOG_ERR, "%s: epoll_ctl(add) on fd %d", __func__, fd);
+		return 0;
+	}
+
+	if (devices) {
+		fd_owner_set(fd, selected);
+	}
+#else
+	NUT_UNUSED_VARIABLE(fd);
+#endif
+	return 1;
+}
+
+static void poll_del(int fd)
+{
+#ifdef USE_EPOLL
+	struct epoll_event	ev;
+
+	if (epfd < 0) {
+		return;
+	}
+
+	/* non-NULL event for kernels before 2.6.9; a descriptor that was
+	 * closed already left the set by itself, so errors are expected */
+	memset(&ev, 0, sizeof(ev));
+	epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
+
+	if (devices) {
+		fd_owner_set(fd, NULL);
+	}
+#else
+	NUT_UNUSED_VARIABLE(fd);
+#endif
+}
+
+static int wakefd_find(int fd)
+{
+	int	i;
+
+	for (i = 0; i < wakefds_used; i++) {
+		if (wakefds[i] == fd) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+#ifdef USE_EPOLL
+static conn_t *conn_find(int fd)
+{
+	conn_t	*conn;
+
+	for (conn = connhead; conn; conn = conn->next) {
+		if (conn->fd == fd) {
+			return conn;
+		}
+	}
+
+	return NULL;
+}
+
+/* the fd is the socket or a connection of one of the devices */
+static int fd_in_use(int fd)
+{
+	dstate_device_t	*entry = selected, *dev = devices;
+	int	used = 0;
+
+	do {
+		dstate_select_device(dev);
+
+		if ((fd == sockfd) || (conn_find(fd) != NULL)) {
+			used = 1;
+			break;
+		}
+	} while (dev && ((dev = dev->next) != NULL));
+
+	dstate_select_device(entry);
+
+	return used;
+}
+
+/* follow changes of the extrafd passed by the caller */
+static void poll_extrafd(int extrafd)
+{
+	/* a driver that closed its extrafd (from an INSTCMD handler, say)
+	 * may have seen the number go to a new connection since */
+	if ((polled_extrafd != -1) && (polled_extrafd != extrafd) && (wakefd_find(polled_extrafd) < 0)
+		&& !fd_in_use(polled_extrafd)) {
+		poll_del(polled_extrafd);
+	}
+
+	/* added on each call: a driver that closes and reopens its fd may
+	 * get the same number back, which silently dropped it from the set */
+	if (extrafd != -1) {
+		poll_add(extrafd);
+	}
+
+	polled_extrafd = extrafd;
+}
+#endif	/* USE_EPOLL */
+
+/* add a descriptor to the array of the next poll() */
+static void pfds_add(int fd)
+{
+	if (pfds_used == pfds_size) {
+		pfds_size = pfds_size ? pfds_size * 2 : 64;
+		pfds = xrealloc(pfds, pfds_size * sizeof(*pfds));
+	}
+
+	pfds[pfds_used].fd = fd;
+	pfds[pfds_used].events = POLLIN;
+	pfds[pfds_used].revents = 0;
+	pfds_used++;
+}
+
+/* spread the results of poll() by fd number for fd_ready() */
+static void pfds_spread(int maxfd)
+{
+	int	i;
+
+	if (maxfd >= fd_revents_size) {
+		fd_revents_size = maxfd + 1;
+		fd_revents = xrealloc(fd_revents, fd_revents_size * sizeof(*fd_revents));
+	}
+
+	memset(fd_revents, 0, (maxfd + 1) * sizeof(*fd_revents));
+
+	for (i = 0; i < pfds_used; i++) {
+		fd_revents[pfds[i].fd] |= pfds[i].revents;
+	}
+}
+
+/* readable (or hung up) as of the last poll() */
+static int fd_ready(int fd)
+{
+	return (fd >= 0) && (fd < fd_revents_size) && (fd_revents[fd] != 0);
+}
+
 static void sock_disconnect(conn_t *conn)
 {
+	poll_del(conn->fd);
 	close(conn->fd);
 
 	pconf_finish(&conn->ctx);
+	dsframe_free(&conn->frame);
+	free(conn->vardef);
+	free(conn->tbuf);
 
 	if (conn->prev) {
 		conn->prev->next = conn->next;
@@ -165,87 +428,411 @@ static void sock_disconnect(conn_t *conn)
 	free(conn);
 }
 
-static void send_to_all(const char *fmt, ...)
+static unsigned int varid_hashfn(const char *var)
+{
+	unsigned int	h = 2166136261U;
+
+	while (*var) {
+		h ^= (unsigned char)*var++;
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+/* id of a variable for the binary protocol, assigned on first use;
+ * ids are never reused, so that upsd can keep them for the connection */
+static unsigned int dstate_varid(const char *var)
+{
+	unsigned int	i, slot, id;
+
+	if (varid_hash_size) {
+		for (slot = varid_hashfn(var) & (varid_hash_size - 1); varid_hash[slot];
+			slot = (slot + 1) & (varid_hash_size - 1)) {
+
+			if (!strcmp(varid_names[varid_hash[slot]], var)) {
+				return varid_hash[slot];
+			}
+		}
+	}
+
+	if (varid_count >= DSFRAME_MAXVARID) {
+		upslogx(LOG_ERR, "%s: too many variables, can't send %s", __func__, var);
+		return 0;
+	}
+
+	id = ++varid_count;
+
+	if (id >= varid_names_size) {
+		varid_names_size = varid_names_size ? varid_names_size * 2 : 256;
+		varid_names = xrealloc(varid_names, varid_names_size * sizeof(*varid_names));
+	}
+
+	varid_names[id] = xstrdup(var);
+
+	/* keep the table at most half full */
+	if (varid_count * 2 > varid_hash_size) {
+		varid_hash_size = varid_hash_size ? varid_hash_size * 2 : 512;
+		free(varid_hash);
+		varid_hash = xcalloc(varid_hash_size, sizeof(*varid_hash));
+
+		for (i = 1; i < id; i++) {
+			for (slot = varid_hashfn(varid_names[i]) & (varid_hash_size - 1); varid_hash[slot];
+				slot = (slot + 1) & (varid_hash_size - 1));
+			varid_hash[slot] = i;
+		}
+	}
+
+	for (slot = varid_hashfn(var) & (varid_hash_size - 1); varid_hash[slot];
+		slot = (slot + 1) & (varid_hash_size - 1));
+	varid_hash[slot] = id;
+
+	return id;
+}
+
+static void varid_free(void)
+{
+	unsigned int	i;
+
+	for (i = 1; i <= varid_count; i++) {
+		free(varid_names[i]);
+	}
+
+	free(varid_names);
+	free(varid_hash);
+
+	varid_names = NULL;
+	varid_hash = NULL;
+	varid_count = varid_names_size = varid_hash_size = 0;
+}
+
+static int conn_write(conn_t *conn, const void *buf, size_t len)
+{
+	ssize_t	ret;
+
+	ret = write(conn->fd, buf, len);
+
+	if ((ret < 0) || ((size_t)ret != len)) {
+		upsdebugx(1, "write %d bytes to socket %d failed", (int)len, conn->fd);
+		sock_disconnect(conn);
+		return 0;	/* failed */
+	}
+
+	return 1;	/* OK */
+}
+
+/* send the text lines or the frame queued on a connection */
+static int conn_flush(conn_t *conn)
+{
+	size_t	len;
+
+	if (!conn->binary) {
+		len = conn->tbuf_len;
+
+		if (!len) {
+			return 1;
+		}
+
+		upsdebugx(5, "%s: %d bytes to socket %d", __func__, (int)len, conn->fd);
+
+		conn->tbuf_len = 0;
+
+		return conn_write(conn, conn->tbuf, len);
+	}
+
+	len = dsframe_seal(&conn->frame);
+
+	if (!len) {
+		return 1;	/* nothing pending */
+	}
+
+	upsdebugx(5, "%s: %d byte frame to socket %d", __func__, (int)len, conn->fd);
+
+	dsframe_reset(&conn->frame);
+
+	return conn_write(conn, conn->frame.buf, len);
+}
+
+static void flush_all(void)
 {
-	int	ret;
-	char	buf[ST_SOCK_BUF_LEN];
-	va_list	ap;
 	conn_t	*conn, *cnext;
 
-	va_start(ap, fmt);
-#ifdef HAVE_PRAGMAS_FOR_GCC_DIAGNOSTIC_IGNORED_FORMAT_NONLITERAL
-#pragma GCC diagnostic push
-#endif
-#ifdef HAVE_PRAGMA_GCC_DIAGNOSTIC_IGNORED_FORMAT_NONLITERAL
-#pragma GCC diagnostic ignored "-Wformat-nonliteral"
-#endif
-#ifdef HAVE_PRAGMA_GCC_DIAGNOSTIC_IGNORED_FORMAT_SECURITY
-#pragma GCC diagnostic ignored "-Wformat-security"
-#endif
-	ret = vsnprintf(buf, sizeof(buf), fmt, ap);
-#ifdef HAVE_PRAGMAS_FOR_GCC_DIAGNOSTIC_IGNORED_FORMAT_NONLITERAL
-#pragma GCC diagnostic pop
-#endif
-	va_end(ap);
+	for (conn = connhead; conn; conn = cnext) {
+		cnext = conn->next;
+		conn_flush(conn);
+	}
+}
+
+/* flush_all() for each device */
+static void flush_devices(void)
+{
+	dstate_device_t	*entry = selected, *dev;
+
+	if (!devices) {
+		flush_all();
+		return;
+	}
+
+	for (dev = devices; dev; dev = dev->next) {
+		dstate_select_device(dev);
+		flush_all();
+	}
+
+	dstate_select_device(entry);
+}
+
+/* queue one update, as a line of text or as a record in the next frame;
+ * everything goes out at the latest when the driver is about to sleep */
+static int send_to_conn(conn_t *conn, int op, const char *var, size_t argc, const char **argv)
+{
+	size_t	i, len;
+	unsigned int	id = 0;
+
+	if (!conn->binary) {
+		char	buf[ST_SOCK_BUF_LEN];
+		/* values may contain spaces */
+		int	quote = (op == DSF_SETINFO) || (op == DSF_ADDENUM) || (op == DSF_DELENUM);
+
+		snprintf(buf, sizeof(buf), "%s", dsframe_opname(op));
+
+		if (var) {
+			snprintfcat(buf, sizeof(buf), " %s", var);
+		}
+
+		for (i = 0; i < argc; i++) {
+			if (quote) {
+				snprintfcat(buf, sizeof(buf), " \"%s\"", argv[i]);
+			} else {
+				snprintfcat(buf, sizeof(buf), " %s", argv[i]);
+			}
+		}
+
+		snprintfcat(buf, sizeof(buf), "\n");
+
+		upsdebugx(5, "%s: %.*s", __func__, (int)strlen(buf) - 1, buf);
+
+		len = strlen(buf);
+
+		if (conn->tbuf_len + len > conn->tbuf_size) {
+			size_t	size = conn->tbuf_size ? conn->tbuf_size : DSFRAME_FLUSH * 2;
+
+			while (conn->tbuf_len + len > size) {
+				size *= 2;
+			}
+
+			conn->tbuf = xrealloc(conn->tbuf, size);
+			conn->tbuf_size = size;
+		}
+
+		memcpy(conn->tbuf + conn->tbuf_len, buf, len);
+		conn->tbuf_len += len;
+
+		if (conn->tbuf_len >= DSFRAME_FLUSH) {
+			return conn_flush(conn);
+		}
+
+		return 1;
+	}
+
+	if (var) {
+		id = dstate_varid(var);
+
+		if (!id) {
+			return 1;	/* skip it, but keep the connection */
+		}
+
+		/* announce the name the first time it is used on this connection */
+		if ((id >= conn->vardef_size) || !conn->vardef[id]) {
+			const char	*name[1];
+
+			if (id >= conn->vardef_size) {
+				unsigned int	size = conn->vardef_size ? conn->vardef_size : 256;
+
+				while (size <= id) {
+					size *= 2;
+				}
+
+				conn->vardef = xrealloc(conn->vardef, size);
+				memset(conn->vardef + conn->vardef_size, 0, size - conn->vardef_size);
+				conn->vardef_size = size;
+			}
+
+			name[0] = var;
+			dsframe_add(&conn->frame, DSF_DEFVAR, id, 1, name);
+			conn->vardef[id] = 1;
+		}
+	}
+
+	if (!dsframe_add(&conn->frame, op, id, argc, argv)) {
+		upslogx(LOG_ERR, "%s: can't encode %s %s", __func__, dsframe_opname(op), var ? var : "");
+		return 1;
+	}
+
+	if (conn->frame.len >= DSFRAME_FLUSH) {
+		return conn_flush(conn);
+	}
+
+	return 1;
+}
 
-	if (ret < 1) {
-		upsdebugx(2, "%s: nothing to write", __func__);
+/* where a change that replaces the previous one of its kind is queued */
+static size_t *batch_find(int op, const char *var)
+{
+	int	key;
+	unsigned int	id;
+
+	switch (op)
+	{
+	case DSF_SETINFO:
+		key = 0;
+		break;
+	case DSF_SETFLAGS:
+		key = 1;
+		break;
+	case DSF_SETAUX:
+		key = 2;
+		break;
+	default:
+		return NULL;
+	}
+
+	id = dstate_varid(var);
+
+	if (!id) {
+		return NULL;
+	}
+
+	if (id >= batch_slot_size) {
+		unsigned int	size = varid_names_size;
+
+		batch_slot = xrealloc(batch_slot, size * BATCH_KEYS * sizeof(*batch_slot));
+		memset(batch_slot + batch_slot_size * BATCH_KEYS, 0,
+			(size - batch_slot_size) * BATCH_KEYS * sizeof(*batch_slot));
+		batch_slot_size = size;
+	}
+
+	return &batch_slot[id * BATCH_KEYS + key];
+}
+
+static void batch_set_args(batch_change_t *change, size_t argc, const char **argv)
+{
+	size_t	i;
+
+	for (i = 0; i < change->argc; i++) {
+		free(change->argv[i]);
+	}
+
+	for (i = 0; i < argc; i++) {
+		change->argv[i] = xstrdup(argv[i]);
+	}
+
+	change->argc = argc;
+}
+
+static void batch_add(int op, const char *var, size_t argc, const char **argv, const char *orig)
+{
+	size_t	*slot = var ? batch_find(op, var) : NULL;
+	batch_change_t	*change;
+
+	/* a new value replaces the queued one, keeping its place */
+	if (slot && *slot) {
+		batch_set_args(&batch[*slot - 1], argc, argv);
 		return;
 	}
 
-	upsdebugx(5, "%s: %.*s", __func__, ret-1, buf);
+	/* anything set again after a DELINFO has to follow it */
+	if ((op == DSF_DELINFO) && var) {
+		unsigned int	id = dstate_varid(var);
+
+		if (id && (id < batch_slot_size)) {
+			memset(&batch_slot[id * BATCH_KEYS], 0, BATCH_KEYS * sizeof(*batch_slot));
+		}
+	}
+
+	if (batch_len >= batch_size) {
+		batch_size = batch_size ? batch_size * 2 : 64;
+		batch = xrealloc(batch, batch_size * sizeof(*batch));
+	}
+
+	change = &batch[batch_len++];
+	memset(change, 0, sizeof(*change));
+
+	change->op = op;
+	change->var = var ? xstrdup(var) : NULL;
+	change->orig = orig ? xstrdup(orig) : NULL;
+	batch_set_args(change, argc, argv);
+
+	if (slot) {
+		*slot = batch_len;
+	}
+}
+
+static void send_to_all_argv(int op, const char *var, size_t argc, const char **argv)
+{
+	conn_t	*conn, *cnext;
+
+	if (batch_depth) {
+		batch_add(op, var, argc, argv, NULL);
+		return;
+	}
 
 	for (conn = connhead; conn; conn = cnext) {
 		cnext = conn->next;
+		send_to_conn(conn, op, var, argc, argv);
+	}
+}
 
-		ret = write(conn->fd, buf, strlen(buf));
+/* up to two arguments, NULL when not used */
+static void send_to_all(int op, const char *var, const char *arg1, const char *arg2)
+{
+	const char	*argv[2];
+	size_t	argc = 0;
 
-		if (ret != (int)strlen(buf)) {
-			upsdebugx(1, "write %d bytes to socket %d failed", (int)strlen(buf), conn->fd);
-			sock_disconnect(conn);
+	if (arg1) {
+		argv[argc++] = arg1;
+
+		if (arg2) {
+			argv[argc++] = arg2;
 		}
 	}
+
+	send_to_all_argv(op, var, argc, argv);
 }
 
-static int send_to_one(conn_t *conn, const char *fmt, ...)
+static int send_to_one(conn_t *conn, int op, const char *var, const char *arg1, const char *arg2)
 {
-	int	ret;
-	va_list	ap;
-	char	buf[ST_SOCK_BUF_LEN];
+	const char	*argv[2];
+	size_t	argc = 0;
 
-	va_start(ap, fmt);
-#ifdef HAVE_PRAGMAS_FOR_GCC_DIAGNOSTIC_IGNORED_FORMAT_NONLITERAL
-#pragma GCC diagnostic push
-#endif
-#ifdef HAVE_PRAGMA_GCC_DIAGNOSTIC_IGNORED_FORMAT_NONLITERAL
-#pragma GCC diagnostic ignored "-Wformat-nonliteral"
-#endif
-#ifdef HAVE_PRAGMA_GCC_DIAGNOSTIC_IGNORED_FORMAT_SECURITY
-#pragma GCC diagnostic ignored "-Wformat-security"
-#endif
-	ret = vsnprintf(buf, sizeof(buf), fmt, ap);
-#ifdef HAVE_PRAGMAS_FOR_GCC_DIAGNOSTIC_IGNORED_FORMAT_NONLITERAL
-#pragma GCC diagnostic pop
-#endif
-	va_end(ap);
+	if (arg1) {
+		argv[argc++] = arg1;
 
-	upsdebugx(2, "%s: sending %.*s", __func__, (int)strcspn(buf, "\n"), buf);
-	if (ret < 1) {
-		upsdebugx(2, "%s: nothing to write", __func__);
-		return 1;
+		if (arg2) {
+			argv[argc++] = arg2;
+		}
 	}
 
-	upsdebugx(5, "%s: %.*s", __func__, ret-1, buf);
+	return send_to_conn(conn, op, var, argc, argv);
+}
 
-	ret = write(conn->fd, buf, strlen(buf));
+/* names of the flags, for SETFLAGS */
+static size_t flags_argv(int flags, const char **argv)
+{
+	size_t	argc = 0;
 
-	if (ret != (int)strlen(buf)) {
-		upsdebugx(1, "write %d bytes to socket %d failed", (int)strlen(buf), conn->fd);
-		sock_disconnect(conn);
-		return 0;	/* failed */
+	if (flags & ST_FLAG_RW) {
+		argv[argc++] = "RW";
+	}
+
+	if (flags & ST_FLAG_STRING) {
+		argv[argc++] = "STRING";
+	}
+
+	if (flags & ST_FLAG_NUMBER) {
+		argv[argc++] = "NUMBER";
 	}
 
-	return 1;	/* OK */
+	return argc;
 }
 
 static void sock_connect(int sock)
@@ -285,10 +872,16 @@ static void sock_connect(int sock)
 		}
 	}
 
+	if (!poll_add(fd)) {
+		close(fd);
+		return;
+	}
+
 	conn = xcalloc(1, sizeof(*conn));
 	conn->fd = fd;
 
 	pconf_init(&conn->ctx, NULL);
+	dsframe_init(&conn->frame);
 
 	if (connhead) {
 		conn->next = connhead;
@@ -300,11 +893,29 @@ static void sock_connect(int sock)
 	upsdebugx(3, "new connection on fd %d", fd);
 }
 
+/* undo pconf_encode(): the tree keeps enums escaped for the text
+ * protocol, frames carry values as they are */
+static void value_decode(const char *src, char *dest, size_t destsize)
+{
+	size_t	len = 0;
+
+	for (; *src && (len < destsize - 1); src++) {
+		if ((*src == '\\') && src[1]) {
+			src++;
+		}
+
+		dest[len++] = *src;
+	}
+
+	dest[len] = '\0';
+}
+
 static int st_tree_dump_conn(st_tree_t *node, conn_t *conn)
 {
 	int	ret;
 	enum_t	*etmp;
 	range_t	*rtmp;
+	char	value[ST_MAX_VALUE_LEN];
 
 	if (!node) {
 		return 1;	/* not an error */
@@ -318,49 +929,52 @@ static int st_tree_dump_conn(st_tree_t *node, conn_t *conn)
 		}
 	}
 
-	if (!send_to_one(conn, "SETINFO %s \"%s\"\n", node->var, node->val)) {
+	/* frames carry values as they are, as the live updates do; in
+	 * text they go between quotes, escaped */
+	if (!send_to_one(conn, DSF_SETINFO, node->var, conn->binary ? node->raw : node->val, NULL)) {
 		return 0;	/* write failed, bail out */
 	}
 
 	/* send any enums */
 	for (etmp = node->enum_list; etmp; etmp = etmp->next) {
-		if (!send_to_one(conn, "ADDENUM %s \"%s\"\n", node->var, etmp->val)) {
+		if (conn->binary) {
+			value_decode(etmp->val, value, sizeof(value));
+		}
+
+		if (!send_to_one(conn, DSF_ADDENUM, node->var, conn->binary ? value : etmp->val, NULL)) {
 			return 0;
 		}
 	}
 
 	/* send any ranges */
 	for (rtmp = node->range_list; rtmp; rtmp = rtmp->next) {
-		if (!send_to_one(conn, "ADDRANGE %s %i %i\n", node->var, rtmp->min, rtmp->max)) {
+		char	min[SMALLBUF], max[SMALLBUF];
+
+		snprintf(min, sizeof(min), "%i", rtmp->min);
+		snprintf(max, sizeof(max), "%i", rtmp->max);
+
+		if (!send_to_one(conn, DSF_ADDRANGE, node->var, min, max)) {
 			return 0;
 		}
 	}
 
 	/* provide any auxiliary data */
 	if (node->aux) {
-		if (!send_to_one(conn, "SETAUX %s %ld\n", node->var, node->aux)) {
+		char	aux[SMALLBUF];
+
+		snprintf(aux, sizeof(aux), "%ld", node->aux);
+
+		if (!send_to_one(conn, DSF_SETAUX, node->var, aux, NULL)) {
 			return 0;
 		}
 	}
 
 	/* finally report any flags */
 	if (node->flags) {
-		char	flist[SMALLBUF];
-
-		/* build the list */
-		snprintf(flist, sizeof(flist), "%s", node->var);
-
-		if (node->flags & ST_FLAG_RW) {
-			snprintfcat(flist, sizeof(flist), " RW");
-		}
-		if (node->flags & ST_FLAG_STRING) {
-			snprintfcat(flist, sizeof(flist), " STRING");
-		}
-		if (node->flags & ST_FLAG_NUMBER) {
-			snprintfcat(flist, sizeof(flist), " NUMBER");
-		}
+		const char	*flist[DSFRAME_MAXARGS];
+		size_t	fcount = flags_argv(node->flags, flist);
 
-		if (!send_to_one(conn, "SETFLAGS %s\n", flist)) {
+		if (!send_to_conn(conn, DSF_SETFLAGS, node->var, fcount, flist)) {
 			return 0;
 		}
 	}
@@ -377,7 +991,7 @@ static int cmd_dump_conn(conn_t *conn)
 	cmdlist_t	*cmd;
 
 	for (cmd = cmdhead; cmd; cmd = cmd->next) {
-		if (!send_to_one(conn, "ADDCMD %s\n", cmd->name)) {
+		if (!send_to_one(conn, DSF_ADDCMD, NULL, cmd->name, NULL)) {
 			return 0;
 		}
 	}
@@ -388,7 +1002,10 @@ static int cmd_dump_conn(conn_t *conn)
 
 static void send_tracking(conn_t *conn, const char *id, int value)
 {
-	send_to_one(conn, "TRACKING %s %i\n", id, value);
+	char	status[SMALLBUF];
+
+	snprintf(status, sizeof(status), "%i", value);
+	send_to_one(conn, DSF_TRACKING, NULL, id, status);
 }
 
 static int sock_arg(conn_t *conn, size_t numarg, char **arg)
@@ -399,8 +1016,22 @@ static int sock_arg(conn_t *conn, size_t numarg, char **arg)
 
 	if (!strcasecmp(arg[0], "DUMPALL")) {
 
+		/* DUMPALL BINARY: the server understands frames (see dsframe.h),
+		 * confirm in text and send everything as frames from now on */
+		if ((numarg > 1) && !strcasecmp(arg[1], "BINARY") && !conn->binary) {
+			const char	*ack = "FRAMING BINARY\n";
+
+			/* anything still queued goes out as text */
+			if (!conn_flush(conn) || !conn_write(conn, ack, strlen(ack))) {
+				return 1;
+			}
+
+			upsdebugx(2, "%s: binary protocol on socket %d", __func__, conn->fd);
+			conn->binary = 1;
+		}
+
 		/* first thing: the staleness flag */
-		if ((stale == 1) && !send_to_one(conn, "DATASTALE\n")) {
+		if ((stale == 1) && !send_to_one(conn, DSF_DATASTALE, NULL, NULL, NULL)) {
 			return 1;
 		}
 
@@ -412,16 +1043,16 @@ static int sock_arg(conn_t *conn, size_t numarg, char **arg)
 			return 1;
 		}
 
-		if ((stale == 0) && !send_to_one(conn, "DATAOK\n")) {
+		if ((stale == 0) && !send_to_one(conn, DSF_DATAOK, NULL, NULL, NULL)) {
 			return 1;
 		}
 
-		send_to_one(conn, "DUMPDONE\n");
+		send_to_one(conn, DSF_DUMPDONE, NULL, NULL, NULL);
 		return 1;
 	}
 
 	if (!strcasecmp(arg[0], "PING")) {
-		send_to_one(conn, "PONG\n");
+		send_to_one(conn, DSF_PONG, NULL, NULL, NULL);
 		return 1;
 	}
 
@@ -511,7 +1142,8 @@ static int sock_arg(conn_t *conn, size_t numarg, char **arg)
 
 static void sock_read(conn_t *conn)
 {
-	int	i, ret;
+	int	ret;
+	size_t	i, used;
 	char	buf[SMALLBUF];
 
 	ret = read(conn->fd, buf, sizeof(buf));
@@ -529,9 +1161,9 @@ static void sock_read(conn_t *conn)
 		}
 	}
 
-	for (i = 0; i < ret; i++) {
+	for (i = 0; i < (size_t)ret; i += used) {
 
-		switch(pconf_char(&conn->ctx, buf[i]))
+		switch(pconf_buf(&conn->ctx, buf + i, ret - i, &used))
 		{
 		case 0: /* nothing to parse yet */
 			continue;
@@ -555,7 +1187,8 @@ static void sock_read(conn_t *conn)
 	}
 }
 
-static void sock_close(void)
+/* close the socket and connections of the selected device */
+static void sock_close_device(void)
 {
 	conn_t	*conn, *cnext;
 
@@ -577,14 +1210,120 @@ static void sock_close(void)
 
 	connhead = NULL;
 	/* conntail = NULL; */
+
+	free(batch);
+	free(batch_slot);
+	batch = NULL;
+	batch_slot = NULL;
+	batch_len = batch_size = 0;
+	batch_slot_size = 0;
 }
 
-/* interface */
+static void sock_close(void)
+{
+#ifdef USE_EPOLL
+	if (epfd >= 0) {
+		close(epfd);
+		epfd = -1;
+	}
+#endif
+	free(wakefds);
+	wakefds = NULL;
+	wakefds_used = wakefds_size = 0;
+	polled_extrafd = -1;
+
+	free(pfds);
+	pfds = NULL;
+	pfds_used = pfds_size = 0;
+	free(fd_revents);
+	fd_revents = NULL;
+	fd_revents_size = 0;
+
+	varid_free();
+}
 
-void dstate_init(const char *prog, const char *devname)
+/* open the socket of the selected device */
+static void sock_listen(const char *prog, const char *devname)
 {
 	char	sockname[SMALLBUF];
 
+	if (devname) {
+		snprintf(sockname, sizeof(sockname), "%s/%s-%s", dflt_statepath(), prog, devname);
+	} else {
+		snprintf(sockname, sizeof(sockname), "%s/%s", dflt_statepath(), prog);
+	}
+
+	sockfd = sock_open(sockname);
+
+	upsdebugx(2, "dstate_init: sock %s open on fd %d", sockname, sockfd);
+}
+
+static void device_save(dstate_device_t *dev)
+{
+	dev->sockfd = sockfd;
+	dev->stale = stale;
+	dev->alarm_active = alarm_active;
+	dev->ignorelb = ignorelb;
+	dev->sockfn = sockfn;
+	dev->dtree_root = dtree_root;
+	dev->connhead = connhead;
+	dev->cmdhead = cmdhead;
+	dev->batch = batch;
+	dev->batch_len = batch_len;
+	dev->batch_size = batch_size;
+	dev->batch_depth = batch_depth;
+	dev->batch_slot = batch_slot;
+	dev->batch_slot_size = batch_slot_size;
+}
+
+static void device_load(const dstate_device_t *dev)
+{
+	sockfd = dev->sockfd;
+	stale = dev->stale;
+	alarm_active = dev->alarm_active;
+	ignorelb = dev->ignorelb;
+	sockfn = dev->sockfn;
+	dtree_root = dev->dtree_root;
+	connhead = dev->connhead;
+	cmdhead = dev->cmdhead;
+	batch = dev->batch;
+	batch_len = dev->batch_len;
+	batch_size = dev->batch_size;
+	batch_depth = dev->batch_depth;
+	batch_slot = dev->batch_slot;
+	batch_slot_size = dev->batch_slot_size;
+}
+
+/* the device of dstate_init() becomes the first of the list */
+static void devices_begin(void)
+{
+	conn_t	*conn;
+
+	if (devices) {
+		return;
+	}
+
+	devices = devices_tail = selected = xcalloc(1, sizeof(*devices));
+
+#ifdef USE_EPOLL
+	if (epfd >= 0) {
+		if (sockfd != -1) {
+			fd_owner_set(sockfd, selected);
+		}
+
+		for (conn = connhead; conn; conn = conn->next) {
+			fd_owner_set(conn->fd, selected);
+		}
+	}
+#else
+	NUT_UNUSED_VARIABLE(conn);
+#endif
+}
+
+/* interface */
+
+void dstate_init(const char *prog, const char *devname)
+{
 	/* do this here for now */
 #if (defined HAVE_PRAGMA_GCC_DIAGNOSTIC_PUSH_POP) && (defined HAVE_PRAGMA_GCC_DIAGNOSTIC_IGNORED_STRICT_PROTOTYPES)
 # pragma GCC diagnostic push
@@ -595,47 +1334,163 @@ void dstate_init(const char *prog, const char *devname)
 # pragma GCC diagnostic pop
 #endif
 
-	if (devname) {
-		snprintf(sockname, sizeof(sockname), "%s/%s-%s", dflt_statepath(), prog, devname);
+	sock_listen(prog, devname);
+
+#ifdef USE_EPOLL
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+
+	if (epfd < 0) {
+		upslog_with_errno(LOG_WARNING, "epoll_create1 failed, falling back to poll()");
 	} else {
-		snprintf(sockname, sizeof(sockname), "%s/%s", dflt_statepath(), prog);
+		int	i;
+
+		poll_add(sockfd);
+
+		/* descriptors registered before the socket was opened */
+		for (i = 0; i < wakefds_used; i++) {
+			poll_add(wakefds[i]);
+		}
+
+		upsdebugx(2, "dstate_init: using epoll");
 	}
+#endif
 
-	sockfd = sock_open(sockname);
+	listen_prog = xstrdup(prog);
 
-	upsdebugx(2, "dstate_init: sock %s open on fd %d", sockname, sockfd);
+	/* devices added before */
+	if (devices) {
+		dstate_device_t	*entry = selected, *dev;
+
+		for (dev = devices->next; dev; dev = dev->next) {
+			dstate_select_device(dev);
+			sock_listen(listen_prog, dev->devname);
+			poll_add(sockfd);
+		}
+
+		dstate_select_device(entry);
+	}
 }
 
-/* returns 1 if timeout expired or data is available on UPS fd, 0 otherwise */
-int dstate_poll_fds(struct timeval timeout, int extrafd)
+/* Serve one more device, with its own socket (<prog>-<devname>) and
+ * state. The dstate_* and status_* functions apply to the device
+ * selected with dstate_select_device(), which is the first one until
+ * then; dstate_poll_fds() serves them all. The socket is opened at once,
+ * or by dstate_init() if it was not called yet. */
+dstate_device_t *dstate_add_device(const char *prog, const char *devname)
 {
-	int	ret, maxfd, overrun = 0;
-	fd_set	rfds;
-	struct timeval	now;
-	conn_t	*conn, *cnext;
+	dstate_device_t	*entry, *dev;
 
-	FD_ZERO(&rfds);
-	FD_SET(sockfd, &rfds);
+	devices_begin();
+	entry = selected;
 
-	maxfd = sockfd;
+	dev = xcalloc(1, sizeof(*dev));
+	dev->sockfd = -1;
+	dev->stale = 1;
+	dev->devname = xstrdup(devname);
 
-	if (extrafd != -1) {
-		FD_SET(extrafd, &rfds);
+	devices_tail->next = dev;
+	devices_tail = dev;
 
-		if (extrafd > maxfd) {
-			maxfd = extrafd;
-		}
+	if (listen_prog) {
+		dstate_select_device(dev);
+		sock_listen(prog, devname);
+		poll_add(sockfd);
+		dstate_select_device(entry);
 	}
 
-	for (conn = connhead; conn; conn = conn->next) {
-		FD_SET(conn->fd, &rfds);
+	return dev;
+}
 
-		if (conn->fd > maxfd) {
-			maxfd = conn->fd;
-		}
+/* the selected device, see dstate_add_device() */
+dstate_device_t *dstate_get_device(void)
+{
+	devices_begin();
+
+	return selected;
+}
+
+/* the device after dev, or the first one if dev is NULL: NULL after the
+ * last one, and for drivers that did not add any */
+dstate_device_t *dstate_next_device(dstate_device_t *dev)
+{
+	return dev ? dev->next : devices;
+}
+
+void dstate_select_device(dstate_device_t *dev)
+{
+	if (!dev || (dev == selected)) {
+		return;
+	}
+
+	device_save(selected);
+	device_load(dev);
+	selected = dev;
+}
+
+/* Have dstate_poll_fds() return as soon as fd is readable, like it does
+ * for the extrafd it is passed. The fd must be unregistered before it is
+ * closed. Returns 1 on success, 0 on failure. */
+int dstate_register_fd(int fd)
+{
+	if (fd < 0) {
+		return 0;
+	}
+
+	if (wakefd_find(fd) >= 0) {
+		return 1;
+	}
+
+	if (!poll_add(fd)) {
+		return 0;
+	}
+
+	if (wakefds_used >= wakefds_size) {
+		wakefds_size = wakefds_size ? wakefds_size * 2 : 4;
+		wakefds = xrealloc(wakefds, wakefds_size * sizeof(*wakefds));
+	}
+
+	wakefds[wakefds_used++] = fd;
+
+	upsdebugx(3, "%s: fd %d", __func__, fd);
+
+	return 1;
+}
+
+void dstate_unregister_fd(int fd)
+{
+	int	i = wakefd_find(fd);
+
+	if (i < 0) {
+		return;
 	}
 
-	gettimeofday(&now, NULL);
+	wakefds[i] = wakefds[--wakefds_used];
+
+	if (fd != polled_extrafd) {
+		poll_del(fd);
+	}
+
+	upsdebugx(3, "%s: fd %d", __func__, fd);
+}
+
+/* Wait until the deadline in timeout, which is an absolute time as
+ * returned by get_monotonic_time(), while serving the driver socket.
+ * Returns 1 if the deadline passed or data is available on extrafd or on
+ * a descriptor registered with dstate_register_fd(), 0 otherwise. */
+int dstate_poll_fds(struct timeval timeout, int extrafd)
+{
+	int	i, ms, maxfd = -1, ret, overrun = 0, wake = 0, naccept = 0;
+	struct timeval	now;
+	conn_t	*conn, *cnext;
+	dstate_device_t	*entry = selected, *dev, *accepting[DS_POLL_EVENTS];
+#ifdef USE_EPOLL
+	struct epoll_event	events[DS_POLL_EVENTS];
+#endif
+
+	/* updates batched since the last call go out before sleeping */
+	flush_devices();
+
+	get_monotonic_time(&now);
 
 	/* number of microseconds should always be positive */
 	if (timeout.tv_usec < now.tv_usec) {
@@ -652,7 +1507,64 @@ int dstate_poll_fds(struct timeval timeout, int extrafd)
 		timeout.tv_usec -= now.tv_usec;
 	}
 
-	ret = select(maxfd + 1, &rfds, NULL, NULL, &timeout);
+	/* rounded up, so that the deadline has passed on wakeup */
+	if (timeout.tv_sec > INT_MAX / 1000 - 1) {
+		ms = (INT_MAX / 1000 - 1) * 1000;
+	} else {
+		ms = (int)timeout.tv_sec * 1000 + (int)(timeout.tv_usec + 999) / 1000;
+	}
+
+#ifdef USE_EPOLL
+	if (epfd >= 0) {
+		poll_extrafd(extrafd);
+
+		ret = epoll_wait(epfd, events, DS_POLL_EVENTS, ms);
+	} else
+#endif
+	{
+		pfds_used = 0;
+
+		/* each device in turn, if there are several */
+		dev = devices;
+
+		do {
+			dstate_select_device(dev);
+
+			pfds_add(sockfd);
+
+			if (sockfd > maxfd) {
+				maxfd = sockfd;
+			}
+
+			for (conn = connhead; conn; conn = conn->next) {
+				pfds_add(conn->fd);
+
+				if (conn->fd > maxfd) {
+					maxfd = conn->fd;
+				}
+			}
+		} while (dev && ((dev = dev->next) != NULL));
+
+		dstate_select_device(entry);
+
+		if (extrafd != -1) {
+			pfds_add(extrafd);
+
+			if (extrafd > maxfd) {
+				maxfd = extrafd;
+			}
+		}
+
+		for (i = 0; i < wakefds_used; i++) {
+			pfds_add(wakefds[i]);
+
+			if (wakefds[i] > maxfd) {
+				maxfd = wakefds[i];
+			}
+		}
+
+		ret = poll(pfds, pfds_used, ms);
+	}
 
 	if (ret == 0) {
 		return 1;	/* timer expired */
@@ -667,36 +1579,96 @@ int dstate_poll_fds(struct timeval timeout, int extrafd)
 			break;
 
 		default:
-			upslog_with_errno(LOG_ERR, "select unix sockets failed");
+			upslog_with_errno(LOG_ERR, "poll unix sockets failed");
 		}
 
 		return overrun;
 	}
 
-	if (FD_ISSET(sockfd, &rfds)) {
-		sock_connect(sockfd);
-	}
+#ifdef USE_EPOLL
+	if (epfd >= 0) {
+		for (i = 0; i < ret; i++) {
+			int	fd = events[i].data.fd;
 
-	for (conn = connhead; conn; conn = cnext) {
-		cnext = conn->next;
+			/* the state of the device it belongs to */
+			if (devices && (fd < fd_owner_size)) {
+				dstate_select_device(fd_owner[fd]);
+			}
+
+			if (fd == sockfd) {
+				accepting[naccept++] = selected;
+			} else if ((fd == extrafd) || (wakefd_find(fd) >= 0)) {
+				wake = 1;
+			} else if ((conn = conn_find(fd)) != NULL) {
+				/* looked up each time: reading may drop connections */
+				sock_read(conn);
+
+				if (devices) {
+					flush_all();
+				}
+			}
+		}
+	} else
+#endif
+	{
+		pfds_spread(maxfd);
+
+		dev = devices;
+
+		do {
+			dstate_select_device(dev);
+
+			if (fd_ready(sockfd)) {
+				accepting[naccept++] = selected;
+			}
+
+			for (conn = connhead; conn; conn = cnext) {
+				cnext = conn->next;
+
+				if (fd_ready(conn->fd)) {
+					sock_read(conn);
+				}
+			}
+
+			if (devices) {
+				flush_all();
+			}
 
-		if (FD_ISSET(conn->fd, &rfds)) {
-			sock_read(conn);
+			/* a full list: the next ones wait for the next call */
+		} while (dev && (naccept < DS_POLL_EVENTS) && ((dev = dev->next) != NULL));
+
+		if ((extrafd != -1) && fd_ready(extrafd)) {
+			wake = 1;
+		}
+
+		for (i = 0; i < wakefds_used; i++) {
+			if (fd_ready(wakefds[i])) {
+				wake = 1;
+			}
 		}
 	}
 
-	/* tell the caller if that fd woke up */
-	if ((extrafd != -1) && (FD_ISSET(extrafd, &rfds))) {
-		return 1;
+	/* new connections last, so that an fd number released above and
+	 * reused by accept() does not see an event meant for the old one */
+	for (i = 0; i < naccept; i++) {
+		dstate_select_device(accepting[i]);
+		sock_connect(sockfd);
 	}
 
-	return overrun;
+	/* answers to the commands just read */
+	flush_all();
+
+	dstate_select_device(entry);
+
+	/* tell the caller if one of its fds woke up */
+	return wake ? 1 : overrun;
 }
 
 int dstate_setinfo(const char *var, const char *fmt, ...)
 {
 	int	ret;
-	char	value[ST_MAX_VALUE_LEN];
+	char	value[ST_MAX_VALUE_LEN], orig[ST_MAX_VALUE_LEN];
+	const char	*prev = NULL;
 	va_list	ap;
 
 	va_start(ap, fmt);
@@ -715,10 +1687,27 @@ int dstate_setinfo(const char *var, const char *fmt, ...)
 #endif
 	va_end(ap);
 
+	/* in a batch, remember what the listeners know, to only send the net change */
+	if (batch_depth) {
+		size_t	*slot = batch_find(DSF_SETINFO, var);
+
+		if (slot && !*slot && ((prev = state_getinfo(dtree_root, var)) != NULL)) {
+			snprintf(orig, sizeof(orig), "%s", prev);
+			prev = orig;
+		}
+	}
+
 	ret = state_setinfo(&dtree_root, var, value);
 
 	if (ret == 1) {
-		send_to_all("SETINFO %s \"%s\"\n", var, value);
+		if (batch_depth) {
+			const char	*arg[1];
+
+			arg[0] = value;
+			batch_add(DSF_SETINFO, var, 1, arg, prev);
+		} else {
+			send_to_all(DSF_SETINFO, var, value, NULL);
+		}
 	}
 
 	return ret;
@@ -749,7 +1738,7 @@ int dstate_addenum(const char *var, const char *fmt, ...)
 	ret = state_addenum(dtree_root, var, value);
 
 	if (ret == 1) {
-		send_to_all("ADDENUM %s \"%s\"\n", var, value);
+		send_to_all(DSF_ADDENUM, var, value, NULL);
 	}
 
 	return ret;
@@ -762,7 +1751,11 @@ int dstate_addrange(const char *var, const int min, const int max)
 	ret = state_addrange(dtree_root, var, min, max);
 
 	if (ret == 1) {
-		send_to_all("ADDRANGE %s %i %i\n", var, min, max);
+		char	smin[SMALLBUF], smax[SMALLBUF];
+
+		snprintf(smin, sizeof(smin), "%i", min);
+		snprintf(smax, sizeof(smax), "%i", max);
+		send_to_all(DSF_ADDRANGE, var, smin, smax);
 		/* Also add the "NUMBER" flag for ranges */
 		dstate_addflags(var, ST_FLAG_NUMBER);
 	}
@@ -773,7 +1766,7 @@ int dstate_addrange(const char *var, const int min, const int max)
 void dstate_setflags(const char *var, int flags)
 {
 	st_tree_t	*sttmp;
-	char	flist[SMALLBUF];
+	const char	*flist[DSFRAME_MAXARGS];
 
 	/* find the dtree node for var */
 	sttmp = state_tree_find(dtree_root, var);
@@ -794,23 +1787,8 @@ void dstate_setflags(const char *var, int flags)
 
 	sttmp->flags = flags;
 
-	/* build the list */
-	snprintf(flist, sizeof(flist), "%s", var);
-
-	if (flags & ST_FLAG_RW) {
-		snprintfcat(flist, sizeof(flist), " RW");
-	}
-
-	if (flags & ST_FLAG_STRING) {
-		snprintfcat(flist, sizeof(flist), " STRING");
-	}
-
-	if (flags & ST_FLAG_NUMBER) {
-		snprintfcat(flist, sizeof(flist), " NUMBER");
-	}
-
 	/* update listeners */
-	send_to_all("SETFLAGS %s\n", flist);
+	send_to_all_argv(DSF_SETFLAGS, var, flags_argv(flags, flist), flist);
 }
 
 void dstate_addflags(const char *var, const int addflags)
@@ -852,6 +1830,7 @@ void dstate_delflags(const char *var, const int delflags)
 void dstate_setaux(const char *var, long aux)
 {
 	st_tree_t	*sttmp;
+	char	saux[SMALLBUF];
 
 	/* find the dtree node for var */
 	sttmp = state_tree_find(dtree_root, var);
@@ -868,7 +1847,8 @@ void dstate_setaux(const char *var, long aux)
 	sttmp->aux = aux;
 
 	/* update listeners */
-	send_to_all("SETAUX %s %ld\n", var, aux);
+	snprintf(saux, sizeof(saux), "%ld", aux);
+	send_to_all(DSF_SETAUX, var, saux, NULL);
 }
 
 const char *dstate_getinfo(const char *var)
@@ -884,7 +1864,7 @@ void dstate_addcmd(const char *cmdname)
 
 	/* update listeners */
 	if (ret == 1) {
-		send_to_all("ADDCMD %s\n", cmdname);
+		send_to_all(DSF_ADDCMD, NULL, cmdname, NULL);
 	}
 }
 
@@ -896,7 +1876,7 @@ int dstate_delinfo(const char *var)
 
 	/* update listeners */
 	if (ret == 1) {
-		send_to_all("DELINFO %s\n", var);
+		send_to_all(DSF_DELINFO, var, NULL, NULL);
 	}
 
 	return ret;
@@ -910,7 +1890,7 @@ int dstate_delenum(const char *var, const char *val)
 
 	/* update listeners */
 	if (ret == 1) {
-		send_to_all("DELENUM %s \"%s\"\n", var, val);
+		send_to_all(DSF_DELENUM, var, val, NULL);
 	}
 
 	return ret;
@@ -924,7 +1904,11 @@ int dstate_delrange(const char *var, const int min, const int max)
 
 	/* update listeners */
 	if (ret == 1) {
-		send_to_all("DELRANGE %s %i %i\n", var, min, max);
+		char	smin[SMALLBUF], smax[SMALLBUF];
+
+		snprintf(smin, sizeof(smin), "%i", min);
+		snprintf(smax, sizeof(smax), "%i", max);
+		send_to_all(DSF_DELRANGE, var, smin, smax);
 	}
 
 	return ret;
@@ -938,21 +1922,95 @@ int dstate_delcmd(const char *cmd)
 
 	/* update listeners */
 	if (ret == 1) {
-		send_to_all("DELCMD %s\n", cmd);
+		send_to_all(DSF_DELCMD, NULL, cmd, NULL);
 	}
 
 	return ret;
 }
 
+/* from here on, changes are only queued; a change replaces any queued
+ * one of the same kind for the variable (the last value wins) */
+void dstate_batch_begin(void)
+{
+	batch_depth++;
+}
+
+/* send the net changes queued since dstate_batch_begin() at once */
+void dstate_batch_commit(void)
+{
+	size_t	i, j, sent = 0;
+	conn_t	*conn, *cnext;
+
+	if ((batch_depth < 1) || (--batch_depth > 0)) {
+		return;
+	}
+
+	for (i = 0; i < batch_len; i++) {
+		batch_change_t	*change = &batch[i];
+
+		/* changed, then changed back */
+		if ((change->op != DSF_SETINFO) || !change->orig || (change->argc != 1) ||
+			strcmp(change->orig, change->argv[0])) {
+
+			for (conn = connhead; conn; conn = cnext) {
+				cnext = conn->next;
+				send_to_conn(conn, change->op, change->var, change->argc,
+					(const char **)change->argv);
+			}
+
+			sent++;
+		}
+
+		for (j = 0; j < change->argc; j++) {
+			free(change->argv[j]);
+		}
+
+		free(change->var);
+		free(change->orig);
+	}
+
+	if (batch_len) {
+		upsdebugx(3, "%s: %d changes queued, %d sent", __func__, (int)batch_len, (int)sent);
+		memset(batch_slot, 0, batch_slot_size * BATCH_KEYS * sizeof(*batch_slot));
+	}
+
+	batch_len = 0;
+
+	flush_all();
+}
+
 void dstate_free(void)
 {
-	state_infofree(dtree_root);
-	dtree_root = NULL;
+	dstate_device_t	*dev = devices, *dnext;
 
-	state_cmdfree(cmdhead);
-	cmdhead = NULL;
+	do {
+		dstate_select_device(dev);
+
+		state_infofree(dtree_root);
+		dtree_root = NULL;
+
+		state_cmdfree(cmdhead);
+		cmdhead = NULL;
+
+		sock_close_device();
+	} while (dev && ((dev = dev->next) != NULL));
 
 	sock_close();
+
+	for (dev = devices; dev; dev = dnext) {
+		dnext = dev->next;
+		free(dev->devname);
+		free(dev);
+	}
+
+	devices = devices_tail = selected = NULL;
+
+	free(listen_prog);
+	listen_prog = NULL;
+
+	free(fd_owner);
+	fd_owner = NULL;
+	fd_owner_size = 0;
 }
 
 const st_tree_t *dstate_getroot(void)
@@ -969,7 +2027,7 @@ void dstate_dataok(void)
 {
 	if (stale == 1) {
 		stale = 0;
-		send_to_all("DATAOK\n");
+		send_to_all(DSF_DATAOK, NULL, NULL, NULL);
 	}
 }
 
@@ -977,7 +2035,7 @@ void dstate_datastale(void)
 {
 	if (stale == 0) {
 		stale = 1;
-		send_to_all("DATASTALE\n");
+		send_to_all(DSF_DATASTALE, NULL, NULL, NULL);
 	}
 }
 
@@ -28,6 +28,7 @@
 
 #include "parseconf.h"
 #include "upshandler.h"
+#include "dsframe.h"
 
 #define DS_LISTEN_BACKLOG 16
 #define DS_MAX_READ 256		/* don't read forever from upsd */
@@ -40,6 +41,13 @@
 typedef struct conn_s {
 	int     fd;
 	PCONF_CTX_t	ctx;
+	int	binary;			/* framed protocol negotiated */
+	dsframe_t	frame;		/* batched updates, when binary */
+	char	*tbuf;			/* batched updates, when text */
+	size_t	tbuf_len;
+	size_t	tbuf_size;
+	unsigned char	*vardef;	/* variable ids announced so far */
+	unsigned int	vardef_size;
 	struct conn_s	*prev;
 	struct conn_s	*next;
 } conn_t;
@@ -52,6 +60,17 @@ typedef struct conn_s {
 
 void dstate_init(const char *prog, const char *devname);
 int dstate_poll_fds(struct timeval timeout, int extrafd);
+
+/* several devices served by one driver, see dstate_add_device() */
+typedef struct dstate_device_s	dstate_device_t;
+
+dstate_device_t *dstate_add_device(const char *prog, const char *devname);
+dstate_device_t *dstate_get_device(void);
+dstate_device_t *dstate_next_device(dstate_device_t *dev);
+void dstate_select_device(dstate_device_t *dev);
+
+int dstate_register_fd(int fd);
+void dstate_unregister_fd(int fd);
 int dstate_setinfo(const char *var, const char *fmt, ...)
 	__attribute__ ((__format__ (__printf__, 2, 3)));
 int dstate_addenum(const char *var, const char *fmt, ...)
@@ -71,6 +90,10 @@ void dstate_free(void);
 const st_tree_t *dstate_getroot(void);
 const cmdlist_t *dstate_getcmdlist(void);
 
+/* bracket the updates of one poll, so that they are sent together */
+void dstate_batch_begin(void);
+void dstate_batch_commit(void);
+
 void dstate_dataok(void);
 void dstate_datastale(void);
 
@@ -26,7 +26,6 @@
  *   * variable/value enforcement using cmdvartab for testing
  *     the variable existance, and possible values
  *   * allow variable creation on the fly (using upsrw)
- *   * poll the "port" file for change
  */
 
 #include <netdb.h>
@@ -40,7 +39,7 @@
 #include "dummy-ups.h"
 
 #define DRIVER_NAME	"Device simulation and repeater driver"
-#define DRIVER_VERSION	"0.14"
+#define DRIVER_VERSION	"0.16"
 
 /* driver description structure */
 upsdrv_info_t upsdrv_info =
@@ -59,15 +58,69 @@ upsdrv_info_t upsdrv_info =
 
 static int mode = MODE_NONE;
 
-/* parseconf context, for dummy mode using a file */
-static PCONF_CTX_t	*ctx = NULL;
-static time_t		next_update = -1;
+/* dummy mode: the definition file, read once into a list of steps which
+ * are replayed from memory, and read again when it changes */
+#define STEP_SETVAR	1	/* <varname>: <value> */
+#define STEP_STATUS	2	/* ups.status: <value> */
+#define STEP_TIMER	3	/* TIMER <seconds> */
+
+typedef struct {
+	int	type;
+	char	*var;
+	char	*value;
+	dummy_info_t	*item;	/* definition of var, if known */
+	int	delay;		/* for TIMER */
+} dummy_step_t;
+
+static dummy_step_t	*steps = NULL;
+static size_t	numsteps = 0;
+static int	has_timer = 0;
+
+static char	datafile[SMALLBUF];
+static struct stat	datafile_st;
+static time_t	datafile_checked = 0;
+
+/* where each device is in the replay: the first one is the device of the
+ * ups.conf section, the others those added by "devices" */
+typedef struct {
+	dstate_device_t	*dev;
+	size_t	nextstep;
+
+	/* replay is paused by a TIMER until resume_time */
+	int	paused;
+	struct timeval	resume_time;
+
+	/* a timeline without TIMER is only replayed again after upsrw
+	 * changed something, which it then sets back as when the file
+	 * was read each time */
+	int	replayed, overridden;
+
+	/* synthetic variables, see simulate() */
+	double	changes_due;
+	unsigned long	changes;
+} dummy_device_t;
+
+static dummy_device_t	*devs = NULL;
+static size_t	numdevs = 1;
+
+/* "simvars" variables sim.var.<n> per device, changing "simrate" times
+ * per second */
+static int	simvars = 0;
+static double	simrate = 0;
+static struct timeval	sim_last;
+
+/* upper bound of "simvars", the one of "devices" is shared with upsd */
+#define MAX_SIMVARS	10000
 
 #define MAX_STRING_SIZE	128
 
 static int setvar(const char *varname, const char *val);
 static int instcmd(const char *cmdname, const char *extra);
 static int parse_data_file(int upsfd);
+static void init_devices(void);
+static void update_devices(void);
+static void wake_at(const struct timeval *tv);
+static dummy_device_t *current_device(void);
 static dummy_info_t *find_info(const char *varname);
 static int is_valid_data(const char* varname);
 static int is_valid_value(const char* varname, const char *value);
@@ -106,10 +159,10 @@ void upsdrv_initinfo(void)
 			if (parse_data_file(upsfd) < 0)
 				upslogx(LOG_NOTICE, "Unable to parse the definition file %s", device_path);
 
+			init_devices();
+
 			/* Initialize handler */
 			upsh.setvar = setvar;
-
-			dstate_dataok();
 			break;
 		case MODE_META:
 		case MODE_REPEATER:
@@ -152,14 +205,12 @@ void upsdrv_updateinfo(void)
 {
 	upsdebugx(1, "upsdrv_updateinfo...");
 
-	sleep(1);
-
 	switch (mode)
 	{
 		case MODE_DUMMY:
-			/* Now get user's defined variables */
-			if (parse_data_file(upsfd) >= 0)
-				dstate_dataok();
+			/* Read the definition file again if it changed */
+			parse_data_file(upsfd);
+			update_devices();
 			break;
 		case MODE_META:
 		case MODE_REPEATER:
@@ -208,6 +259,14 @@ static int instcmd(const char *cmdname, const char *extra)
 	 * if (mode == MODE_META) => ?
 	 */
 
+	/* nothing to switch off in dummy mode, and no log either, as load
+	 * tests send it at high rates (see tests/nutupsdbench.c) */
+	if ((mode == MODE_DUMMY) && !strcasecmp(cmdname, "load.off"))
+	{
+		upsdebugx(2, "instcmd: %s, nothing to do in dummy mode", cmdname);
+		return STAT_INSTCMD_HANDLED;
+	}
+
 	upslogx(LOG_NOTICE, "instcmd: unknown command [%s] [%s]", cmdname, extra);
 	return STAT_INSTCMD_UNKNOWN;
 }
@@ -218,6 +277,9 @@ void upsdrv_help(void)
 
 void upsdrv_makevartable(void)
 {
+	addvar(VAR_VALUE, "devices", "Number of devices simulated in addition to this one (dummy mode)");
+	addvar(VAR_VALUE, "simvars", "Number of sim.var.<n> variables added to each device (dummy mode)");
+	addvar(VAR_VALUE, "simrate", "Changes per second of the sim.var.<n> variables of each device (dummy mode)");
 }
 
 void upsdrv_initups(void)
@@ -238,8 +300,31 @@ void upsdrv_initups(void)
 	}
 }
 
+static void free_steps(dummy_step_t *list, size_t count)
+{
+	size_t	i;
+
+	for (i = 0; i < count; i++)
+	{
+		free(list[i].var);
+		free(list[i].value);
+	}
+
+	free(list);
+}
+
 void upsdrv_cleanup(void)
 {
+	if (mode == MODE_DUMMY)
+	{
+		free_steps(steps, numsteps);
+		steps = NULL;
+		numsteps = 0;
+
+		free(devs);
+		devs = NULL;
+	}
+
 	if ( (mode == MODE_META) || (mode == MODE_REPEATER) )
 	{
 		if (ups)
@@ -247,12 +332,6 @@ void upsdrv_cleanup(void)
 			upscli_disconnect(ups);
 		}
 
-		if (ctx)
-		{
-			pconf_finish(ctx);
-			free(ctx);
-		}
-
 		free(client_upsname);
 		free(hostname);
 		free(ups);
@@ -265,6 +344,10 @@ static int setvar(const char *varname, const char *val)
 
 	upsdebugx(2, "entering setvar(%s, %s)", varname, val);
 
+	/* see replay_data_file() */
+	if (devs != NULL)
+		current_device()->overridden = 1;
+
 	/* FIXME: the below is only valid if (mode == MODE_DUMMY)
 	 * if (mode == MODE_REPEATER) => forward
 	 * if (mode == MODE_META) => ?
@@ -424,130 +507,474 @@ static void upsconf_err(const char *errmsg)
 	upslogx(LOG_ERR, "Fatal error in parseconf(ups.conf): %s", errmsg);
 }
 
+/* set a variable as setvar() does, the checks being done already */
+static void set_data(const char *varname, const char *val, dummy_info_t *item)
+{
+	if (strlen(val) == 0)
+	{
+		dstate_delinfo(varname);
+		return;
+	}
+
+	dstate_setinfo(varname, "%s", val);
+
+	if (item != NULL)
+	{
+		dstate_setflags(item->info_type, item->info_flags);
+
+		/* Set max length for strings, if needed */
+		if (item->info_flags & ST_FLAG_STRING)
+			dstate_setaux(item->info_type, item->info_len);
+	}
+	else
+	{
+		dstate_setflags(varname, ST_FLAG_STRING | ST_FLAG_RW);
+		dstate_setaux(varname, 32);
+	}
+}
+
+/* has the definition file changed since it was read? */
+static int data_file_changed(void)
+{
+	struct stat	st;
+
+	if (stat(datafile, &st) < 0)
+	{
+		/* being replaced, keep what we have */
+		return 0;
+	}
+
+	return (st.st_mtime != datafile_st.st_mtime) || (st.st_size != datafile_st.st_size)
+		|| (st.st_ino != datafile_st.st_ino) || (st.st_dev != datafile_st.st_dev);
+}
+
 /* for dummy mode
- * parse the definition file and process its content
+ * parse the definition file into steps, when it is first read or changed:
+ * returns 1 if it was (re)read, 0 if unchanged, -1 on error
  */
 static int parse_data_file(int arg_upsfd)
 {
-	char	fn[SMALLBUF];
+	PCONF_CTX_t	ctx;
+	struct stat	st;
+	dummy_step_t	*list = NULL, *step;
+	size_t	count = 0, size = 0, counter;
 	char	*ptr, var_value[MAX_STRING_SIZE];
-	size_t	value_args = 0, counter;
-	time_t	now;
+	int	timer = 0, first = (datafile[0] == '\0');
 	NUT_UNUSED_VARIABLE(arg_upsfd);
 
-	time(&now);
-
 	upsdebugx(1, "entering parse_data_file()");
 
-	if (now < next_update)
+	if (first)
 	{
-		upsdebugx(1, "leaving (paused)...");
-		return 1;
+		if (device_path[0] == '/')
+			snprintf(datafile, sizeof(datafile), "%s", device_path);
+		else
+			snprintf(datafile, sizeof(datafile), "%s/%s", confpath(), device_path);
 	}
-
-	/* initialise everything, to loop back at the beginning of the file */
-	if (ctx == NULL)
+	else if ((time(NULL) == datafile_checked) || !data_file_changed())
 	{
-		ctx = (PCONF_CTX_t *)xmalloc(sizeof(PCONF_CTX_t));
+		/* once a second is enough, however often devices wake up */
+		return 0;
+	}
 
-		if (device_path[0] == '/')
-			snprintf(fn, sizeof(fn), "%s", device_path);
-		else
-			snprintf(fn, sizeof(fn), "%s/%s", confpath(), device_path);
+	time(&datafile_checked);
 
-		pconf_init(ctx, upsconf_err);
+	pconf_init(&ctx, upsconf_err);
 
-		if (!pconf_file_begin(ctx, fn))
+	if (!pconf_file_begin(&ctx, datafile))
+	{
+		if (first)
 			fatalx(EXIT_FAILURE, "Can't open dummy-ups definition file %s: %s",
-				fn, ctx->errmsg);
+				datafile, ctx.errmsg);
+
+		/* keep going with what was read before */
+		upslogx(LOG_NOTICE, "Can't open dummy-ups definition file %s: %s",
+			datafile, ctx.errmsg);
+		pconf_finish(&ctx);
+		return -1;
 	}
 
-	/* Reset the next call time, so that we can loop back on the file
-	 * if there is no blocking action (ie TIMER) until the end of the file */
-	next_update = -1;
+	/* as opened, so that a change made while reading is seen next time */
+	if (fstat(fileno(ctx.f), &st) < 0)
+		memset(&st, 0, sizeof(st));
 
-	/* Now start or continue parsing... */
-	while (pconf_file_next(ctx))
+	while (pconf_file_next(&ctx))
 	{
-		if (pconf_parse_error(ctx))
+		if (pconf_parse_error(&ctx))
 		{
 			upsdebugx(2, "Parse error: %s:%d: %s",
-				fn, ctx->linenum, ctx->errmsg);
+				datafile, ctx.linenum, ctx.errmsg);
 			continue;
 		}
 
 		/* Check if we have something to process */
-		if (ctx->numargs < 1)
+		if (ctx.numargs < 1)
 			continue;
 
+		if (count == size)
+		{
+			size = size ? size * 2 : 64;
+			list = xrealloc(list, size * sizeof(*list));
+		}
+
+		step = &list[count];
+		memset(step, 0, sizeof(*step));
+
 		/* Process actions (only "TIMER" ATM) */
-		if (!strncmp(ctx->arglist[0], "TIMER", 5))
+		if (!strncmp(ctx.arglist[0], "TIMER", 5))
 		{
 			/* TIMER <seconds> will wait "seconds" before
-			 * continuing the parsing */
-			int delay = atoi (ctx->arglist[1]);
-			time(&next_update);
-			next_update += delay;
-			upsdebugx(1, "suspending execution for %i seconds...", delay);
-			break;
+			 * continuing with the next steps */
+			step->type = STEP_TIMER;
+			step->delay = (ctx.numargs > 1) ? atoi(ctx.arglist[1]) : 0;
+			timer = 1;
+			count++;
+			continue;
 		}
 
 		/* Remove ":" suffix, after the variable name */
-		if ((ptr = strchr(ctx->arglist[0], ':')) != NULL)
+		if ((ptr = strchr(ctx.arglist[0], ':')) != NULL)
 			*ptr = '\0';
 
 		upsdebugx(3, "parse_data_file: variable \"%s\" with %d args",
-			ctx->arglist[0], (int)ctx->numargs);
+			ctx.arglist[0], (int)ctx.numargs);
 
 		/* Skip the driver.* collection data */
-		if (!strncmp(ctx->arglist[0], "driver.", 7))
+		if (!strncmp(ctx.arglist[0], "driver.", 7))
 		{
-			upsdebugx(2, "parse_data_file: skipping %s", ctx->arglist[0]);
+			upsdebugx(2, "parse_data_file: skipping %s", ctx.arglist[0]);
 			continue;
 		}
 
 		/* From there, we get varname in arg[0], and values in other arg[1...x] */
+		var_value[0] = '\0';
+
+		for (counter = 1; counter < ctx.numargs; counter++)
+		{
+			if (counter == 1) /* don't append the first space separator */
+				snprintf(var_value, sizeof(var_value), "%s", ctx.arglist[counter]);
+			else
+				snprintfcat(var_value, sizeof(var_value), " %s", ctx.arglist[counter]);
+		}
+
 		/* special handler for status */
-		if (!strncmp( ctx->arglist[0], "ups.status", 10))
+		if (!strncmp(ctx.arglist[0], "ups.status", 10))
 		{
-			status_init();
-			for (counter = 1, value_args = ctx->numargs ;
-				counter < value_args ; counter++)
-			{
-				status_set(ctx->arglist[counter]);
-			}
-			status_commit();
+			step->type = STEP_STATUS;
 		}
 		else
 		{
-			for (counter = 1, value_args = ctx->numargs ;
-				counter < value_args ; counter++)
+			if (!is_valid_data(ctx.arglist[0]) || !is_valid_value(ctx.arglist[0], var_value))
 			{
-				if (counter == 1) /* don't append the first space separator */
-					snprintf(var_value, sizeof(var_value), "%s", ctx->arglist[counter]);
-				else
-					snprintfcat(var_value, sizeof(var_value), " %s", ctx->arglist[counter]);
+				upsdebugx(2, "parse_data_file: can't add \"%s\" with value \"%s\"",
+					ctx.arglist[0], var_value);
+				continue;
 			}
 
-			if (setvar(ctx->arglist[0], var_value) == STAT_SET_UNKNOWN)
-			{
-				upsdebugx(2, "parse_data_file: can't add \"%s\" with value \"%s\"\nError: %s",
-					ctx->arglist[0], var_value, ctx->errmsg);
-			}
-			else
+			step->type = STEP_SETVAR;
+			step->item = find_info(ctx.arglist[0]);
+		}
+
+		step->var = xstrdup(ctx.arglist[0]);
+		step->value = xstrdup(var_value);
+		count++;
+	}
+
+	pconf_finish(&ctx);
+
+	upsdebugx(1, "parse_data_file: %s: %d steps", datafile, (int)count);
+
+	/* start over with the new definitions */
+	free_steps(steps, numsteps);
+
+	steps = list;
+	numsteps = count;
+	has_timer = timer;
+	datafile_st = st;
+
+	for (counter = 0; devs && (counter < numdevs); counter++)
+	{
+		devs[counter].nextstep = 0;
+		devs[counter].paused = 0;
+		devs[counter].replayed = 0;
+	}
+
+	return 1;
+}
+
+/* for dummy mode
+ * go on with the steps, up to the next TIMER or the end of the file
+ */
+static void replay_data_file(dummy_device_t *d)
+{
+	struct timeval	now;
+	dummy_step_t	*step;
+	char	*status, *word, *last = NULL;
+	int	looped = 0;
+
+	if (d->paused)
+	{
+		get_monotonic_time(&now);
+
+		if ((now.tv_sec < d->resume_time.tv_sec) ||
+			((now.tv_sec == d->resume_time.tv_sec) && (now.tv_usec < d->resume_time.tv_usec)))
+		{
+			upsdebugx(1, "replay_data_file: paused");
+			wake_at(&d->resume_time);
+			return;
+		}
+
+		d->paused = 0;
+	}
+
+	/* nothing new to set */
+	if ((d->nextstep == 0) && d->replayed && !has_timer && !d->overridden)
+		return;
+
+	while (d->nextstep < numsteps)
+	{
+		step = &steps[d->nextstep++];
+
+		switch (step->type)
+		{
+			case STEP_TIMER:
+				get_monotonic_time(&d->resume_time);
+				d->resume_time.tv_sec += step->delay;
+				d->paused = 1;
+
+				/* TIMER 0 waits for the next poll */
+				if (step->delay > 0)
+					wake_at(&d->resume_time);
+
+				/* the last step: start over when it expires */
+				if (d->nextstep == numsteps)
+					d->nextstep = 0;
+
+				upsdebugx(1, "suspending execution for %i seconds...", step->delay);
+				return;
+
+			case STEP_STATUS:
+				status = xstrdup(step->value);
+
+				status_init();
+				for (word = strtok_r(status, " ", &last); word; word = strtok_r(NULL, " ", &last))
+					status_set(word);
+				status_commit();
+
+				free(status);
+				break;
+
+			default:
+				set_data(step->var, step->value, step->item);
+				upsdebugx(3, "replay_data_file: set \"%s\" to \"%s\"", step->var, step->value);
+				break;
+		}
+
+		/* loop back at the beginning of the file, right away when
+		 * there is a TIMER to stop at, else with the next poll */
+		if ((d->nextstep == numsteps) && has_timer && !looped)
+		{
+			d->nextstep = 0;
+			looped = 1;
+		}
+	}
+
+	d->nextstep = 0;
+	d->replayed = 1;
+	d->overridden = 0;
+}
+
+/* copy the driver.* variables and device.type of a device to the
+ * selected one */
+static void copy_driver_vars(const st_tree_t *node)
+{
+	if (node == NULL)
+		return;
+
+	copy_driver_vars(node->left);
+
+	if (!strncmp(node->var, "driver.", 7) || !strcmp(node->var, "device.type"))
+		dstate_setinfo(node->var, "%s", node->raw);
+
+	copy_driver_vars(node->right);
+}
+
+/* for dummy mode
+ * have upsdrv_updateinfo() called again at tv, if that is sooner
+ */
+static void wake_at(const struct timeval *tv)
+{
+	if ((next_wakeup.tv_sec == 0) || (tv->tv_sec < next_wakeup.tv_sec) ||
+		((tv->tv_sec == next_wakeup.tv_sec) && (tv->tv_usec < next_wakeup.tv_usec)))
+	{
+		next_wakeup = *tv;
+	}
+}
+
+/* for dummy mode
+ * change the synthetic variables of a device as often as simrate says
+ */
+static void simulate(dummy_device_t *d, double elapsed)
+{
+	char	var[SMALLBUF];
+
+	if ((simvars < 1) || (simrate <= 0))
+		return;
+
+	for (d->changes_due += simrate * elapsed; d->changes_due >= 1; d->changes_due--)
+	{
+		snprintf(var, sizeof(var), "sim.var.%d", (int)(d->changes % simvars) + 1);
+		dstate_setinfo(var, "%lu", ++d->changes);
+	}
+}
+
+/* the device whose socket a command came from */
+static dummy_device_t *current_device(void)
+{
+	dstate_device_t	*dev;
+	size_t	i;
+
+	if (numdevs < 2)
+		return &devs[0];
+
+	dev = dstate_get_device();
+
+	for (i = 0; i < numdevs; i++)
+	{
+		if (devs[i].dev == dev)
+			return &devs[i];
+	}
+
+	return &devs[0];
+}
+
+/* value of a numeric option of the simulation, from 0 to max */
+static double sim_option(const char *name, double max)
+{
+	const char	*val = getval(name);
+	char	*end;
+	double	ret;
+
+	ret = strtod(val, &end);
+
+	if ((end == val) || (*end != '\0') || !(ret >= 0) || (ret > max))
+		fatalx(EXIT_FAILURE, "Invalid %s: %s (expected 0 to %g)", name, val, max);
+
+	return ret;
+}
+
+/* for dummy mode
+ * set up this device and the ones of "devices", which get the driver.*
+ * variables of this one, then the same steps and variables
+ */
+static void init_devices(void)
+{
+	const st_tree_t	*root;
+	dummy_info_t	*item;
+	char	name[SMALLBUF];
+	size_t	i;
+	int	k;
+
+	if (testvar("devices"))
+		numdevs = 1 + (size_t)sim_option("devices", UPSCONF_MAX_DEVICES);
+
+	if (testvar("simvars"))
+		simvars = (int)sim_option("simvars", MAX_SIMVARS);
+
+	if (testvar("simrate"))
+		simrate = sim_option("simrate", 1e6);
+
+	devs = xcalloc(numdevs, sizeof(*devs));
+	get_monotonic_time(&sim_last);
+
+	if (numdevs > 1)
+	{
+		root = dstate_getroot();
+		devs[0].dev = dstate_get_device();
+
+		for (i = 1; i < numdevs; i++)
+		{
+			snprintf(name, sizeof(name), "%s-%d", upsname, (int)i);
+			devs[i].dev = dstate_add_device(progname, name);
+			dstate_select_device(devs[i].dev);
+
+			for (item = nut_data; item->info_type != NULL; item++)
 			{
-				upsdebugx(3, "parse_data_file: added \"%s\" with value \"%s\"",
-					ctx->arglist[0], var_value);
+				if (item->drv_flags & DU_FLAG_INIT)
+					set_data(item->info_type, item->default_value, item);
 			}
+
+			copy_driver_vars(root);
+			dstate_addcmd("load.off");
 		}
+
+		upslogx(LOG_INFO, "Simulating %d more devices, %s-1 to %s-%d",
+			(int)numdevs - 1, upsname, upsname, (int)numdevs - 1);
 	}
 
-	/* Cleanup parseconf if there is no pending action */
-	if (next_update == -1)
+	for (i = 0; i < numdevs; i++)
 	{
-		pconf_finish(ctx);
-		free(ctx);
-		ctx=NULL;
+		dstate_select_device(devs[i].dev);
+
+		for (k = 1; k <= simvars; k++)
+		{
+			snprintf(name, sizeof(name), "sim.var.%d", k);
+			dstate_setinfo(name, "0");
+		}
+
+		/* spread the changes of the devices over time */
+		devs[i].changes_due = (double)i / numdevs;
+
+		replay_data_file(&devs[i]);
+		dstate_dataok();
+	}
+
+	dstate_select_device(devs[0].dev);
+}
+
+/* for dummy mode
+ * go on with the replay of each device, and change their variables
+ */
+static void update_devices(void)
+{
+	struct timeval	now, tick;
+	double	elapsed;
+	long	usec;
+	size_t	i;
+
+	get_monotonic_time(&now);
+	elapsed = (now.tv_sec - sim_last.tv_sec) + (now.tv_usec - sim_last.tv_usec) / 1e6;
+	sim_last = now;
+
+	for (i = 0; i < numdevs; i++)
+	{
+		dstate_select_device(devs[i].dev);
+		dstate_batch_begin();
+
+		replay_data_file(&devs[i]);
+		simulate(&devs[i], elapsed);
+		dstate_dataok();
+
+		dstate_batch_commit();
+	}
+
+	dstate_select_device(devs[0].dev);
+
+	/* often enough for the changes to be spread over the devices,
+	 * within 10 ms and poll_interval */
+	if ((simvars > 0) && (simrate > 0))
+	{
+		usec = (long)(1e6 / (simrate * numdevs));
+
+		if (usec < 10000)
+			usec = 10000;
+
+		if (usec < (long)poll_interval * 1000000)
+		{
+			tick.tv_sec = now.tv_sec + (now.tv_usec + usec) / 1000000;
+			tick.tv_usec = (now.tv_usec + usec) % 1000000;
+			wake_at(&tick);
+		}
 	}
-	return 1;
 }
+
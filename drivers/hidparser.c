@@ -54,6 +54,28 @@ typedef struct {
 	uint8_t		UsageSize;			/* Design number of usage used	*/
 } HIDParser_t;
 
+/*
+ * HIDIndex struct
+ *
+ * Hash indexes over the items of a parsed descriptor, so that drivers can
+ * look items up on every interrupt report without scanning them all.
+ * FindObject_with_Path() matches any leading part of the path of items,
+ * so each item is entered with each length of its path.  Hashes are kept
+ * at most half full, and the first item of a key wins, as with a scan.
+ * -------------------------------------------------------------------------- */
+typedef struct {
+	int		item;				/* index in pDesc->item + 1, 0 if free */
+	int		len;				/* number of nodes of the key */
+} HIDPathSlot_t;
+
+struct HIDIndex_s {
+	int		size;				/* slots of each hash, a power of 2 */
+	HIDPathSlot_t	*by_path;			/* by Path and Type		*/
+	int		*by_id;				/* by ReportID, Offset and Type	*/
+	int		*by_report;			/* items, grouped by ReportID	*/
+	int		report_first[257];		/* of each ReportID in by_report */
+};
+
 /* return 1 + the position of the leftmost "1" bit of an int, or 0 if
    none. */
 static inline unsigned int hibit(unsigned int x)
@@ -372,14 +394,162 @@ int FindObject(HIDDesc_t *pDesc, HIDData_t *pData)
 	return 1;
 }
 
+/* FNV-1a */
+static unsigned int HIDIndexHash(const uint8_t *key, size_t len, unsigned int hash)
+{
+	size_t	i;
+
+	for (i = 0; i < len; i++) {
+		hash = (hash ^ key[i]) * 16777619U;
+	}
+
+	return hash;
+}
+
+static unsigned int HIDPathHash(const HIDNode_t *Node, int len, uint8_t Type)
+{
+	unsigned int	hash = HIDIndexHash(&Type, 1, 2166136261U);
+
+	return HIDIndexHash((const uint8_t *)Node, len * sizeof(*Node), hash);
+}
+
+static unsigned int HIDIDHash(uint8_t ReportID, uint8_t Offset, uint8_t Type)
+{
+	uint8_t	key[3] = { ReportID, Offset, Type };
+
+	return HIDIndexHash(key, sizeof(key), 2166136261U);
+}
+
+static HIDPathSlot_t *HIDPathSlot(HIDDesc_t *pDesc, const HIDNode_t *Node, int len, uint8_t Type)
+{
+	struct HIDIndex_s	*index = pDesc->index;
+	unsigned int	mask = index->size - 1, i;
+
+	for (i = HIDPathHash(Node, len, Type) & mask; index->by_path[i].item; i = (i + 1) & mask) {
+		HIDData_t	*pData = &pDesc->item[index->by_path[i].item - 1];
+
+		if ((index->by_path[i].len == len) && (pData->Type == Type)
+			&& !memcmp(pData->Path.Node, Node, len * sizeof(*Node))) {
+			break;
+		}
+	}
+
+	return &index->by_path[i];
+}
+
+static int *HIDIDSlot(HIDDesc_t *pDesc, uint8_t ReportID, uint8_t Offset, uint8_t Type)
+{
+	struct HIDIndex_s	*index = pDesc->index;
+	unsigned int	mask = index->size - 1, i;
+
+	for (i = HIDIDHash(ReportID, Offset, Type) & mask; index->by_id[i]; i = (i + 1) & mask) {
+		HIDData_t	*pData = &pDesc->item[index->by_id[i] - 1];
+
+		if ((pData->ReportID == ReportID) && (pData->Offset == Offset) && (pData->Type == Type)) {
+			break;
+		}
+	}
+
+	return &index->by_id[i];
+}
+
+/* free the indexes of a descriptor */
+static void Free_Index(HIDDesc_t *pDesc)
+{
+	if (!pDesc->index) {
+		return;
+	}
+
+	free(pDesc->index->by_path);
+	free(pDesc->index->by_id);
+	free(pDesc->index->by_report);
+	free(pDesc->index);
+	pDesc->index = NULL;
+}
+
+/* build the indexes of a descriptor. Without them (out of memory),
+   lookups scan the items. */
+static void Build_Index(HIDDesc_t *pDesc)
+{
+	struct HIDIndex_s	*index;
+	HIDPathSlot_t	*pathslot;
+	int		*idslot;
+	int		i, len, size;
+
+	index = calloc(1, sizeof(*index));
+	if (!index) {
+		return;
+	}
+
+	pDesc->index = index;
+
+	/* each item, with each length of path */
+	size = 64;
+	while (size < 2 * pDesc->nitems * (PATH_SIZE + 1)) {
+		size *= 2;
+	}
+
+	index->size = size;
+	index->by_path = calloc(size, sizeof(*index->by_path));
+	index->by_id = calloc(size, sizeof(*index->by_id));
+	index->by_report = calloc(pDesc->nitems, sizeof(*index->by_report));
+
+	if (!index->by_path || !index->by_id || !index->by_report) {
+		Free_Index(pDesc);
+		return;
+	}
+
+	for (i = 0; i < pDesc->nitems; i++) {
+		HIDData_t	*pData = &pDesc->item[i];
+
+		for (len = 0; len <= PATH_SIZE; len++) {
+			pathslot = HIDPathSlot(pDesc, pData->Path.Node, len, pData->Type);
+			if (!pathslot->item) {
+				pathslot->item = i + 1;
+				pathslot->len = len;
+			}
+		}
+
+		idslot = HIDIDSlot(pDesc, pData->ReportID, pData->Offset, pData->Type);
+		if (!*idslot) {
+			*idslot = i + 1;
+		}
+
+		index->report_first[pData->ReportID + 1]++;
+	}
+
+	/* counting sort of the items by ReportID, in descriptor order */
+	for (i = 1; i < 257; i++) {
+		index->report_first[i] += index->report_first[i - 1];
+	}
+
+	for (i = 0; i < pDesc->nitems; i++) {
+		/* report_first[id] is moved to the end of its group... */
+		index->by_report[index->report_first[pDesc->item[i].ReportID]++] = i;
+	}
+
+	/* ...which is the start of the next one: shift them back */
+	for (i = 256; i > 0; i--) {
+		index->report_first[i] = index->report_first[i - 1];
+	}
+
+	index->report_first[0] = 0;
+}
+
 /*
  * FindObject_with_Path
  * Get pData item with given Path and Type. Return NULL if not found.
+ * Items with a longer path, starting with Path, also match.
  * -------------------------------------------------------------------------- */
 HIDData_t *FindObject_with_Path(HIDDesc_t *pDesc, HIDPath_t *Path, uint8_t Type)
 {
 	int	i;
 
+	if (pDesc->index && (Path->Size <= PATH_SIZE)) {
+		i = HIDPathSlot(pDesc, Path->Node, Path->Size, Type)->item;
+		return i ? &pDesc->item[i - 1] : NULL;
+	}
+
 	for (i = 0; i < pDesc->nitems; i++) {
 		HIDData_t *pData = &pDesc->item[i];
 
@@ -406,6 +576,11 @@ HIDData_t *FindObject_with_ID(HIDDesc_t *pDesc, uint8_t ReportID, uint8_t Offset
 {
 	int	i;
 
+	if (pDesc->index) {
+		i = *HIDIDSlot(pDesc, ReportID, Offset, Type);
+		return i ? &pDesc->item[i - 1] : NULL;
+	}
+
 	for (i = 0; i < pDesc->nitems; i++) {
 		HIDData_t *pData = &pDesc->item[i];
 
@@ -427,6 +602,61 @@ HIDData_t *FindObject_with_ID(HIDDesc_t *pDesc, uint8_t ReportID, uint8_t Offset
 	return NULL;
 }
 
+/*
+ * FindObjects_with_ID
+ * Store in pData[] the items of report ReportID with given Type, up to
+ * size of them, in descriptor order. Return how many there are, which
+ * may be more than size.
+ * -------------------------------------------------------------------------- */
+int FindObjects_with_ID(HIDDesc_t *pDesc, uint8_t ReportID, uint8_t Type, HIDData_t **pData, int size)
+{
+	int	i, first = 0, last = pDesc->nitems, count = 0;
+
+	if (pDesc->index) {
+		first = pDesc->index->report_first[ReportID];
+		last = pDesc->index->report_first[ReportID + 1];
+	}
+
+	for (i = first; i < last; i++) {
+		HIDData_t *pItem = &pDesc->item[pDesc->index ? pDesc->index->by_report[i] : i];
+
+		if (pItem->ReportID != ReportID) {
+			continue;
+		}
+
+		if (pItem->Type != Type) {
+			continue;
+		}
+
+		if (count < size) {
+			pData[count] = pItem;
+		}
+
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * ClaimObject
+ * Record owner as what uses pData, unless something claimed it first,
+ * so that the driver gets from an item back to its own data. Return the
+ * owner of pData.
+ * -------------------------------------------------------------------------- */
+void *ClaimObject(HIDData_t *pData, void *owner)
+{
+	if (!pData) {
+		return NULL;
+	}
+
+	if (!pData->owner) {
+		pData->owner = owner;
+	}
+
+	return pData->owner;
+}
+
 /*
  * GetValue
  * Extract data from a report stored in Buf.
@@ -614,6 +844,8 @@ HIDDesc_t *Parse_ReportDesc(const unsigned char *ReportDesc, const int n)
 
 	pDesc->item = realloc(pDesc->item, pDesc->nitems * sizeof(*pDesc->item));
 
+	Build_Index(pDesc);
+
 	return pDesc;
 }
 
@@ -624,6 +856,7 @@ void Free_ReportDesc(HIDDesc_t *pDesc)
 		return;
 	}
 
+	Free_Index(pDesc);
 	free(pDesc->item);
 	free(pDesc);
 }
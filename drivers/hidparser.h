@@ -53,6 +53,13 @@ HIDData_t *FindObject_with_Path(HIDDesc_t *pDesc, HIDPath_t *Path, uint8_t Type)
 
 HIDData_t *FindObject_with_ID(HIDDesc_t *pDesc, uint8_t ReportID, uint8_t Offset, uint8_t Type);
 
+int FindObjects_with_ID(HIDDesc_t *pDesc, uint8_t ReportID, uint8_t Type, HIDData_t **pData, int size);
+
+/*
+ * ClaimObject
+ * -------------------------------------------------------------------------- */
+void *ClaimObject(HIDData_t *pData, void *owner);
+
 /*
  * GetValue
  * -------------------------------------------------------------------------- */
@@ -132,6 +132,8 @@ typedef struct {
 	long		PhyMax;				/* Physical Max			*/
 	int8_t		have_PhyMin;			/* Physical Min defined?		*/
 	int8_t		have_PhyMax;			/* Physical Max defined?		*/
+
+	void		*owner;				/* set by the driver: what uses this item */
 } HIDData_t;
 
 /*
@@ -143,6 +145,7 @@ typedef struct {
 	int		nitems;				/* number of items in descriptor */
 	HIDData_t	*item;				/* list of items			*/
 	int		replen[256];			/* list of report lengths, in byte */
+	struct HIDIndex_s	*index;			/* lookup indexes, see hidparser.c */
 } HIDDesc_t;
 
 #ifdef __cplusplus
@@ -63,6 +63,9 @@ int max_report_size = 0;
 int interrupt_only = 0;
 int unsigned interrupt_size = 0;
 
+/* Number of reports requested from the device (control transfers) */
+unsigned long report_requests = 0;
+
 /* ---------------------------------------------------------------------- */
 /* report buffering system */
 
@@ -147,9 +150,8 @@ reportbuf_t *new_report_buffer(HIDDesc_t *arg_pDesc)
 /* because buggy firmwares from APC return wrong report size, we either
    ask the report with the found report size or with the whole buffer size
    depending on the max_report_size flag */
-static int refresh_report_buffer(reportbuf_t *rbuf, hid_dev_handle_t udev, HIDData_t *pData, int age)
+static int refresh_report_buffer(reportbuf_t *rbuf, hid_dev_handle_t udev, int id, int age)
 {
-	int	id = pData->ReportID;
 	int	r;
 
 	if (interrupt_only || rbuf->ts[id] + age > time(NULL)) {
@@ -158,6 +160,8 @@ static int refresh_report_buffer(reportbuf_t *rbuf, hid_dev_handle_t udev, HIDDa
 		return 0;
 	}
 
+	report_requests++;
+
 	r = comm_driver->get_report(udev, id, rbuf->data[id],
 		max_report_size ? (int)sizeof(rbuf->data[id]):rbuf->len[id]);
 
@@ -178,25 +182,6 @@ static int refresh_report_buffer(reportbuf_t *rbuf, hid_dev_handle_t udev, HIDDa
 	return 0;
 }
 
-/* read the logical value for the given pData. No logical to physical
-   conversion is performed. If age>0, the read operation is buffered
-   if the item's age is less than "age". On success, return 0 and
-   store the answer in *value. On failure, return -1 and set errno. */
-static int get_item_buffered(reportbuf_t *rbuf, hid_dev_handle_t udev, HIDData_t *pData, long *Value, int age)
-{
-	int id = pData->ReportID;
-	int r;
-
-	r = refresh_report_buffer(rbuf, udev, pData, age);
-	if (r<0) {
-		return -1;
-	}
-
-	GetValue(rbuf->data[id], pData, Value);
-
-	return 0;
-}
-
 /* set the logical value for the given pData. No physical to logical
    conversion is performed. On success, return 0, and failure, return
    -1 and set errno. The updated value is sent to the device. */
@@ -379,19 +364,33 @@ char *HIDGetDataItem(const HIDData_t *hiddata, usage_tables_t *utab)
 int HIDGetDataValue(hid_dev_handle_t udev, HIDData_t *hiddata, double *Value, int age)
 {
 	int	r;
-	long	hValue;
 
 	if (hiddata == NULL) {
 		return 0;
 	}
 
-	r = get_item_buffered(reportbuf, udev, hiddata, &hValue, age);
+	r = refresh_report_buffer(reportbuf, udev, hiddata->ReportID, age);
 	if (r<0) {
 		upsdebug_with_errno(1, "Can't retrieve Report %02x", hiddata->ReportID);
 		return -errno;
 	}
 
-	*Value = hValue;
+	return HIDGetBufferedValue(hiddata, Value);
+}
+
+/* Return the physical value associated with the given HIDData path,
+ * from its report as last read, without reading it again.
+ * return 1 if OK, 0 on fail.
+ */
+int HIDGetBufferedValue(HIDData_t *hiddata, double *Value)
+{
+	long	hValue;
+
+	if (hiddata == NULL) {
+		return 0;
+	}
+
+	GetValue(reportbuf->data[hiddata->ReportID], hiddata, &hValue);
 
 	/* Convert Logical Min, Max and Value into Physical */
 	*Value = logical_to_physical(hiddata, hValue);
@@ -402,6 +401,30 @@ int HIDGetDataValue(hid_dev_handle_t udev, HIDData_t *hiddata, double *Value, in
 	return 1;
 }
 
+/* Read each of the count reports of ids[] once, unless it is younger
+ * than "age" seconds, so that their items can then be decoded with
+ * HIDGetBufferedValue(). status[i] gets what HIDGetDataValue() would
+ * return for the items of report ids[i]: 1 if it is usable, 0 or
+ * -errno otherwise. Return the number of usable reports.
+ */
+int HIDGetReports(hid_dev_handle_t udev, int *ids, int *status, int count, int age)
+{
+	int	i, usable = 0;
+
+	for (i = 0; i < count; i++) {
+		if (refresh_report_buffer(reportbuf, udev, ids[i], age) < 0) {
+			upsdebug_with_errno(1, "Can't retrieve Report %02x", ids[i]);
+			status[i] = -errno;
+			continue;
+		}
+
+		status[i] = 1;
+		usable++;
+	}
+
+	return usable;
+}
+
 /* Return the physical value associated with the given path.
  * return 1 if OK, 0 on fail, -errno otherwise (ie disconnect).
  */
@@ -486,9 +509,8 @@ bool_t HIDSetItemValue(hid_dev_handle_t udev, const char *hidpath, double Value,
 int HIDGetEvents(hid_dev_handle_t udev, HIDData_t **event, int eventsize)
 {
 	unsigned char	buf[SMALLBUF];
-	int		itemCount = 0;
-	int		buflen, r, i;
-	HIDData_t	*pData;
+	int		itemCount;
+	int		buflen, r;
 
 	/* needs libusb-0.1.8 to work => use ifdef and autoconf */
 	buflen = comm_driver->get_interrupt(udev, buf, interrupt_size ? interrupt_size:sizeof(buf), 250);
@@ -502,26 +524,13 @@ int HIDGetEvents(hid_dev_handle_t udev, HIDData_t **event, int eventsize)
 		return -errno;
 	}
 
-	/* now read all items that are part of this report */
-	for (i=0; i<pDesc->nitems; i++) {
-
-		pData = &pDesc->item[i];
-
-		/* Variable not part of this report */
-		if (pData->ReportID != buf[0])
-			continue;
-
-		/* Not an input report */
-		if (pData->Type != ITEM_INPUT)
-			continue;
-
-		/* maximum number of events reached? */
-		if (itemCount >= eventsize) {
-			upsdebugx(1, "%s: too many events (truncated)", __func__);
-			break;
-		}
+	/* now read all input items that are part of this report */
+	itemCount = FindObjects_with_ID(pDesc, buf[0], ITEM_INPUT, event, eventsize);
 
-		event[itemCount++] = pData;
+	/* maximum number of events reached? */
+	if (itemCount > eventsize) {
+		upsdebugx(1, "%s: too many events (truncated)", __func__);
+		itemCount = eventsize;
 	}
 
 	if (itemCount == 0) {
@@ -92,6 +92,7 @@ extern reportbuf_t	*reportbuf;	/* buffer for most recent reports */
 extern int max_report_size;
 extern int interrupt_only;
 extern unsigned int interrupt_size;
+extern unsigned long report_requests;	/* reports requested from the device */
 
 /* ---------------------------------------------------------------------- */
 
@@ -125,6 +126,16 @@ char *HIDGetDataItem(const HIDData_t *hiddata, usage_tables_t *utab);
  * -------------------------------------------------------------------------- */
 int HIDGetDataValue(hid_dev_handle_t udev, HIDData_t *hiddata, double *Value, int age);
 
+/*
+ * HIDGetBufferedValue
+ * -------------------------------------------------------------------------- */
+int HIDGetBufferedValue(HIDData_t *hiddata, double *Value);
+
+/*
+ * HIDGetReports
+ * -------------------------------------------------------------------------- */
+int HIDGetReports(hid_dev_handle_t udev, int *ids, int *status, int count, int age);
+
 /*
  * HIDSetDataValue
  * -------------------------------------------------------------------------- */
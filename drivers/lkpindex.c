@@ -0,0 +1,214 @@
+/* lkpindex.c - sorted indexes over the value lookup tables of drivers
+
+   The info_lkp_t tables of snmp-ups and usbhid-ups map device values to
+   NUT values and back, and each status, alarm or enumerated value is
+   converted on every poll. Instead of scanning a table each time, the
+   first lookup in it sorts its positions by device value and by NUT
+   value, and the following ones are binary searches. Tables are found
+   back from their address with a small hash.
+
+   Equal keys stay in table order, so the first matching entry is found,
+   as with a linear scan.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "common.h"
+#include "lkpindex.h"
+
+#include <stdint.h>
+
+typedef struct {
+	long	value;
+	const char	*nut_value;
+	size_t	pos;
+} lkpindex_key_t;
+
+struct lkpindex_s {
+	const void	*table;
+	size_t	count;
+	lkpindex_key_t	*by_value;
+	lkpindex_key_t	*by_nut_value;
+};
+
+static lkpindex_t	**slots = NULL;	/* open addressing on the table address */
+static size_t	nslots = 0, nindexes = 0;
+
+static size_t lkpindex_hash(const void *table)
+{
+	return (size_t)(((uintptr_t)table >> 3) * 2654435761U);
+}
+
+static lkpindex_t **lkpindex_slot(const void *table)
+{
+	size_t	i;
+
+	for (i = lkpindex_hash(table) & (nslots - 1); slots[i]; i = (i + 1) & (nslots - 1)) {
+		if (slots[i]->table == table) {
+			break;
+		}
+	}
+
+	return &slots[i];
+}
+
+static int cmp_value(const void *a, const void *b)
+{
+	const lkpindex_key_t	*ka = a, *kb = b;
+
+	if (ka->value != kb->value) {
+		return (ka->value < kb->value) ? -1 : 1;
+	}
+
+	return (ka->pos < kb->pos) ? -1 : (ka->pos > kb->pos);
+}
+
+static int cmp_nut_value(const void *a, const void *b)
+{
+	const lkpindex_key_t	*ka = a, *kb = b;
+	int	ret = strcmp(ka->nut_value, kb->nut_value);
+
+	if (ret) {
+		return ret;
+	}
+
+	return (ka->pos < kb->pos) ? -1 : (ka->pos > kb->pos);
+}
+
+static lkpindex_t *lkpindex_build(const void *table, lkpindex_entry_t entry)
+{
+	lkpindex_t	*idx;
+	long	value;
+	const char	*nut_value;
+	size_t	i;
+
+	idx = xcalloc(1, sizeof(*idx));
+	idx->table = table;
+
+	while (entry(table, idx->count, &value, &nut_value)) {
+		idx->count++;
+	}
+
+	idx->by_value = xcalloc(idx->count + 1, sizeof(*idx->by_value));
+	idx->by_nut_value = xcalloc(idx->count + 1, sizeof(*idx->by_nut_value));
+
+	for (i = 0; i < idx->count; i++) {
+		entry(table, i, &value, &nut_value);
+
+		idx->by_value[i].value = idx->by_nut_value[i].value = value;
+		idx->by_value[i].nut_value = idx->by_nut_value[i].nut_value = nut_value;
+		idx->by_value[i].pos = idx->by_nut_value[i].pos = i;
+	}
+
+	qsort(idx->by_value, idx->count, sizeof(*idx->by_value), cmp_value);
+	qsort(idx->by_nut_value, idx->count, sizeof(*idx->by_nut_value), cmp_nut_value);
+
+	return idx;
+}
+
+const lkpindex_t *lkpindex_get(const void *table, lkpindex_entry_t entry)
+{
+	lkpindex_t	**slot, **old = slots;
+	size_t	i, oldsize = nslots;
+
+	if (nslots) {
+		slot = lkpindex_slot(table);
+
+		if (*slot) {
+			return *slot;
+		}
+	}
+
+	/* keep it at most half full */
+	if ((nindexes + 1) * 2 > nslots) {
+		nslots = nslots ? nslots * 2 : 64;
+		slots = xcalloc(nslots, sizeof(*slots));
+
+		for (i = 0; i < oldsize; i++) {
+			if (old[i]) {
+				*lkpindex_slot(old[i]->table) = old[i];
+			}
+		}
+
+		free(old);
+	}
+
+	slot = lkpindex_slot(table);
+	*slot = lkpindex_build(table, entry);
+	nindexes++;
+
+	return *slot;
+}
+
+ssize_t lkpindex_find_value(const lkpindex_t *idx, long value)
+{
+	size_t	lo = 0, hi = idx->count, mid;
+
+	/* first of the equal ones */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+
+		if (idx->by_value[mid].value < value) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if ((lo < idx->count) && (idx->by_value[lo].value == value)) {
+		return (ssize_t)idx->by_value[lo].pos;
+	}
+
+	return -1;
+}
+
+ssize_t lkpindex_find_nut_value(const lkpindex_t *idx, const char *nut_value)
+{
+	size_t	lo = 0, hi = idx->count, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+
+		if (strcmp(idx->by_nut_value[mid].nut_value, nut_value) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if ((lo < idx->count) && (!strcmp(idx->by_nut_value[lo].nut_value, nut_value))) {
+		return (ssize_t)idx->by_nut_value[lo].pos;
+	}
+
+	return -1;
+}
+
+void lkpindex_free(void)
+{
+	size_t	i;
+
+	for (i = 0; i < nslots; i++) {
+		if (slots[i]) {
+			free(slots[i]->by_value);
+			free(slots[i]->by_nut_value);
+			free(slots[i]);
+		}
+	}
+
+	free(slots);
+
+	slots = NULL;
+	nslots = nindexes = 0;
+}
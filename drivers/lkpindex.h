@@ -0,0 +1,52 @@
+/* lkpindex.h - sorted indexes over the value lookup tables of drivers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef LKPINDEX_H_SEEN
+#define LKPINDEX_H_SEEN 1
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+/* *INDENT-OFF* */
+extern "C" {
+/* *INDENT-ON* */
+#endif
+
+typedef struct lkpindex_s lkpindex_t;
+
+/* describe entry i of a lookup table: its device value and NUT value,
+ * or 0 past the end of the table */
+typedef int (*lkpindex_entry_t)(const void *table, size_t i, long *value, const char **nut_value);
+
+/* the index of a table, built on first use; tables must not change
+ * once they have been looked up */
+const lkpindex_t *lkpindex_get(const void *table, lkpindex_entry_t entry);
+
+/* position in the table of the first entry with that device value or
+ * NUT value, -1 if there is none */
+ssize_t lkpindex_find_value(const lkpindex_t *idx, long value);
+ssize_t lkpindex_find_nut_value(const lkpindex_t *idx, const char *nut_value);
+
+void lkpindex_free(void);
+
+#ifdef __cplusplus
+/* *INDENT-OFF* */
+}
+/* *INDENT-ON* */
+#endif
+
+#endif	/* LKPINDEX_H_SEEN */
@@ -33,6 +33,10 @@ const char	*progname = NULL, *upsname = NULL, *device_name = NULL;
 /* may be set by the driver to wake up while in dstate_poll_fds */
 int	extrafd = -1;
 
+/* may be set by upsdrv_updateinfo() to be called again before the end
+ * of poll_interval (monotonic time, see get_monotonic_time) */
+struct timeval	next_wakeup = { 0, 0 };
+
 /* for ser_open */
 int	do_lock_port = 1;
 
@@ -515,6 +519,7 @@ int main(int argc, char **argv)
 	struct	passwd	*new_uid = NULL;
 	int	i, do_forceshutdown = 0;
 	int	update_count = 0;
+	dstate_device_t	*dev;
 
 	atexit(exit_cleanup);
 
@@ -717,20 +722,30 @@ int main(int argc, char **argv)
 	if (!dump_data)
 		dstate_init(progname, upsname);
 
-	/* The poll_interval may have been changed from the default */
-	dstate_setinfo("driver.parameter.pollinterval", "%d", poll_interval);
+	/* for each device, if the driver serves several */
+	dev = dstate_next_device(NULL);
+
+	do {
+		dstate_select_device(dev);
+
+		/* The poll_interval may have been changed from the default */
+		dstate_setinfo("driver.parameter.pollinterval", "%d", poll_interval);
+
+		/* The synchronous option may have been changed from the default */
+		dstate_setinfo("driver.parameter.synchronous", "%s",
+			(do_synchronous==1)?"yes":"no");
 
-	/* The synchronous option may have been changed from the default */
-	dstate_setinfo("driver.parameter.synchronous", "%s",
-		(do_synchronous==1)?"yes":"no");
+		/* remap the device.* info from ups.* for the transition period */
+		if (dstate_getinfo("ups.mfr") != NULL)
+			dstate_setinfo("device.mfr", "%s", dstate_getinfo("ups.mfr"));
+		if (dstate_getinfo("ups.model") != NULL)
+			dstate_setinfo("device.model", "%s", dstate_getinfo("ups.model"));
+		if (dstate_getinfo("ups.serial") != NULL)
+			dstate_setinfo("device.serial", "%s", dstate_getinfo("ups.serial"));
 
-	/* remap the device.* info from ups.* for the transition period */
-	if (dstate_getinfo("ups.mfr") != NULL)
-		dstate_setinfo("device.mfr", "%s", dstate_getinfo("ups.mfr"));
-	if (dstate_getinfo("ups.model") != NULL)
-		dstate_setinfo("device.model", "%s", dstate_getinfo("ups.model"));
-	if (dstate_getinfo("ups.serial") != NULL)
-		dstate_setinfo("device.serial", "%s", dstate_getinfo("ups.serial"));
+	} while ((dev != NULL) && ((dev = dstate_next_device(dev)) != NULL));
+
+	dstate_select_device(dstate_next_device(NULL));
 
 	if ( (nut_debug_level == 0) && (!dump_data) ) {
 		background();
@@ -741,10 +756,19 @@ int main(int argc, char **argv)
 
 		struct timeval	timeout;
 
-		gettimeofday(&timeout, NULL);
+		get_monotonic_time(&timeout);
 		timeout.tv_sec += poll_interval;
 
+		next_wakeup.tv_sec = next_wakeup.tv_usec = 0;
+
+		dstate_batch_begin();
 		upsdrv_updateinfo();
+		dstate_batch_commit();
+
+		if ((next_wakeup.tv_sec != 0) && ((next_wakeup.tv_sec < timeout.tv_sec) ||
+			((next_wakeup.tv_sec == timeout.tv_sec) && (next_wakeup.tv_usec < timeout.tv_usec)))) {
+			timeout = next_wakeup;
+		}
 
 		/* Dump the data tree (in upsc-like format) to stdout and exit */
 		if (dump_data) {
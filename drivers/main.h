@@ -11,6 +11,7 @@ extern const char	*progname, *upsname, *device_name;
 extern char		*device_path;
 extern int		upsfd, extrafd, broken_driver, experimental_driver, do_lock_port, exit_flag;
 extern unsigned int	poll_interval;
+extern struct timeval	next_wakeup;
 
 /* functions & variables required in each driver */
 void upsdrv_initups(void);	/* open connection to UPS, fail if not found */
@@ -39,6 +39,7 @@
 #include "nut_float.h"
 #include "snmp-ups.h"
 #include "parseconf.h"
+#include "lkpindex.h"
 
 /* include all known mib2nut lookup tables */
 #include "apc-mib.h"
@@ -148,8 +149,66 @@ alarms_info_t *alarms_info;
 static const char *mibname;
 static const char *mibvers;
 
+/* Hash indexes over snmp_info[], by NUT variable name (case-insensitive)
+ * and by OID, built once the MIB is known. The instances of templates
+ * expanded by the init walk are added too, and point to their template */
+typedef struct {
+	const char	*key;		/* NULL for a free slot */
+	snmp_info_t	*info;
+	bool_t	owned;		/* key allocated for an instance */
+} su_index_slot_t;
+
+typedef struct {
+	su_index_slot_t	*slots;	/* open addressing */
+	size_t	size;
+	size_t	count;
+	bool_t	nocase;
+} su_index_t;
+
+static su_index_t info_by_type = { NULL, 0, 0, TRUE };
+static su_index_t info_by_OID = { NULL, 0, 0, FALSE };
+static snmp_info_t *info_indexed = NULL;	/* the table they cover */
+
+/* GET batching: an update walk fetches the same OIDs as the one before,
+ * so these are requested up front, getbatch OIDs per request, and
+ * nut_snmp_get() takes the answers from there instead of the network */
+typedef struct {
+	char	*OID;
+	struct snmp_pdu	*pdu;	/* answer, NULL if not fetched or already used */
+	bool_t	sent;		/* requested by the pipeline */
+} su_prefetch_t;
+
+static int getbatch = DEFAULT_GETBATCH;
+static int getbatch_max = DEFAULT_GETBATCH;	/* as configured */
+static int getbatch_walks = 0;		/* good walks since the last shrink */
+static bool_t walk_failed = FALSE;	/* the agent did not answer */
+static bool_t walking = FALSE;		/* in an update walk */
+static su_prefetch_t *prefetch = NULL;	/* OIDs of the last walk, and answers */
+static int prefetch_count = 0;
+static int prefetch_next = 0;		/* where the next lookup starts */
+static su_prefetch_t *walked = NULL;	/* OIDs fetched by the current walk */
+static int walked_count = 0;
+static int walked_size = 0;
+static unsigned long walk_requests = 0;	/* round-trips of the current walk */
+
+/* GET pipelining: up to "pipeline" of these batched GET requests are in
+ * flight at once, and their answers are stored as they come in */
+typedef struct {
+	int	first;		/* the batch is prefetch[first..first+count-1] */
+	int	count;
+	int	*index;		/* variable of the request -> entry of the batch */
+	int	added;		/* variables in the request */
+	bool_t	abandoned;	/* the prefetch ended without waiting for it */
+} su_request_t;
+
+static int pipeline = DEFAULT_PIPELINE;
+static su_request_t **inflight = NULL;	/* [pipeline] */
+static int inflight_count = 0;
+static int pipe_next = 0;		/* first prefetch entry that may not be sent */
+static bool_t pipe_failed = FALSE;	/* stop sending, the agent does not answer */
+
 #define DRIVER_NAME	"Generic SNMP UPS driver"
-#define DRIVER_VERSION		"1.12"
+#define DRIVER_VERSION		"1.16"
 
 /* driver description structure */
 upsdrv_info_t	upsdrv_info = {
@@ -182,6 +241,10 @@ static int device_template_offset = -1;
 
 /* Forward functions declarations */
 static void disable_transfer_oids(void);
+static void prefetch_free(su_prefetch_t *array, int count);
+static void su_index_build(void);
+static void su_index_instance(snmp_info_t *su_info_p, const char *info_type, const char *OID);
+static void su_index_free(su_index_t *idx);
 bool_t get_and_process_data(int mode, snmp_info_t *su_info_p);
 int extract_template_number(int template_type, const char* varname);
 int get_template_type(const char* varname);
@@ -321,6 +384,10 @@ void upsdrv_makevartable(void)
 		"Set SNMP version (default=v1, allowed v2c)");
 	addvar(VAR_VALUE, SU_VAR_POLLFREQ,
 		"Set polling frequency in seconds, to reduce network flow (default=30)");
+	addvar(VAR_VALUE, SU_VAR_GETBATCH,
+		"Set the number of OIDs requested at once in updates (default=16, 1 to disable)");
+	addvar(VAR_VALUE, SU_VAR_PIPELINE,
+		"Set the number of GET requests in flight at once in updates (default=4, 1 to disable)");
 	addvar(VAR_VALUE, SU_VAR_RETRIES,
 		"Specifies the number of Net-SNMP retries to be used in the requests (default=5)");
 	addvar(VAR_VALUE, SU_VAR_TIMEOUT,
@@ -484,6 +551,17 @@ void upsdrv_cleanup(void)
 	if (daisychain_info)
 		free(daisychain_info);
 
+	prefetch_free(prefetch, prefetch_count);
+	prefetch = NULL;
+	prefetch_count = 0;
+	free(inflight);
+	inflight = NULL;
+
+	su_index_free(&info_by_type);
+	su_index_free(&info_by_OID);
+	info_indexed = NULL;
+	lkpindex_free();
+
 	/* Net-SNMP specific cleanup */
 	nut_snmp_cleanup();
 }
@@ -532,6 +610,22 @@ void nut_snmp_init(const char *type, const char *hostname)
 	g_snmp_sess.timeout = snmp_timeout * ONE_SEC;
 	upsdebugx(2, "Setting SNMP timeout to %ld second(s)", snmp_timeout);
 
+	if (testvar(SU_VAR_GETBATCH)) {
+		getbatch = atoi(getval(SU_VAR_GETBATCH));
+		if (getbatch < 1)
+			getbatch = 1;
+		getbatch_max = getbatch;
+	}
+	upsdebugx(2, "Setting SNMP GET batch size to %i", getbatch);
+
+	if (testvar(SU_VAR_PIPELINE)) {
+		pipeline = atoi(getval(SU_VAR_PIPELINE));
+		if (pipeline < 1)
+			pipeline = 1;
+	}
+	upsdebugx(2, "Setting SNMP GET pipeline depth to %i", pipeline);
+	inflight = xcalloc(pipeline, sizeof(*inflight));
+
 	/* Retrieve user parameters */
 	version = testvar(SU_VAR_VERSION) ? getval(SU_VAR_VERSION) : "v1";
 
@@ -692,6 +786,7 @@ static struct snmp_pdu **nut_snmp_walk(const char *OID, int max_iteration)
 	oid * current_name;
 	size_t current_name_len;
 	static unsigned int numerr = 0;
+	snmp_info_t *su_info_p;
 	int nb_iteration = 0;
 	struct snmp_pdu ** ret_array = NULL;
 	int type = SNMP_MSG_GET;
@@ -724,6 +819,7 @@ static struct snmp_pdu **nut_snmp_walk(const char *OID, int max_iteration)
 		snmp_add_null_var(pdu, current_name, current_name_len);
 
 		status = snmp_synch_response(g_snmp_sess_p, pdu, &response);
+		walk_requests++;
 
 		if (!response) {
 			break;
@@ -750,8 +846,10 @@ static struct snmp_pdu **nut_snmp_walk(const char *OID, int max_iteration)
 					upsdebugx(2, "=> No more OID, walk complete");
 				}
 				else {
+					su_info_p = su_find_info_OID(OID);
 					nut_snmp_perror(g_snmp_sess_p, status, response,
-							"%s: %s", __func__, OID);
+							"%s: %s (%s)", __func__, OID,
+							su_info_p ? su_info_p->info_type : "?");
 				}
 			}
 
@@ -783,6 +881,439 @@ static struct snmp_pdu **nut_snmp_walk(const char *OID, int max_iteration)
 	return ret_array;
 }
 
+/* An answer that only says the OID does not exist (SNMP v2c and v3) */
+static bool_t is_snmp_exception(const struct snmp_pdu *pdu)
+{
+	if (pdu->variables == NULL)
+		return TRUE;
+
+	switch (pdu->variables->type) {
+	case SNMP_NOSUCHOBJECT:
+	case SNMP_NOSUCHINSTANCE:
+	case SNMP_ENDOFMIBVIEW:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static void prefetch_free(su_prefetch_t *array, int count)
+{
+	int	i;
+
+	for (i = 0; i < count; i++) {
+		free(array[i].OID);
+		if (array[i].pdu != NULL)
+			snmp_free_pdu(array[i].pdu);
+	}
+
+	free(array);
+}
+
+/* Remember an OID fetched by the current walk, for the next one */
+static void walk_record(const char *OID)
+{
+	if (walked_count == walked_size) {
+		walked_size = walked_size ? walked_size * 2 : 64;
+		walked = xrealloc(walked, walked_size * sizeof(*walked));
+	}
+
+	walked[walked_count].OID = xstrdup(OID);
+	walked[walked_count].pdu = NULL;
+	walked[walked_count].sent = FALSE;
+	walked_count++;
+}
+
+/* Take the prefetched answer for OID, if any. The walk asks for the
+ * OIDs in the same order as the last time, so the search starts where
+ * the last one ended and wraps around */
+static struct snmp_pdu *prefetch_take(const char *OID)
+{
+	struct snmp_pdu	*pdu;
+	int	i, n;
+
+	for (n = 0; n < prefetch_count; n++) {
+		i = (prefetch_next + n) % prefetch_count;
+
+		if ((prefetch[i].pdu == NULL) || strcmp(prefetch[i].OID, OID))
+			continue;
+
+		pdu = prefetch[i].pdu;
+		prefetch[i].pdu = NULL;
+		prefetch_next = i + 1;
+		return pdu;
+	}
+
+	return NULL;
+}
+
+/* Build the GET request for entries[0..count-1], and fill index[] with
+ * the entry of each of its variables. NULL if no OID could be parsed */
+static struct snmp_pdu *batch_request(su_prefetch_t *entries, int count, int *index, int *added)
+{
+	struct snmp_pdu *pdu;
+	oid name[MAX_OID_LEN];
+	size_t name_len;
+	int i;
+
+	pdu = snmp_pdu_create(SNMP_MSG_GET);
+
+	if (pdu == NULL) {
+		fatalx(EXIT_FAILURE, "Not enough memory");
+	}
+
+	/* the variables of the answer come in the order of the request */
+	for (*added = 0, i = 0; i < count; i++) {
+		name_len = MAX_OID_LEN;
+
+		if (!snmp_parse_oid(entries[i].OID, name, &name_len))
+			continue;
+
+		snmp_add_null_var(pdu, name, name_len);
+		index[(*added)++] = i;
+	}
+
+	if (*added == 0) {
+		snmp_free_pdu(pdu);
+		return NULL;
+	}
+
+	return pdu;
+}
+
+/* Store the answers of a batch request in its entries. Returns 1 when
+ * done, 0 if the agent refused that many OIDs at once (tooBig, or genErr
+ * from agents that do not say so) and -1 without an answer. The response
+ * is left to the caller */
+static int batch_answer(su_prefetch_t *entries, const int *index, int added,
+	int status, struct snmp_pdu *response)
+{
+	struct snmp_pdu *answer;
+	struct variable_list *var;
+	int i;
+
+	if (!response)
+		return -1;
+
+	if ((status != STAT_SUCCESS) || (response->errstat != SNMP_ERR_NOERROR)) {
+		/* SNMP v1 fails the whole request when a single OID is missing,
+		 * only the size of the request is a reason to make them smaller */
+		upsdebugx(3, "%s: %d OIDs, error status %ld (index %ld)", __func__,
+			added, response->errstat, response->errindex);
+
+		return ((response->errstat == SNMP_ERR_TOOBIG)
+			|| (response->errstat == SNMP_ERR_GENERR)) ? 0 : 1;
+	}
+
+	for (var = response->variables, i = 0; (var != NULL) && (i < added); var = var->next_variable, i++) {
+
+		/* a single variable answer, as nut_snmp_get() returns it */
+		answer = snmp_pdu_create(SNMP_MSG_RESPONSE);
+
+		if (answer == NULL) {
+			fatalx(EXIT_FAILURE, "Not enough memory");
+		}
+
+		snmp_pdu_add_variable(answer, var->name, var->name_length,
+			var->type, var->val.string, var->val_len);
+
+		if (is_snmp_exception(answer)) {
+			snmp_free_pdu(answer);
+			continue;
+		}
+
+		entries[index[i]].pdu = answer;
+	}
+
+	return 1;
+}
+
+/* The agent refused a GET of count OIDs: make the next requests smaller,
+ * down to single GETs. Requests of the pipeline may fail together, only
+ * the first one counts */
+static void batch_shrink(int count)
+{
+	getbatch_walks = 0;
+
+	if ((getbatch < count) || (getbatch == 1))
+		return;
+
+	getbatch = (count > 1) ? count / 2 : 1;
+	upslogx(LOG_WARNING, "[%s] GET of %d OIDs failed, now requesting %d at once",
+		upsname?upsname:device_name, count, getbatch);
+}
+
+/* Fetch the answers for entries[0..count-1] with one GET request.
+ * Returns as batch_answer(). Entries without an answer in the end are
+ * fetched again, alone, when the walk gets there */
+static int nut_snmp_get_batch(su_prefetch_t *entries, int count)
+{
+	struct snmp_pdu *pdu, *response = NULL;
+	int *index, added, status, ret;
+
+	index = xcalloc(count, sizeof(*index));
+	pdu = batch_request(entries, count, index, &added);
+
+	if (pdu == NULL) {
+		free(index);
+		return 1;
+	}
+
+	status = snmp_synch_response(g_snmp_sess_p, pdu, &response);
+	walk_requests++;
+
+	ret = batch_answer(entries, index, added, status, response);
+
+	if (response)
+		snmp_free_pdu(response);
+
+	free(index);
+	return ret;
+}
+
+static void pipe_remove(su_request_t *req)
+{
+	int	i;
+
+	for (i = 0; i < inflight_count; i++) {
+		if (inflight[i] == req) {
+			inflight[i] = inflight[--inflight_count];
+			return;
+		}
+	}
+}
+
+/* net-snmp callback for the answers of the pipeline */
+static int pipe_callback(int operation, struct snmp_session *sess, int reqid,
+	struct snmp_pdu *response, void *magic)
+{
+	su_request_t	*req = magic;
+	int	i, ret = -1;
+
+	NUT_UNUSED_VARIABLE(sess);
+	upsdebugx(4, "%s: request %d, operation %d", __func__, reqid, operation);
+
+	/* the entries may be gone already, only free it */
+	if (req->abandoned == FALSE) {
+		pipe_remove(req);
+
+		if (operation == NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE)
+			ret = batch_answer(&prefetch[req->first], req->index, req->added,
+				STAT_SUCCESS, response);
+
+		if (ret == 0)
+			batch_shrink(req->count);
+
+		if (ret == 0 && req->count > 1) {
+			/* send these again, in smaller requests */
+			for (i = req->first; i < req->first + req->count; i++)
+				prefetch[i].sent = FALSE;
+
+			if (pipe_next > req->first)
+				pipe_next = req->first;
+		}
+
+		/* the agent may just be gone, leave the rest to the walk */
+		if (ret < 0) {
+			pipe_failed = TRUE;
+			walk_failed = TRUE;
+		}
+	}
+
+	free(req->index);
+	free(req);
+	return 1;
+}
+
+/* Send the next batch of entries not requested yet. FALSE if there are
+ * none left, or sending failed */
+static bool_t pipe_send(void)
+{
+	su_request_t	*req;
+	struct snmp_pdu	*pdu;
+	int	count;
+
+	while ((pipe_next < prefetch_count) && (prefetch[pipe_next].sent == TRUE))
+		pipe_next++;
+
+	if (pipe_next >= prefetch_count)
+		return FALSE;
+
+	req = xcalloc(1, sizeof(*req));
+	req->first = pipe_next;
+
+	for (count = 0; (count < getbatch) && (pipe_next < prefetch_count)
+		&& (prefetch[pipe_next].sent == FALSE); count++, pipe_next++) {
+		prefetch[pipe_next].sent = TRUE;
+	}
+
+	req->count = count;
+	req->index = xcalloc(count, sizeof(*req->index));
+
+	pdu = batch_request(&prefetch[req->first], count, req->index, &req->added);
+
+	if (pdu == NULL) {
+		free(req->index);
+		free(req);
+		return TRUE;
+	}
+
+	if (snmp_async_send(g_snmp_sess_p, pdu, pipe_callback, req) == 0) {
+		nut_snmp_perror(g_snmp_sess_p, 0, NULL, "%s: snmp_async_send", __func__);
+		snmp_free_pdu(pdu);
+		free(req->index);
+		free(req);
+		pipe_failed = TRUE;
+		return FALSE;
+	}
+
+	walk_requests++;
+	inflight[inflight_count++] = req;
+	return TRUE;
+}
+
+/* Prefetch with up to "pipeline" requests in flight, for no longer than
+ * the poll interval of the driver */
+static void walk_prefetch_pipelined(void)
+{
+	struct timeval	start, now, tv;
+	fd_set	fdset;
+	int	numfds, block, ret, i;
+	long	left;
+
+	pipe_next = 0;
+	pipe_failed = FALSE;
+	get_monotonic_time(&start);
+
+	while (exit_flag == 0) {
+
+		while ((pipe_failed == FALSE) && (inflight_count < pipeline) && pipe_send())
+			;
+
+		if (inflight_count == 0)
+			break;
+
+		get_monotonic_time(&now);
+		left = (long)poll_interval * 1000
+			- ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000);
+
+		if (left <= 0) {
+			upsdebugx(1, "%s: poll interval exceeded with %d requests in flight",
+				__func__, inflight_count);
+			break;
+		}
+
+		/* net-snmp lowers the timeout to its next retransmission */
+		numfds = 0;
+		block = 0;
+		FD_ZERO(&fdset);
+		tv.tv_sec = left / 1000;
+		tv.tv_usec = (left % 1000) * 1000;
+
+		snmp_select_info(&numfds, &fdset, &tv, &block);
+
+		ret = select(numfds, &fdset, NULL, NULL, &tv);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			upslog_with_errno(LOG_ERR, "%s: select", __func__);
+			break;
+		}
+
+		if (ret > 0)
+			snmp_read(&fdset);
+		else
+			snmp_timeout();
+	}
+
+	/* late answers are dropped by pipe_callback(), the walk fetches
+	 * what is missing */
+	for (i = 0; i < inflight_count; i++)
+		inflight[i]->abandoned = TRUE;
+
+	inflight_count = 0;
+}
+
+/* Start of a walk: in update mode, fetch what the last one fetched */
+static void walk_start(int mode)
+{
+	int	first, count, ret;
+
+	walk_requests = 0;
+	walk_failed = FALSE;
+
+	if (mode != SU_WALKMODE_UPDATE)
+		return;
+
+	walking = TRUE;
+	prefetch_next = 0;
+
+	if (pipeline > 1) {
+		walk_prefetch_pipelined();
+		upsdebugx(2, "%s: %d OIDs prefetched with %lu requests", __func__,
+			prefetch_count, walk_requests);
+		return;
+	}
+
+	for (first = 0; (getbatch > 1) && (first < prefetch_count); first += count) {
+
+		if (exit_flag != 0)
+			break;
+
+		count = prefetch_count - first;
+		if (count > getbatch)
+			count = getbatch;
+
+		ret = nut_snmp_get_batch(&prefetch[first], count);
+
+		if (ret == 1)
+			continue;
+
+		/* the agent may just be gone, leave it to the walk */
+		if (ret < 0) {
+			walk_failed = TRUE;
+			break;
+		}
+
+		/* too big: go on with smaller requests */
+		batch_shrink(count);
+		count = 0;	/* retry these */
+	}
+
+	upsdebugx(2, "%s: %d OIDs prefetched with %lu requests", __func__,
+		prefetch_count, walk_requests);
+}
+
+/* End of a walk: what it fetched is prefetched by the next one */
+static void walk_end(int mode)
+{
+	dstate_setinfo("driver.snmp.requests", "%lu", walk_requests);
+
+	if (mode != SU_WALKMODE_UPDATE)
+		return;
+
+	walking = FALSE;
+
+	/* after a while without refusals, try larger requests again */
+	if (walk_failed == TRUE) {
+		getbatch_walks = 0;
+	} else if ((getbatch < getbatch_max) && (++getbatch_walks >= GETBATCH_REGROW_WALKS)) {
+		getbatch = (getbatch * 2 < getbatch_max) ? getbatch * 2 : getbatch_max;
+		getbatch_walks = 0;
+		upsdebugx(1, "[%s] now requesting %d OIDs at once",
+			upsname?upsname:device_name, getbatch);
+	}
+
+	prefetch_free(prefetch, prefetch_count);
+	prefetch = walked;
+	prefetch_count = walked_count;
+
+	walked = NULL;
+	walked_count = walked_size = 0;
+}
+
 struct snmp_pdu *nut_snmp_get(const char *OID)
 {
 	struct snmp_pdu ** pdu_array;
@@ -793,6 +1324,16 @@ struct snmp_pdu *nut_snmp_get(const char *OID)
 
 	upsdebugx(3, "%s(%s)", __func__, OID);
 
+	if (walking == TRUE) {
+		ret_pdu = prefetch_take(OID);
+
+		if (ret_pdu != NULL) {
+			upsdebugx(4, "%s: prefetched", __func__);
+			walk_record(OID);
+			return ret_pdu;
+		}
+	}
+
 	pdu_array = nut_snmp_walk(OID,1);
 
 	if(pdu_array == NULL) {
@@ -803,6 +1344,10 @@ struct snmp_pdu *nut_snmp_get(const char *OID)
 
 	nut_snmp_free(pdu_array);
 
+	/* only fetch again what exists */
+	if ((walking == TRUE) && (ret_pdu != NULL) && !is_snmp_exception(ret_pdu))
+		walk_record(OID);
+
 	return ret_pdu;
 }
 
@@ -1285,11 +1830,130 @@ void su_alarm_set(snmp_info_t *su_info_p, long value)
 	/* TODO: else */
 }
 
-/* find info element definition in my info array. */
+/* FNV-1a, over the lowercase key for info types */
+static size_t su_index_hash(const char *key, bool_t nocase)
+{
+	size_t	hash = 2166136261U;
+
+	for (; *key; key++) {
+		hash ^= nocase ? (unsigned char)tolower((unsigned char)*key) : (unsigned char)*key;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static su_index_slot_t *su_index_slot(const su_index_t *idx, const char *key)
+{
+	su_index_slot_t	*slot;
+	size_t	i;
+
+	for (i = su_index_hash(key, idx->nocase) & (idx->size - 1); ; i = (i + 1) & (idx->size - 1)) {
+		slot = &idx->slots[i];
+
+		if ((slot->key == NULL) || !(idx->nocase ? strcasecmp(slot->key, key) : strcmp(slot->key, key)))
+			return slot;
+	}
+}
+
+static snmp_info_t *su_index_lookup(const su_index_t *idx, const char *key)
+{
+	if (idx->size == 0)
+		return NULL;
+
+	return su_index_slot(idx, key)->info;
+}
+
+/* Add key, unless already there: the first entry of the table wins, as
+ * with a linear search. Instance keys are copied */
+static void su_index_add(su_index_t *idx, const char *key, snmp_info_t *su_info_p, bool_t copy)
+{
+	su_index_slot_t	*slot, *old = idx->slots;
+	size_t	i, oldsize = idx->size;
+
+	/* keep it at most half full */
+	if ((idx->count + 1) * 2 > idx->size) {
+		idx->size = idx->size ? idx->size * 2 : 256;
+		idx->slots = xcalloc(idx->size, sizeof(*idx->slots));
+
+		for (i = 0; i < oldsize; i++) {
+			if (old[i].key != NULL)
+				*su_index_slot(idx, old[i].key) = old[i];
+		}
+
+		free(old);
+	}
+
+	slot = su_index_slot(idx, key);
+
+	if (slot->key != NULL)
+		return;
+
+	slot->key = copy ? xstrdup(key) : key;
+	slot->info = su_info_p;
+	slot->owned = copy;
+	idx->count++;
+}
+
+static void su_index_free(su_index_t *idx)
+{
+	size_t	i;
+
+	for (i = 0; i < idx->size; i++) {
+		if (idx->slots[i].owned == TRUE)
+			free((char *)idx->slots[i].key);
+	}
+
+	free(idx->slots);
+	idx->slots = NULL;
+	idx->size = idx->count = 0;
+}
+
+/* Index the table of the MIB just loaded */
+static void su_index_build(void)
+{
+	snmp_info_t *su_info_p;
+
+	su_index_free(&info_by_type);
+	su_index_free(&info_by_OID);
+
+	for (su_info_p = &snmp_info[0]; su_info_p->info_type != NULL ; su_info_p++) {
+		su_index_add(&info_by_type, su_info_p->info_type, su_info_p, FALSE);
+
+		if (su_info_p->OID != NULL)
+			su_index_add(&info_by_OID, su_info_p->OID, su_info_p, FALSE);
+	}
+
+	info_indexed = snmp_info;
+	upsdebugx(2, "%s: %lu variables, %lu OIDs", __func__,
+		(unsigned long)info_by_type.count, (unsigned long)info_by_OID.count);
+}
+
+/* Index an instance of the template su_info_p */
+static void su_index_instance(snmp_info_t *su_info_p, const char *info_type, const char *OID)
+{
+	if (info_indexed != snmp_info)
+		return;
+
+	su_index_add(&info_by_type, info_type, su_info_p, TRUE);
+
+	if (OID != NULL)
+		su_index_add(&info_by_OID, OID, su_info_p, TRUE);
+}
+
+/* find info element definition in my info array.
+ * For a template instance, this is its template */
 snmp_info_t *su_find_info(const char *type)
 {
 	snmp_info_t *su_info_p;
 
+	/* load_mib2nut() tries the tables before one is indexed */
+	if ((info_indexed != NULL) && (info_indexed == snmp_info)) {
+		su_info_p = su_index_lookup(&info_by_type, type);
+		upsdebugx(3, "%s: \"%s\" %s", __func__, type, su_info_p ? "found" : "unknown");
+		return su_info_p;
+	}
+
 	for (su_info_p = &snmp_info[0]; su_info_p->info_type != NULL ; su_info_p++)
 		if (!strcasecmp(su_info_p->info_type, type)) {
 			upsdebugx(3, "%s: \"%s\" found", __func__, type);
@@ -1300,6 +1964,21 @@ snmp_info_t *su_find_info(const char *type)
 	return NULL;
 }
 
+/* find info element definition by OID, as su_find_info() */
+snmp_info_t *su_find_info_OID(const char *OID)
+{
+	snmp_info_t *su_info_p;
+
+	if ((info_indexed != NULL) && (info_indexed == snmp_info))
+		return su_index_lookup(&info_by_OID, OID);
+
+	for (su_info_p = &snmp_info[0]; su_info_p->info_type != NULL ; su_info_p++)
+		if ((su_info_p->OID != NULL) && !strcmp(su_info_p->OID, OID))
+			return su_info_p;
+
+	return NULL;
+}
+
 /* Counter match the sysOID using {device,ups}.model OID
  * Return TRUE if this OID can be retrieved, FALSE otherwise */
 static bool_t match_model_OID()
@@ -1495,6 +2174,7 @@ bool_t load_mib2nut(const char *mib)
 		mibvers = m2n->mib_version;
 		alarms_info = m2n->alarms_info;
 		upsdebugx(1, "load_mib2nut: using %s mib", mibname);
+		su_index_build();
 		return TRUE;
 	}
 
@@ -1509,15 +2189,30 @@ bool_t load_mib2nut(const char *mib)
 	return FALSE;
 }
 
+/* lookup tables end with a NULL or "NULL" INFO_* value */
+static int su_lkp_entry(const void *table, size_t i, long *value, const char **info_value)
+{
+	const info_lkp_t *info_lkp = (const info_lkp_t *)table + i;
+
+	if ((info_lkp->info_value == NULL) || !strcmp(info_lkp->info_value, "NULL"))
+		return 0;
+
+	*value = info_lkp->oid_value;
+	*info_value = info_lkp->info_value;
+	return 1;
+}
+
 /* find the OID value matching that INFO_* value */
 long su_find_valinfo(info_lkp_t *oid2info, const char* value)
 {
 	info_lkp_t *info_lkp;
+	ssize_t pos;
 
-	for (info_lkp = oid2info; (info_lkp != NULL) &&
-		(strcmp(info_lkp->info_value, "NULL")); info_lkp++) {
+	if (oid2info != NULL) {
+		pos = lkpindex_find_nut_value(lkpindex_get(oid2info, su_lkp_entry), value);
 
-		if (!(strcmp(info_lkp->info_value, value))) {
+		if (pos >= 0) {
+			info_lkp = &oid2info[pos];
 			upsdebugx(1, "%s: found %s (value: %s)",
 					__func__, info_lkp->info_value, value);
 
@@ -1532,6 +2227,7 @@ long su_find_valinfo(info_lkp_t *oid2info, const char* value)
 const char *su_find_infoval(info_lkp_t *oid2info, long value)
 {
 	info_lkp_t *info_lkp;
+	ssize_t pos;
 
 	/* First test if we have a generic lookup function */
 	if ( (oid2info != NULL) && (oid2info->fun != NULL) ) {
@@ -1542,10 +2238,11 @@ const char *su_find_infoval(info_lkp_t *oid2info, long value)
 	}
 
 	/* Otherwise, use the simple values mapping */
-	for (info_lkp = oid2info; (info_lkp != NULL) &&
-		 (info_lkp->info_value != NULL) && (strcmp(info_lkp->info_value, "NULL")); info_lkp++) {
+	if (oid2info != NULL) {
+		pos = lkpindex_find_value(lkpindex_get(oid2info, su_lkp_entry), value);
 
-		if (info_lkp->oid_value == value) {
+		if (pos >= 0) {
+			info_lkp = &oid2info[pos];
 			upsdebugx(1, "%s: found %s (value: %ld)",
 					__func__, info_lkp->info_value, value);
 
@@ -1972,6 +2669,9 @@ static bool_t process_template(int mode, const char* type, snmp_info_t *su_info_
 #pragma GCC diagnostic pop
 #endif
 
+				if (mode == SU_WALKMODE_INIT)
+					su_index_instance(su_info_p, cur_info_p.info_type, cur_info_p.OID);
+
 				/* add instant commands to the info database. */
 				if (SU_TYPE(su_info_p) == SU_TYPE_CMD) {
 					upsdebugx(1, "Adding template command %s", cur_info_p.info_type);
@@ -2369,6 +3069,8 @@ bool_t snmp_ups_walk(int mode)
 	 * for the whole (#0) virtual device, so it *seems* similar to unitary.
 	 */
 
+	walk_start(mode);
+
 	for (current_device_number = 0 ; current_device_number <= devices_count ; current_device_number++)
 	{
 		/* reinit the alarm buffer, before */
@@ -2392,6 +3094,7 @@ bool_t snmp_ups_walk(int mode)
 			/* Check if we are asked to stop (reactivity++) */
 			if (exit_flag != 0) {
 				upsdebugx(1, "%s: aborting because exit_flag was set", __func__);
+				walk_end(mode);
 				return TRUE;
 			}
 
@@ -2516,6 +3219,7 @@ bool_t snmp_ups_walk(int mode)
 			device_alarm_init();
 		}
 	}
+	walk_end(mode);
 	iterations++;
 	return status;
 }
@@ -2853,15 +3557,20 @@ static int su_setOID(int mode, const char *varname, const char *val)
 				__func__, item_number, total_items);
 			return STAT_SET_INVALID;
 		}
-		/* find back the item template */
-		char *item_varname = (char *)xmalloc(SU_INFOSIZE);
-		snprintf(item_varname, SU_INFOSIZE, "%s.%s%s",
-				(vartype == SU_OUTLET)?"outlet":"outlet.group",
-				"%i", strchr(item_number_ptr++, '.'));
+		/* find back the item template: the init walk indexed its
+		 * instances, otherwise look for the template name */
+		tmp_info_p = su_find_info(varname);
 
-		upsdebugx(3, "%s: searching for template\"%s\"", __func__, item_varname);
-		tmp_info_p = su_find_info(item_varname);
-		free(item_varname);
+		if ((tmp_info_p == NULL) || !(tmp_info_p->flags & (SU_OUTLET | SU_OUTLET_GROUP))) {
+			char *item_varname = (char *)xmalloc(SU_INFOSIZE);
+			snprintf(item_varname, SU_INFOSIZE, "%s.%s%s",
+					(vartype == SU_OUTLET)?"outlet":"outlet.group",
+					"%i", strchr(item_number_ptr, '.'));
+
+			upsdebugx(3, "%s: searching for template\"%s\"", __func__, item_varname);
+			tmp_info_p = su_find_info(item_varname);
+			free(item_varname);
+		}
 
 		/* for an snmp_info_t instance */
 		su_info_p = instantiate_info(tmp_info_p, su_info_p);
@@ -30,10 +30,8 @@
 - add syscontact/location (to all mib.h or centralized?)
 - complete shutdown
 - add enum values to OIDs.
-- optimize network flow by:
-  1) caching OID values (as in usbhid-ups) with timestamping and lifetime
-  2) constructing one big packet (calling snmp_add_null_var
-     for each OID request we made), instead of sending many small packets
+- optimize network flow by caching OID values (as in usbhid-ups) with
+  timestamping and lifetime
 - add support for registration and traps (manager mode)
   => Issue: 1 trap listener for N snmp-ups drivers!
 - complete mib2nut data (add all OID translation to NUT)
@@ -85,6 +83,9 @@
 #define DEFAULT_POLLFREQ          30   /* in seconds */
 #define DEFAULT_NETSNMP_RETRIES   5
 #define DEFAULT_NETSNMP_TIMEOUT   1    /* in seconds */
+#define DEFAULT_GETBATCH          16   /* OIDs per GET request */
+#define GETBATCH_REGROW_WALKS     10   /* good updates before doubling it back */
+#define DEFAULT_PIPELINE          4    /* GET requests in flight */
 
 /* use explicit booleans */
 #ifndef FALSE
@@ -198,6 +199,8 @@ typedef struct {
 #define SU_VAR_TIMEOUT		"snmp_timeout"
 #define SU_VAR_MIBS			"mibs"
 #define SU_VAR_POLLFREQ		"pollfreq"
+#define SU_VAR_GETBATCH		"getbatch"
+#define SU_VAR_PIPELINE		"pipeline"
 /* SNMP v3 related parameters */
 #define SU_VAR_SECLEVEL		"secLevel"
 #define SU_VAR_SECNAME		"secName"
@@ -266,6 +269,7 @@ void su_setinfo(snmp_info_t *su_info_p, const char *value);
 void su_status_set(snmp_info_t *, long value);
 void su_alarm_set(snmp_info_t *, long value);
 snmp_info_t *su_find_info(const char *type);
+snmp_info_t *su_find_info_OID(const char *OID);
 bool_t snmp_ups_walk(int mode);
 bool_t su_ups_get(snmp_info_t *su_info_p);
 
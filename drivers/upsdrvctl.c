@@ -55,6 +55,9 @@ static int	maxretry = 1;
 	/* timer - delay between each restart attempt of the driver(s) */
 static int	retrydelay = 5;
 
+	/* number of drivers started or shut down at the same time */
+static int	maxparallel = 1;
+
 	/* Directory where driver executables live */
 static char	*driverpath = NULL;
 
@@ -84,6 +87,9 @@ void do_upsconf_args(char *upsname, char *var, char *val)
 		if (!strcmp(var, "nowait"))
 			waitfordrivers = 0;
 
+		if (!strcmp(var, "maxparallel"))
+			maxparallel = atoi(val);
+
 		/* ignore anything else - it's probably for main */
 
 		return;
@@ -199,9 +205,37 @@ static void debugcmdline(int level, const char *msg, char *const argv[])
 	upsdebugx(level, "%s", cmdline);
 }
 
-static void forkexec(char *const argv[], const ups_t *ups)
+/* the driver's startup delay, local value if available */
+static int startdelay(const ups_t *ups)
+{
+	if (ups->maxstartdelay != -1)
+		return ups->maxstartdelay;
+
+	return maxstartdelay;
+}
+
+static long ms_since(const struct timeval *start)
+{
+	struct timeval	now;
+
+	get_monotonic_time(&now);
+
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_usec - start->tv_usec) / 1000;
+}
+
+/* seconds on the clock of ms_since(), for the deadlines of run_parallel():
+ * a step of the wall clock must not expire or stall them */
+static time_t mono_time(void)
+{
+	struct timeval	now;
+
+	get_monotonic_time(&now);
+
+	return now.tv_sec;
+}
+
+static pid_t spawn(char *const argv[])
 {
-	int	ret;
 	pid_t	pid;
 
 	pid = fork();
@@ -209,89 +243,103 @@ static void forkexec(char *const argv[], const ups_t *ups)
 	if (pid < 0)
 		fatal_with_errno(EXIT_FAILURE, "fork");
 
-	if (pid != 0) {			/* parent */
-		int	wstat;
-		struct sigaction	sa;
+	if (pid != 0)			/* parent */
+		return pid;
 
-		/* Handle "parallel" drivers startup */
-		if (waitfordrivers == 0) {
-			upsdebugx(2, "'nowait' set, continuing...");
-			return;
-		}
+	/* child */
 
-		sigemptyset(&sa.sa_mask);
-		sa.sa_flags = 0;
-		sa.sa_handler = waitpid_timeout;
-		sigaction(SIGALRM, &sa, NULL);
+	execv(argv[0], argv);
 
-		/* Use the local maxstartdelay, if available */
-		if (ups->maxstartdelay != -1)
-			alarm(ups->maxstartdelay);
-		else /* Otherwise, use the global (or default) value */
-			alarm(maxstartdelay);
+	/* shouldn't get here */
+	fatal_with_errno(EXIT_FAILURE, "execv");
+}
 
-		ret = waitpid(pid, &wstat, 0);
+/* check how the driver went into the background: 0 if fine, -1 if not */
+static int driver_status(const ups_t *ups, int wstat)
+{
+	if (WIFEXITED(wstat) == 0) {
+		upslogx(LOG_WARNING, "Driver for UPS [%s] exited abnormally", ups->upsname);
+		return -1;
+	}
 
-		alarm(0);
+	if (WEXITSTATUS(wstat) != 0) {
+		upslogx(LOG_WARNING, "Driver for UPS [%s] failed to start"
+		" (exit status=%d)", ups->upsname, WEXITSTATUS(wstat));
+		return -1;
+	}
 
-		if (ret == -1) {
-			upslogx(LOG_WARNING, "Startup timer elapsed, continuing...");
-			exec_error++;
-			return;
-		}
+	/* the rest only work when WIFEXITED is nonzero */
 
-		if (WIFEXITED(wstat) == 0) {
-			upslogx(LOG_WARNING, "Driver exited abnormally");
-			exec_error++;
-			return;
-		}
+	if (WIFSIGNALED(wstat)) {
+		upslog_with_errno(LOG_WARNING, "Driver for UPS [%s] died after signal %d",
+			ups->upsname, WTERMSIG(wstat));
+		return -1;
+	}
 
-		if (WEXITSTATUS(wstat) != 0) {
-			upslogx(LOG_WARNING, "Driver failed to start"
-			" (exit status=%d)", WEXITSTATUS(wstat));
-			exec_error++;
-			return;
-		}
+	return 0;
+}
+
+static void forkexec(char *const argv[], const ups_t *ups)
+{
+	int	ret, wstat;
+	pid_t	pid;
+	struct timeval	start;
+	struct sigaction	sa;
 
-		/* the rest only work when WIFEXITED is nonzero */
+	get_monotonic_time(&start);
 
-		if (WIFSIGNALED(wstat)) {
-			upslog_with_errno(LOG_WARNING, "Driver died after signal %d",
-				WTERMSIG(wstat));
-			exec_error++;
-		}
+	pid = spawn(argv);
 
+	/* Handle "parallel" drivers startup */
+	if (waitfordrivers == 0) {
+		upsdebugx(2, "'nowait' set, continuing...");
 		return;
 	}
 
-	/* child */
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	sa.sa_handler = waitpid_timeout;
+	sigaction(SIGALRM, &sa, NULL);
 
-	ret = execv(argv[0], argv);
+	alarm(startdelay(ups));
 
-	/* shouldn't get here */
-	fatal_with_errno(EXIT_FAILURE, "execv");
+	ret = waitpid(pid, &wstat, 0);
+
+	alarm(0);
+
+	if (ret == -1) {
+		upslogx(LOG_WARNING, "Startup timer elapsed, continuing...");
+		exec_error++;
+		return;
+	}
+
+	if (driver_status(ups, wstat) != 0) {
+		exec_error++;
+		return;
+	}
+
+	upsdebugx(1, "UPS [%s]: driver done in %ld ms", ups->upsname, ms_since(&start));
 }
 
-static void start_driver(const ups_t *ups)
+/* fill argv (9 entries) to start the driver, or to shut the UPS down */
+static void driver_argv(const ups_t *ups, int shutdown, char *dfn, size_t dfnlen,
+	char **argv)
 {
-	char	*argv[8];
-	char	dfn[SMALLBUF];
-	int	ret, arg = 0;
-	int	initial_exec_error = exec_error, drv_maxretry = maxretry;
+	int	arg = 0;
 	struct stat	fs;
 
-	upsdebugx(1, "Starting UPS: %s", ups->upsname);
-
-	snprintf(dfn, sizeof(dfn), "%s/%s", driverpath, ups->driver);
-	ret = stat(dfn, &fs);
+	snprintf(dfn, dfnlen, "%s/%s", driverpath, ups->driver);
 
-	if (ret < 0)
+	if ((!shutdown) && (stat(dfn, &fs) < 0))
 		fatal_with_errno(EXIT_FAILURE, "Can't start %s", dfn);
 
 	argv[arg++] = dfn;
 	argv[arg++] = (char *)"-a";		/* FIXME: cast away const */
 	argv[arg++] = ups->upsname;
 
+	if (shutdown)
+		argv[arg++] = (char *)"-k";	/* FIXME: cast away const */
+
 	/* stick on the chroot / user args if given to us */
 	if (pt_root) {
 		argv[arg++] = (char *)"-r";	/* FIXME: cast away const */
@@ -305,7 +353,17 @@ static void start_driver(const ups_t *ups)
 
 	/* tie it off */
 	argv[arg++] = NULL;
+}
+
+static void start_driver(const ups_t *ups)
+{
+	char	*argv[9];
+	char	dfn[SMALLBUF];
+	int	initial_exec_error = exec_error, drv_maxretry = maxretry;
+
+	upsdebugx(1, "Starting UPS: %s", ups->upsname);
 
+	driver_argv(ups, 0, dfn, sizeof(dfn), argv);
 
 	while (drv_maxretry > 0) {
 		int cur_exec_error = exec_error;
@@ -358,29 +416,10 @@ static void shutdown_driver(const ups_t *ups)
 {
 	char	*argv[9];
 	char	dfn[SMALLBUF];
-	int	arg = 0;
 
 	upsdebugx(1, "Shutdown UPS: %s", ups->upsname);
 
-	snprintf(dfn, sizeof(dfn), "%s/%s", driverpath, ups->driver);
-
-	argv[arg++] = dfn;
-	argv[arg++] = (char *)"-a";		/* FIXME: cast away const */
-	argv[arg++] = ups->upsname;
-	argv[arg++] = (char *)"-k";		/* FIXME: cast away const */
-
-	/* stick on the chroot / user args if given to us */
-	if (pt_root) {
-		argv[arg++] = (char *)"-r";	/* FIXME: cast away const */
-		argv[arg++] = pt_root;
-	}
-
-	if (pt_user) {
-		argv[arg++] = (char *)"-u";	/* FIXME: cast away const */
-		argv[arg++] = pt_user;
-	}
-
-	argv[arg++] = NULL;
+	driver_argv(ups, 1, dfn, sizeof(dfn), argv);
 
 	debugcmdline(2, "exec: ", argv);
 
@@ -408,6 +447,201 @@ static void send_one_driver(void (*command)(const ups_t *), const char *upsname)
 	fatalx(EXIT_FAILURE, "UPS %s not found in ups.conf", upsname);
 }
 
+/* a driver being started or shut down in parallel mode */
+typedef struct {
+	const ups_t	*ups;
+	pid_t	pid;		/* running attempt, 0 if none */
+	int	attempts;	/* attempts left */
+	time_t	when;		/* deadline of the running attempt, or time of the next one (mono_time()) */
+	struct timeval	start;
+	int	done;
+}	job_t;
+
+/* an attempt failed: plan the next one, or give up */
+static void job_failed(job_t *job, time_t now, size_t *left)
+{
+	if (job->attempts > 0) {
+		job->when = now + retrydelay;
+		return;
+	}
+
+	exec_error++;
+	job->done = 1;
+	(*left)--;
+}
+
+/* run up to maxparallel drivers at a time, each with its own
+ * maxstartdelay deadline and maxretry attempts */
+static void run_parallel(const ups_t **list, size_t count, int shutdown)
+{
+	job_t	*jobs, *job;
+	char	*argv[9];
+	char	dfn[SMALLBUF];
+	size_t	i, left = count;
+	int	running = 0, wstat;
+	time_t	now, wake;
+	pid_t	pid;
+	struct sigaction	sa;
+
+	if (count == 0)
+		return;
+
+	jobs = xcalloc(count, sizeof(*jobs));
+
+	for (i = 0; i < count; i++) {
+		jobs[i].ups = list[i];
+		jobs[i].attempts = shutdown ? 1 : maxretry;
+	}
+
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	sa.sa_handler = waitpid_timeout;
+	sigaction(SIGALRM, &sa, NULL);
+
+	while (left > 0) {
+		now = mono_time();
+
+		for (i = 0; (i < count) && (running < maxparallel); i++) {
+			job = &jobs[i];
+
+			if ((job->done) || (job->pid) || (job->when > now))
+				continue;
+
+			upsdebugx(1, "%s UPS: %s", shutdown ? "Shutdown" : "Starting",
+				job->ups->upsname);
+
+			driver_argv(job->ups, shutdown, dfn, sizeof(dfn), argv);
+
+			upsdebugx(2, "%i remaining attempts", job->attempts);
+			debugcmdline(2, "exec: ", argv);
+			job->attempts--;
+
+			if (testmode) {
+				job->done = 1;
+				left--;
+				continue;
+			}
+
+			get_monotonic_time(&job->start);
+			job->pid = spawn(argv);
+			job->when = now + startdelay(job->ups);
+			running++;
+		}
+
+		if (left == 0)
+			break;
+
+		/* next deadline or retry */
+		wake = 0;
+
+		for (i = 0; i < count; i++) {
+			job = &jobs[i];
+
+			if ((job->done) || ((!job->pid) && (job->when <= now)))
+				continue;
+
+			if ((!wake) || (job->when < wake))
+				wake = job->when;
+		}
+
+		if (running == 0) {
+			/* only retries are left, all of them later */
+			if (wake > now)
+				sleep((unsigned int)(wake - now));
+			continue;
+		}
+
+		alarm((wake > now) ? (unsigned int)(wake - now) : 1);
+
+		pid = waitpid(-1, &wstat, 0);
+
+		alarm(0);
+		now = mono_time();
+
+		if (pid > 0) {
+			for (i = 0; i < count; i++) {
+				if (jobs[i].pid == pid)
+					break;
+			}
+
+			/* an attempt given up on earlier */
+			if (i == count)
+				continue;
+
+			job = &jobs[i];
+			job->pid = 0;
+			running--;
+
+			if (driver_status(job->ups, wstat) != 0) {
+				job_failed(job, now, &left);
+				continue;
+			}
+
+			upsdebugx(1, "UPS [%s]: driver done in %ld ms", job->ups->upsname,
+				ms_since(&job->start));
+
+			job->done = 1;
+			left--;
+			continue;
+		}
+
+		/* timer elapsed: leave the late ones running, like one at a time */
+		for (i = 0; i < count; i++) {
+			job = &jobs[i];
+
+			if ((!job->pid) || (job->when > now))
+				continue;
+
+			upslogx(LOG_WARNING, "Startup timer elapsed for UPS [%s], continuing...",
+				job->ups->upsname);
+
+			job->pid = 0;
+			running--;
+			job_failed(job, now, &left);
+		}
+	}
+
+	free(jobs);
+}
+
+/* parallel mode: all drivers at once, or one sdorder group after another */
+static void send_all_parallel(void (*command)(const ups_t *))
+{
+	const ups_t	**list;
+	ups_t	*ups;
+	size_t	count = 0;
+	int	i;
+
+	for (ups = upstable; ups; ups = ups->next)
+		count++;
+
+	list = xcalloc(count, sizeof(*list));
+
+	if (command != &shutdown_driver) {
+		count = 0;
+
+		for (ups = upstable; ups; ups = ups->next)
+			list[count++] = ups;
+
+		run_parallel(list, count, 0);
+		free(list);
+		return;
+	}
+
+	for (i = 0; i <= maxsdorder; i++) {
+		count = 0;
+
+		for (ups = upstable; ups; ups = ups->next) {
+			if (ups->sdorder == i)
+				list[count++] = ups;
+		}
+
+		run_parallel(list, count, 1);
+	}
+
+	free(list);
+}
+
 /* walk UPS table and send command to all UPSes according to sdorder */
 static void send_all_drivers(void (*command)(const ups_t *))
 {
@@ -417,6 +651,12 @@ static void send_all_drivers(void (*command)(const ups_t *))
 	if (!upstable)
 		fatalx(EXIT_FAILURE, "Error: no UPS definitions found in ups.conf");
 
+	/* stopping only sends signals, and nowait does not wait anyway */
+	if ((maxparallel > 1) && (waitfordrivers) && (command != &stop_driver)) {
+		send_all_parallel(command);
+		return;
+	}
+
 	if (command != &shutdown_driver) {
 		ups = upstable;
 
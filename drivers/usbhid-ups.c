@@ -28,13 +28,14 @@
  */
 
 #define DRIVER_NAME	"Generic HID driver"
-#define DRIVER_VERSION		"0.43"
+#define DRIVER_VERSION		"0.46"
 
 #include "main.h"
 #include "libhid.h"
 #include "usbhid-ups.h"
 #include "hidparser.h"
 #include "hidtypes.h"
+#include "lkpindex.h"
 
 /* include all known subdrivers */
 #include "mge-hid.h"
@@ -1021,6 +1022,7 @@ void upsdrv_cleanup(void)
 	comm_driver->close(udev);
 	Free_ReportDesc(pDesc);
 	free_report_buffer(reportbuf);
+	lkpindex_free();
 #ifndef SHUT_MODE
 	USBFreeExactMatcher(exact_matcher);
 	USBFreeRegexMatcher(regex_matcher);
@@ -1082,6 +1084,7 @@ static int callback(hid_dev_handle_t argudev, HIDDevice_t *arghd, unsigned char
 {
 	int i;
 	const char *mfr = NULL, *model = NULL, *serial = NULL;
+	HIDDesc_t *oldDesc;
 #ifndef SHUT_MODE
 	int ret;
 #endif
@@ -1093,19 +1096,39 @@ static int callback(hid_dev_handle_t argudev, HIDDevice_t *arghd, unsigned char
 	udev = argudev;
 
 	/* Parse Report Descriptor */
-	Free_ReportDesc(pDesc);
+	oldDesc = pDesc;
 	pDesc = Parse_ReportDesc(rdbuf, rdlen);
 	if (!pDesc) {
 		upsdebug_with_errno(1, "Failed to parse report descriptor!");
+		Free_ReportDesc(oldDesc);
 		return 0;
 	}
 
+	/* Reconnecting: move the NUT-to-HID mapping to the new descriptor
+	 * (of the same device), which hid_ups_walk() then keeps */
+	if (oldDesc && subdriver) {
+		hid_info_t	*item;
+
+		for (item = subdriver->hid2nut; item->info_type != NULL; item++) {
+			size_t	pos;
+
+			if (item->hiddata == NULL)
+				continue;
+
+			pos = (size_t)(item->hiddata - oldDesc->item);
+			item->hiddata = (pos < (size_t)pDesc->nitems) ? &pDesc->item[pos] : NULL;
+		}
+	}
+
+	Free_ReportDesc(oldDesc);
+
 	/* prepare report buffer */
 	free_report_buffer(reportbuf);
 	reportbuf = new_report_buffer(pDesc);
 	if (!reportbuf) {
 		upsdebug_with_errno(1, "Failed to allocate report buffer!");
 		Free_ReportDesc(pDesc);
+		pDesc = NULL;
 		return 0;
 	}
 
@@ -1183,21 +1206,87 @@ static double interval(void)
 }
 #endif
 
-/* walk ups variables and set elements of the info array. */
-static bool_t hid_ups_walk(walkmode_t mode)
+/* whether an update walk (not the init one) reads this item */
+static bool_t hu_walk_wants(const hid_info_t *item, walkmode_t mode)
 {
-	hid_info_t	*item;
-	double		value;
-	int		retcode;
+	if (mode == HU_WALKMODE_QUICK_UPDATE) {
+		/* Quick update only deals with status and alarms! */
+		return (item->hidflags & HU_FLAG_QUICK_POLL) ? TRUE : FALSE;
+	}
+
+	/* These don't need polling after initinfo() */
+	if (item->hidflags & (HU_FLAG_ABSENT | HU_TYPE_CMD | HU_FLAG_STATIC))
+		return FALSE;
+
+	/* These need to be polled after user changes (setvar / instcmd) */
+	if ( (item->hidflags & HU_FLAG_SEMI_STATIC) && (data_has_changed == FALSE) )
+		return FALSE;
 
+	return TRUE;
+}
+
+/* whether the report of this HID data must not be read */
+static bool_t hu_report_skipped(const HIDData_t *hiddata)
+{
 #ifndef SHUT_MODE
 	/* extract the VendorId for further testing */
 	int vendorID = usb_device((struct usb_dev_handle *)udev)->descriptor.idVendor;
 	int productID = usb_device((struct usb_dev_handle *)udev)->descriptor.idProduct;
+
+	/* skip report 0x54 for Tripplite SU3000LCD2UHV due to firmware bug */
+	if ((vendorID == 0x09ae) && (productID == 0x1330)) {
+		if (hiddata && (hiddata->ReportID == 0x54)) {
+			return TRUE;
+		}
+	}
+#else
+	NUT_UNUSED_VARIABLE(hiddata);
 #endif
+	return FALSE;
+}
+
+/* walk ups variables and set elements of the info array. */
+static bool_t hid_ups_walk(walkmode_t mode)
+{
+	hid_info_t	*item;
+	double		value;
+	int		retcode;
+	unsigned long	requests = report_requests;
+	bool_t		prefetched[256];	/* reports read ahead for this walk... */
+	int		report_status[256];	/* ...and what reading them returned */
 
 	/* 3 modes: HU_WALKMODE_INIT, HU_WALKMODE_QUICK_UPDATE and HU_WALKMODE_FULL_UPDATE */
 
+	/* Update walks first read each of the reports they need once, then
+	 * decode all their items from these; the init walk, which finds
+	 * out which items exist, reads them as it goes */
+	memset(prefetched, 0, sizeof(prefetched));
+
+	if (mode != HU_WALKMODE_INIT) {
+		int	ids[256], status[256], count = 0, i, id;
+
+		for (item = subdriver->hid2nut; item->info_type != NULL; item++) {
+
+			if ((item->hiddata == NULL) || !hu_walk_wants(item, mode) || hu_report_skipped(item->hiddata))
+				continue;
+
+			id = item->hiddata->ReportID;
+			if (prefetched[id])
+				continue;
+
+			prefetched[id] = TRUE;
+			ids[count++] = id;
+		}
+
+		i = HIDGetReports(udev, ids, status, count, poll_interval);
+		upsdebugx(2, "%s: %d of %d reports read with %lu requests", __func__,
+			i, count, report_requests - requests);
+
+		for (i = 0; i < count; i++) {
+			report_status[ids[i]] = status[i];
+		}
+	}
+
 	/* Device data walk ----------------------------- */
 	for (item = subdriver->hid2nut; item->info_type != NULL; item++) {
 
@@ -1255,19 +1344,8 @@ static bool_t hid_ups_walk(walkmode_t mode)
 			continue;
 
 		case HU_WALKMODE_QUICK_UPDATE:
-			/* Quick update only deals with status and alarms! */
-			if (!(item->hidflags & HU_FLAG_QUICK_POLL))
-				continue;
-
-			break;
-
 		case HU_WALKMODE_FULL_UPDATE:
-			/* These don't need polling after initinfo() */
-			if (item->hidflags & (HU_FLAG_ABSENT | HU_TYPE_CMD | HU_FLAG_STATIC))
-				continue;
-
-			/* These need to be polled after user changes (setvar / instcmd) */
-			if ( (item->hidflags & HU_FLAG_SEMI_STATIC) && (data_has_changed == FALSE) )
+			if (!hu_walk_wants(item, mode))
 				continue;
 
 			break;
@@ -1287,16 +1365,23 @@ static bool_t hid_ups_walk(walkmode_t mode)
 # pragma GCC diagnostic pop
 #endif
 
-#ifndef SHUT_MODE
-		/* skip report 0x54 for Tripplite SU3000LCD2UHV due to firmware bug */
-		if ((vendorID == 0x09ae) && (productID == 0x1330)) {
-			if (item->hiddata && (item->hiddata->ReportID == 0x54)) {
-				continue;
-			}
+		/* Point HID data back to the first of its NUT variables,
+		 * for find_hid_info(), which server side ones never are
+		 * (they still get here on reconnect) */
+		if ((mode == HU_WALKMODE_INIT) && !(item->hidflags & HU_FLAG_ABSENT)) {
+			ClaimObject(item->hiddata, item);
 		}
-#endif
 
-		retcode = HIDGetDataValue(udev, item->hiddata, &value, poll_interval);
+		if (hu_report_skipped(item->hiddata))
+			continue;
+
+		if (item->hiddata && prefetched[item->hiddata->ReportID]) {
+			retcode = report_status[item->hiddata->ReportID];
+			if (retcode == 1)
+				retcode = HIDGetBufferedValue(item->hiddata, &value);
+		} else {
+			retcode = HIDGetDataValue(udev, item->hiddata, &value, poll_interval);
+		}
 
 		switch (retcode)
 		{
@@ -1373,6 +1458,8 @@ static bool_t hid_ups_walk(walkmode_t mode)
 		}
 	}
 
+	dstate_setinfo("driver.hid.requests", "%lu", report_requests - requests);
+
 	return TRUE;
 }
 
@@ -1517,24 +1604,27 @@ static hid_info_t *find_nut_info(const char *varname)
  */
 static hid_info_t *find_hid_info(const HIDData_t *hiddata)
 {
-	hid_info_t *hidups_item;
-
 	if(!hiddata) {
 		upsdebugx(2, "%s: hiddata == NULL", __func__);
 		return NULL;
 	}
 
-	for (hidups_item = subdriver->hid2nut; hidups_item->info_type != NULL ; hidups_item++) {
+	/* set by hid_ups_walk() on the HID data it uses */
+	return hiddata->owner;
+}
 
-		/* Skip server side vars */
-		if (hidups_item->hidflags & HU_FLAG_ABSENT)
-			continue;
+/* lookup tables end with a NULL NUT value */
+static int hu_lkp_entry(const void *table, size_t i, long *value, const char **nut_value)
+{
+	const info_lkp_t	*info_lkp = (const info_lkp_t *)table + i;
 
-		if (hidups_item->hiddata == hiddata)
-			return hidups_item;
+	if (info_lkp->nut_value == NULL) {
+		return 0;
 	}
 
-	return NULL;
+	*value = info_lkp->hid_value;
+	*nut_value = info_lkp->nut_value;
+	return 1;
 }
 
 /* find the HID Item value matching that NUT value */
@@ -1542,6 +1632,7 @@ static hid_info_t *find_hid_info(const HIDData_t *hiddata)
 static long hu_find_valinfo(info_lkp_t *hid2info, const char* value)
 {
 	info_lkp_t	*info_lkp;
+	ssize_t	pos;
 
 	/* if a conversion function is defined, use 'value' as argument for it */
 	if (hid2info->nuf != NULL) {
@@ -1551,11 +1642,12 @@ static long hu_find_valinfo(info_lkp_t *hid2info, const char* value)
 		return hid_value;
 	}
 
-	for (info_lkp = hid2info; info_lkp->nut_value != NULL; info_lkp++) {
-		if (!(strcmp(info_lkp->nut_value, value))) {
-			upsdebugx(5, "hu_find_valinfo: found %s (value: %ld)", info_lkp->nut_value, info_lkp->hid_value);
-			return info_lkp->hid_value;
-		}
+	pos = lkpindex_find_nut_value(lkpindex_get(hid2info, hu_lkp_entry), value);
+
+	if (pos >= 0) {
+		info_lkp = &hid2info[pos];
+		upsdebugx(5, "hu_find_valinfo: found %s (value: %ld)", info_lkp->nut_value, info_lkp->hid_value);
+		return info_lkp->hid_value;
 	}
 
 	upsdebugx(3, "hu_find_valinfo: no matching HID value for this INFO_* value (%s)", value);
@@ -1566,6 +1658,7 @@ static long hu_find_valinfo(info_lkp_t *hid2info, const char* value)
 static const char *hu_find_infoval(info_lkp_t *hid2info, const double value)
 {
 	info_lkp_t	*info_lkp;
+	ssize_t	pos;
 
 	/* if a conversion function is defined, use 'value' as argument for it */
 	if (hid2info->fun != NULL) {
@@ -1573,11 +1666,12 @@ static const char *hu_find_infoval(info_lkp_t *hid2info, const double value)
 	}
 
 	/* use 'value' as an index for a lookup in an array */
-	for (info_lkp = hid2info; info_lkp->nut_value != NULL; info_lkp++) {
-		if (info_lkp->hid_value == (long)value) {
-			upsdebugx(5, "hu_find_infoval: found %s (value: %ld)", info_lkp->nut_value, (long)value);
-			return info_lkp->nut_value;
-		}
+	pos = lkpindex_find_value(lkpindex_get(hid2info, hu_lkp_entry), (long)value);
+
+	if (pos >= 0) {
+		info_lkp = &hid2info[pos];
+		upsdebugx(5, "hu_find_infoval: found %s (value: %ld)", info_lkp->nut_value, (long)value);
+		return info_lkp->nut_value;
 	}
 
 	upsdebugx(3, "hu_find_infoval: no matching INFO_* value for this HID value (%g)", value);
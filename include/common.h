@@ -140,6 +140,9 @@ char *xstrdup(const char *string);
 ssize_t select_read(const int fd, void *buf, const size_t buflen, const long d_sec, const long d_usec);
 ssize_t select_write(const int fd, const void *buf, const size_t buflen, const long d_sec, const long d_usec);
 
+/* current time of a clock that is not affected by setting the system time */
+void get_monotonic_time(struct timeval *tv);
+
 char * get_libname(const char* base_libname);
 
 /* Buffer sizes used for various functions */
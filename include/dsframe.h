@@ -0,0 +1,103 @@
+/* dsframe.h - binary framing for the driver to server socket protocol
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef NUT_DSFRAME_H_SEEN
+#define NUT_DSFRAME_H_SEEN 1
+
+#ifdef __cplusplus
+/* *INDENT-OFF* */
+extern "C" {
+/* *INDENT-ON* */
+#endif
+
+/* A frame is a 4 byte big-endian payload length followed by records:
+
+	<op:1> <argc:1> [<varid:2>] argc * (<len:2> <bytes:len> <NUL>)
+
+   The variable id is only present for the operations that act on a
+   variable; ids are assigned by the driver and announced once with
+   DSF_DEFVAR before their first use on a connection.
+   See docs/sock-protocol.txt for the negotiation. */
+
+#define DSFRAME_HDRLEN	4
+#define DSFRAME_MAXLEN	(1024 * 1024)	/* sanity limit on one frame */
+#define DSFRAME_FLUSH	16384		/* send a frame once it grows past this */
+#define DSFRAME_MAXARGS	8
+#define DSFRAME_MAXVARID	0xffff
+
+typedef enum {
+	DSF_DEFVAR = 1,	/* <varid> <varname> */
+	DSF_SETINFO,	/* <varid> <value> */
+	DSF_DELINFO,	/* <varid> */
+	DSF_ADDENUM,	/* <varid> <value> */
+	DSF_DELENUM,	/* <varid> <value> */
+	DSF_ADDRANGE,	/* <varid> <min> <max> */
+	DSF_DELRANGE,	/* <varid> <min> <max> */
+	DSF_SETAUX,	/* <varid> <aux> */
+	DSF_SETFLAGS,	/* <varid> <flag>... */
+	DSF_ADDCMD,	/* <cmdname> */
+	DSF_DELCMD,	/* <cmdname> */
+	DSF_DATAOK,
+	DSF_DATASTALE,
+	DSF_DUMPDONE,
+	DSF_PONG,
+	DSF_TRACKING,	/* <id> <status> */
+
+	DSF_COUNT
+} dsframe_op_t;
+
+#define DSFRAME_HAS_VAR(op)	(((op) >= DSF_DEFVAR) && ((op) < DSF_ADDCMD))
+
+/* an outgoing frame being built */
+typedef struct {
+	unsigned char	*buf;
+	size_t	len;		/* header included */
+	size_t	size;
+} dsframe_t;
+
+/* one decoded record; strings point into the frame */
+typedef struct {
+	int	op;
+	unsigned int	varid;
+	size_t	argc;
+	char	*argv[DSFRAME_MAXARGS];
+} dsframe_rec_t;
+
+/* text protocol name of an operation */
+const char *dsframe_opname(int op);
+
+void dsframe_init(dsframe_t *frame);
+void dsframe_free(dsframe_t *frame);
+int dsframe_add(dsframe_t *frame, int op, unsigned int varid, size_t argc, const char **argv);
+int dsframe_pending(const dsframe_t *frame);
+size_t dsframe_seal(dsframe_t *frame);
+void dsframe_reset(dsframe_t *frame);
+
+/* size of the frame starting at buf, header included, as soon as the
+ * header is there: 0 if it isn't yet, -1 if the length is invalid */
+long dsframe_length(const unsigned char *buf, size_t len);
+
+/* fetch the record at *pos of a payload: 1 if found, 0 at the end, -1 if malformed */
+int dsframe_next(unsigned char *payload, size_t len, size_t *pos, dsframe_rec_t *rec);
+
+#ifdef __cplusplus
+/* *INDENT-OFF* */
+}
+/* *INDENT-ON* */
+#endif
+
+#endif	/* NUT_DSFRAME_H_SEEN */
@@ -41,13 +41,14 @@ typedef struct {
 	int	ch;			/* last character read		*/
 
 	char	**arglist;		/* array of pointers to words	*/
-	size_t	*argsize;		/* list of sizes for realloc	*/
+	size_t	*argofs;		/* where each word is in wordbuf */
 	size_t	numargs;		/* max usable in arglist	*/
 	size_t	maxargs;		/* for reallocing arglist	*/
 
-	char	*wordbuf;		/* accumulator for current word	*/
+	char	*wordbuf;		/* the words of the current line */
 	char	*wordptr;		/* where next char goes in word	*/
 	size_t	wordbufsize;		/* for reallocing wordbuf	*/
+	size_t	wordstart;		/* where the current word began	*/
 
 	int	linenum;		/* for good error reporting	*/
 	int	error;			/* set when an error occurred	*/
@@ -71,6 +72,7 @@ int pconf_line(PCONF_CTX_t *ctx, const char *line);
 void pconf_finish(PCONF_CTX_t *ctx);
 char *pconf_encode(const char *src, char *dest, size_t destsize);
 int pconf_char(PCONF_CTX_t *ctx, char ch);
+int pconf_buf(PCONF_CTX_t *ctx, const char *buf, size_t buflen, size_t *used);
 
 #ifdef __cplusplus
 /* *INDENT-OFF* */
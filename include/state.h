@@ -32,8 +32,13 @@ extern "C" {
 
 #define ST_SOCK_BUF_LEN 512
 
+/* The variable tree is kept height-balanced (AVL), ordered by the
+ * case-folded variable name, so lookups stay O(log n) even when the
+ * driver publishes its variables in sorted order. An in-order walk of
+ * left/right still yields the variables sorted as strcasecmp would. */
 typedef struct st_tree_s {
 	char	*var;
+	char	*key;			/* lowercase copy of var, for ordering */
 	char	*val;			/* points to raw or safe */
 
 	char	*raw;			/* raw data from caller */
@@ -50,6 +55,7 @@ typedef struct st_tree_s {
 
 	struct st_tree_s	*left;
 	struct st_tree_s	*right;
+	int	height;			/* of the subtree rooted here */
 } st_tree_t;
 
 int state_setinfo(st_tree_t **nptr, const char *var, const char *val);
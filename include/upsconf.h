@@ -29,6 +29,10 @@ extern "C" {
 /* *INDENT-ON* */
 #endif
 
+/* upper bound of "devices", the devices that dummy-ups publishes and upsd
+ * serves besides the one of the section */
+#define UPSCONF_MAX_DEVICES	10000
+
 /* callback function from read_upsconf */
 void do_upsconf_args(char *upsname, char *var, char *val);
 
@@ -23,6 +23,7 @@
 #include "sstate.h"
 #include "user.h"
 #include "netssl.h"
+#include "upsindex.h"
 #include <ctype.h>
 
 static ups_t	*upstable = NULL;
@@ -33,11 +34,9 @@ static void ups_create(const char *fn, const char *name, const char *desc)
 {
 	upstype_t	*temp;
 
-	for (temp = firstups; temp != NULL; temp = temp->next) {
-		if (!strcasecmp(temp->name, name)) {
-			upslogx(LOG_ERR, "UPS name [%s] is already in use!", name);
-			return;
-		}
+	if (get_ups_ptr(name)) {
+		upslogx(LOG_ERR, "UPS name [%s] is already in use!", name);
+		return;
 	}
 
 	/* grab some memory and add the info */
@@ -58,6 +57,7 @@ static void ups_create(const char *fn, const char *name, const char *desc)
 
 	temp->next = firstups;
 	firstups = temp;
+	upsindex_add(temp);
 	num_ups++;
 }
 
@@ -87,12 +87,7 @@ static void ups_update(const char *fn, const char *name, const char *desc)
 		upslogx(LOG_NOTICE, "Redefined UPS [%s]", name);
 
 		/* release all data */
-		sstate_infofree(temp);
-		sstate_cmdfree(temp);
-		pconf_finish(&temp->sock_ctx);
-
-		close(temp->sock_fd);
-		temp->sock_fd = -1;
+		sstate_disconnect(temp);
 		temp->dumpdone = 0;
 
 		/* now redefine the filename and wrap up */
@@ -176,6 +171,20 @@ static int parse_upsd_conf_args(size_t numargs, char **arg)
 		}
 	}
 
+	/* DRIVERPROTOCOL <text|binary> */
+	if (!strcmp(arg[0], "DRIVERPROTOCOL")) {
+		if (!strcasecmp(arg[1], "binary")) {
+			driver_binary = 1;
+			return 1;
+		}
+		if (!strcasecmp(arg[1], "text")) {
+			driver_binary = 0;
+			return 1;
+		}
+		upslogx(LOG_ERR, "DRIVERPROTOCOL has unknown value (%s)!", arg[1]);
+		return 0;
+	}
+
 	/* STATEPATH <dir> */
 	if (!strcmp(arg[0], "STATEPATH")) {
 		free(statepath);
@@ -244,6 +253,12 @@ static int parse_upsd_conf_args(size_t numargs, char **arg)
 	if (numargs < 3)
 		return 0;
 
+	/* METRICS <address> <port> */
+	if (!strcmp(arg[0], "METRICS")) {
+		metrics_listen_add(arg[1], arg[2]);
+		return 1;
+	}
+
 	/* ACL <aclname> <ip block> */
 	if (!strcmp(arg[0], "ACL")) {
 		upslogx(LOG_WARNING, "ACL in upsd.conf is no longer supported - switch to LISTEN");
@@ -355,14 +370,43 @@ void do_upsconf_args(char *upsname, char *var, char *val)
 	} else if (!strcmp(var, "desc")) {
 		free(temp->desc);
 		temp->desc = xstrdup(val);
+	} else if (!strcmp(var, "devices")) {
+		char	*end;
+		long	devices;
+
+		devices = strtol(val, &end, 10);
+
+		/* dummy-ups refuses these, there are no such devices */
+		if ((end == val) || (*end != '\0') || (devices < 0) || (devices > UPSCONF_MAX_DEVICES)) {
+			upslogx(LOG_WARNING, "Ignoring invalid devices value [%s] for UPS [%s] (expected 0 to %d)",
+				val, temp->upsname, UPSCONF_MAX_DEVICES);
+			devices = 0;
+		}
+
+		temp->devices = (int)devices;
 	}
 }
 
+/* add or update one UPS served by a driver */
+static void upsconf_add_one(int reloading, const char *driver, const char *upsname, const char *desc)
+{
+	char	statefn[SMALLBUF];
+
+	snprintf(statefn, sizeof(statefn), "%s-%s", driver, upsname);
+
+	/* if a UPS exists, update it, else add it as new */
+	if ((reloading) && (get_ups_ptr(upsname) != NULL))
+		ups_update(statefn, upsname, desc);
+	else
+		ups_create(statefn, upsname, desc);
+}
+
 /* add valid UPSes from ups.conf to the internal structures */
 void upsconf_add(int reloading)
 {
 	ups_t	*tmp = upstable, *next;
-	char	statefn[SMALLBUF];
+	char	name[SMALLBUF];
+	int	i;
 
 	if (!tmp) {
 		upslogx(LOG_WARNING, "Warning: no UPS definitions in ups.conf");
@@ -385,14 +429,21 @@ void upsconf_add(int reloading)
 			upslogx(LOG_WARNING, "Warning: ignoring incomplete configuration for UPS [%s]\n",
 				tmp->upsname);
 		} else {
-			snprintf(statefn, sizeof(statefn), "%s-%s",
-				tmp->driver, tmp->upsname);
+			upsconf_add_one(reloading, tmp->driver, tmp->upsname, tmp->desc);
+
+			/* only dummy-ups publishes more devices, the others would
+			 * leave these entries without a driver forever */
+			if ((tmp->devices > 0) && (strcmp(tmp->driver, "dummy-ups"))) {
+				upslogx(LOG_WARNING, "Ignoring devices for UPS [%s], driver %s does not support it",
+					tmp->upsname, tmp->driver);
+				tmp->devices = 0;
+			}
 
-			/* if a UPS exists, update it, else add it as new */
-			if ((reloading) && (get_ups_ptr(tmp->upsname) != NULL))
-				ups_update(statefn, tmp->upsname, tmp->desc);
-			else
-				ups_create(statefn, tmp->upsname, tmp->desc);
+			/* <upsname>-1 to <upsname>-<devices>, see dummy-ups */
+			for (i = 1; i <= tmp->devices; i++) {
+				snprintf(name, sizeof(name), "%s-%d", tmp->upsname, i);
+				upsconf_add_one(reloading, tmp->driver, name, tmp->desc);
+			}
 		}
 
 		/* free tmp's resources */
@@ -433,8 +484,14 @@ static void delete_ups(upstype_t *target)
 			else
 				last->next = ptr->next;
 
-			if (ptr->sock_fd != -1)
+			upsindex_del(ptr);
+
+			evtimer_del(&ptr->check_timer);
+
+			if (ptr->sock_fd != -1) {
+				evloop_del(ptr->sock_fd);
 				close(ptr->sock_fd);
+			}
 
 			/* release memory */
 			sstate_infofree(ptr);
@@ -43,6 +43,7 @@ typedef struct ups_s {
 	char	*driver;
 	char	*port;
 	char	*desc;
+	int	devices;	/* more devices served by the driver */
 	struct ups_s	*next;
 } ups_t;
 
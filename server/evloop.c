@@ -0,0 +1,479 @@
+/* evloop.c - persistent socket readiness set and timer wheel for upsd
+
+   The readiness set keeps every driver, client and listening socket
+   registered from the time it is opened until it is closed, instead of
+   rebuilding a pollfd array on every pass. On Linux it is backed by
+   epoll, so a wakeup only costs work for the sockets that are ready;
+   elsewhere (or if epoll is unavailable at runtime) a persistent pollfd
+   array is maintained incrementally.
+
+   The timer wheel holds the per-driver staleness checks and the
+   per-client inactivity deadlines, so that idle connections are not
+   looked at until their deadline comes up.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "common.h"
+#include "evloop.h"
+
+#include <poll.h>
+
+#if (defined HAVE_SYS_EPOLL_H) && (defined HAVE_EPOLL_CREATE1)
+#include <sys/epoll.h>
+#define USE_EPOLL 1
+#endif
+
+/* number of one-second slots in the timer wheel; timers further out
+ * than this simply stay in their slot for more than one turn */
+#define EVTIMER_SLOTS	64
+
+/* extra list of timers that are due and about to fire */
+#define EVTIMER_DUE	EVTIMER_SLOTS
+
+typedef struct {
+	int	fd;
+	int	revents;
+} evready_t;
+
+	/* registered sockets and the poll events wanted, indexed by fd */
+static handler_t	*handlers = NULL;
+static int	*fdevents = NULL;
+static int	handlers_size = 0;
+static int	registered = 0;
+
+	/* poll() backend: persistent array and the position of each fd in it */
+static struct pollfd	*pfds = NULL;
+static int	*pfds_pos = NULL;
+static int	pfds_used = 0, pfds_size = 0;
+
+#ifdef USE_EPOLL
+static int	epfd = -1;
+static struct epoll_event	*epevents = NULL;
+static int	epevents_size = 0;
+#endif
+
+	/* events returned by the last evloop_wait() */
+static evready_t	*ready = NULL;
+static int	ready_count = 0, ready_pos = 0, ready_size = 0;
+
+	/* timer wheel */
+static evtimer_t	*wheel[EVTIMER_SLOTS + 1];
+static time_t	wheel_now = 0;
+
+static void handlers_grow(int fd)
+{
+	int	i, size = handlers_size;
+
+	if (fd < handlers_size) {
+		return;
+	}
+
+	while (size <= fd) {
+		size = size ? size * 2 : 64;
+	}
+
+	handlers = xrealloc(handlers, size * sizeof(*handlers));
+	fdevents = xrealloc(fdevents, size * sizeof(*fdevents));
+	pfds_pos = xrealloc(pfds_pos, size * sizeof(*pfds_pos));
+
+	for (i = handlers_size; i < size; i++) {
+		handlers[i].type = 0;
+		handlers[i].data = NULL;
+		fdevents[i] = 0;
+		pfds_pos[i] = -1;
+	}
+
+	handlers_size = size;
+}
+
+static void ready_add(int fd, int revents)
+{
+	if (ready_count >= ready_size) {
+		ready_size = ready_size ? ready_size * 2 : 64;
+		ready = xrealloc(ready, ready_size * sizeof(*ready));
+	}
+
+	ready[ready_count].fd = fd;
+	ready[ready_count].revents = revents;
+	ready_count++;
+}
+
+void evloop_init(void)
+{
+#ifdef USE_EPOLL
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+
+	if (epfd < 0) {
+		upslog_with_errno(LOG_WARNING, "epoll_create1 failed, falling back to poll()");
+	} else {
+		upsdebugx(2, "%s: using epoll", __func__);
+		return;
+	}
+#endif
+	upsdebugx(2, "%s: using poll", __func__);
+}
+
+void evloop_free(void)
+{
+#ifdef USE_EPOLL
+	if (epfd >= 0) {
+		close(epfd);
+		epfd = -1;
+	}
+
+	free(epevents);
+	epevents = NULL;
+	epevents_size = 0;
+#endif
+	free(handlers);
+	free(fdevents);
+	free(pfds);
+	free(pfds_pos);
+	free(ready);
+
+	handlers = NULL;
+	fdevents = NULL;
+	pfds = NULL;
+	pfds_pos = NULL;
+	ready = NULL;
+
+	handlers_size = pfds_used = pfds_size = registered = 0;
+	ready_count = ready_pos = ready_size = 0;
+}
+
+int evloop_add(int fd, handler_type_t type, void *data)
+{
+	if (fd < 0) {
+		return 0;
+	}
+
+	handlers_grow(fd);
+
+	/* already registered - just update the handler */
+	if (handlers[fd].type) {
+		handlers[fd].type = type;
+		handlers[fd].data = data;
+		return 1;
+	}
+
+#ifdef USE_EPOLL
+	if (epfd >= 0) {
+		struct epoll_event	ev;
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			upslog_with_errno(LOG_ERR, "%s: epoll_ctl(add) on fd %d", __func__, fd);
+			return 0;
+		}
+	} else
+#endif
+	{
+		if (pfds_used >= pfds_size) {
+			pfds_size = pfds_size ? pfds_size * 2 : 64;
+			pfds = xrealloc(pfds, pfds_size * sizeof(*pfds));
+		}
+
+		pfds[pfds_used].fd = fd;
+		pfds[pfds_used].events = POLLIN;
+		pfds[pfds_used].revents = 0;
+		pfds_pos[fd] = pfds_used++;
+	}
+
+	handlers[fd].type = type;
+	handlers[fd].data = data;
+	fdevents[fd] = POLLIN;
+	registered++;
+
+	return 1;
+}
+
+/* change the events (POLLIN and/or POLLOUT) a registered socket waits for */
+int evloop_set_events(int fd, int events)
+{
+	if ((fd < 0) || (fd >= handlers_size) || (!handlers[fd].type)) {
+		return 0;
+	}
+
+	if (fdevents[fd] == events) {
+		return 1;
+	}
+
+#ifdef USE_EPOLL
+	if (epfd >= 0) {
+		struct epoll_event	ev;
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = ((events & POLLIN) ? EPOLLIN : 0) | ((events & POLLOUT) ? EPOLLOUT : 0);
+		ev.data.fd = fd;
+
+		if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+			upslog_with_errno(LOG_ERR, "%s: epoll_ctl(mod) on fd %d", __func__, fd);
+			return 0;
+		}
+	} else
+#endif
+	{
+		pfds[pfds_pos[fd]].events = events;
+	}
+
+	fdevents[fd] = events;
+
+	return 1;
+}
+
+void evloop_del(int fd)
+{
+	int	i;
+
+	if ((fd < 0) || (fd >= handlers_size) || (!handlers[fd].type)) {
+		return;
+	}
+
+#ifdef USE_EPOLL
+	if (epfd >= 0) {
+		struct epoll_event	ev;
+
+		/* non-NULL event for kernels before 2.6.9 */
+		memset(&ev, 0, sizeof(ev));
+		epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
+	} else
+#endif
+	{
+		int	pos = pfds_pos[fd];
+
+		/* move the last entry into the hole */
+		pfds_used--;
+		if (pos != pfds_used) {
+			pfds[pos] = pfds[pfds_used];
+			pfds_pos[pfds[pos].fd] = pos;
+		}
+
+		pfds_pos[fd] = -1;
+	}
+
+	handlers[fd].type = 0;
+	handlers[fd].data = NULL;
+	registered--;
+
+	/* drop pending events, in case the fd number gets reused */
+	for (i = ready_pos; i < ready_count; i++) {
+		if (ready[i].fd == fd) {
+			ready[i].fd = -1;
+		}
+	}
+}
+
+int evloop_count(void)
+{
+	return registered;
+}
+
+int evloop_wait(int timeout_ms)
+{
+	int	i, ret;
+
+	ready_count = ready_pos = 0;
+
+#ifdef USE_EPOLL
+	if (epfd >= 0) {
+		if (epevents_size < registered) {
+			epevents_size = registered;
+			epevents = xrealloc(epevents, epevents_size * sizeof(*epevents));
+		}
+
+		ret = epoll_wait(epfd, epevents, (epevents_size > 0) ? epevents_size : 1, timeout_ms);
+
+		for (i = 0; i < ret; i++) {
+			int	revents = 0;
+
+			if (epevents[i].events & EPOLLIN)
+				revents |= POLLIN;
+			if (epevents[i].events & EPOLLOUT)
+				revents |= POLLOUT;
+			if (epevents[i].events & EPOLLERR)
+				revents |= POLLERR;
+			if (epevents[i].events & EPOLLHUP)
+				revents |= POLLHUP;
+
+			ready_add(epevents[i].data.fd, revents);
+		}
+
+		return ret;
+	}
+#endif
+
+	ret = poll(pfds, pfds_used, timeout_ms);
+
+	for (i = 0; (ret > 0) && (i < pfds_used); i++) {
+		if (pfds[i].revents) {
+			ready_add(pfds[i].fd, pfds[i].revents);
+		}
+	}
+
+	return ret;
+}
+
+int evloop_next(handler_t *handler, int *revents)
+{
+	while (ready_pos < ready_count) {
+
+		evready_t	*ev = &ready[ready_pos++];
+
+		if (ev->fd < 0) {
+			continue;	/* removed since */
+		}
+
+		*handler = handlers[ev->fd];
+		*revents = ev->revents;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/* timers */
+
+static void evtimer_link(evtimer_t *timer, int slot)
+{
+	timer->slot = slot;
+	timer->prev = NULL;
+	timer->next = wheel[slot];
+
+	if (wheel[slot]) {
+		wheel[slot]->prev = timer;
+	}
+
+	wheel[slot] = timer;
+}
+
+/* seconds of the monotonic clock, the time base of all timers */
+time_t evtimer_now(void)
+{
+	struct timeval	tv;
+
+	get_monotonic_time(&tv);
+
+	return tv.tv_sec;
+}
+
+void evtimer_init(evtimer_t *timer, void (*func)(void *), void *data)
+{
+	memset(timer, 0, sizeof(*timer));
+
+	timer->func = func;
+	timer->data = data;
+	timer->slot = -1;
+}
+
+void evtimer_del(evtimer_t *timer)
+{
+	if (timer->slot < 0) {
+		return;
+	}
+
+	if (timer->prev) {
+		timer->prev->next = timer->next;
+	} else {
+		wheel[timer->slot] = timer->next;
+	}
+
+	if (timer->next) {
+		timer->next->prev = timer->prev;
+	}
+
+	timer->slot = -1;
+	timer->prev = timer->next = NULL;
+}
+
+/* (re)arm a timer; anything already due fires on the next tick */
+void evtimer_add(evtimer_t *timer, time_t expires)
+{
+	time_t	when = expires;
+
+	evtimer_del(timer);
+
+	if (when <= wheel_now) {
+		when = wheel_now + 1;
+	}
+
+	timer->expires = expires;
+
+	evtimer_link(timer, (int)(when % EVTIMER_SLOTS));
+}
+
+/* milliseconds until the next non-empty slot, at most max_ms */
+int evtimer_timeout(time_t now, int max_ms)
+{
+	time_t	t;
+
+	if (wheel[EVTIMER_DUE]) {
+		return 0;
+	}
+
+	for (t = now; (t - now) * 1000 < max_ms; t++) {
+
+		if (t <= wheel_now) {
+			continue;
+		}
+
+		if (wheel[t % EVTIMER_SLOTS]) {
+			return (int)(t - now) * 1000;
+		}
+	}
+
+	return max_ms;
+}
+
+/* fire all timers that expired at or before now */
+void evtimer_run(time_t now)
+{
+	time_t	t;
+	evtimer_t	*timer, *next;
+
+	if (now <= wheel_now) {
+		return;
+	}
+
+	/* first run or a big clock jump: look at each slot once */
+	t = ((wheel_now == 0) || (now - wheel_now > EVTIMER_SLOTS)) ?
+		now - EVTIMER_SLOTS + 1 : wheel_now + 1;
+
+	for (; t <= now; t++) {
+		for (timer = wheel[t % EVTIMER_SLOTS]; timer; timer = next) {
+
+			next = timer->next;
+
+			if (timer->expires > now) {
+				continue;	/* due in a later turn */
+			}
+
+			evtimer_del(timer);
+			evtimer_link(timer, EVTIMER_DUE);
+		}
+	}
+
+	wheel_now = now;
+
+	/* callbacks may re-arm or delete any timer, including due ones */
+	while ((timer = wheel[EVTIMER_DUE]) != NULL) {
+		evtimer_del(timer);
+		timer->func(timer->data);
+	}
+}
@@ -0,0 +1,81 @@
+/* evloop.h - persistent socket readiness set and timer wheel for upsd
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef NUT_EVLOOP_H_SEEN
+#define NUT_EVLOOP_H_SEEN 1
+
+#include "timehead.h"
+
+#ifdef __cplusplus
+/* *INDENT-OFF* */
+extern "C" {
+/* *INDENT-ON* */
+#endif
+
+typedef enum {
+	DRIVER = 1,
+	CLIENT,
+	SERVER
+} handler_type_t;
+
+typedef struct {
+	handler_type_t	type;
+	void		*data;
+} handler_t;
+
+/* one-shot timer, embedded in the object it watches; the wheel has
+ * a one second resolution, which is all that upsd needs, and runs on
+ * evtimer_now() so that setting the system time does not stall it */
+typedef struct evtimer_s {
+	time_t	expires;		/* in evtimer_now() seconds */
+	void	(*func)(void *data);
+	void	*data;
+
+	int	slot;			/* -1 when not armed */
+	struct evtimer_s	*prev;
+	struct evtimer_s	*next;
+} evtimer_t;
+
+/* sockets are registered once (at connect/accept time) and stay in
+ * the set until evloop_del(), which must be called before close();
+ * they are watched for POLLIN unless evloop_set_events() says otherwise */
+void evloop_init(void);
+void evloop_free(void);
+int evloop_add(int fd, handler_type_t type, void *data);
+int evloop_set_events(int fd, int events);
+void evloop_del(int fd);
+int evloop_count(void);
+
+/* wait up to timeout_ms for events, then fetch them one by one with
+ * evloop_next(); sockets removed in between are skipped */
+int evloop_wait(int timeout_ms);
+int evloop_next(handler_t *handler, int *revents);
+
+time_t evtimer_now(void);
+void evtimer_init(evtimer_t *timer, void (*func)(void *), void *data);
+void evtimer_add(evtimer_t *timer, time_t expires);
+void evtimer_del(evtimer_t *timer);
+int evtimer_timeout(time_t now, int max_ms);
+void evtimer_run(time_t now);
+
+#ifdef __cplusplus
+/* *INDENT-OFF* */
+}
+/* *INDENT-ON* */
+#endif
+
+#endif	/* NUT_EVLOOP_H_SEEN */
@@ -34,6 +34,8 @@
 #include "netmisc.h"
 #include "netuser.h"
 #include "netinstcmd.h"
+#include "netwatch.h"
+#include "nettoken.h"
 
 #define FLAG_USER	0x0001		/* username and password must be set */
 
@@ -43,32 +45,38 @@ extern "C" {
 /* *INDENT-ON* */
 #endif
 
+/* kept in the order of nettoken_t, so that parse_net() can index
+ * this table by the token of the first word of a request */
 static struct {
+	nettoken_t	token;
 	const	char	*name;
 	void	(*func)(nut_ctype_t *client, size_t numargs, const char **arg);
 	int	flags;
 } netcmds[] = {
-	{ "VER",	net_ver,	0		},
-	{ "NETVER",	net_netver,	0		},
-	{ "HELP",	net_help,	0		},
-	{ "STARTTLS",	net_starttls,	0		},
+	{ NT_VER,	"VER",	net_ver,	0		},
+	{ NT_NETVER,	"NETVER",	net_netver,	0		},
+	{ NT_HELP,	"HELP",	net_help,	0		},
+	{ NT_STARTTLS,	"STARTTLS",	net_starttls,	0		},
 
-	{ "GET",	net_get,	0		},
-	{ "LIST",	net_list,	0		},
+	{ NT_GET,	"GET",	net_get,	0		},
+	{ NT_LIST,	"LIST",	net_list,	0		},
 
-	{ "USERNAME",	net_username,	0		},
-	{ "PASSWORD",	net_password,	0		},
+	{ NT_USERNAME,	"USERNAME",	net_username,	0		},
+	{ NT_PASSWORD,	"PASSWORD",	net_password,	0		},
 
-	{ "LOGIN",	net_login,	FLAG_USER	},
-	{ "LOGOUT", 	net_logout,	0		},
-	{ "MASTER",	net_master,	FLAG_USER	},
+	{ NT_LOGIN,	"LOGIN",	net_login,	FLAG_USER	},
+	{ NT_LOGOUT,	"LOGOUT", 	net_logout,	0		},
+	{ NT_MASTER,	"MASTER",	net_master,	FLAG_USER	},
 
-	{ "FSD",	net_fsd,	FLAG_USER	},
+	{ NT_FSD,	"FSD",	net_fsd,	FLAG_USER	},
 
-	{ "SET",	net_set,	FLAG_USER	},
-	{ "INSTCMD",	net_instcmd,	FLAG_USER	},
+	{ NT_SET,	"SET",	net_set,	FLAG_USER	},
+	{ NT_INSTCMD,	"INSTCMD",	net_instcmd,	FLAG_USER	},
 
-	{ NULL,		(void(*)(struct nut_ctype_s *, size_t,  const char **))(NULL), 0		}
+	{ NT_WATCH,	"WATCH",	net_watch,	0		},
+	{ NT_UNWATCH,	"UNWATCH",	net_unwatch,	0		},
+
+	{ NT_UNKNOWN,	NULL,		(void(*)(struct nut_ctype_s *, size_t,  const char **))(NULL), 0		}
 };
 
 #ifdef __cplusplus
@@ -24,6 +24,8 @@
 #include "state.h"
 #include "desc.h"
 #include "neterr.h"
+#include "nettoken.h"
+#include "stats.h"
 
 #include "netget.h"
 
@@ -176,6 +178,11 @@ static void get_var_server(nut_ctype_t *client, const char *upsname, const char
 		return;
 	}
 
+	/* runtime metrics of upsd, see stats.c */
+	if (!strncasecmp(var, "upsd.", 5) && stats_get_var(client, upsname, var)) {
+		return;
+	}
+
 	send_err(client, NUT_ERR_VAR_NOT_SUPPORTED);
 }
 
@@ -184,8 +191,9 @@ static void get_var(nut_ctype_t *client, const char *upsname, const char *var)
 	const	upstype_t	*ups;
 	const	char	*val;
 
-	/* ignore upsname for server.* variables */
-	if (!strncasecmp(var, "server.", 7)) {
+	/* ignore upsname for server.* variables, and for upsd.* ones
+	 * except the counters of its driver */
+	if (!strncasecmp(var, "server.", 7) || !strncasecmp(var, "upsd.", 5)) {
 		get_var_server(client, upsname, var);
 		return;
 	}
@@ -216,13 +224,17 @@ static void get_var(nut_ctype_t *client, const char *upsname, const char *var)
 
 void net_get(nut_ctype_t *client, size_t numarg, const char **arg)
 {
+	nettoken_t	tok;
+
 	if (numarg < 1) {
 		send_err(client, NUT_ERR_INVALID_ARGUMENT);
 		return;
 	}
 
+	tok = nettoken(arg[0]);
+
 	/* GET TRACKING [ID] */
-	if (!strcasecmp(arg[0], "TRACKING")) {
+	if (tok == NT_TRACKING) {
 		if (numarg < 2) {
 			sendback(client, "%s\n", (client->tracking) ? "ON" : "OFF");
 		}
@@ -241,13 +253,13 @@ void net_get(nut_ctype_t *client, size_t numarg, const char **arg)
 	}
 
 	/* GET NUMLOGINS UPS */
-	if (!strcasecmp(arg[0], "NUMLOGINS")) {
+	if (tok == NT_NUMLOGINS) {
 		get_numlogins(client, arg[1]);
 		return;
 	}
 
 	/* GET UPSDESC UPS */
-	if (!strcasecmp(arg[0], "UPSDESC")) {
+	if (tok == NT_UPSDESC) {
 		get_upsdesc(client, arg[1]);
 		return;
 	}
@@ -258,25 +270,25 @@ void net_get(nut_ctype_t *client, size_t numarg, const char **arg)
 	}
 
 	/* GET VAR UPS VARNAME */
-	if (!strcasecmp(arg[0], "VAR")) {
+	if (tok == NT_VAR) {
 		get_var(client, arg[1], arg[2]);
 		return;
 	}
 
 	/* GET TYPE UPS VARNAME */
-	if (!strcasecmp(arg[0], "TYPE")) {
+	if (tok == NT_TYPE) {
 		get_type(client, arg[1], arg[2]);
 		return;
 	}
 
 	/* GET DESC UPS VARNAME */
-	if (!strcasecmp(arg[0], "DESC")) {
+	if (tok == NT_DESC) {
 		get_desc(client, arg[1], arg[2]);
 		return;
 	}
 
 	/* GET CMDDESC UPS CMDNAME */
-	if (!strcasecmp(arg[0], "CMDDESC")) {
+	if (tok == NT_CMDDESC) {
 		get_cmddesc(client, arg[1], arg[2]);
 		return;
 	}
@@ -25,6 +25,7 @@
 #include "sstate.h"
 #include "state.h"
 #include "neterr.h"
+#include "nettoken.h"
 
 #include "netlist.h"
 
@@ -274,8 +275,13 @@ static void list_clients(nut_ctype_t *client, const char *upsname)
 		int	ret;
 		/* show connected clients */
 		for (c = firstclient; c; c = cnext) {
-			if (c->loginups && (!ups || !strcasecmp(c->loginups, ups->name))) {
-				ret = sendback(client, "CLIENT %s %s\n", c->loginups, c->addr);
+			size_t	i;
+
+			for (i = 0; i < c->numloginups; i++) {
+				if (ups && strcasecmp(c->loginups[i], ups->name))
+					continue;
+
+				ret = sendback(client, "CLIENT %s %s\n", c->loginups[i], c->addr);
 				if (!ret)
 					return;
 			}
@@ -287,13 +293,17 @@ static void list_clients(nut_ctype_t *client, const char *upsname)
 
 void net_list(nut_ctype_t *client, size_t numarg, const char **arg)
 {
+	nettoken_t	tok;
+
 	if (numarg < 1) {
 		send_err(client, NUT_ERR_INVALID_ARGUMENT);
 		return;
 	}
 
+	tok = nettoken(arg[0]);
+
 	/* LIST UPS */
-	if (!strcasecmp(arg[0], "UPS")) {
+	if (tok == NT_UPS) {
 		list_ups(client);
 		return;
 	}
@@ -304,25 +314,25 @@ void net_list(nut_ctype_t *client, size_t numarg, const char **arg)
 	}
 
 	/* LIST VAR UPS */
-	if (!strcasecmp(arg[0], "VAR")) {
+	if (tok == NT_VAR) {
 		list_var(client, arg[1]);
 		return;
 	}
 
 	/* LIST RW UPS */
-	if (!strcasecmp(arg[0], "RW")) {
+	if (tok == NT_RW) {
 		list_rw(client, arg[1]);
 		return;
 	}
 
 	/* LIST CMD UPS */
-	if (!strcasecmp(arg[0], "CMD")) {
+	if (tok == NT_CMD) {
 		list_cmd(client, arg[1]);
 		return;
 	}
 
 	/* LIST CLIENT UPS */
-	if (!strcasecmp(arg[0], "CLIENT")) {
+	if (tok == NT_CLIENT) {
 		list_clients(client, arg[1]);
 		return;
 	}
@@ -333,13 +343,13 @@ void net_list(nut_ctype_t *client, size_t numarg, const char **arg)
 	}
 
 	/* LIST ENUM UPS VARNAME */
-	if (!strcasecmp(arg[0], "ENUM")) {
+	if (tok == NT_ENUM) {
 		list_enum(client, arg[1], arg[2]);
 		return;
 	}
 
 	/* LIST RANGE UPS VARNAME */
-	if (!strcasecmp(arg[0], "RANGE")) {
+	if (tok == NT_RANGE) {
 		list_range(client, arg[1], arg[2]);
 		return;
 	}
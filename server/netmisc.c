@@ -26,6 +26,7 @@
 #include "state.h"
 #include "user.h"		/* for user_checkaction */
 #include "neterr.h"
+#include "netwatch.h"
 
 #include "netmisc.h"
 
@@ -61,7 +62,7 @@ void net_help(nut_ctype_t *client, size_t numarg, const char **arg)
 	}
 
 	sendback(client, "Commands: HELP VER GET LIST SET INSTCMD LOGIN LOGOUT"
-		" USERNAME PASSWORD STARTTLS\n");
+		" USERNAME PASSWORD STARTTLS WATCH UNWATCH\n");
 }
 
 void net_fsd(nut_ctype_t *client, size_t numarg, const char **arg)
@@ -91,5 +92,7 @@ void net_fsd(nut_ctype_t *client, size_t numarg, const char **arg)
 
 	ups->fsd = 1;
 	sendback(client, "OK FSD-SET\n");
+
+	watch_notify_var(ups, "ups.status");
 }
 
@@ -24,6 +24,7 @@
 #include "state.h"
 #include "user.h"		/* for user_checkaction */
 #include "neterr.h"
+#include "nettoken.h"
 
 #include "netset.h"
 
@@ -169,6 +170,7 @@ static void set_var(nut_ctype_t *client, const char *upsname, const char *var,
 void net_set(nut_ctype_t *client, size_t numarg, const char **arg)
 {
 	char	tracking_id[UUID4_LEN] = "";
+	nettoken_t	tok;
 
 	/* Base verification, to ensure that we have at least the SET parameter */
 	if (numarg < 2) {
@@ -176,8 +178,10 @@ void net_set(nut_ctype_t *client, size_t numarg, const char **arg)
 		return;
 	}
 
+	tok = nettoken(arg[0]);
+
 	/* SET VAR UPS VARNAME VALUE */
-	if (!strcasecmp(arg[0], "VAR")) {
+	if (tok == NT_VAR) {
 		if (numarg < 4) {
 			send_err(client, NUT_ERR_INVALID_ARGUMENT);
 			return;
@@ -194,12 +198,14 @@ void net_set(nut_ctype_t *client, size_t numarg, const char **arg)
 	}
 
 	/* SET TRACKING VALUE */
-	if (!strcasecmp(arg[0], "TRACKING")) {
-		if (!strcasecmp(arg[1], "ON")) {
+	if (tok == NT_TRACKING) {
+		tok = nettoken(arg[1]);
+
+		if (tok == NT_ON) {
 			/* general enablement along with for this client */
 			client->tracking = tracking_enable();
 		}
-		else if (!strcasecmp(arg[1], "OFF")) {
+		else if (tok == NT_OFF) {
 			/* disable status tracking for this client first */
 			client->tracking = 0;
 			/* then only disable the general one if no other clients use it!
@@ -120,12 +120,15 @@ static int ssl_error(SSL *ssl, int ret)
 
 	switch (e)
 	{
+	/* non-blocking socket: let the caller retry when it is ready */
 	case SSL_ERROR_WANT_READ:
 		upsdebugx(1, "ssl_error() ret=%d SSL_ERROR_WANT_READ", ret);
+		errno = EAGAIN;
 		break;
 
 	case SSL_ERROR_WANT_WRITE:
 		upsdebugx(1, "ssl_error() ret=%d SSL_ERROR_WANT_WRITE", ret);
+		errno = EAGAIN;
 		break;
 
 	case SSL_ERROR_SYSCALL:
@@ -233,6 +236,22 @@ static void HandshakeCallback(PRFileDesc *fd, nut_ctype_t *client_data)
 
 #endif /* WITH_OPENSSL | WITH_NSS */
 
+static void ssl_set_blocking(int fd, int blocking)
+{
+	int	flags = fcntl(fd, F_GETFL, 0);
+
+	if (flags == -1) {
+		upsdebug_with_errno(1, "%s: fcntl(get)", __func__);
+		return;
+	}
+
+	flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+
+	if (fcntl(fd, F_SETFL, flags) == -1) {
+		upsdebug_with_errno(1, "%s: fcntl(set)", __func__);
+	}
+}
+
 void net_starttls(nut_ctype_t *client, size_t numarg, const char **arg)
 {
 #ifdef WITH_OPENSSL
@@ -272,6 +291,14 @@ void net_starttls(nut_ctype_t *client, size_t numarg, const char **arg)
 		return;
 	}
 
+	/* the answer has to reach the client in clear before the handshake
+	 * starts, and the handshake itself is done in blocking mode */
+	ssl_set_blocking(client->sock_fd, 1);
+
+	if (sendback_flush(client) != 1) {
+		return;
+	}
+
 #ifdef WITH_OPENSSL
 
 	client->ssl = SSL_new(ssl_ctx);
@@ -294,6 +321,8 @@ void net_starttls(nut_ctype_t *client, size_t numarg, const char **arg)
 	case 1:
 		client->ssl_connected = 1;
 		upsdebugx(3, "SSL connected (%s)", SSL_get_version(client->ssl));
+		/* back to queued, non-blocking answers (see sendback_flush) */
+		ssl_set_blocking(client->sock_fd, 0);
 		break;
 
 	case 0:
@@ -381,6 +410,8 @@ void net_starttls(nut_ctype_t *client, size_t numarg, const char **arg)
 			return;
 		}
 	}
+	/* NSS connections stay in blocking mode: each PR_Write still
+	 * sends a whole batch of queued answers at once */
 	client->ssl_connected = 1;
 #endif /* WITH_OPENSSL | WITH_NSS */
 }
@@ -445,6 +476,10 @@ void ssl_init(void)
 
 	SSL_CTX_set_verify(ssl_ctx, SSL_VERIFY_NONE, NULL);
 
+	/* sendback_flush() may send part of its queue, and retry with
+	 * a queue that has grown (and moved) in the meantime */
+	SSL_CTX_set_mode(ssl_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
 	ssl_initialized = 1;
 
 #elif defined(WITH_NSS) /* WITH_OPENSSL */
@@ -555,6 +590,8 @@ int ssl_read(nut_ctype_t *client, char *buf, size_t buflen)
 		return -1;
 	}
 
+	errno = 0;
+
 #ifdef WITH_OPENSSL
 	ret = SSL_read(client->ssl, buf, buflen);
 #elif defined(WITH_NSS) /* WITH_OPENSSL */
@@ -580,6 +617,8 @@ int ssl_write(nut_ctype_t *client, const char *buf, size_t buflen)
 		return -1;
 	}
 
+	errno = 0;
+
 #ifdef WITH_OPENSSL
 	ret = SSL_write(client->ssl, buf, buflen);
 #elif defined(WITH_NSS) /* WITH_OPENSSL */
@@ -591,6 +630,11 @@ int ssl_write(nut_ctype_t *client, const char *buf, size_t buflen)
 
 	upsdebugx(5, "ssl_write ret=%d", ret);
 
+	if (ret < 1) {
+		ssl_error(client->ssl, ret);
+		return -1;
+	}
+
 	return ret;
 }
 
@@ -0,0 +1,156 @@
+/* nettoken.c - keyword lookup for the network protocol parser in upsd
+
+   Each request line used to be matched against the command table, and
+   then against each sub-command, with one strcasecmp() per candidate.
+   This is a perfect hash (in the spirit of gperf) over the case-folded
+   keywords: the length, first two and last characters of a word select
+   one slot, and a single strcasecmp() confirms the match.
+
+   The slot table is built from the keyword list by nettoken_init(), with
+   NETTOKEN_MULT chosen so that no two keywords collide. When adding a
+   keyword, pick a new multiplier if upsd refuses to start over a
+   collision; tests/nutnettokentest checks that every keyword resolves
+   to itself.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "common.h"
+#include "nettoken.h"
+
+#include <ctype.h>
+
+#define NETTOKEN_SLOTS	128
+#define NETTOKEN_MULT	351U
+
+/* indexed by nettoken_t */
+static const char	*nettoken_names[NT_COUNT] = {
+	NULL,
+
+	"VER",
+	"NETVER",
+	"HELP",
+	"STARTTLS",
+	"GET",
+	"LIST",
+	"USERNAME",
+	"PASSWORD",
+	"LOGIN",
+	"LOGOUT",
+	"MASTER",
+	"FSD",
+	"SET",
+	"INSTCMD",
+	"WATCH",
+	"UNWATCH",
+
+	"TRACKING",
+	"NUMLOGINS",
+	"UPSDESC",
+	"VAR",
+	"TYPE",
+	"DESC",
+	"CMDDESC",
+	"UPS",
+	"RW",
+	"CMD",
+	"CLIENT",
+	"ENUM",
+	"RANGE",
+	"ON",
+	"OFF"
+};
+
+/* slot -> keyword, see nettoken_init() */
+static unsigned char	nettoken_slots[NETTOKEN_SLOTS];
+static int	nettoken_ready = 0;
+
+static unsigned int nettoken_hash(const char *word, size_t len)
+{
+	unsigned int	h = (unsigned int)len;
+
+	h = (h ^ (unsigned char)tolower((unsigned char)word[0])) * NETTOKEN_MULT;
+	h = (h ^ (unsigned char)tolower((unsigned char)word[1])) * NETTOKEN_MULT;
+	h = (h ^ (unsigned char)tolower((unsigned char)word[len - 1])) * NETTOKEN_MULT;
+
+	return ((h & 0xffffffffU) >> 16) % NETTOKEN_SLOTS;
+}
+
+void nettoken_init(void)
+{
+	size_t	len;
+	unsigned int	slot;
+	int	token;
+
+	if (nettoken_ready) {
+		return;
+	}
+
+	for (token = NT_UNKNOWN + 1; token < NT_COUNT; token++) {
+		if (!nettoken_names[token]) {
+			fatalx(EXIT_FAILURE, "nettoken: no name for keyword %d", token);
+		}
+
+		len = strlen(nettoken_names[token]);
+		slot = nettoken_hash(nettoken_names[token], len);
+
+		if (nettoken_slots[slot] != NT_UNKNOWN) {
+			fatalx(EXIT_FAILURE, "nettoken: %s and %s collide, change NETTOKEN_MULT",
+				nettoken_names[nettoken_slots[slot]], nettoken_names[token]);
+		}
+
+		nettoken_slots[slot] = (unsigned char)token;
+	}
+
+	nettoken_ready = 1;
+}
+
+nettoken_t nettoken(const char *word)
+{
+	size_t	len;
+	nettoken_t	token;
+
+	if (!word) {
+		return NT_UNKNOWN;
+	}
+
+	len = strlen(word);
+
+	/* no keyword is shorter than this */
+	if (len < 2) {
+		return NT_UNKNOWN;
+	}
+
+	if (!nettoken_ready) {
+		nettoken_init();
+	}
+
+	token = (nettoken_t)nettoken_slots[nettoken_hash(word, len)];
+
+	if ((token == NT_UNKNOWN) || strcasecmp(word, nettoken_names[token])) {
+		return NT_UNKNOWN;
+	}
+
+	return token;
+}
+
+const char *nettoken_name(nettoken_t token)
+{
+	if ((token <= NT_UNKNOWN) || (token >= NT_COUNT)) {
+		return NULL;
+	}
+
+	return nettoken_names[token];
+}
@@ -0,0 +1,82 @@
+/* nettoken.h - keyword lookup for the network protocol parser in upsd
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef NUT_NETTOKEN_H_SEEN
+#define NUT_NETTOKEN_H_SEEN 1
+
+#ifdef __cplusplus
+/* *INDENT-OFF* */
+extern "C" {
+/* *INDENT-ON* */
+#endif
+
+/* every keyword of the protocol, commands first and in the same order
+ * as netcmds[] (see netcmds.h), then their sub-commands and arguments */
+typedef enum {
+	NT_UNKNOWN = 0,
+
+	NT_VER,
+	NT_NETVER,
+	NT_HELP,
+	NT_STARTTLS,
+	NT_GET,
+	NT_LIST,
+	NT_USERNAME,
+	NT_PASSWORD,
+	NT_LOGIN,
+	NT_LOGOUT,
+	NT_MASTER,
+	NT_FSD,
+	NT_SET,
+	NT_INSTCMD,
+	NT_WATCH,
+	NT_UNWATCH,
+	NT_LAST_COMMAND = NT_UNWATCH,	/* keep it on the last command */
+
+	NT_TRACKING,
+	NT_NUMLOGINS,
+	NT_UPSDESC,
+	NT_VAR,
+	NT_TYPE,
+	NT_DESC,
+	NT_CMDDESC,
+	NT_UPS,
+	NT_RW,
+	NT_CMD,
+	NT_CLIENT,
+	NT_ENUM,
+	NT_RANGE,
+	NT_ON,
+	NT_OFF,
+
+	NT_COUNT
+} nettoken_t;
+
+/* build the lookup table, done by the first nettoken() if need be */
+void nettoken_init(void);
+
+/* map a (case-insensitive) word to its keyword, or NT_UNKNOWN */
+nettoken_t nettoken(const char *word);
+const char *nettoken_name(nettoken_t token);
+
+#ifdef __cplusplus
+/* *INDENT-OFF* */
+}
+/* *INDENT-ON* */
+#endif
+
+#endif	/* NUT_NETTOKEN_H_SEEN */
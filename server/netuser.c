@@ -37,12 +37,6 @@ void net_login(nut_ctype_t *client, size_t numarg, const char **arg)
 		return;
 	}
 
-	if (client->loginups != NULL) {
-		upslogx(LOG_INFO, "Client %s@%s tried to login twice", client->username, client->addr);
-		send_err(client, NUT_ERR_ALREADY_LOGGED_IN);
-		return;
-	}
-
 	/* make sure we got a valid UPS name */
 	ups = get_ups_ptr(arg[0]);
 
@@ -51,6 +45,13 @@ void net_login(nut_ctype_t *client, size_t numarg, const char **arg)
 		return;
 	}
 
+	/* one connection may log into several UPSes, each of them once */
+	if (client_loginups(client, ups->name) >= 0) {
+		upslogx(LOG_INFO, "Client %s@%s tried to login twice", client->username, client->addr);
+		send_err(client, NUT_ERR_ALREADY_LOGGED_IN);
+		return;
+	}
+
 	/* make sure this is a valid user */
 	if (!user_checkaction(client->username, client->password, "LOGIN")) {
 		send_err(client, NUT_ERR_ACCESS_DENIED);
@@ -58,24 +59,56 @@ void net_login(nut_ctype_t *client, size_t numarg, const char **arg)
 	}
 
 	ups->numlogins++;
-	client->loginups = xstrdup(ups->name);
+	client->loginups = xrealloc(client->loginups, (client->numloginups + 1) * sizeof(*client->loginups));
+	client->loginups[client->numloginups++] = xstrdup(ups->name);
 
 	upslogx(LOG_INFO, "User %s@%s logged into UPS [%s]%s", client->username, client->addr,
-		client->loginups, client->ssl ? " (SSL)" : "");
+		ups->name, client->ssl ? " (SSL)" : "");
 	sendback(client, "OK\n");
 }
 
+/* LOGOUT [<ups>] */
 void net_logout(nut_ctype_t *client, size_t numarg, const char **arg)
 {
-	NUT_UNUSED_VARIABLE(arg);
-	if (numarg != 0) {
+	upstype_t	*ups;
+	size_t	i;
+	int	pos;
+
+	if (numarg > 1) {
 		send_err(client, NUT_ERR_INVALID_ARGUMENT);
 		return;
 	}
 
-	if (client->loginups != NULL) {
+	/* only leave this UPS, and stay connected for the others */
+	if (numarg == 1) {
+		ups = get_ups_ptr(arg[0]);
+
+		if (!ups) {
+			send_err(client, NUT_ERR_UNKNOWN_UPS);
+			return;
+		}
+
+		pos = client_loginups(client, ups->name);
+
+		if (pos < 0) {
+			send_err(client, NUT_ERR_INVALID_ARGUMENT);
+			return;
+		}
+
+		upslogx(LOG_INFO, "User %s@%s logged out from UPS [%s]%s", client->username, client->addr,
+			ups->name, client->ssl ? " (SSL)" : "");
+
+		ups->numlogins--;
+		free(client->loginups[pos]);
+		client->loginups[pos] = client->loginups[--client->numloginups];
+
+		sendback(client, "OK\n");
+		return;
+	}
+
+	for (i = 0; i < client->numloginups; i++) {
 		upslogx(LOG_INFO, "User %s@%s logged out from UPS [%s]%s", client->username, client->addr,
-			client->loginups, client->ssl ? " (SSL)" : "");
+			client->loginups[i], client->ssl ? " (SSL)" : "");
 	}
 
 	sendback(client, "OK Goodbye\n");
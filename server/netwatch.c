@@ -0,0 +1,316 @@
+/* netwatch.c - WATCH subscriptions for upsd
+
+   A client sends WATCH <ups> [<var>] (both may be shell-style patterns)
+   and from then on gets a NOTIFY line whenever a driver changes or
+   removes a matching variable, instead of polling with GET and LIST:
+
+	NOTIFY VAR <ups> <var> "<value>"
+	NOTIFY DELVAR <ups> <var>
+	NOTIFY DATASTALE <ups>
+	NOTIFY DATAOK <ups>
+
+   Notifications are queued with the answers of the connection while
+   the driver updates are applied, and written out once per pass of the
+   main loop.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "common.h"
+
+#include "upsd.h"
+#include "sstate.h"
+#include "neterr.h"
+#include "netwatch.h"
+
+#include <ctype.h>
+#include <fnmatch.h>
+
+typedef struct watch_s {
+	char	*ups;
+	char	*var;
+	struct watch_s	*next;
+} watch_t;
+
+	/* clients holding at least one subscription */
+static nut_ctype_t	*firstwatcher = NULL;
+
+	/* set when some watcher has notifications queued */
+static int	watch_pending = 0;
+
+/* UPS and variable names do not care for case anywhere else, so the
+ * patterns are kept in lower case and the names folded to match them
+ * (FNM_CASEFOLD is not portable) */
+static void fold_case(char *dest, const char *src, size_t destsize)
+{
+	size_t	i;
+
+	for (i = 0; src[i] && (i < destsize - 1); i++) {
+		dest[i] = (char)tolower((unsigned char)src[i]);
+	}
+
+	dest[i] = '\0';
+}
+
+static char *fold_dup(const char *src)
+{
+	char	*dest = xmalloc(strlen(src) + 1);
+
+	fold_case(dest, src, strlen(src) + 1);
+
+	return dest;
+}
+
+static int watch_match(const char *pattern, const char *name)
+{
+	char	folded[SMALLBUF];
+
+	if ((pattern[0] == '*') && (pattern[1] == '\0')) {
+		return 1;
+	}
+
+	fold_case(folded, name, sizeof(folded));
+
+	return !fnmatch(pattern, folded, 0);
+}
+
+static void watcher_link(nut_ctype_t *client)
+{
+	client->watch_prev = NULL;
+	client->watch_next = firstwatcher;
+
+	if (firstwatcher) {
+		firstwatcher->watch_prev = client;
+	}
+
+	firstwatcher = client;
+}
+
+static void watcher_unlink(nut_ctype_t *client)
+{
+	if (client->watch_prev) {
+		client->watch_prev->watch_next = client->watch_next;
+	} else {
+		firstwatcher = client->watch_next;
+	}
+
+	if (client->watch_next) {
+		client->watch_next->watch_prev = client->watch_prev;
+	}
+
+	client->watch_prev = client->watch_next = NULL;
+}
+
+static void watch_free(watch_t *watch)
+{
+	free(watch->ups);
+	free(watch->var);
+	free(watch);
+}
+
+void net_watch(nut_ctype_t *client, size_t numarg, const char **arg)
+{
+	watch_t	*watch, *last = NULL;
+	const char	*var;
+	int	count = 0;
+
+	if ((numarg < 1) || (numarg > 2)) {
+		send_err(client, NUT_ERR_INVALID_ARGUMENT);
+		return;
+	}
+
+	var = (numarg > 1) ? arg[1] : "*";
+
+	/* a plain name has to be a known UPS, a pattern may match later ones */
+	if ((!strpbrk(arg[0], "*?[")) && (!get_ups_ptr(arg[0]))) {
+		send_err(client, NUT_ERR_UNKNOWN_UPS);
+		return;
+	}
+
+	for (watch = client->watches; watch; watch = watch->next) {
+
+		if ((!strcasecmp(watch->ups, arg[0])) && (!strcasecmp(watch->var, var))) {
+			sendback(client, "OK\n");	/* already there */
+			return;
+		}
+
+		last = watch;
+		count++;
+	}
+
+	if (count >= WATCH_MAX) {
+		send_err(client, NUT_ERR_INVALID_ARGUMENT);
+		return;
+	}
+
+	watch = xcalloc(1, sizeof(*watch));
+	watch->ups = fold_dup(arg[0]);
+	watch->var = fold_dup(var);
+
+	if (last) {
+		last->next = watch;
+	} else {
+		client->watches = watch;
+		watcher_link(client);
+	}
+
+	upsdebugx(2, "%s: %s watches %s %s", __func__, client->addr, watch->ups, watch->var);
+
+	sendback(client, "OK\n");
+}
+
+void net_unwatch(nut_ctype_t *client, size_t numarg, const char **arg)
+{
+	watch_t	*watch, *next, **prev;
+	int	watching = (client->watches != NULL);
+
+	if (numarg > 2) {
+		send_err(client, NUT_ERR_INVALID_ARGUMENT);
+		return;
+	}
+
+	/* without arguments, drop everything */
+	prev = &client->watches;
+
+	for (watch = client->watches; watch; watch = next) {
+		next = watch->next;
+
+		if (((numarg > 0) && strcasecmp(watch->ups, arg[0])) ||
+			((numarg > 1) && strcasecmp(watch->var, arg[1]))) {
+			prev = &watch->next;
+			continue;
+		}
+
+		*prev = next;
+		watch_free(watch);
+	}
+
+	if ((watching) && (!client->watches)) {
+		watcher_unlink(client);
+	}
+
+	sendback(client, "OK\n");
+}
+
+/* queue a notification for every watcher with a matching subscription;
+ * a NULL var matches any variable pattern */
+static void watch_notify(const upstype_t *ups, const char *var, const char *fmt, ...)
+	__attribute__ ((__format__ (__printf__, 3, 4)));
+
+static void watch_notify(const upstype_t *ups, const char *var, const char *fmt, ...)
+{
+	nut_ctype_t	*client;
+	watch_t	*watch;
+	char	buf[NUT_NET_ANSWER_MAX];
+	va_list	ap;
+
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	for (client = firstwatcher; client; client = client->watch_next) {
+
+		for (watch = client->watches; watch; watch = watch->next) {
+
+			if ((!watch_match(watch->ups, ups->name)) ||
+				((var) && (!watch_match(watch->var, var)))) {
+				continue;
+			}
+
+			sendback(client, "%s", buf);
+			client->watch_pending = 1;
+			watch_pending = 1;
+			break;
+		}
+	}
+}
+
+void watch_notify_var(const upstype_t *ups, const char *var)
+{
+	const char	*val;
+
+	if (!firstwatcher) {
+		return;
+	}
+
+	val = sstate_getinfo(ups, var);
+
+	if (!val) {
+		return;
+	}
+
+	/* same special case as GET VAR */
+	if ((!strcasecmp(var, "ups.status")) && (ups->fsd)) {
+		watch_notify(ups, var, "NOTIFY VAR %s %s \"FSD %s\"\n", ups->name, var, val);
+	} else {
+		watch_notify(ups, var, "NOTIFY VAR %s %s \"%s\"\n", ups->name, var, val);
+	}
+}
+
+void watch_notify_delvar(const upstype_t *ups, const char *var)
+{
+	if (!firstwatcher) {
+		return;
+	}
+
+	watch_notify(ups, var, "NOTIFY DELVAR %s %s\n", ups->name, var);
+}
+
+void watch_notify_ups(const upstype_t *ups, const char *event)
+{
+	if (!firstwatcher) {
+		return;
+	}
+
+	watch_notify(ups, NULL, "NOTIFY %s %s\n", event, ups->name);
+}
+
+void watch_flush(void (*write)(nut_ctype_t *client))
+{
+	nut_ctype_t	*client, *cnext;
+
+	if (!watch_pending) {
+		return;
+	}
+
+	watch_pending = 0;
+
+	/* write() may disconnect the client, which unlinks it */
+	for (client = firstwatcher; client; client = cnext) {
+		cnext = client->watch_next;
+
+		if (client->watch_pending) {
+			client->watch_pending = 0;
+			write(client);
+		}
+	}
+}
+
+void watch_client_free(nut_ctype_t *client)
+{
+	watch_t	*watch, *next;
+
+	if (!client->watches) {
+		return;
+	}
+
+	for (watch = client->watches; watch; watch = next) {
+		next = watch->next;
+		watch_free(watch);
+	}
+
+	client->watches = NULL;
+	watcher_unlink(client);
+}
@@ -0,0 +1,52 @@
+/* netwatch.h - WATCH subscriptions for upsd
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef NUT_NETWATCH_H_SEEN
+#define NUT_NETWATCH_H_SEEN 1
+
+#include "nut_ctype.h"
+#include "upstype.h"
+
+#ifdef __cplusplus
+/* *INDENT-OFF* */
+extern "C" {
+/* *INDENT-ON* */
+#endif
+
+/* most subscriptions a single connection may hold */
+#define WATCH_MAX	64
+
+void net_watch(nut_ctype_t *client, size_t numarg, const char **arg);
+void net_unwatch(nut_ctype_t *client, size_t numarg, const char **arg);
+
+/* changes applied to the state of a UPS */
+void watch_notify_var(const upstype_t *ups, const char *var);
+void watch_notify_delvar(const upstype_t *ups, const char *var);
+void watch_notify_ups(const upstype_t *ups, const char *event);
+
+/* hand the clients with queued notifications to write() */
+void watch_flush(void (*write)(nut_ctype_t *client));
+
+void watch_client_free(nut_ctype_t *client);
+
+#ifdef __cplusplus
+/* *INDENT-OFF* */
+}
+/* *INDENT-ON* */
+#endif
+
+#endif /* NUT_NETWATCH_H_SEEN */
@@ -38,6 +38,7 @@
 #endif
 
 #include "parseconf.h"
+#include "evloop.h"
 
 #ifdef __cplusplus
 /* *INDENT-OFF* */
@@ -50,7 +51,8 @@ typedef struct nut_ctype_s {
 	char	*addr;
 	int	sock_fd;
 	time_t	last_heard;
-	char	*loginups;
+	char	**loginups;		/* UPSes this client did LOGIN to */
+	size_t	numloginups;
 	char	*password;
 	char	*username;
 	/* per client status info for commands and settings
@@ -68,6 +70,25 @@ typedef struct nut_ctype_s {
 
 	PCONF_CTX_t	ctx;
 
+	/* answers queued by sendback(), sent out when the socket is writable */
+	char	*outbuf;
+	size_t	outbuf_len;
+	size_t	outbuf_size;
+
+	evtimer_t	idle_timer;	/* disconnect after inactivity */
+	time_t	last_active;		/* evtimer_now() as of last_heard */
+
+	/* WATCH subscriptions, see netwatch.c */
+	struct watch_s	*watches;
+	int	watch_pending;		/* notifications queued since the last flush */
+	struct nut_ctype_s	*watch_prev;
+	struct nut_ctype_s	*watch_next;
+
+	/* client of a METRICS listener: its HTTP request so far, see stats.c */
+	int	metrics;
+	char	*request;
+	size_t	request_len;
+
 	/* doubly linked list */
 	struct nut_ctype_s	*prev;
 	struct nut_ctype_s	*next;
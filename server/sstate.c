@@ -27,6 +27,9 @@
 #include "sstate.h"
 #include "upsd.h"
 #include "upstype.h"
+#include "evloop.h"
+#include "dsframe.h"
+#include "netwatch.h"
 
 #include <fcntl.h>
 #include <stdio.h>
@@ -48,6 +51,12 @@ static int parse_args(upstype_t *ups, size_t numargs, char **arg)
 
 	if (!strcasecmp(arg[0], "DUMPDONE")) {
 		upsdebugx(3, "UPS [%s]: dump is done", ups->name);
+
+		/* after a reconnection, watchers have the full set again */
+		if (!ups->dumpdone) {
+			watch_notify_ups(ups, "DATAOK");
+		}
+
 		ups->dumpdone = 1;
 		return 1;
 	}
@@ -65,6 +74,16 @@ static int parse_args(upstype_t *ups, size_t numargs, char **arg)
 	if (numargs < 2)
 		return 0;
 
+	/* FRAMING BINARY: the driver accepted DUMPALL BINARY */
+	if (!strcasecmp(arg[0], "FRAMING")) {
+		if (!strcasecmp(arg[1], "BINARY")) {
+			upsdebugx(2, "UPS [%s]: driver switched to binary frames", ups->name);
+			ups->binary = 1;
+			return 1;
+		}
+		return 0;
+	}
+
 	/* FIXME: all these should return their state_...() value! */
 	/* ADDCMD <cmdname> */
 	if (!strcasecmp(arg[0], "ADDCMD")) {
@@ -80,7 +99,9 @@ static int parse_args(upstype_t *ups, size_t numargs, char **arg)
 
 	/* DELINFO <var> */
 	if (!strcasecmp(arg[0], "DELINFO")) {
-		state_delinfo(&ups->inforoot, arg[1]);
+		if (state_delinfo(&ups->inforoot, arg[1])) {
+			watch_notify_delvar(ups, arg[1]);
+		}
 		return 1;
 	}
 
@@ -95,7 +116,9 @@ static int parse_args(upstype_t *ups, size_t numargs, char **arg)
 
 	/* SETINFO <varname> <value> */
 	if (!strcasecmp(arg[0], "SETINFO")) {
-		state_setinfo(&ups->inforoot, arg[1], arg[2]);
+		if (state_setinfo(&ups->inforoot, arg[1], arg[2])) {
+			watch_notify_var(ups, arg[1]);
+		}
 		return 1;
 	}
 
@@ -147,6 +170,179 @@ static int parse_args(upstype_t *ups, size_t numargs, char **arg)
 	return 0;
 }
 
+/* one record of a binary frame, see dsframe.h */
+static int parse_record(upstype_t *ups, dsframe_rec_t *rec)
+{
+	size_t	i;
+	char	*var = NULL;
+	char	*arg[DSFRAME_MAXARGS + 2];
+	size_t	numargs = 0;
+
+	if (rec->op == DSF_DEFVAR) {
+		if ((rec->argc != 1) || (rec->varid < 1)) {
+			return 0;
+		}
+
+		if (rec->varid >= ups->varnames_size) {
+			unsigned int	size = ups->varnames_size ? ups->varnames_size : 256;
+
+			while (size <= rec->varid) {
+				size *= 2;
+			}
+
+			ups->varnames = xrealloc(ups->varnames, size * sizeof(*ups->varnames));
+			memset(ups->varnames + ups->varnames_size, 0,
+				(size - ups->varnames_size) * sizeof(*ups->varnames));
+			ups->varnames_size = size;
+		}
+
+		free(ups->varnames[rec->varid]);
+		ups->varnames[rec->varid] = xstrdup(rec->argv[0]);
+		return 1;
+	}
+
+	if (DSFRAME_HAS_VAR(rec->op)) {
+		if ((rec->varid >= ups->varnames_size) || !ups->varnames[rec->varid]) {
+			upslogx(LOG_NOTICE, "UPS [%s]: undefined variable id %u", ups->name, rec->varid);
+			return 0;
+		}
+
+		var = ups->varnames[rec->varid];
+	}
+
+	/* the bulk of the traffic */
+	if ((rec->op == DSF_SETINFO) && (rec->argc == 1)) {
+		if (state_setinfo(&ups->inforoot, var, rec->argv[0])) {
+			watch_notify_var(ups, var);
+		}
+		return 1;
+	}
+
+	/* everything else goes the same way as its text form */
+	arg[numargs++] = (char *)dsframe_opname(rec->op);
+
+	if (var) {
+		arg[numargs++] = var;
+	}
+
+	for (i = 0; i < rec->argc; i++) {
+		arg[numargs++] = rec->argv[i];
+	}
+
+	return parse_args(ups, numargs, arg);
+}
+
+/* decode the complete frames in the read buffer, keep any partial one */
+static void parse_frames(upstype_t *ups)
+{
+	size_t	pos = 0, rpos;
+	long	flen;
+	int	ret;
+	dsframe_rec_t	rec;
+
+	while ((flen = dsframe_length(ups->rbuf + pos, ups->rbuf_len - pos)) > 0) {
+
+		unsigned char	*payload = ups->rbuf + pos + DSFRAME_HDRLEN;
+		size_t	plen = (size_t)flen - DSFRAME_HDRLEN;
+
+		if (ups->rbuf_len - pos < (size_t)flen) {
+			break;	/* not all there yet */
+		}
+
+		rpos = 0;
+
+		while ((ret = dsframe_next(payload, plen, &rpos, &rec)) > 0) {
+			ups->stat_updates++;
+
+			if (!parse_record(ups, &rec)) {
+				upsdebugx(2, "UPS [%s]: ignored %s record", ups->name,
+					dsframe_opname(rec.op));
+			}
+		}
+
+		if (ret < 0) {
+			flen = -1;
+			break;
+		}
+
+		pos += (size_t)flen;
+
+		/* set the 'last heard' time to now for later staleness checks */
+		time(&ups->last_heard);
+	}
+
+	if (flen < 0) {
+		upslogx(LOG_ERR, "Malformed frame from UPS [%s]", ups->name);
+		sstate_disconnect(ups);
+		return;
+	}
+
+	if (pos > 0) {
+		ups->rbuf_len -= pos;
+		memmove(ups->rbuf, ups->rbuf + pos, ups->rbuf_len);
+	}
+}
+
+static void rbuf_reserve(upstype_t *ups, size_t want)
+{
+	size_t	size = ups->rbuf_size ? ups->rbuf_size : DSFRAME_FLUSH * 4;
+
+	if (want <= ups->rbuf_size) {
+		return;
+	}
+
+	while (want > size) {
+		size *= 2;
+	}
+
+	ups->rbuf = xrealloc(ups->rbuf, size);
+	ups->rbuf_size = size;
+}
+
+static void rbuf_append(upstype_t *ups, const char *buf, size_t len)
+{
+	rbuf_reserve(ups, ups->rbuf_len + len);
+
+	memcpy(ups->rbuf + ups->rbuf_len, buf, len);
+	ups->rbuf_len += len;
+}
+
+/* binary mode: read as much as fits and decode whole frames */
+static void sstate_readframes(upstype_t *ups)
+{
+	ssize_t	ret;
+	long	flen = dsframe_length(ups->rbuf, ups->rbuf_len);
+	size_t	want = ups->rbuf_len + DSFRAME_FLUSH;
+
+	/* room for the rest of a large frame, or at least a typical one */
+	if ((flen > 0) && ((size_t)flen > want)) {
+		want = (size_t)flen;
+	}
+
+	rbuf_reserve(ups, want);
+
+	ret = read(ups->sock_fd, ups->rbuf + ups->rbuf_len, ups->rbuf_size - ups->rbuf_len);
+
+	if (ret < 0) {
+		switch(errno)
+		{
+		case EINTR:
+		case EAGAIN:
+			return;
+
+		default:
+			upslog_with_errno(LOG_WARNING, "Read from UPS [%s] failed", ups->name);
+			sstate_disconnect(ups);
+			return;
+		}
+	}
+
+	ups->rbuf_len += (size_t)ret;
+	ups->stat_bytes += (unsigned long)ret;
+
+	parse_frames(ups);
+}
+
 /* nothing fancy - just make the driver say something back to us */
 static void sendping(upstype_t *ups)
 {
@@ -175,7 +371,9 @@ static void sendping(upstype_t *ups)
 int sstate_connect(upstype_t *ups)
 {
 	int	ret, fd;
-	const char	*dumpcmd = "DUMPALL\n";
+	/* the driver answers FRAMING BINARY if it supports it, or else
+	 * ignores the argument and keeps to the text protocol */
+	const char	*dumpcmd = driver_binary ? "DUMPALL BINARY\n" : "DUMPALL\n";
 	struct sockaddr_un	sa;
 
 	memset(&sa, '\0', sizeof(sa));
@@ -234,6 +432,10 @@ int sstate_connect(upstype_t *ups)
 	}
 
 	pconf_init(&ups->sock_ctx, NULL);
+	ups->binary = 0;
+	ups->rbuf_len = 0;
+
+	evloop_add(fd, DRIVER, ups);
 
 	ups->dumpdone = 0;
 	ups->stale = 0;
@@ -245,12 +447,15 @@ int sstate_connect(upstype_t *ups)
 	state_setinfo(&ups->inforoot, "ups.status", "WAIT");
 
 	upslogx(LOG_INFO, "Connected to UPS [%s]: %s", ups->name, ups->fn);
+	ups->stat_connects++;
 
 	return fd;
 }
 
 void sstate_disconnect(upstype_t *ups)
 {
+	unsigned int	i;
+
 	if ((!ups) || (ups->sock_fd < 0)) {
 		return;
 	}
@@ -260,19 +465,43 @@ void sstate_disconnect(upstype_t *ups)
 
 	pconf_finish(&ups->sock_ctx);
 
+	/* variable ids are only valid for one connection */
+	for (i = 0; i < ups->varnames_size; i++) {
+		free(ups->varnames[i]);
+	}
+
+	free(ups->varnames);
+	free(ups->rbuf);
+
+	ups->varnames = NULL;
+	ups->varnames_size = 0;
+	ups->rbuf = NULL;
+	ups->rbuf_len = ups->rbuf_size = 0;
+	ups->binary = 0;
+
+	evloop_del(ups->sock_fd);
 	close(ups->sock_fd);
 	ups->sock_fd = -1;
+
+	/* the variables are gone until the driver is back */
+	watch_notify_ups(ups, "DATASTALE");
 }
 
 void sstate_readline(upstype_t *ups)
 {
-	int	i, ret;
+	int	ret;
+	size_t	i, used;
 	char	buf[SMALLBUF];
 
 	if ((!ups) || (ups->sock_fd < 0)) {
 		return;
 	}
 
+	if (ups->binary) {
+		sstate_readframes(ups);
+		return;
+	}
+
 	ret = read(ups->sock_fd, buf, sizeof(buf));
 
 	if (ret < 0) {
@@ -289,15 +518,26 @@ void sstate_readline(upstype_t *ups)
 		}
 	}
 
-	for (i = 0; i < ret; i++) {
+	ups->stat_bytes += (unsigned long)ret;
+
+	for (i = 0; i < (size_t)ret; i += used) {
 
-		switch (pconf_char(&ups->sock_ctx, buf[i]))
+		switch (pconf_buf(&ups->sock_ctx, buf + i, ret - i, &used))
 		{
 		case 1:
+			ups->stat_updates++;
+
 			/* set the 'last heard' time to now for later staleness checks */
 			if (parse_args(ups, ups->sock_ctx.numargs, ups->sock_ctx.arglist)) {
 			        time(&ups->last_heard);
 			}
+
+			/* the rest of the data is already framed */
+			if (ups->binary) {
+				rbuf_append(ups, buf + i + used, ret - i - used);
+				parse_frames(ups);
+				return;
+			}
 			continue;
 
 		case 0:
@@ -0,0 +1,468 @@
+/* stats.c - runtime counters and latency histograms of upsd
+
+   upsd counts what goes through it (connections, requests by command,
+   answers and the writes that could not send them at once, driver
+   updates) and times its main loop passes, the requests of clients and
+   the reads from drivers into histograms of power of 2 microseconds.
+   This costs an increment here and there and a clock read around the
+   timed parts.
+
+   They are served as the upsd.* variables of GET VAR, with the per driver
+   ones for the UPS named in the query, and in the Prometheus text format
+   to HTTP clients of the METRICS listeners of upsd.conf.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <ctype.h>
+
+#include "common.h"
+#include "upsd.h"
+#include "neterr.h"
+#include "nettoken.h"
+#include "stats.h"
+
+/* longest HTTP request headers taken from a METRICS client */
+#define STATS_REQUEST_MAX	8192
+
+upsd_stats_t	stats;
+
+/* the plain counters, by variable and Prometheus name */
+static const struct {
+	const char	*var;
+	const char	*prom;
+	const char	*help;
+	unsigned long	*value;
+} counters[] = {
+	{ "upsd.clients.accepted", "nut_upsd_clients_accepted_total",
+		"Client connections accepted", &stats.accepted },
+	{ "upsd.clients.refused", "nut_upsd_clients_refused_total",
+		"Client connections refused over MAXCONN", &stats.refused },
+	{ "upsd.requests.unknown", "nut_upsd_unknown_requests_total",
+		"Client requests with an unknown command", &stats.unknown },
+	{ "upsd.answers", "nut_upsd_answers_total",
+		"Answer lines queued for clients", &stats.answers },
+	{ "upsd.answers.bytes", "nut_upsd_answer_bytes_total",
+		"Bytes of answers queued for clients", &stats.answer_bytes },
+	{ "upsd.writes.short", "nut_upsd_short_writes_total",
+		"Writes to clients that left answers queued for later", &stats.short_writes },
+	{ "upsd.writes.failed", "nut_upsd_failed_writes_total",
+		"Writes to clients that failed", &stats.failed_writes },
+	{ "upsd.outbuf.overflows", "nut_upsd_outbuf_overflows_total",
+		"Clients dropped for not reading their answers", &stats.overflows },
+	{ NULL, NULL, NULL, NULL }
+};
+
+static const struct {
+	const char	*var;
+	const char	*prom;
+	const char	*help;
+	stats_hist_t	*hist;
+} hists[] = {
+	{ "upsd.loop.time", "nut_upsd_loop_seconds",
+		"Time spent on the ready sockets in a pass of the main loop", &stats.loop },
+	{ "upsd.request.time", "nut_upsd_request_seconds",
+		"Time spent on a client request", &stats.request },
+	{ "upsd.driver.time", "nut_upsd_driver_read_seconds",
+		"Time spent reading and applying updates from a driver", &stats.driver },
+	{ NULL, NULL, NULL, NULL }
+};
+
+/* the state of the clients, looked at when asked for */
+typedef struct {
+	unsigned long	clients;
+	unsigned long	waiting;	/* with answers not sent yet */
+	unsigned long	watching;	/* with WATCH subscriptions */
+	size_t		queued;		/* bytes of those answers */
+} stats_clients_t;
+
+static void count_clients(stats_clients_t *sc)
+{
+	nut_ctype_t	*client;
+
+	memset(sc, 0, sizeof(*sc));
+
+	for (client = firstclient; client; client = client->next) {
+		sc->clients++;
+
+		if (client->outbuf_len > 0) {
+			sc->waiting++;
+			sc->queued += client->outbuf_len;
+		}
+
+		if (client->watches) {
+			sc->watching++;
+		}
+	}
+}
+
+void stats_init(void)
+{
+	memset(&stats, 0, sizeof(stats));
+	time(&stats.started);
+}
+
+void stats_hist_usec(stats_hist_t *hist, unsigned long usec)
+{
+	int	i;
+
+	for (i = 0; (i < STATS_BUCKETS - 1) && (usec > (1UL << i)); i++);
+
+	hist->bucket[i]++;
+	hist->count++;
+	hist->sum += usec;
+
+	if (usec > hist->max) {
+		hist->max = usec;
+	}
+}
+
+/* add the time since start */
+void stats_hist_add(stats_hist_t *hist, const struct timeval *start)
+{
+	struct timeval	now;
+	long	usec;
+
+	get_monotonic_time(&now);
+	usec = (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_usec - start->tv_usec);
+
+	stats_hist_usec(hist, (usec > 0) ? (unsigned long)usec : 0);
+}
+
+/* the duration that a fraction q of those in hist did not exceed, as
+ * the bound of its bucket (or the longest one seen, if that is less) */
+unsigned long stats_hist_quantile(const stats_hist_t *hist, double q)
+{
+	unsigned long	want, seen = 0;
+	int	i;
+
+	if (hist->count < 1) {
+		return 0;
+	}
+
+	want = (unsigned long)(q * hist->count);
+
+	if (want < q * hist->count) {
+		want++;
+	}
+
+	if (want < 1) {
+		want = 1;
+	}
+
+	for (i = 0; i < STATS_BUCKETS - 1; i++) {
+		seen += hist->bucket[i];
+
+		if (seen >= want) {
+			return ((1UL << i) < hist->max) ? (1UL << i) : hist->max;
+		}
+	}
+
+	return hist->max;
+}
+
+static int get_hist(nut_ctype_t *client, const char *upsname, const char *var)
+{
+	const stats_hist_t	*hist;
+	const char	*what;
+	unsigned long	value;
+	size_t	len;
+	int	i;
+
+	for (i = 0; hists[i].var; i++) {
+		len = strlen(hists[i].var);
+
+		if (!strncasecmp(var, hists[i].var, len) && (var[len] == '.')) {
+			break;
+		}
+	}
+
+	if (!hists[i].var) {
+		return 0;
+	}
+
+	hist = hists[i].hist;
+	what = var + len + 1;
+
+	if (!strcasecmp(what, "count")) {
+		value = hist->count;
+	} else if (!strcasecmp(what, "avg")) {
+		value = hist->count ? (unsigned long)(hist->sum / hist->count) : 0;
+	} else if (!strcasecmp(what, "p50")) {
+		value = stats_hist_quantile(hist, 0.5);
+	} else if (!strcasecmp(what, "p99")) {
+		value = stats_hist_quantile(hist, 0.99);
+	} else if (!strcasecmp(what, "p999")) {
+		value = stats_hist_quantile(hist, 0.999);
+	} else if (!strcasecmp(what, "max")) {
+		value = hist->max;
+	} else {
+		return 0;
+	}
+
+	sendback(client, "VAR %s %s \"%lu\"\n", upsname, var, value);
+	return 1;
+}
+
+/* the counters of each driver */
+enum {
+	DRIVER_CONNECTED = 0,
+	DRIVER_UPDATES,
+	DRIVER_BYTES,
+	DRIVER_CONNECTS
+};
+
+static unsigned long driver_value(const upstype_t *ups, int which)
+{
+	switch (which)
+	{
+	case DRIVER_UPDATES:
+		return ups->stat_updates;
+	case DRIVER_BYTES:
+		return ups->stat_bytes;
+	case DRIVER_CONNECTS:
+		return ups->stat_connects;
+	default:
+		return (ups->sock_fd >= 0);
+	}
+}
+
+static int get_driver(nut_ctype_t *client, const char *upsname, const char *var)
+{
+	const upstype_t	*ups;
+	int	which;
+
+	if (!strcasecmp(var, "upsd.driver.connected")) {
+		which = DRIVER_CONNECTED;
+	} else if (!strcasecmp(var, "upsd.driver.updates")) {
+		which = DRIVER_UPDATES;
+	} else if (!strcasecmp(var, "upsd.driver.bytes")) {
+		which = DRIVER_BYTES;
+	} else if (!strcasecmp(var, "upsd.driver.connects")) {
+		which = DRIVER_CONNECTS;
+	} else {
+		return 0;
+	}
+
+	ups = get_ups_ptr(upsname);
+
+	if (!ups) {
+		send_err(client, NUT_ERR_UNKNOWN_UPS);
+		return 1;
+	}
+
+	sendback(client, "VAR %s %s \"%lu\"\n", upsname, var, driver_value(ups, which));
+	return 1;
+}
+
+int stats_get_var(nut_ctype_t *client, const char *upsname, const char *var)
+{
+	stats_clients_t	sc;
+	nettoken_t	tok;
+	unsigned long	value;
+	int	i;
+
+	for (i = 0; counters[i].var; i++) {
+		if (!strcasecmp(var, counters[i].var)) {
+			sendback(client, "VAR %s %s \"%lu\"\n", upsname, var, *counters[i].value);
+			return 1;
+		}
+	}
+
+	/* upsd.requests, and upsd.requests.<command> */
+	if (!strcasecmp(var, "upsd.requests")) {
+		for (value = 0, i = 0; i < STATS_COMMANDS; i++) {
+			value += stats.command[i];
+		}
+
+		sendback(client, "VAR %s %s \"%lu\"\n", upsname, var, value);
+		return 1;
+	}
+
+	if (!strncasecmp(var, "upsd.requests.", 14)) {
+		tok = nettoken(var + 14);
+
+		if ((tok < NT_VER) || (tok > NT_LAST_COMMAND)) {
+			return 0;
+		}
+
+		sendback(client, "VAR %s %s \"%lu\"\n", upsname, var, stats.command[tok - NT_VER]);
+		return 1;
+	}
+
+	if (get_hist(client, upsname, var) || get_driver(client, upsname, var)) {
+		return 1;
+	}
+
+	count_clients(&sc);
+
+	if (!strcasecmp(var, "upsd.uptime")) {
+		value = (unsigned long)difftime(time(NULL), stats.started);
+	} else if (!strcasecmp(var, "upsd.clients")) {
+		value = sc.clients;
+	} else if (!strcasecmp(var, "upsd.clients.waiting")) {
+		value = sc.waiting;
+	} else if (!strcasecmp(var, "upsd.clients.watching")) {
+		value = sc.watching;
+	} else if (!strcasecmp(var, "upsd.outbuf.bytes")) {
+		value = (unsigned long)sc.queued;
+	} else if (!strcasecmp(var, "upsd.outbuf.max")) {
+		value = (unsigned long)stats.outbuf_max;
+	} else {
+		return 0;
+	}
+
+	sendback(client, "VAR %s %s \"%lu\"\n", upsname, var, value);
+	return 1;
+}
+
+/* queue a line of the HTTP answer to a METRICS client */
+static void http_printf(nut_ctype_t *client, const char *fmt, ...)
+	__attribute__ ((__format__ (__printf__, 2, 3)));
+
+static void http_printf(nut_ctype_t *client, const char *fmt, ...)
+{
+	char	buf[LARGEBUF];
+	va_list	ap;
+
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	sendback_http(client, buf, strlen(buf));
+}
+
+static void prom_family(nut_ctype_t *client, const char *name, const char *type, const char *help)
+{
+	http_printf(client, "# HELP %s %s\n", name, help);
+	http_printf(client, "# TYPE %s %s\n", name, type);
+}
+
+static void prom_gauge(nut_ctype_t *client, const char *name, const char *help, unsigned long value)
+{
+	prom_family(client, name, "gauge", help);
+	http_printf(client, "%s %lu\n", name, value);
+}
+
+static void prom_hist(nut_ctype_t *client, const char *name, const char *help, const stats_hist_t *hist)
+{
+	unsigned long	seen = 0;
+	int	i;
+
+	prom_family(client, name, "histogram", help);
+
+	for (i = 0; i < STATS_BUCKETS - 1; i++) {
+		seen += hist->bucket[i];
+		http_printf(client, "%s_bucket{le=\"%g\"} %lu\n", name, (double)(1UL << i) / 1e6, seen);
+	}
+
+	http_printf(client, "%s_bucket{le=\"+Inf\"} %lu\n", name, hist->count);
+	http_printf(client, "%s_sum %.6f\n", name, hist->sum / 1e6);
+	http_printf(client, "%s_count %lu\n", name, hist->count);
+}
+
+/* a driver counter, as one family with a sample for each driver */
+static void prom_drivers(nut_ctype_t *client, const char *name, const char *type, const char *help, int which)
+{
+	const upstype_t	*ups;
+
+	prom_family(client, name, type, help);
+
+	for (ups = firstups; ups; ups = ups->next) {
+		http_printf(client, "%s{ups=\"%s\"} %lu\n", name, ups->name, driver_value(ups, which));
+	}
+}
+
+static void prometheus(nut_ctype_t *client)
+{
+	stats_clients_t	sc;
+	char	name[SMALLBUF];
+	size_t	j;
+	int	i;
+
+	count_clients(&sc);
+
+	prom_gauge(client, "nut_upsd_uptime_seconds", "Seconds since upsd started",
+		(unsigned long)difftime(time(NULL), stats.started));
+	prom_gauge(client, "nut_upsd_clients", "Connected clients", sc.clients);
+	prom_gauge(client, "nut_upsd_clients_waiting", "Clients with answers not sent yet", sc.waiting);
+	prom_gauge(client, "nut_upsd_clients_watching", "Clients with WATCH subscriptions", sc.watching);
+	prom_gauge(client, "nut_upsd_outbuf_bytes", "Bytes of answers not sent yet", (unsigned long)sc.queued);
+	prom_gauge(client, "nut_upsd_outbuf_max_bytes", "Most answer bytes queued for a client",
+		(unsigned long)stats.outbuf_max);
+
+	for (i = 0; counters[i].var; i++) {
+		prom_family(client, counters[i].prom, "counter", counters[i].help);
+		http_printf(client, "%s %lu\n", counters[i].prom, *counters[i].value);
+	}
+
+	prom_family(client, "nut_upsd_requests_total", "counter", "Client requests, by command");
+
+	for (i = 0; i < STATS_COMMANDS; i++) {
+		snprintf(name, sizeof(name), "%s", nettoken_name((nettoken_t)(NT_VER + i)));
+
+		for (j = 0; name[j]; j++) {
+			name[j] = tolower((unsigned char)name[j]);
+		}
+
+		http_printf(client, "nut_upsd_requests_total{command=\"%s\"} %lu\n", name, stats.command[i]);
+	}
+
+	for (i = 0; hists[i].var; i++) {
+		prom_hist(client, hists[i].prom, hists[i].help, hists[i].hist);
+	}
+
+	prom_drivers(client, "nut_upsd_driver_connected", "gauge",
+		"Driver connected to upsd", DRIVER_CONNECTED);
+	prom_drivers(client, "nut_upsd_driver_updates_total", "counter",
+		"Updates read from a driver", DRIVER_UPDATES);
+	prom_drivers(client, "nut_upsd_driver_bytes_total", "counter",
+		"Bytes read from a driver", DRIVER_BYTES);
+	prom_drivers(client, "nut_upsd_driver_connects_total", "counter",
+		"Connections made to a driver", DRIVER_CONNECTS);
+}
+
+/* Take what a METRICS client sent. Once the headers of its request are
+ * in, queue the answer and return 1: the connection is closed when it is
+ * sent. 0 if the request is not complete yet, -1 to drop the client. */
+int stats_http_read(nut_ctype_t *client, const char *buf, size_t len)
+{
+	if (client->request_len + len > STATS_REQUEST_MAX) {
+		upslogx(LOG_NOTICE, "Overlong metrics request from %s", client->addr);
+		return -1;
+	}
+
+	client->request = xrealloc(client->request, client->request_len + len + 1);
+	memcpy(client->request + client->request_len, buf, len);
+	client->request_len += len;
+	client->request[client->request_len] = '\0';
+
+	/* the headers end with an empty line */
+	if (!strstr(client->request, "\r\n\r\n") && !strstr(client->request, "\n\n")) {
+		return 0;
+	}
+
+	if (strncmp(client->request, "GET ", 4)) {
+		http_printf(client, "HTTP/1.0 405 Method Not Allowed\r\n"
+			"Allow: GET\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+		return 1;
+	}
+
+	http_printf(client, "HTTP/1.0 200 OK\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n");
+	prometheus(client);
+
+	return 1;
+}
@@ -0,0 +1,86 @@
+/* stats.h - runtime counters and latency histograms of upsd
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef NUT_STATS_H_SEEN
+#define NUT_STATS_H_SEEN 1
+
+#include "timehead.h"
+#include "nut_ctype.h"
+#include "nettoken.h"
+
+#ifdef __cplusplus
+/* *INDENT-OFF* */
+extern "C" {
+/* *INDENT-ON* */
+#endif
+
+/* bucket i counts durations of up to 2^i us, the last one all longer */
+#define STATS_BUCKETS	25
+
+typedef struct {
+	unsigned long	bucket[STATS_BUCKETS];
+	unsigned long	count;
+	unsigned long	max;		/* us */
+	double		sum;		/* us */
+} stats_hist_t;
+
+/* the commands of netcmds.h, by their token */
+#define STATS_COMMANDS	(NT_LAST_COMMAND - NT_VER + 1)
+
+typedef struct {
+	time_t		started;
+
+	unsigned long	accepted;	/* client connections */
+	unsigned long	refused;	/* over MAXCONN */
+
+	unsigned long	command[STATS_COMMANDS];
+	unsigned long	unknown;	/* requests with no such command */
+
+	unsigned long	answers;	/* lines queued by sendback() */
+	unsigned long	answer_bytes;
+	unsigned long	short_writes;	/* flushes that left some for later */
+	unsigned long	failed_writes;
+	unsigned long	overflows;	/* clients over CLIENT_OUTBUF_MAX */
+	size_t		outbuf_max;	/* longest output queue seen */
+
+	stats_hist_t	loop;		/* mainloop() pass, once woken up */
+	stats_hist_t	request;	/* parse_net() */
+	stats_hist_t	driver;		/* sstate_readline() */
+} upsd_stats_t;
+
+extern upsd_stats_t	stats;
+
+void stats_init(void);
+void stats_hist_usec(stats_hist_t *hist, unsigned long usec);
+void stats_hist_add(stats_hist_t *hist, const struct timeval *start);
+
+/* in us, the bound of the bucket reached by a fraction q of the count */
+unsigned long stats_hist_quantile(const stats_hist_t *hist, double q);
+
+/* GET VAR <upsname> upsd.*: 1 if answered, 0 if there is no such variable */
+int stats_get_var(nut_ctype_t *client, const char *upsname, const char *var);
+
+/* clients of METRICS listeners, answered in the Prometheus text format */
+int stats_http_read(nut_ctype_t *client, const char *buf, size_t len);
+
+#ifdef __cplusplus
+/* *INDENT-OFF* */
+}
+/* *INDENT-ON* */
+#endif
+
+#endif	/* NUT_STATS_H_SEEN */
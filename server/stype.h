@@ -41,6 +41,7 @@ typedef struct stype_s {
 	char	*addr;
 	char	*port;
 	int	sock_fd;
+	int	metrics;	/* a METRICS listener, serving HTTP */
 	struct stype_s	*next;
 } stype_t;
 
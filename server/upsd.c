@@ -30,6 +30,8 @@
 
 #include <sys/un.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <poll.h>
 #include <signal.h>
@@ -41,6 +43,9 @@
 #include "sstate.h"
 #include "desc.h"
 #include "neterr.h"
+#include "evloop.h"
+#include "upsindex.h"
+#include "stats.h"
 
 #ifdef HAVE_WRAP
 #include <tcpd.h>
@@ -64,6 +69,9 @@ int	tracking_delay = 3600;
  */
 int allow_no_device = 0;
 
+/* ask drivers for the binary socket protocol (DRIVERPROTOCOL) */
+int driver_binary = 0;
+
 /* preloaded to {OPEN_MAX} in main, can be overridden via upsd.conf */
 int	maxconn = 0;
 
@@ -82,18 +90,24 @@ nut_ctype_t	*firstclient = NULL;
 /* default is to listen on all local interfaces */
 static stype_t	*firstaddr = NULL;
 
+/* METRICS listeners, for the Prometheus text format (none by default) */
+static stype_t	*firstmetrics = NULL;
+
 static int 	opt_af = AF_UNSPEC;
 
-typedef enum {
-	DRIVER = 1,
-	CLIENT,
-	SERVER
-} handler_type_t;
+/* shed clients after 1 minute of inactivity */
+/* FIXME: create an upsd.conf parameter (CLIENT_INACTIVITY_DELAY) */
+#define CLIENT_INACTIVITY_DELAY	60
 
-typedef struct {
-	handler_type_t	type;
-	void		*data;
-} handler_t;
+/* upper bound for one wait in mainloop(), so flags set by signals
+ * handlers are noticed even if nothing else happens */
+#define MAINLOOP_TIMEOUT	2000
+
+/* stop reading new requests from a client while this much of its
+ * output is still queued, and drop it if the queue grows past the
+ * hard limit (a single LIST on a big PDU can take a few 100 kB) */
+#define CLIENT_OUTBUF_HIWAT	65536
+#define CLIENT_OUTBUF_MAX	(4 * 1024 * 1024)
 
 
 /* Commands and settings status tracking */
@@ -117,10 +131,6 @@ typedef struct tracking_s {
 static tracking_t	*tracking_list = NULL;
 
 
-	/* pollfd  */
-static struct pollfd	*fds = NULL;
-static handler_t	*handler = NULL;
-
 	/* pid file */
 static char	pidfn[SMALLBUF];
 
@@ -151,19 +161,7 @@ static const char *inet_ntopW (struct sockaddr_storage *s)
 /* return a pointer to the named ups if possible */
 upstype_t *get_ups_ptr(const char *name)
 {
-	upstype_t	*tmp;
-
-	if (!name) {
-		return NULL;
-	}
-
-	for (tmp = firstups; tmp; tmp = tmp->next) {
-		if (!strcasecmp(tmp->name, name)) {
-			return tmp;
-		}
-	}
-
-	return NULL;
+	return upsindex_find(name);
 }
 
 /* mark the data stale if this is new, otherwise cleanup any remaining junk */
@@ -177,6 +175,8 @@ static void ups_data_stale(upstype_t *ups)
 	ups->stale = 1;
 
 	upslogx(LOG_NOTICE, "Data for UPS [%s] is stale - check driver", ups->name);
+
+	watch_notify_ups(ups, "DATASTALE");
 }
 
 /* mark the data ok if this is new, otherwise do nothing */
@@ -189,6 +189,8 @@ static void ups_data_ok(upstype_t *ups)
 	ups->stale = 0;
 
 	upslogx(LOG_NOTICE, "UPS [%s] data is no longer stale", ups->name);
+
+	watch_notify_ups(ups, "DATAOK");
 }
 
 /* add another listening address */
@@ -213,6 +215,28 @@ void listen_add(const char *addr, const char *port)
 	upsdebugx(3, "listen_add: added %s:%s", server->addr, server->port);
 }
 
+/* add a listening address for the metrics of stats.c */
+void metrics_listen_add(const char *addr, const char *port)
+{
+	stype_t	*server;
+
+	/* don't change listening addresses on reload */
+	if (reload_flag) {
+		return;
+	}
+
+	server = xcalloc(1, sizeof(*server));
+	server->addr = xstrdup(addr);
+	server->port = xstrdup(port);
+	server->sock_fd = -1;
+	server->metrics = 1;
+	server->next = firstmetrics;
+
+	firstmetrics = server;
+
+	upsdebugx(3, "metrics_listen_add: added %s:%s", server->addr, server->port);
+}
+
 /* create a listening socket for tcp connections */
 static void setuptcp(stype_t *server)
 {
@@ -306,23 +330,31 @@ static void declogins(const char *upsname)
 /* disconnect a client connection and free all related memory */
 static void client_disconnect(nut_ctype_t *client)
 {
+	size_t	i;
+
 	if (!client) {
 		return;
 	}
 
 	upsdebugx(2, "Disconnect from %s", client->addr);
 
+	evloop_del(client->sock_fd);
+	evtimer_del(&client->idle_timer);
+
 	shutdown(client->sock_fd, 2);
 	close(client->sock_fd);
 
-	if (client->loginups) {
-		declogins(client->loginups);
+	for (i = 0; i < client->numloginups; i++) {
+		declogins(client->loginups[i]);
+		free(client->loginups[i]);
 	}
 
 	ssl_finish(client);
 
 	pconf_finish(&client->ctx);
 
+	watch_client_free(client);
+
 	if (client->prev) {
 		client->prev->next = client->next;
 	} else {
@@ -337,6 +369,8 @@ static void client_disconnect(nut_ctype_t *client)
 		/* lastclient = client->prev; */
 	}
 
+	free(client->outbuf);
+	free(client->request);
 	free(client->addr);
 	free(client->loginups);
 	free(client->password);
@@ -346,10 +380,34 @@ static void client_disconnect(nut_ctype_t *client)
 	return;
 }
 
-/* send the buffer <sendbuf> of length <sendlen> to host <dest> */
+/* append <len> bytes to the output queue of <client> */
+static int outbuf_add(nut_ctype_t *client, const char *buf, size_t len)
+{
+	if (client->outbuf_len + len > CLIENT_OUTBUF_MAX) {
+		upslogx(LOG_NOTICE, "Output queue overflow for %s (not reading answers?)", client->addr);
+		stats.overflows++;
+		client->outbuf_len = 0;
+		client->last_heard = 0;
+		return 0;	/* failed */
+	}
+
+	if (client->outbuf_len + len > client->outbuf_size) {
+		while (client->outbuf_len + len > client->outbuf_size) {
+			client->outbuf_size = client->outbuf_size ? client->outbuf_size * 2 : LARGEBUF;
+		}
+		client->outbuf = xrealloc(client->outbuf, client->outbuf_size);
+	}
+
+	memcpy(client->outbuf + client->outbuf_len, buf, len);
+	client->outbuf_len += len;
+
+	return 1;	/* OK */
+}
+
+/* queue a formatted answer for <client>, see sendback_flush() */
 int sendback(nut_ctype_t *client, const char *fmt, ...)
 {
-	int	res, len;
+	int	len;
 	char ans[NUT_NET_ANSWER_MAX+1];
 	va_list ap;
 
@@ -357,30 +415,97 @@ int sendback(nut_ctype_t *client, const char *fmt, ...)
 		return 0;
 	}
 
+	/* going away (LOGOUT, overflow, failed write): nothing more for it,
+	 * and no rest of an answer cut short after what was already sent */
+	if (client->last_heard == 0) {
+		return 0;
+	}
+
 	va_start(ap, fmt);
 	vsnprintf(ans, sizeof(ans), fmt, ap);
 	va_end(ap);
 
 	len = strlen(ans);
 
+	if (!outbuf_add(client, ans, len)) {
+		return 0;	/* failed */
+	}
+
+	stats.answers++;
+	stats.answer_bytes += len;
+
+	if (client->outbuf_len > stats.outbuf_max) {
+		stats.outbuf_max = client->outbuf_len;
+	}
+
+	upsdebugx(2, "write: [destfd=%d] [len=%d] [%s]", client->sock_fd, len, str_rtrim(ans, '\n'));
+
+	return 1;	/* OK */
+}
+
+/* queue the HTTP answer of a METRICS client: unlike sendback(), this is
+ * not counted with the NUT answers, nor logged line by line */
+int sendback_http(nut_ctype_t *client, const char *buf, size_t len)
+{
+	if (!client || (client->last_heard == 0)) {
+		return 0;
+	}
+
+	return outbuf_add(client, buf, len);
+}
+
+/* write out as much of the queued answers as the socket takes without
+ * blocking: returns 1 if all is sent, 0 if some is left, -1 on error */
+int sendback_flush(nut_ctype_t *client)
+{
+	size_t	sent = 0;
+	int	res = 0;
+
+	while (sent < client->outbuf_len) {
+
 #ifdef WITH_SSL
-	if (client->ssl) {
-		res = ssl_write(client, ans, len);
-	} else
+		if (client->ssl) {
+			res = ssl_write(client, client->outbuf + sent, client->outbuf_len - sent);
+		} else
 #endif /* WITH_SSL */
-	{
-		res = write(client->sock_fd, ans, len);
+		{
+			res = write(client->sock_fd, client->outbuf + sent, client->outbuf_len - sent);
+		}
+
+		if (res > 0) {
+			sent += res;
+			continue;
+		}
+
+		if ((res < 0) && (errno == EINTR)) {
+			continue;
+		}
+
+		break;
 	}
 
-	upsdebugx(2, "write: [destfd=%d] [len=%d] [%s]", client->sock_fd, len, str_rtrim(ans, '\n'));
+	upsdebugx(3, "%s: [destfd=%d] sent %u of %u bytes", __func__, client->sock_fd,
+		(unsigned int)sent, (unsigned int)client->outbuf_len);
 
-	if (len != res) {
-		upslog_with_errno(LOG_NOTICE, "write() failed for %s", client->addr);
-		client->last_heard = 0;
-		return 0;	/* failed */
+	/* keep the rest for when the socket becomes writable */
+	client->outbuf_len -= sent;
+	memmove(client->outbuf, client->outbuf + sent, client->outbuf_len);
+
+	if (client->outbuf_len == 0) {
+		return 1;	/* OK */
 	}
 
-	return 1;	/* OK */
+	if ((res < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+		stats.short_writes++;
+		return 0;	/* try again later */
+	}
+
+	upslog_with_errno(LOG_NOTICE, "write() failed for %s", client->addr);
+	stats.failed_writes++;
+	client->outbuf_len = 0;
+	client->last_heard = 0;
+
+	return -1;	/* failed */
 }
 
 /* just a simple wrapper for now */
@@ -395,6 +520,20 @@ int send_err(nut_ctype_t *client, const char *errtype)
 	return sendback(client, "ERR %s\n", errtype);
 }
 
+/* position of upsname in the LOGINs of a client, -1 if it has none */
+int client_loginups(const nut_ctype_t *client, const char *upsname)
+{
+	size_t	i;
+
+	for (i = 0; i < client->numloginups; i++) {
+		if (!strcmp(client->loginups[i], upsname)) {
+			return (int)i;
+		}
+	}
+
+	return -1;
+}
+
 /* disconnect anyone logged into this UPS */
 void kick_login_clients(const char *upsname)
 {
@@ -404,12 +543,7 @@ void kick_login_clients(const char *upsname)
 
 		cnext = client->next;
 
-		/* if it's not logged in, don't check it */
-		if (!client->loginups) {
-			continue;
-		}
-
-		if (!strcmp(client->loginups, upsname)) {
+		if (client_loginups(client, upsname) >= 0) {
 			upslogx(LOG_INFO, "Kicking client %s (was on UPS [%s])\n", client->addr, upsname);
 			client_disconnect(client);
 		}
@@ -471,7 +605,9 @@ static void check_command(int cmdnum, nut_ctype_t *client, size_t numarg,
 /* parse requests from the network */
 static void parse_net(nut_ctype_t *client)
 {
+	nettoken_t	tok;
 	int	i;
+	struct timeval	start;
 
 	/* shouldn't happen */
 	if (client->ctx.numargs < 1) {
@@ -479,16 +615,73 @@ static void parse_net(nut_ctype_t *client)
 		return;
 	}
 
-	for (i = 0; netcmds[i].name; i++) {
-		if (!strcasecmp(netcmds[i].name, client->ctx.arglist[0])) {
-			check_command(i, client, client->ctx.numargs, (const char **) client->ctx.arglist);
-			return;
-		}
+	get_monotonic_time(&start);
+
+	/* commands come first in nettoken_t, in the order of netcmds */
+	tok = nettoken(client->ctx.arglist[0]);
+	i = (int)tok - (int)NT_VER;
+
+	if ((tok >= NT_VER) && (tok <= NT_LAST_COMMAND) && (netcmds[i].token == tok)) {
+		stats.command[i]++;
+		check_command(i, client, client->ctx.numargs, (const char **) client->ctx.arglist);
+		stats_hist_add(&stats.request, &start);
+		return;
 	}
 
 	/* fallthrough = not matched by any entry in netcmds */
 
+	stats.unknown++;
 	send_err(client, NUT_ERR_UNKNOWN_COMMAND);
+	stats_hist_add(&stats.request, &start);
+}
+
+/* inactivity timer for a client connection */
+static void client_check(void *data)
+{
+	nut_ctype_t	*client = (nut_ctype_t *)data;
+	time_t	now = evtimer_now();
+
+	/* subscribed clients are only expected to listen */
+	if (client->watches) {
+		evtimer_add(&client->idle_timer, now + CLIENT_INACTIVITY_DELAY);
+		return;
+	}
+
+	if (now - client->last_active > CLIENT_INACTIVITY_DELAY) {
+		client_disconnect(client);
+		return;
+	}
+
+	/* heard from it since the timer was armed: push the deadline out */
+	evtimer_add(&client->idle_timer, client->last_active + CLIENT_INACTIVITY_DELAY + 1);
+}
+
+/* send queued answers and pick what to wait for next on this client:
+ * stop reading requests while too much output is pending, and go away
+ * once everything is out after LOGOUT or a failure */
+static void client_write(nut_ctype_t *client)
+{
+	int	events = 0;
+
+	if (sendback_flush(client) < 0) {
+		client_disconnect(client);
+		return;
+	}
+
+	if (client->last_heard == 0) {
+		if (client->outbuf_len == 0) {
+			client_disconnect(client);
+			return;
+		}
+	} else if (client->outbuf_len < CLIENT_OUTBUF_HIWAT) {
+		events |= POLLIN;
+	}
+
+	if (client->outbuf_len > 0) {
+		events |= POLLOUT;
+	}
+
+	evloop_set_events(client->sock_fd, events);
 }
 
 /* answer incoming tcp connections */
@@ -500,7 +693,7 @@ static void client_connect(stype_t *server)
 #else
 	socklen_t	clen;
 #endif
-	int		fd;
+	int		fd, one = 1;
 	nut_ctype_t		*client;
 
 	clen = sizeof(csock);
@@ -510,11 +703,35 @@ static void client_connect(stype_t *server)
 		return;
 	}
 
+	/* answers are queued and written out as the socket takes them */
+	if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) == -1) {
+		upslog_with_errno(LOG_ERR, "%s: fcntl(set)", __func__);
+		close(fd);
+		return;
+	}
+
+	/* answers are written whole already, and the writes of the blocking
+	 * TLS handshake must not wait for delayed acknowledgements */
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	if (evloop_count() >= maxconn) {
+		/* refuse clients that we are unable to handle */
+		upslogx(LOG_NOTICE, "Maximum number of connections (%d) reached, "
+			"refusing connection from %s", maxconn, inet_ntopW(&csock));
+		stats.refused++;
+		close(fd);
+		return;
+	}
+
+	stats.accepted++;
+
 	client = xcalloc(1, sizeof(*client));
 
 	client->sock_fd = fd;
+	client->metrics = server->metrics;
 
 	time(&client->last_heard);
+	client->last_active = evtimer_now();
 
 	client->addr = xstrdup(inet_ntopW(&csock));
 
@@ -522,6 +739,11 @@ static void client_connect(stype_t *server)
 
 	pconf_init(&client->ctx, NULL);
 
+	evloop_add(fd, CLIENT, client);
+
+	evtimer_init(&client->idle_timer, client_check, client);
+	evtimer_add(&client->idle_timer, client->last_active + CLIENT_INACTIVITY_DELAY + 1);
+
 	if (firstclient) {
 		firstclient->prev = client;
 		client->next = firstclient;
@@ -544,7 +766,8 @@ static void client_connect(stype_t *server)
 static void client_readline(nut_ctype_t *client)
 {
 	char	buf[SMALLBUF];
-	int	i, ret;
+	int	ret;
+	size_t	i, used;
 
 #ifdef WITH_SSL
 	if (client->ssl) {
@@ -555,6 +778,10 @@ static void client_readline(nut_ctype_t *client)
 		ret = read(client->sock_fd, buf, sizeof(buf));
 	}
 
+	if ((ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))) {
+		return;	/* nothing after all */
+	}
+
 	if (ret < 0) {
 		upsdebug_with_errno(2, "Disconnect %s (read failure)", client->addr);
 		client_disconnect(client);
@@ -567,15 +794,42 @@ static void client_readline(nut_ctype_t *client)
 		return;
 	}
 
+	/* HTTP, not the NUT protocol: one request, then the connection is
+	 * closed once the answer is out */
+	if (client->metrics) {
+		switch (stats_http_read(client, buf, (size_t)ret))
+		{
+		case 1:
+			client->last_heard = 0;
+			client_write(client);
+			return;
+
+		case 0:
+			return;
+
+		default:
+			client_disconnect(client);
+			return;
+		}
+	}
+
 	/* fragment handling code */
-	for (i = 0; i < ret; i++) {
+	for (i = 0; i < (size_t)ret; i += used) {
 
-		/* add to the receive queue one by one */
-		switch (pconf_char(&client->ctx, buf[i]))
+		/* add to the receive queue a line at a time */
+		switch (pconf_buf(&client->ctx, buf + i, ret - i, &used))
 		{
 		case 1:
 			time(&client->last_heard);	/* command received */
+			client->last_active = evtimer_now();
 			parse_net(client);
+
+			/* LOGOUT, or an answer that overflowed the output queue:
+			 * the client is going away, leave its other requests */
+			if (client->last_heard == 0) {
+				client_write(client);
+				return;
+			}
 			continue;
 
 		case 0:
@@ -584,11 +838,13 @@ static void client_readline(nut_ctype_t *client)
 		default:
 			/* parse error */
 			upslogx(LOG_NOTICE, "Parse error on sock: %s", client->ctx.errmsg);
+			client_write(client);
 			return;
 		}
 	}
 
-	return;
+	/* all answers to this batch of requests go out together */
+	client_write(client);
 }
 
 void server_load(void)
@@ -608,23 +864,34 @@ void server_load(void)
 
 	for (server = firstaddr; server; server = server->next) {
 		setuptcp(server);
+		evloop_add(server->sock_fd, SERVER, server);
 	}
 
 	/* check if we have at least 1 valid LISTEN interface */
 	if (firstaddr->sock_fd < 0) {
 		fatalx(EXIT_FAILURE, "no listening interface available");
 	}
+
+	/* the metrics are optional, upsd runs without them if need be */
+	for (server = firstmetrics; server; server = server->next) {
+		setuptcp(server);
+
+		if (server->sock_fd >= 0) {
+			evloop_add(server->sock_fd, SERVER, server);
+		}
+	}
 }
 
-void server_free(void)
+static void server_list_free(stype_t *first)
 {
 	stype_t	*server, *snext;
 
 	/* cleanup server fds */
-	for (server = firstaddr; server; server = snext) {
+	for (server = first; server; server = snext) {
 		snext = server->next;
 
 		if (server->sock_fd != -1) {
+			evloop_del(server->sock_fd);
 			close(server->sock_fd);
 		}
 
@@ -632,8 +899,15 @@ void server_free(void)
 		free(server->port);
 		free(server);
 	}
+}
+
+void server_free(void)
+{
+	server_list_free(firstaddr);
+	server_list_free(firstmetrics);
 
 	firstaddr = NULL;
+	firstmetrics = NULL;
 }
 
 static void client_free(void)
@@ -654,7 +928,10 @@ static void driver_free(void)
 	for (ups = firstups; ups; ups = unext) {
 		unext = ups->next;
 
+		evtimer_del(&ups->check_timer);
+
 		if (ups->sock_fd != -1) {
+			evloop_del(ups->sock_fd);
 			close(ups->sock_fd);
 		}
 
@@ -668,6 +945,8 @@ static void driver_free(void)
 		free(ups->desc);
 		free(ups);
 	}
+
+	upsindex_free();
 }
 
 static void upsd_cleanup(void)
@@ -692,13 +971,31 @@ static void upsd_cleanup(void)
 	free(certname);
 	free(certpasswd);
 
-	free(fds);
-	free(handler);
+	evloop_free();
+}
+
+/* periodic check of a driver connection: reconnect or update staleness */
+static void ups_check(void *data)
+{
+	upstype_t	*ups = (upstype_t *)data;
+
+	/* see if we need to (re)connect to the socket */
+	if (ups->sock_fd < 0) {
+		ups->sock_fd = sstate_connect(ups);
+	} else if (sstate_dead(ups, maxage)) {
+		/* throw some warnings if it's not feeding us data any more */
+		ups_data_stale(ups);
+	} else {
+		ups_data_ok(ups);
+	}
+
+	evtimer_add(&ups->check_timer, evtimer_now() + 1);
 }
 
 static void poll_reload(void)
 {
 	int	ret;
+	upstype_t	*ups;
 
 	ret = sysconf(_SC_OPEN_MAX);
 
@@ -709,8 +1006,16 @@ static void poll_reload(void)
 			"problem is resolved.\n", ret, maxconn);
 	}
 
-	fds = xrealloc(fds, maxconn * sizeof(*fds));
-	handler = xrealloc(handler, maxconn * sizeof(*handler));
+	/* start watching newly defined UPS entries */
+	for (ups = firstups; ups; ups = ups->next) {
+
+		if (ups->check_timer.func) {
+			continue;
+		}
+
+		evtimer_init(&ups->check_timer, ups_check, ups);
+		evtimer_add(&ups->check_timer, 0);
+	}
 }
 
 /* instant command and setvar status tracking */
@@ -929,14 +1234,12 @@ int nut_uuid_v4(char *uuid_str)
 /* service requests and check on new data */
 static void mainloop(void)
 {
-	int	i, ret, nfds = 0;
-
-	upstype_t	*ups;
-	nut_ctype_t		*client, *cnext;
-	stype_t		*server;
+	int	ret, revents;
+	handler_t	handler;
 	time_t	now;
+	struct timeval	start, read_start;
 
-	time(&now);
+	now = evtimer_now();
 
 	if (reload_flag) {
 		conf_reload();
@@ -947,76 +1250,16 @@ static void mainloop(void)
 	/* cleanup instcmd/setvar status tracking entries if needed */
 	tracking_cleanup();
 
-	/* scan through driver sockets */
-	for (ups = firstups; ups && (nfds < maxconn); ups = ups->next) {
-
-		/* see if we need to (re)connect to the socket */
-		if (ups->sock_fd < 0) {
-			ups->sock_fd = sstate_connect(ups);
-			continue;
-		}
-
-		/* throw some warnings if it's not feeding us data any more */
-		if (sstate_dead(ups, maxage)) {
-			ups_data_stale(ups);
-		} else {
-			ups_data_ok(ups);
-		}
-
-		fds[nfds].fd = ups->sock_fd;
-		fds[nfds].events = POLLIN;
+	/* driver staleness checks, reconnects and idle clients */
+	evtimer_run(now);
 
-		handler[nfds].type = DRIVER;
-		handler[nfds].data = ups;
+	/* notifications queued since the last pass, by driver updates and
+	 * the staleness checks above */
+	watch_flush(client_write);
 
-		nfds++;
-	}
+	upsdebugx(2, "%s: polling %d filedescriptors", __func__, evloop_count());
 
-	/* scan through client sockets */
-	for (client = firstclient; client; client = cnext) {
-
-		cnext = client->next;
-
-		if (difftime(now, client->last_heard) > 60) {
-			/* shed clients after 1 minute of inactivity */
-			/* FIXME: create an upsd.conf parameter (CLIENT_INACTIVITY_DELAY) */
-			client_disconnect(client);
-			continue;
-		}
-
-		if (nfds >= maxconn) {
-			/* ignore clients that we are unable to handle */
-			continue;
-		}
-
-		fds[nfds].fd = client->sock_fd;
-		fds[nfds].events = POLLIN;
-
-		handler[nfds].type = CLIENT;
-		handler[nfds].data = client;
-
-		nfds++;
-	}
-
-	/* scan through server sockets */
-	for (server = firstaddr; server && (nfds < maxconn); server = server->next) {
-
-		if (server->sock_fd < 0) {
-			continue;
-		}
-
-		fds[nfds].fd = server->sock_fd;
-		fds[nfds].events = POLLIN;
-
-		handler[nfds].type = SERVER;
-		handler[nfds].data = server;
-
-		nfds++;
-	}
-
-	upsdebugx(2, "%s: polling %d filedescriptors", __func__, nfds);
-
-	ret = poll(fds, nfds, 2000);
+	ret = evloop_wait(evtimer_timeout(now, MAINLOOP_TIMEOUT));
 
 	if (ret == 0) {
 		upsdebugx(2, "%s: no data available", __func__);
@@ -1024,21 +1267,26 @@ static void mainloop(void)
 	}
 
 	if (ret < 0) {
-		upslog_with_errno(LOG_ERR, "%s", __func__);
+		if (errno != EINTR) {
+			upslog_with_errno(LOG_ERR, "%s", __func__);
+		}
 		return;
 	}
 
-	for (i = 0; i < nfds; i++) {
+	/* the time spent on what woke us up, not the wait */
+	get_monotonic_time(&start);
+
+	while (evloop_next(&handler, &revents)) {
 
-		if (fds[i].revents & (POLLHUP|POLLERR|POLLNVAL)) {
+		if (revents & (POLLHUP|POLLERR|POLLNVAL)) {
 
-			switch(handler[i].type)
+			switch(handler.type)
 			{
 			case DRIVER:
-				sstate_disconnect((upstype_t *)handler[i].data);
+				sstate_disconnect((upstype_t *)handler.data);
 				break;
 			case CLIENT:
-				client_disconnect((nut_ctype_t *)handler[i].data);
+				client_disconnect((nut_ctype_t *)handler.data);
 				break;
 			case SERVER:
 				upsdebugx(2, "%s: server disconnected", __func__);
@@ -1064,18 +1312,27 @@ static void mainloop(void)
 			continue;
 		}
 
-		if (fds[i].revents & POLLIN) {
+		/* a client with queued output; any new request will still
+		 * be there next time */
+		if ((revents & POLLOUT) && (handler.type == CLIENT)) {
+			client_write((nut_ctype_t *)handler.data);
+			continue;
+		}
 
-			switch(handler[i].type)
+		if (revents & POLLIN) {
+
+			switch(handler.type)
 			{
 			case DRIVER:
-				sstate_readline((upstype_t *)handler[i].data);
+				get_monotonic_time(&read_start);
+				sstate_readline((upstype_t *)handler.data);
+				stats_hist_add(&stats.driver, &read_start);
 				break;
 			case CLIENT:
-				client_readline((nut_ctype_t *)handler[i].data);
+				client_readline((nut_ctype_t *)handler.data);
 				break;
 			case SERVER:
-				client_connect((stype_t *)handler[i].data);
+				client_connect((stype_t *)handler.data);
 				break;
 
 #if (defined HAVE_PRAGMA_GCC_DIAGNOSTIC_PUSH_POP) && (defined HAVE_PRAGMA_GCC_DIAGNOSTIC_IGNORED_COVERED_SWITCH_DEFAULT)
@@ -1097,6 +1354,8 @@ static void mainloop(void)
 			continue;
 		}
 	}
+
+	stats_hist_add(&stats.loop, &start);
 }
 
 static void help(const char *arg_progname)
@@ -1296,6 +1555,11 @@ int main(int argc, char **argv)
 	/* default to system limit (may be overridden in upsd.conf */
 	maxconn = sysconf(_SC_OPEN_MAX);
 
+	/* sockets get registered as they are opened from here on */
+	evloop_init();
+	stats_init();
+	nettoken_init();	/* fails on a keyword collision */
+
 	/* handle upsd.conf */
 	load_upsdconf(0);	/* 0 = initial */
 
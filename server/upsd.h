@@ -57,10 +57,14 @@ upstype_t *get_ups_ptr(const char *upsname);
 int ups_available(const upstype_t *ups, nut_ctype_t *client);
 
 void listen_add(const char *addr, const char *port);
+void metrics_listen_add(const char *addr, const char *port);
 
 void kick_login_clients(const char *upsname);
+int client_loginups(const nut_ctype_t *client, const char *upsname);
 int sendback(nut_ctype_t *client, const char *fmt, ...)
 	__attribute__ ((__format__ (__printf__, 2, 3)));
+int sendback_http(nut_ctype_t *client, const char *buf, size_t len);
+int sendback_flush(nut_ctype_t *client);
 int send_err(nut_ctype_t *client, const char *errtype);
 
 void server_load(void);
@@ -90,7 +94,7 @@ int tracking_disable(void);
 int tracking_is_enabled(void);
 
 /* declarations from upsd.c */
-extern int		maxage, maxconn, tracking_delay, allow_no_device;
+extern int		maxage, maxconn, tracking_delay, allow_no_device, driver_binary;
 extern char		*statepath, *datapath;
 extern upstype_t	*firstups;
 extern nut_ctype_t	*firstclient;
@@ -0,0 +1,126 @@
+/* upsindex.c - name-keyed hash index over the configured UPS entries
+
+   Almost every network command starts by resolving a UPS name, so with
+   hundreds of devices behind one upsd a linear scan of the firstups
+   list is paid on each request. This keeps a chained hash table next
+   to that list, keyed on the case-folded name, and grows it as needed.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "common.h"
+#include "upsindex.h"
+
+#include <ctype.h>
+
+static upstype_t	**buckets = NULL;
+static size_t	nbuckets = 0, nentries = 0;
+
+/* FNV-1a over the lowercase name */
+static size_t upsindex_hash(const char *name)
+{
+	size_t	hash = 2166136261U;
+
+	for (; *name; name++) {
+		hash ^= (unsigned char)tolower((unsigned char)*name);
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static void upsindex_grow(void)
+{
+	upstype_t	**old = buckets, *ups, *next;
+	size_t	i, oldsize = nbuckets;
+
+	nbuckets = nbuckets ? nbuckets * 2 : 64;
+	buckets = xcalloc(nbuckets, sizeof(*buckets));
+
+	for (i = 0; i < oldsize; i++) {
+		for (ups = old[i]; ups; ups = next) {
+			size_t	h = upsindex_hash(ups->name) & (nbuckets - 1);
+
+			next = ups->hash_next;
+			ups->hash_next = buckets[h];
+			buckets[h] = ups;
+		}
+	}
+
+	free(old);
+}
+
+void upsindex_add(upstype_t *ups)
+{
+	size_t	h;
+
+	/* keep the chains short: at most one entry per bucket on average */
+	if (nentries >= nbuckets) {
+		upsindex_grow();
+	}
+
+	h = upsindex_hash(ups->name) & (nbuckets - 1);
+
+	ups->hash_next = buckets[h];
+	buckets[h] = ups;
+	nentries++;
+}
+
+void upsindex_del(const upstype_t *ups)
+{
+	upstype_t	**pp;
+
+	if (!nbuckets) {
+		return;
+	}
+
+	for (pp = &buckets[upsindex_hash(ups->name) & (nbuckets - 1)]; *pp; pp = &(*pp)->hash_next) {
+
+		if (*pp != ups) {
+			continue;
+		}
+
+		*pp = ups->hash_next;
+		nentries--;
+		return;
+	}
+
+	upslogx(LOG_ERR, "%s: UPS [%s] not found", __func__, ups->name);
+}
+
+upstype_t *upsindex_find(const char *name)
+{
+	upstype_t	*ups;
+
+	if ((!name) || (!nbuckets)) {
+		return NULL;
+	}
+
+	for (ups = buckets[upsindex_hash(name) & (nbuckets - 1)]; ups; ups = ups->hash_next) {
+		if (!strcasecmp(ups->name, name)) {
+			return ups;
+		}
+	}
+
+	return NULL;
+}
+
+void upsindex_free(void)
+{
+	free(buckets);
+
+	buckets = NULL;
+	nbuckets = nentries = 0;
+}
@@ -0,0 +1,42 @@
+/* upsindex.h - name-keyed hash index over the configured UPS entries
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef NUT_UPSINDEX_H_SEEN
+#define NUT_UPSINDEX_H_SEEN 1
+
+#include "upstype.h"
+
+#ifdef __cplusplus
+/* *INDENT-OFF* */
+extern "C" {
+/* *INDENT-ON* */
+#endif
+
+/* entries are added when created from ups.conf and removed before
+ * they are freed; names are matched case-insensitively */
+void upsindex_add(upstype_t *ups);
+void upsindex_del(const upstype_t *ups);
+upstype_t *upsindex_find(const char *name);
+void upsindex_free(void);
+
+#ifdef __cplusplus
+/* *INDENT-OFF* */
+}
+/* *INDENT-ON* */
+#endif
+
+#endif	/* NUT_UPSINDEX_H_SEEN */
@@ -23,6 +23,7 @@
 #define NUT_UPSTYPE_H_SEEN 1
 
 #include "parseconf.h"
+#include "evloop.h"
 
 #ifdef __cplusplus
 /* *INDENT-OFF* */
@@ -44,6 +45,12 @@ typedef struct upstype_s {
 	time_t			last_ping;
 	time_t			last_connfail;
 	PCONF_CTX_t		sock_ctx;
+	int			binary;		/* driver sends dsframe frames */
+	unsigned char		*rbuf;		/* partial frame, when binary */
+	size_t			rbuf_len;
+	size_t			rbuf_size;
+	char			**varnames;	/* interned variable names, by id */
+	unsigned int		varnames_size;
 	struct st_tree_s	*inforoot;
 	struct cmdlist_s	*cmdlist;
 
@@ -52,7 +59,15 @@ typedef struct upstype_s {
 
 	int	retain;
 
+	evtimer_t		check_timer;	/* staleness and reconnect checks */
+
+	/* counters served by stats.c */
+	unsigned long		stat_updates;	/* lines or records read */
+	unsigned long		stat_bytes;
+	unsigned long		stat_connects;
+
 	struct upstype_s	*next;
+	struct upstype_s	*hash_next;	/* see upsindex.c */
 
 } upstype_t;
 
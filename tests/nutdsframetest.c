@@ -0,0 +1,221 @@
+/* nutdsframetest - checks the binary driver socket framing
+ * (common/dsframe.c) and compares its decoding cost with the text form.
+ *
+ * Records are encoded and decoded back, truncated or corrupted frames
+ * must be rejected. With NUT_TEST_BENCH set, a poll's worth of SETINFO
+ * updates is parsed both as text lines through pconf_char() (as upsd does
+ * for the text protocol) and as one frame.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common.h"
+#include "nuttest.h"
+#include "parseconf.h"
+#include "dsframe.h"
+
+#define NUMVARS	500
+#define ROUNDS	200
+
+/* decode all records of a sealed frame, -1 if it is rejected */
+static int decode(unsigned char *buf, size_t len, dsframe_rec_t *recs, int max)
+{
+	long	flen = dsframe_length(buf, len);
+	size_t	pos = 0;
+	int	n = 0, ret;
+
+	if ((flen <= 0) || ((size_t)flen > len)) {
+		return -1;
+	}
+
+	while ((n < max) && ((ret = dsframe_next(buf + DSFRAME_HDRLEN,
+		(size_t)flen - DSFRAME_HDRLEN, &pos, &recs[n])) > 0)) {
+		n++;
+	}
+
+	return (ret < 0) ? -1 : n;
+}
+
+/* one poll of a large device, text lines vs one frame */
+static void bench(dsframe_t *frame)
+{
+	dsframe_rec_t	recs[1];
+	PCONF_CTX_t	ctx;
+	const char	*argv[1];
+	char	line[SMALLBUF], *text;
+	size_t	len, tlen = 0, i;
+	int	r, v;
+	long	parsed_text = 0, parsed_bin = 0;
+	double	t_text, t_bin;
+
+	dsframe_reset(frame);
+	text = xcalloc(NUMVARS, SMALLBUF);
+
+	for (v = 0; v < NUMVARS; v++) {
+		snprintf(line, sizeof(line), "SETINFO outlet.%d.realpower \"%d.%d\"\n", v, v * 3, v % 10);
+		memcpy(text + tlen, line, strlen(line));
+		tlen += strlen(line);
+
+		snprintf(line, sizeof(line), "%d.%d", v * 3, v % 10);
+		argv[0] = line;
+		dsframe_add(frame, DSF_SETINFO, (unsigned int)v + 1, 1, argv);
+	}
+
+	len = dsframe_seal(frame);
+
+	pconf_init(&ctx, NULL);
+	t_text = now();
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; i < tlen; i++) {
+			if (pconf_char(&ctx, text[i]) == 1) {
+				parsed_text += (ctx.numargs == 3);
+			}
+		}
+	}
+	t_text = now() - t_text;
+	pconf_finish(&ctx);
+
+	t_bin = now();
+	for (r = 0; r < ROUNDS; r++) {
+		size_t	pos = 0;
+		long	flen = dsframe_length(frame->buf, len);
+
+		while (dsframe_next(frame->buf + DSFRAME_HDRLEN, (size_t)flen - DSFRAME_HDRLEN,
+			&pos, &recs[0]) > 0) {
+			parsed_bin += (recs[0].argc == 1);
+		}
+	}
+	t_bin = now() - t_bin;
+
+	CHECK(parsed_text == (long)NUMVARS * ROUNDS, "text updates parsed");
+	CHECK(parsed_bin == (long)NUMVARS * ROUNDS, "framed updates parsed");
+
+	printf("driver socket: %d updates, text %d bytes %.1f ns/update, "
+		"binary %d bytes %.1f ns/update\n", NUMVARS,
+		(int)tlen, t_text * 1e9 / ((double)NUMVARS * ROUNDS),
+		(int)len, t_bin * 1e9 / ((double)NUMVARS * ROUNDS));
+
+	free(text);
+}
+
+int main(void)
+{
+	dsframe_t	frame;
+	dsframe_rec_t	recs[16];
+	const char	*argv[3];
+	char	val[SMALLBUF];
+	unsigned char	*copy;
+	size_t	len, i, pos;
+	int	n, v;
+
+	/* round trip */
+	dsframe_init(&frame);
+	CHECK(!dsframe_pending(&frame), "empty frame pending");
+	CHECK(dsframe_seal(&frame) == 0, "empty frame sealed");
+
+	argv[0] = "ups.status";
+	CHECK(dsframe_add(&frame, DSF_DEFVAR, 1, 1, argv), "add DEFVAR");
+	argv[0] = "OL CHRG";
+	CHECK(dsframe_add(&frame, DSF_SETINFO, 1, 1, argv), "add SETINFO");
+	argv[0] = "RW";
+	argv[1] = "STRING";
+	CHECK(dsframe_add(&frame, DSF_SETFLAGS, 1, 2, argv), "add SETFLAGS");
+	argv[0] = "";
+	CHECK(dsframe_add(&frame, DSF_SETINFO, 65535, 1, argv), "add empty value");
+	CHECK(dsframe_add(&frame, DSF_DUMPDONE, 0, 0, NULL), "add DUMPDONE");
+	argv[0] = "load.off";
+	CHECK(dsframe_add(&frame, DSF_ADDCMD, 0, 1, argv), "add ADDCMD");
+	CHECK(!dsframe_add(&frame, DSF_COUNT, 0, 0, NULL), "bad op accepted");
+	CHECK(!dsframe_add(&frame, DSF_SETINFO, 65536, 1, argv), "bad id accepted");
+
+	len = dsframe_seal(&frame);
+	CHECK(len == frame.len, "sealed length");
+
+	n = decode(frame.buf, len, recs, 16);
+	CHECK(n == 6, "decoded %d records", n);
+
+	if (n == 6) {
+		CHECK((recs[0].op == DSF_DEFVAR) && (recs[0].varid == 1) &&
+			!strcmp(recs[0].argv[0], "ups.status"), "DEFVAR");
+		CHECK((recs[1].op == DSF_SETINFO) && (recs[1].argc == 1) &&
+			!strcmp(recs[1].argv[0], "OL CHRG"), "SETINFO");
+		CHECK((recs[2].argc == 2) && !strcmp(recs[2].argv[1], "STRING"), "SETFLAGS");
+		CHECK((recs[3].varid == 65535) && (recs[3].argv[0][0] == '\0'), "empty value");
+		CHECK((recs[4].op == DSF_DUMPDONE) && (recs[4].argc == 0), "DUMPDONE");
+		CHECK((recs[5].op == DSF_ADDCMD) && (recs[5].varid == 0) &&
+			!strcmp(recs[5].argv[0], "load.off"), "ADDCMD");
+	}
+
+	CHECK(!strcmp(dsframe_opname(DSF_SETINFO), "SETINFO"), "opname");
+	CHECK(dsframe_opname(0) == NULL, "opname of 0");
+
+	/* incomplete and corrupted frames */
+	CHECK(dsframe_length(frame.buf, 3) == 0, "short header");
+	CHECK(dsframe_length(frame.buf, len - 1) == (long)len, "length before all data is in");
+
+	copy = xcalloc(1, len);
+
+	for (i = DSFRAME_HDRLEN; i < len; i++) {
+		/* cut the payload short: every cut must be caught */
+		memcpy(copy, frame.buf, len);
+		copy[0] = copy[1] = 0;
+		copy[2] = (unsigned char)(((i - DSFRAME_HDRLEN) >> 8) & 0xff);
+		copy[3] = (unsigned char)((i - DSFRAME_HDRLEN) & 0xff);
+
+		n = decode(copy, i, recs, 16);
+		CHECK((n < 0) || (n < 6), "truncated at %d decoded as complete", (int)i);
+	}
+
+	memcpy(copy, frame.buf, len);
+	copy[DSFRAME_HDRLEN] = 0xff;
+	CHECK(decode(copy, len, recs, 16) < 0, "bad op");
+
+	memcpy(copy, frame.buf, len);
+	copy[len - 1] = 'x';
+	CHECK(decode(copy, len, recs, 16) < 0, "missing NUL");
+
+	memcpy(copy, frame.buf, len);
+	copy[0] = 0x7f;
+	CHECK(dsframe_length(copy, len) < 0, "oversized frame");
+
+	free(copy);
+
+	/* one poll of a large device, varids past one byte */
+	dsframe_reset(&frame);
+	for (v = 0; v < NUMVARS; v++) {
+		snprintf(val, sizeof(val), "%d.%d", v * 3, v % 10);
+		argv[0] = val;
+		dsframe_add(&frame, DSF_SETINFO, (unsigned int)v + 1, 1, argv);
+	}
+
+	len = dsframe_seal(&frame);
+	CHECK(dsframe_length(frame.buf, len) == (long)len, "length of %d updates", NUMVARS);
+
+	for (pos = 0, v = 0; dsframe_next(frame.buf + DSFRAME_HDRLEN, len - DSFRAME_HDRLEN,
+		&pos, &recs[0]) > 0; v++) {
+		snprintf(val, sizeof(val), "%d.%d", v * 3, v % 10);
+		CHECK((recs[0].varid == (unsigned int)v + 1) && !strcmp(recs[0].argv[0], val),
+			"update %d of a large frame", v);
+	}
+	CHECK(v == NUMVARS, "%d of %d updates decoded", v, NUMVARS);
+
+	if (bench_wanted()) {
+		bench(&frame);
+	}
+
+	dsframe_free(&frame);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,432 @@
+/* nutdstatetest - checks how the driver side state (drivers/dstate.c)
+ * sends its changes to a listener such as upsd.
+ *
+ * A listener connects to the driver socket, then a few polls' worth of
+ * changes are made inside dstate_batch_begin()/dstate_batch_commit().
+ * Only the net changes must come out, in order, and each commit must
+ * reach the listener in a single write. The poll loop must then sleep
+ * until its deadline, unless a descriptor registered by the driver
+ * becomes readable. Devices added with dstate_add_device() must each
+ * keep to their own socket and state. Values with quotes and backslashes
+ * must come out of a binary dump as they were set.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common.h"
+#include "nuttest.h"
+#include "dstate.h"
+#include "dsframe.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define NUMVARS	300
+#define NUMDEVICES	3
+
+/* normally from drivers/main.c */
+int	do_synchronous = 0;
+
+/* let the driver side accept and answer whatever is pending */
+static void poll_once(void)
+{
+	struct timeval	tv;
+
+	get_monotonic_time(&tv);
+	dstate_poll_fds(tv, -1);
+}
+
+/* one read: everything a commit sent is expected to be there at once */
+static int read_once(int fd, char *buf, size_t size)
+{
+	ssize_t	ret = read(fd, buf, size - 1);
+
+	buf[(ret > 0) ? ret : 0] = '\0';
+
+	return (int)ret;
+}
+
+/* milliseconds spent in dstate_poll_fds() until it returns 1 */
+static long poll_until(long deadline_ms)
+{
+	struct timeval	start, end, deadline;
+
+	get_monotonic_time(&start);
+	deadline = start;
+	deadline.tv_sec += deadline_ms / 1000;
+	deadline.tv_usec += (deadline_ms % 1000) * 1000;
+
+	if (deadline.tv_usec >= 1000000) {
+		deadline.tv_sec++;
+		deadline.tv_usec -= 1000000;
+	}
+
+	while (!dstate_poll_fds(deadline, -1)) {
+		/* like the driver main loop */
+	}
+
+	get_monotonic_time(&end);
+
+	return (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+}
+
+static int connect_to(const char *dir, const char *name)
+{
+	struct sockaddr_un	sa;
+	int	fd;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	snprintf(sa.sun_path, sizeof(sa.sun_path), "%s/%s", dir, name);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	CHECK(connect(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0, "connect to %s", name);
+
+	return fd;
+}
+
+/* the value of the first op record starting with prefix in the frames
+ * of a binary connection, after the text acknowledgement if ack is set */
+static int read_record(int fd, int ack, int op, const char *prefix, char *val, size_t valsize)
+{
+	static unsigned char	rbuf[65536];
+	size_t	len = 0, pos, rpos;
+	long	flen;
+	dsframe_rec_t	rec;
+	struct pollfd	pfd;
+	ssize_t	ret;
+	const char	*ackline = "FRAMING BINARY\n";
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	while ((poll(&pfd, 1, 100) > 0) && (len < sizeof(rbuf))) {
+		if ((ret = read(fd, rbuf + len, sizeof(rbuf) - len)) <= 0) {
+			break;
+		}
+
+		len += (size_t)ret;
+	}
+
+	pos = 0;
+
+	if (ack) {
+		if ((len < strlen(ackline)) || memcmp(rbuf, ackline, strlen(ackline))) {
+			return 0;
+		}
+
+		pos = strlen(ackline);
+	}
+
+	while ((flen = dsframe_length(rbuf + pos, len - pos)) > 0) {
+		if ((size_t)flen > len - pos) {
+			return 0;
+		}
+
+		rpos = 0;
+
+		while (dsframe_next(rbuf + pos + DSFRAME_HDRLEN, (size_t)flen - DSFRAME_HDRLEN, &rpos, &rec) > 0) {
+			if ((rec.op == op) && (rec.argc > 0) && !strncmp(rec.argv[0], prefix, strlen(prefix))) {
+				snprintf(val, valsize, "%s", rec.argv[0]);
+				return 1;
+			}
+		}
+
+		pos += (size_t)flen;
+	}
+
+	return 0;
+}
+
+static int count_lines(const char *buf, const char *prefix)
+{
+	int	count = 0;
+	const char	*p;
+
+	for (p = buf; p && *p; p = strchr(p, '\n'), p = p ? p + 1 : NULL) {
+		if (!strncmp(p, prefix, strlen(prefix))) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/* the fd the driver passes to dstate_poll_fds() */
+static int	extrafd = -1;
+
+/* an INSTCMD handler reopening it under another number, as drivers do
+ * when they reconnect to their device */
+static int reopen_extrafd(const char *cmdname, const char *extra)
+{
+	int	newfd = dup(extrafd);
+
+	NUT_UNUSED_VARIABLE(cmdname);
+	NUT_UNUSED_VARIABLE(extra);
+
+	close(extrafd);
+	extrafd = newfd;
+
+	return STAT_INSTCMD_HANDLED;
+}
+
+int main(void)
+{
+	char	dir[SMALLBUF], line[SMALLBUF], *buf;
+	int	fd, bfd, i, r, len, oldfd, pfd[2], dfd[NUMDEVICES];
+	struct timeval	tv;
+	struct pollfd	pf;
+	dstate_device_t	*first, *dev[NUMDEVICES];
+	long	ms;
+	size_t	bufsize = 256 * 1024;
+
+	/* a private state path for the driver socket */
+	snprintf(dir, sizeof(dir), "/tmp/nutdstatetest.XXXXXX");
+	if (!mkdtemp(dir)) {
+		fatal_with_errno(EXIT_FAILURE, "mkdtemp");
+	}
+	setenv("NUT_STATEPATH", dir, 1);
+
+	buf = xcalloc(1, bufsize);
+
+	for (i = 0; i < NUMVARS; i++) {
+		snprintf(buf, bufsize, "outlet.%d.current", i);
+		dstate_setinfo(buf, "%d", 0);
+	}
+	dstate_setinfo("ups.status", "OL");
+
+	dstate_init("nutdstatetest", NULL);
+
+	fd = connect_to(dir, "nutdstatetest");
+
+	/* the dump goes out as one write */
+	CHECK(write(fd, "DUMPALL\n", 8) == 8, "DUMPALL");
+	poll_once();	/* accept */
+	poll_once();	/* read DUMPALL, answer */
+
+	len = read_once(fd, buf, bufsize);
+	CHECK(count_lines(buf, "SETINFO ") == NUMVARS + 1, "dump has %d SETINFO", count_lines(buf, "SETINFO "));
+	CHECK(count_lines(buf, "DUMPDONE") == 1, "dump is complete");
+
+	/* each poll changes every value a few times, and puts some back */
+	for (r = 1; r <= 3; r++) {
+		dstate_batch_begin();
+
+		for (i = 0; i < NUMVARS; i++) {
+			snprintf(buf, bufsize, "outlet.%d.current", i);
+			dstate_setinfo(buf, "%d", r * 100);
+			dstate_setinfo(buf, "%d", r * 100 + 1);
+
+			/* even ones end up where they were */
+			dstate_setinfo(buf, "%d", (i % 2) ? r * 100 + 2 : 0);
+		}
+
+		dstate_setinfo("ups.status", "OB");
+		dstate_setinfo("ups.status", "OL");
+
+		/* created and dropped in the same poll */
+		dstate_setinfo("ups.test.result", "in progress");
+		dstate_delinfo("ups.test.result");
+
+		dstate_batch_commit();
+
+		len = read_once(fd, buf, bufsize);
+
+		CHECK(len > 0, "poll %d: nothing sent", r);
+		CHECK(count_lines(buf, "SETINFO outlet.") == NUMVARS / 2,
+			"poll %d: %d outlet updates", r, count_lines(buf, "SETINFO outlet."));
+		CHECK(count_lines(buf, "SETINFO ups.status") == 0, "poll %d: status flapped", r);
+		CHECK(count_lines(buf, "SETINFO ups.test.result") == 1, "poll %d: new variable", r);
+		CHECK(strstr(buf, "SETINFO ups.test.result") < strstr(buf, "DELINFO ups.test.result"),
+			"poll %d: delete before set", r);
+
+		snprintf(line, sizeof(line), "SETINFO outlet.1.current \"%d\"\n", r * 100 + 2);
+		CHECK(strstr(buf, line) != NULL, "poll %d: last value wins", r);
+
+		printf("poll %d: %d changes made, %d lines in a single %d byte write\n", r,
+			3 * NUMVARS + 4, count_lines(buf, ""), len);
+	}
+
+	/* outside of a batch, changes still get out */
+	dstate_setinfo("ups.status", "OB");
+	poll_once();
+	read_once(fd, buf, bufsize);
+	CHECK(!strcmp(buf, "SETINFO ups.status \"OB\"\n"), "unbatched change: %s", buf);
+
+	/* escaped in the tree, but sent as they are in frames, when dumped
+	 * just like when they change */
+	dstate_setinfo("ups.test.quoted", "say \"hi\" to C:\\UPS");
+	dstate_addenum("ups.test.quoted", "an \"enum\" \\ value");
+	poll_once();
+	read_once(fd, buf, bufsize);
+
+	bfd = connect_to(dir, "nutdstatetest");
+	CHECK(write(bfd, "DUMPALL BINARY\n", 15) == 15, "DUMPALL BINARY");
+	poll_once();	/* accept */
+	poll_once();	/* read DUMPALL, answer */
+
+	CHECK(read_record(bfd, 1, DSF_SETINFO, "say ", line, sizeof(line)) &&
+		!strcmp(line, "say \"hi\" to C:\\UPS"), "binary dump: value [%s]", line);
+
+	dstate_setinfo("ups.test.quoted", "say \"bye\" to C:\\UPS");
+	poll_once();
+	read_once(fd, buf, bufsize);
+
+	CHECK(read_record(bfd, 0, DSF_SETINFO, "say ", line, sizeof(line)) &&
+		!strcmp(line, "say \"bye\" to C:\\UPS"), "binary update: value [%s]", line);
+
+	close(bfd);
+	poll_once();	/* notice it is gone */
+
+	bfd = connect_to(dir, "nutdstatetest");
+	CHECK(write(bfd, "DUMPALL BINARY\n", 15) == 15, "DUMPALL BINARY");
+	poll_once();
+	poll_once();
+
+	CHECK(read_record(bfd, 1, DSF_ADDENUM, "an ", line, sizeof(line)) &&
+		!strcmp(line, "an \"enum\" \\ value"), "binary dump: enum [%s]", line);
+
+	close(bfd);
+	poll_once();
+
+	/* nothing to do: sleep until the deadline */
+	ms = poll_until(200);
+	CHECK((ms >= 200) && (ms < 1000), "slept %ld ms for 200", ms);
+
+	/* a registered fd cuts the sleep short */
+	CHECK(pipe(pfd) == 0, "pipe");
+	CHECK(dstate_register_fd(pfd[0]), "register");
+	CHECK(write(pfd[1], "x", 1) == 1, "write to pipe");
+
+	ms = poll_until(5000);
+	CHECK(ms < 1000, "registered fd: woke up after %ld ms", ms);
+	printf("idle poll slept until its deadline, registered fd woke it after %ld ms\n", ms);
+
+	/* and stops doing so once unregistered */
+	dstate_unregister_fd(pfd[0]);
+	ms = poll_until(100);
+	CHECK(ms >= 100, "unregistered fd: woke up after %ld ms", ms);
+
+	close(pfd[0]);
+	close(pfd[1]);
+
+	/* the driver closes its extrafd while handling a command, and the
+	 * number goes to a connection accepted in the same call: moving on
+	 * to the new extrafd must not take that connection out of the set */
+	CHECK(pipe(pfd) == 0, "pipe");
+	extrafd = oldfd = pfd[0];
+	upsh.instcmd = reopen_extrafd;
+
+	get_monotonic_time(&tv);
+	dstate_poll_fds(tv, extrafd);
+
+	bfd = connect_to(dir, "nutdstatetest");
+	CHECK(write(fd, "INSTCMD reopen\n", 15) == 15, "INSTCMD");
+
+	get_monotonic_time(&tv);
+	dstate_poll_fds(tv, extrafd);	/* reopen, then accept */
+	CHECK(extrafd != oldfd, "extrafd not reopened");
+
+	get_monotonic_time(&tv);
+	dstate_poll_fds(tv, extrafd);
+
+	CHECK(write(bfd, "PING\n", 5) == 5, "PING");
+	poll_once();
+
+	pf.fd = bfd;
+	pf.events = POLLIN;
+	CHECK((poll(&pf, 1, 1000) == 1) && (read_once(bfd, buf, bufsize) > 0) && !strcmp(buf, "PONG\n"),
+		"connection after the extrafd was reopened: [%s]", buf);
+
+	upsh.instcmd = NULL;
+	close(bfd);
+	close(extrafd);
+	close(pfd[1]);
+	poll_once();
+
+	/* more devices, each with its own socket and variables */
+	CHECK(dstate_next_device(NULL) == NULL, "devices of a single device driver");
+	first = dstate_get_device();
+
+	for (i = 0; i < NUMDEVICES; i++) {
+		snprintf(line, sizeof(line), "dev%d", i);
+		dev[i] = dstate_add_device("nutdstatetest", line);
+
+		dstate_select_device(dev[i]);
+		dstate_setinfo("ups.status", "OL");
+		dstate_setinfo("device.index", "%d", i);
+		dstate_dataok();
+
+		snprintf(line, sizeof(line), "nutdstatetest-dev%d", i);
+		dfd[i] = connect_to(dir, line);
+		CHECK(write(dfd[i], "DUMPALL\n", 8) == 8, "device %d: DUMPALL", i);
+	}
+
+	dstate_select_device(first);
+	CHECK(!strcmp(dstate_getinfo("ups.status"), "OB"), "first device changed");
+
+	CHECK(dstate_next_device(NULL) == first, "first device listed first");
+	CHECK((dstate_next_device(first) == dev[0]) && (dstate_next_device(dev[0]) == dev[1]) &&
+		(dstate_next_device(dev[NUMDEVICES - 1]) == NULL), "devices listed in order");
+
+	poll_once();	/* accept */
+	poll_once();	/* read DUMPALL, answer */
+
+	for (i = 0; i < NUMDEVICES; i++) {
+		read_once(dfd[i], buf, bufsize);
+		snprintf(line, sizeof(line), "SETINFO device.index \"%d\"\n", i);
+		CHECK(strstr(buf, line) && (count_lines(buf, "SETINFO ") == 2) && strstr(buf, "DUMPDONE"),
+			"device %d: dump %s", i, buf);
+	}
+
+	/* a batch goes to the listeners of its device only */
+	dstate_select_device(dev[1]);
+	dstate_batch_begin();
+	dstate_setinfo("ups.status", "OB");
+	dstate_batch_commit();
+
+	dstate_select_device(dev[2]);
+	dstate_setinfo("ups.status", "OB LB");
+
+	dstate_select_device(first);
+	dstate_setinfo("ups.status", "OL");
+	poll_once();
+
+	read_once(dfd[1], buf, bufsize);
+	CHECK(!strcmp(buf, "SETINFO ups.status \"OB\"\n"), "device 1: %s", buf);
+	read_once(dfd[2], buf, bufsize);
+	CHECK(!strcmp(buf, "SETINFO ups.status \"OB LB\"\n"), "device 2: %s", buf);
+	read_once(fd, buf, bufsize);
+	CHECK(!strcmp(buf, "SETINFO ups.status \"OL\"\n"), "first device: %s", buf);
+	CHECK(dstate_get_device() == first, "first device still selected");
+
+	/* and their commands are answered by them */
+	CHECK(write(dfd[0], "PING\n", 5) == 5, "PING");
+	poll_once();
+	read_once(dfd[0], buf, bufsize);
+	CHECK(!strcmp(buf, "PONG\n"), "device 0: %s", buf);
+
+	for (i = 0; i < NUMDEVICES; i++) {
+		close(dfd[i]);
+	}
+
+	close(fd);
+	dstate_free();
+	free(buf);
+	rmdir(dir);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
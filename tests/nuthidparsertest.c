@@ -0,0 +1,284 @@
+/* nuthidparsertest - check the lookup indexes of the HID parser
+ * (drivers/hidparser.c) against the scans they replace, and time them
+ * when NUT_TEST_BENCH is set.
+ *
+ * Report descriptors are generated in the layout of UPS ones: features
+ * and inputs of several reports under nested collections, with paths
+ * used by several reports and types, and paths that are the leading
+ * part of others. The owner of an item, as usbhid-ups claims it, must
+ * be the first variable of the device to use it.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common.h"
+#include "nuttest.h"
+#include "hidparser.h"
+
+#define ROUNDS	2000
+
+static const uint8_t	types[] = { ITEM_FEATURE, ITEM_INPUT, ITEM_OUTPUT };
+
+static unsigned char	desc[65536];
+static int	desclen;
+
+/* a short item with a one byte value */
+static void emit(uint8_t item, uint8_t value)
+{
+	desc[desclen++] = item | 1;
+	desc[desclen++] = value;
+}
+
+/* a UPS like descriptor, of about 'reports' reports */
+static void generate(int reports, unsigned int seed)
+{
+	int	r, j, depth;
+
+	desclen = 0;
+	srand(seed);
+
+	emit(ITEM_UPAGE, 0x84);		/* Power Device */
+	emit(ITEM_USAGE, 0x04);		/* UPS */
+	emit(ITEM_COLLECTION, 0x01);
+
+	for (r = 1; r <= reports; r++) {
+		emit(ITEM_REP_ID, (uint8_t)(rand() % 64 + 1));
+
+		/* nested collections, from a small set of usages */
+		for (depth = 0; depth < 1 + rand() % 3; depth++) {
+			emit(ITEM_USAGE, (uint8_t)(0x10 + rand() % 6));
+			emit(ITEM_COLLECTION, 0x00);
+		}
+
+		for (j = 0; j < 1 + rand() % 4; j++) {
+			emit(ITEM_UPAGE, (uint8_t)(0x84 + rand() % 2));
+			emit(ITEM_USAGE, (uint8_t)(0x30 + rand() % 8));
+			emit(ITEM_REP_SIZE, 8);
+			emit(ITEM_REP_COUNT, 1);
+			emit(ITEM_LOG_MIN, 0);
+			emit(ITEM_LOG_MAX, 100);
+			emit(types[rand() % 3], 0x02);
+		}
+
+		while (depth-- > 0) {
+			desc[desclen++] = ITEM_END_COLLECTION;
+		}
+	}
+
+	desc[desclen++] = ITEM_END_COLLECTION;
+}
+
+/* the same lookup, with the index and with the scan */
+static HIDData_t *by_path(HIDDesc_t *pDesc, HIDPath_t *Path, uint8_t Type, int indexed)
+{
+	struct HIDIndex_s	*index = pDesc->index;
+	HIDData_t	*pData;
+
+	if (!indexed) {
+		pDesc->index = NULL;
+	}
+
+	pData = FindObject_with_Path(pDesc, Path, Type);
+	pDesc->index = index;
+
+	return pData;
+}
+
+static HIDData_t *by_id(HIDDesc_t *pDesc, uint8_t ReportID, uint8_t Offset, uint8_t Type, int indexed)
+{
+	struct HIDIndex_s	*index = pDesc->index;
+	HIDData_t	*pData;
+
+	if (!indexed) {
+		pDesc->index = NULL;
+	}
+
+	pData = FindObject_with_ID(pDesc, ReportID, Offset, Type);
+	pDesc->index = index;
+
+	return pData;
+}
+
+static int by_report(HIDDesc_t *pDesc, uint8_t ReportID, uint8_t Type, HIDData_t **pData, int size, int indexed)
+{
+	struct HIDIndex_s	*index = pDesc->index;
+	int	count;
+
+	if (!indexed) {
+		pDesc->index = NULL;
+	}
+
+	count = FindObjects_with_ID(pDesc, ReportID, Type, pData, size);
+	pDesc->index = index;
+
+	return count;
+}
+
+static void check_desc(HIDDesc_t *pDesc, const char *name)
+{
+	HIDData_t	*a[MAX_REPORT], *b[MAX_REPORT];
+	HIDPath_t	Path;
+	int	i, t, id, na, nb;
+
+	CHECK(pDesc->index != NULL, "%s: no index", name);
+
+	for (i = 0; i < pDesc->nitems; i++) {
+		HIDData_t	*pData = &pDesc->item[i];
+
+		/* each leading part of the path of items, with each type */
+		Path = pData->Path;
+		for (Path.Size = 0; Path.Size <= PATH_SIZE; Path.Size++) {
+			for (t = 0; t < 3; t++) {
+				CHECK(by_path(pDesc, &Path, types[t], 1) == by_path(pDesc, &Path, types[t], 0),
+					"%s: item %d, path of %d nodes, type %02x", name, i, Path.Size, types[t]);
+			}
+		}
+
+		/* and with one node changed */
+		Path = pData->Path;
+		Path.Node[Path.Size - 1] ^= 0x40;
+		CHECK(by_path(pDesc, &Path, pData->Type, 1) == by_path(pDesc, &Path, pData->Type, 0),
+			"%s: item %d, other path", name, i);
+
+		for (t = 0; t < 3; t++) {
+			CHECK(by_id(pDesc, pData->ReportID, pData->Offset, types[t], 1) == by_id(pDesc, pData->ReportID, pData->Offset, types[t], 0),
+				"%s: item %d, report %d offset %d type %02x", name, i, pData->ReportID, pData->Offset, types[t]);
+			CHECK(by_id(pDesc, pData->ReportID, pData->Offset + 1, types[t], 1) == by_id(pDesc, pData->ReportID, pData->Offset + 1, types[t], 0),
+				"%s: item %d, next offset", name, i);
+		}
+	}
+
+	/* all the reports, complete or truncated */
+	for (id = 0; id < 256; id++) {
+		for (t = 0; t < 3; t++) {
+			na = by_report(pDesc, (uint8_t)id, types[t], a, MAX_REPORT, 1);
+			nb = by_report(pDesc, (uint8_t)id, types[t], b, MAX_REPORT, 0);
+			CHECK((na == nb) && !memcmp(a, b, na * sizeof(*a)), "%s: report %d type %02x", name, id, types[t]);
+
+			na = by_report(pDesc, (uint8_t)id, types[t], a, 1, 1);
+			nb = by_report(pDesc, (uint8_t)id, types[t], b, 1, 0);
+			CHECK((na == nb) && (!na || (a[0] == b[0])), "%s: report %d type %02x, one", name, id, types[t]);
+		}
+	}
+}
+
+/* the owners of HID data, as the init walk of usbhid-ups claims them on
+ * a reconnect: a server side (absent) variable comes first in the table,
+ * with the same HID data as the device variable that must own it */
+static void check_owner(HIDDesc_t *pDesc)
+{
+	struct {
+		const char	*name;
+		int	absent;
+	} items[] = {
+		{ "ups.delay.shutdown", 1 },
+		{ "ups.timer.shutdown", 0 },
+		{ "ups.timer.shutdown.dup", 0 }
+	};
+	HIDData_t	*data = &pDesc->item[0];
+	size_t	i;
+
+	CHECK(ClaimObject(NULL, &items[0]) == NULL, "claim of no HID data");
+
+	for (i = 0; i < sizeof(items) / sizeof(items[0]); i++) {
+		if (!items[i].absent) {
+			ClaimObject(data, &items[i]);
+		}
+	}
+
+	CHECK(data->owner == &items[1], "HID data not owned by %s", items[1].name);
+
+	/* and it stays with it on the next reconnect */
+	CHECK(ClaimObject(data, &items[2]) == &items[1], "HID data claimed again");
+}
+
+/* as usbhid-ups handles interrupt reports: the items of a report,
+ * then each item by its path */
+static void bench(void)
+{
+	HIDDesc_t	*pDesc;
+	HIDData_t	*event[MAX_REPORT];
+	int	i, r, indexed;
+	long	found;
+	double	start, t[2];
+
+	generate(100, 1);
+	pDesc = Parse_ReportDesc(desc, desclen);
+	CHECK(pDesc != NULL, "timed descriptor not parsed");
+
+	if (!pDesc) {
+		return;
+	}
+
+	for (indexed = 1; indexed >= 0; indexed--) {
+		found = 0;
+		start = now();
+
+		for (r = 0; r < ROUNDS; r++) {
+			int	n = by_report(pDesc, (uint8_t)(r % 64 + 1), ITEM_INPUT, event, MAX_REPORT, indexed);
+
+			for (i = 0; i < n; i++) {
+				found += (by_path(pDesc, &event[i]->Path, ITEM_FEATURE, indexed) != NULL);
+				found += (by_path(pDesc, &event[i]->Path, ITEM_INPUT, indexed) != NULL);
+			}
+		}
+
+		t[indexed] = now() - start;
+		CHECK(found > 0, "timed lookups");
+	}
+
+	printf("interrupt reports of a %d items descriptor: scan %.2f us, index %.2f us\n",
+		pDesc->nitems, t[0] * 1e6 / ROUNDS, t[1] * 1e6 / ROUNDS);
+
+	Free_ReportDesc(pDesc);
+}
+
+int main(void)
+{
+	HIDDesc_t	*pDesc;
+	char	name[SMALLBUF];
+	int	i;
+
+	for (i = 0; i < 50; i++) {
+		generate(1 + i * 2, i);
+
+		pDesc = Parse_ReportDesc(desc, desclen);
+		snprintf(name, sizeof(name), "descriptor %d", i);
+		CHECK(pDesc != NULL, "%s: not parsed", name);
+
+		if (pDesc) {
+			check_desc(pDesc, name);
+			Free_ReportDesc(pDesc);
+		}
+	}
+
+	generate(1, 0);
+	pDesc = Parse_ReportDesc(desc, desclen);
+	CHECK((pDesc != NULL) && (pDesc->nitems > 0), "owner descriptor not parsed");
+
+	if (pDesc && (pDesc->nitems > 0)) {
+		check_owner(pDesc);
+	}
+
+	if (pDesc) {
+		Free_ReportDesc(pDesc);
+	}
+
+	if (bench_wanted()) {
+		bench();
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
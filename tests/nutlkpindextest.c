@@ -0,0 +1,243 @@
+/* nutlkpindextest - sanity checks and a lookup benchmark for the value
+ * lookup table index of the drivers (drivers/lkpindex.c).
+ *
+ * The tables are copies of the largest ones of snmp-ups, with the
+ * snmp-ups layout: each status or enumerated value of a poll is
+ * converted with one lookup, which this compares with the former
+ * linear scan of the table when NUT_TEST_BENCH is set.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common.h"
+#include "nuttest.h"
+#include "lkpindex.h"
+
+#define ROUNDS	200000
+#define NUMTABLES	100
+
+typedef struct {
+	int oid_value;
+	const char *info_value;
+	const char *(*fun)(int snmp_value);
+	int (*nuf)(const char *nut_value);
+} info_lkp_t;
+
+/* raritan-px2-mib.c */
+static info_lkp_t raritanpx2_outlet_status_info[] = {
+	{ -1, "unavailable", NULL, NULL },
+	{  0, "open", NULL, NULL },
+	{  1, "closed", NULL, NULL },
+	{  2, "belowLowerCritical", NULL, NULL },
+	{  3, "belowLowerWarning", NULL, NULL },
+	{  4, "normal", NULL, NULL },
+	{  5, "aboveUpperWarning", NULL, NULL },
+	{  6, "aboveUpperCritical", NULL, NULL },
+	{  7, "on", NULL, NULL },
+	{  8, "off", NULL, NULL },
+	{  9, "detected", NULL, NULL },
+	{ 10, "notDetected", NULL, NULL },
+	{ 11, "alarmed", NULL, NULL },
+	{ 12, "ok", NULL, NULL },
+	{ 13, "marginal", NULL, NULL },
+	{ 14, "fail", NULL, NULL },
+	{ 15, "yes", NULL, NULL },
+	{ 16, "no", NULL, NULL },
+	{ 17, "standby", NULL, NULL },
+	{ 18, "one", NULL, NULL },
+	{ 19, "two", NULL, NULL },
+	{ 20, "inSync", NULL, NULL },
+	{ 21, "outOfSync", NULL, NULL },
+	{ 0, "NULL", NULL, NULL }
+};
+
+/* powerware-mib.c, with its repeated values */
+static info_lkp_t pw_pwr_info[] = {
+	{   1, "", NULL, NULL },
+	{   2, "OFF", NULL, NULL },
+	{   3, "OL", NULL, NULL },
+	{   4, "BYPASS", NULL, NULL },
+	{   5, "OB", NULL, NULL },
+	{   6, "OL BOOST", NULL, NULL },
+	{   7, "OL TRIM", NULL, NULL },
+	{   8, "OL", NULL, NULL },
+	{   9, "OL", NULL, NULL },
+	{  10, "OL", NULL, NULL },
+	{  11, "BYPASS", NULL, NULL },
+	{  12, "OL", NULL, NULL },
+	{  13, "OL", NULL, NULL },
+	{  14, "OL", NULL, NULL },
+	{  15, "OL", NULL, NULL },
+	{  16, "OL", NULL, NULL },
+	{   5, "OB BOOST", NULL, NULL },
+	{ 0, NULL, NULL, NULL }
+};
+
+/* as snmp-ups describes its tables */
+static int lkp_entry(const void *table, size_t i, long *value, const char **info_value)
+{
+	const info_lkp_t *info_lkp = (const info_lkp_t *)table + i;
+
+	if ((info_lkp->info_value == NULL) || !strcmp(info_lkp->info_value, "NULL"))
+		return 0;
+
+	*value = info_lkp->oid_value;
+	*info_value = info_lkp->info_value;
+	return 1;
+}
+
+/* what su_find_infoval() and su_find_valinfo() used to do */
+static const info_lkp_t *linear_value(const info_lkp_t *table, long value)
+{
+	const info_lkp_t *info_lkp;
+
+	for (info_lkp = table; (info_lkp->info_value != NULL) && strcmp(info_lkp->info_value, "NULL"); info_lkp++) {
+		if (info_lkp->oid_value == value)
+			return info_lkp;
+	}
+
+	return NULL;
+}
+
+static const info_lkp_t *linear_info_value(const info_lkp_t *table, const char *value)
+{
+	const info_lkp_t *info_lkp;
+
+	for (info_lkp = table; (info_lkp->info_value != NULL) && strcmp(info_lkp->info_value, "NULL"); info_lkp++) {
+		if (!strcmp(info_lkp->info_value, value))
+			return info_lkp;
+	}
+
+	return NULL;
+}
+
+static const info_lkp_t *index_value(const info_lkp_t *table, long value)
+{
+	ssize_t	pos = lkpindex_find_value(lkpindex_get(table, lkp_entry), value);
+
+	return (pos >= 0) ? &table[pos] : NULL;
+}
+
+static const info_lkp_t *index_info_value(const info_lkp_t *table, const char *value)
+{
+	ssize_t	pos = lkpindex_find_nut_value(lkpindex_get(table, lkp_entry), value);
+
+	return (pos >= 0) ? &table[pos] : NULL;
+}
+
+/* both ways, every entry and a few missing keys give the same answer */
+static void check_table(const info_lkp_t *table, const char *name)
+{
+	const info_lkp_t *info_lkp;
+	long	value;
+
+	for (value = -3; value < 30; value++) {
+		CHECK(index_value(table, value) == linear_value(table, value),
+			"%s: value %ld", name, value);
+	}
+
+	for (info_lkp = table; (info_lkp->info_value != NULL) && strcmp(info_lkp->info_value, "NULL"); info_lkp++) {
+		CHECK(index_info_value(table, info_lkp->info_value) == linear_info_value(table, info_lkp->info_value),
+			"%s: %s", name, info_lkp->info_value);
+	}
+
+	CHECK(index_info_value(table, "nosuchvalue") == NULL, "%s: missing value", name);
+}
+
+/* a poll converting the values of the largest table */
+static void bench(void)
+{
+	const info_lkp_t	*table = raritanpx2_outlet_status_info;
+	const char	*names[24];
+	int	i, r, n;
+	long	found = 0;
+	double	start, t_linear, t_index;
+
+	for (n = 0; lkp_entry(table, n, &found, &names[n]); n++)
+		;
+	found = 0;
+
+	start = now();
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; i < n; i++) {
+			found += (linear_value(table, (i * 7) % n - 1) != NULL);
+			found += (linear_info_value(table, names[(i * 5) % n]) != NULL);
+		}
+	}
+	t_linear = now() - start;
+
+	start = now();
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; i < n; i++) {
+			found += (index_value(table, (i * 7) % n - 1) != NULL);
+			found += (index_info_value(table, names[(i * 5) % n]) != NULL);
+		}
+	}
+	t_index = now() - start;
+
+	CHECK(found == 4L * n * ROUNDS, "timed lookups");
+
+	printf("lookups in a %d entries table: linear %.1f ns, index %.1f ns\n", n,
+		t_linear * 1e9 / (2.0 * n * ROUNDS), t_index * 1e9 / (2.0 * n * ROUNDS));
+}
+
+int main(void)
+{
+	info_lkp_t	*tables[NUMTABLES];
+	char	name[SMALLBUF];
+	int	i, j, n;
+
+	check_table(raritanpx2_outlet_status_info, "raritanpx2_outlet_status_info");
+	check_table(pw_pwr_info, "pw_pwr_info");
+
+	/* the first entry wins, as with the scan */
+	CHECK(index_value(pw_pwr_info, 5) == &pw_pwr_info[4], "first of two values");
+	CHECK(index_info_value(pw_pwr_info, "OL") == &pw_pwr_info[2], "first of several OL");
+
+	/* enough tables to grow the table of indexes a few times */
+	for (i = 0; i < NUMTABLES; i++) {
+		n = i % 20;
+		tables[i] = xcalloc(n + 1, sizeof(info_lkp_t));
+
+		for (j = 0; j < n; j++) {
+			snprintf(name, sizeof(name), "t%d-v%d", i, (j * 7) % n);
+			tables[i][j].oid_value = (j * 7) % n - i;
+			tables[i][j].info_value = xstrdup(name);
+		}
+
+		snprintf(name, sizeof(name), "table %d", i);
+		check_table(tables[i], name);
+	}
+
+	for (i = 0; i < NUMTABLES; i++) {
+		snprintf(name, sizeof(name), "table %d again", i);
+		check_table(tables[i], name);
+	}
+
+	if (bench_wanted()) {
+		bench();
+	}
+
+	lkpindex_free();
+
+	for (i = 0; i < NUMTABLES; i++) {
+		for (j = 0; tables[i][j].info_value; j++) {
+			free((char *)tables[i][j].info_value);
+		}
+		free(tables[i]);
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,231 @@
+/* nutnettokentest - checks the keyword table of the upsd network parser
+ * (server/nettoken.c) and benchmarks request dispatch.
+ *
+ * Every keyword must resolve to its own token regardless of case, and
+ * anything else must come back as NT_UNKNOWN; a collision introduced by
+ * a new keyword shows up here. With NUT_TEST_BENCH set, the benchmark
+ * tokenizes typical request lines with pconf_char() like upsd does, then
+ * dispatches them both with the former strcasecmp() scans and with
+ * nettoken().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common.h"
+#include "nuttest.h"
+#include "parseconf.h"
+#include "nettoken.h"
+
+#include <ctype.h>
+
+#define ROUNDS	20000
+
+/* the commands, in the order of the netcmds table */
+static const char	*commands[] = {
+	"VER", "NETVER", "HELP", "STARTTLS", "GET", "LIST", "USERNAME",
+	"PASSWORD", "LOGIN", "LOGOUT", "MASTER", "FSD", "SET", "INSTCMD",
+	"WATCH", "UNWATCH",
+	NULL
+};
+
+static const char	*getsubs[] = {
+	"TRACKING", "NUMLOGINS", "UPSDESC", "VAR", "TYPE", "DESC", "CMDDESC",
+	NULL
+};
+
+static const char	*listsubs[] = {
+	"UPS", "VAR", "RW", "CMD", "CLIENT", "ENUM", "RANGE",
+	NULL
+};
+
+static const char	*requests[] = {
+	"GET VAR myups ups.status\n",
+	"GET VAR myups battery.charge\n",
+	"LIST VAR myups\n",
+	"GET UPSDESC myups\n",
+	"LIST CMD myups\n",
+	"GET CMDDESC myups load.off\n",
+	"LIST RANGE myups input.transfer.low\n",
+	"INSTCMD myups test.battery.start\n",
+	"SET VAR myups ups.delay.shutdown \"120\"\n",
+	"LOGOUT\n",
+	NULL
+};
+
+static int scan(const char **list, const char *word)
+{
+	int	i;
+
+	for (i = 0; list[i]; i++) {
+		if (!strcasecmp(list[i], word)) {
+			return i + 1;
+		}
+	}
+
+	return 0;
+}
+
+/* former dispatch: scan the command table, then the sub-command list */
+static int dispatch_scan(PCONF_CTX_t *ctx)
+{
+	int	cmd = scan(commands, ctx->arglist[0]);
+
+	if ((ctx->numargs < 2) || (cmd < 1)) {
+		return cmd;
+	}
+
+	if (!strcasecmp(commands[cmd - 1], "GET")) {
+		return cmd * 100 + scan(getsubs, ctx->arglist[1]);
+	}
+
+	if (!strcasecmp(commands[cmd - 1], "LIST")) {
+		return cmd * 100 + scan(listsubs, ctx->arglist[1]);
+	}
+
+	return cmd;
+}
+
+static int dispatch_token(PCONF_CTX_t *ctx)
+{
+	nettoken_t	tok = nettoken(ctx->arglist[0]);
+
+	if ((ctx->numargs < 2) || ((tok != NT_GET) && (tok != NT_LIST))) {
+		return tok;
+	}
+
+	return tok * 100 + nettoken(ctx->arglist[1]);
+}
+
+/* feed each request through the tokenizer and dispatch it */
+static long run(PCONF_CTX_t *ctx, int (*dispatch)(PCONF_CTX_t *), double *elapsed)
+{
+	long	sum = 0;
+	int	r, i;
+	const char	*p;
+	double	start = now();
+
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; requests[i]; i++) {
+			for (p = requests[i]; *p; p++) {
+				if (pconf_char(ctx, *p) == 1) {
+					sum += dispatch(ctx) != 0;
+				}
+			}
+		}
+	}
+
+	*elapsed = now() - start;
+
+	return sum;
+}
+
+/* whole requests, tokenizer included, and the keyword lookup alone */
+static void bench(void)
+{
+	PCONF_CTX_t	ctx;
+	int	i, j, requests_count = 0;
+	long	hits_scan, hits_token;
+	double	t_scan, t_token, t_tok;
+
+	for (i = 0; requests[i]; i++) {
+		requests_count++;
+	}
+
+	pconf_init(&ctx, NULL);
+	hits_scan = run(&ctx, dispatch_scan, &t_scan);
+	hits_token = run(&ctx, dispatch_token, &t_token);
+	pconf_finish(&ctx);
+
+	CHECK(hits_scan == (long)ROUNDS * requests_count, "scan dispatch");
+	CHECK(hits_token == (long)ROUNDS * requests_count, "token dispatch");
+
+	/* and the keyword lookup on its own */
+	t_tok = now();
+	for (i = 0; i < ROUNDS; i++) {
+		for (j = 0; commands[j]; j++) {
+			hits_token += nettoken(commands[j]);
+		}
+	}
+	t_tok = now() - t_tok;
+
+	printf("request parsing: strcasecmp scan %.1f ns/request, nettoken %.1f ns/request, "
+		"nettoken() alone %.1f ns\n",
+		t_scan * 1e9 / ((double)ROUNDS * requests_count),
+		t_token * 1e9 / ((double)ROUNDS * requests_count),
+		t_tok * 1e9 / ((double)ROUNDS * (sizeof(commands) / sizeof(commands[0]) - 1)));
+}
+
+int main(void)
+{
+	PCONF_CTX_t	ctx;
+	char	word[SMALLBUF];
+	const char	*name, *p;
+	const char	*unknown[] = {
+		"", "V", "VE", "VERS", "GETS", "LIS", "LOGINS", "TRACK",
+		"ups.status", "OFFF", "NO", "RWX", "USERNAMES", "INSTCMDS",
+		NULL
+	};
+	int	i, j;
+
+	/* all keywords, in upper, lower and mixed case */
+	for (i = NT_UNKNOWN + 1; i < NT_COUNT; i++) {
+		name = nettoken_name((nettoken_t)i);
+		CHECK(name != NULL, "no name for token %d", i);
+		if (!name) {
+			continue;
+		}
+
+		CHECK(nettoken(name) == (nettoken_t)i, "%s", name);
+
+		for (j = 0; name[j]; j++) {
+			word[j] = (char)tolower((unsigned char)name[j]);
+		}
+		word[j] = '\0';
+		CHECK(nettoken(word) == (nettoken_t)i, "%s", word);
+
+		word[0] = (char)toupper((unsigned char)word[0]);
+		CHECK(nettoken(word) == (nettoken_t)i, "%s", word);
+	}
+
+	/* the commands keep the order of the netcmds table */
+	for (i = 0; commands[i]; i++) {
+		CHECK(nettoken(commands[i]) == (nettoken_t)(NT_VER + i), "order of %s", commands[i]);
+	}
+	CHECK(i == NT_LAST_COMMAND - NT_VER + 1, "%d commands up to NT_LAST_COMMAND", i);
+
+	for (i = 0; unknown[i]; i++) {
+		CHECK(nettoken(unknown[i]) == NT_UNKNOWN, "unknown '%s'", unknown[i]);
+	}
+	CHECK(nettoken(NULL) == NT_UNKNOWN, "NULL");
+	CHECK(nettoken_name(NT_UNKNOWN) == NULL, "name of NT_UNKNOWN");
+	CHECK(nettoken_name(NT_COUNT) == NULL, "name of NT_COUNT");
+
+	/* whole requests through the tokenizer, as upsd reads them */
+	pconf_init(&ctx, NULL);
+	for (i = 0; requests[i]; i++) {
+		for (p = requests[i]; *p; p++) {
+			if (pconf_char(&ctx, *p) == 1) {
+				CHECK(dispatch_token(&ctx) != NT_UNKNOWN, "dispatch of %s", ctx.arglist[0]);
+			}
+		}
+	}
+	pconf_finish(&ctx);
+
+	if (bench_wanted()) {
+		bench();
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,150 @@
+/* nutnetwatchtest - checks of the WATCH subscriptions of upsd
+ * (server/netwatch.c): which changes are notified to whom.
+ *
+ * The answers and notifications that netwatch.c queues with sendback()
+ * are collected here in a buffer instead of going to a socket, and the
+ * values come from a stand-in for sstate_getinfo().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common.h"
+#include "nuttest.h"
+#include "upsd.h"
+#include "sstate.h"
+#include "neterr.h"
+#include "netwatch.h"
+
+upstype_t	*firstups = NULL;
+
+/* what netwatch.c sent back */
+static char	out[4096];
+static size_t	out_len = 0;
+
+int sendback(nut_ctype_t *client, const char *fmt, ...)
+{
+	va_list	ap;
+
+	NUT_UNUSED_VARIABLE(client);
+
+	va_start(ap, fmt);
+	vsnprintf(out + out_len, sizeof(out) - out_len, fmt, ap);
+	va_end(ap);
+
+	out_len += strlen(out + out_len);
+
+	return 1;
+}
+
+int send_err(nut_ctype_t *client, const char *errtype)
+{
+	return sendback(client, "ERR %s\n", errtype);
+}
+
+upstype_t *get_ups_ptr(const char *name)
+{
+	upstype_t	*ups;
+
+	for (ups = firstups; ups; ups = ups->next) {
+		if (!strcasecmp(ups->name, name)) {
+			return ups;
+		}
+	}
+
+	return NULL;
+}
+
+/* every variable has the same value */
+const char *sstate_getinfo(const upstype_t *ups, const char *var)
+{
+	NUT_UNUSED_VARIABLE(ups);
+	NUT_UNUSED_VARIABLE(var);
+
+	return "87";
+}
+
+static void reset(void)
+{
+	out_len = 0;
+	out[0] = '\0';
+}
+
+static void watch(nut_ctype_t *client, const char *cmd, const char *upsname, const char *var)
+{
+	const char	*arg[2];
+
+	arg[0] = upsname;
+	arg[1] = var;
+
+	reset();
+
+	if (!strcmp(cmd, "WATCH")) {
+		net_watch(client, var ? 2 : 1, arg);
+	} else {
+		net_unwatch(client, var ? 2 : 1, arg);
+	}
+
+	CHECK(!strcmp(out, "OK\n"), "%s %s %s: %s", cmd, upsname, var ? var : "", out);
+}
+
+/* what a change of var on ups sends to the watchers */
+static void check_notify(upstype_t *ups, const char *var, const char *want)
+{
+	reset();
+	watch_notify_var(ups, var);
+
+	CHECK(!strcmp(out, want), "change of %s %s: [%s], expected [%s]", ups->name, var, out, want);
+}
+
+int main(void)
+{
+	static upstype_t	ups;
+	nut_ctype_t	client;
+	const char	*arg[1];
+
+	memset(&ups, 0, sizeof(ups));
+	ups.name = "ups1";
+	firstups = &ups;
+
+	memset(&client, 0, sizeof(client));
+	client.addr = "127.0.0.1";
+
+	/* names in another case than the configuration and the driver */
+	watch(&client, "WATCH", "UPS1", "Battery.Charge");
+	check_notify(&ups, "battery.charge", "NOTIFY VAR ups1 battery.charge \"87\"\n");
+	check_notify(&ups, "battery.runtime", "");
+
+	/* and in patterns */
+	watch(&client, "WATCH", "Ups*", "INPUT.*");
+	check_notify(&ups, "input.voltage", "NOTIFY VAR ups1 input.voltage \"87\"\n");
+
+	/* a plain name still has to be a known UPS */
+	reset();
+	arg[0] = "UPS2";
+	net_watch(&client, 1, arg);
+	CHECK(!strcmp(out, "ERR " NUT_ERR_UNKNOWN_UPS "\n"), "WATCH UPS2: %s", out);
+
+	/* subscriptions are dropped in any case too */
+	watch(&client, "UNWATCH", "ups1", "battery.charge");
+	check_notify(&ups, "battery.charge", "");
+
+	watch(&client, "UNWATCH", "UPS*", "input.*");
+	check_notify(&ups, "input.voltage", "");
+	CHECK(client.watches == NULL, "subscriptions left");
+
+	watch_client_free(&client);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,747 @@
+/* nutparseconftest - checks the buffer at a time tokenizer of parseconf
+ * (pconf_buf() and the word handling of common/parseconf.c) against the
+ * previous implementation, and times both when NUT_TEST_BENCH is set.
+ *
+ * Random input, heavy in quotes, backslashes, comments, '=' and bytes
+ * that must be filtered out, is split at random and fed to pconf_buf(),
+ * while the former code below takes the same input a character at a
+ * time: both must finish the same lines at the same places, with the
+ * same words, and fail the same way.  pconf_char() and pconf_line() are
+ * held to the same.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common.h"
+#include "nuttest.h"
+#include "parseconf.h"
+#include "attribute.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+
+#define ROUNDS	20000
+#define BENCHLINES	20000
+
+/* common/parseconf.c before pconf_buf(), with its context as it was */
+
+typedef struct {
+	FILE	*f;
+	int	state;
+	int	ch;
+
+	char	**arglist;
+	size_t	*argsize;
+	size_t	numargs;
+	size_t	maxargs;
+
+	char	*wordbuf;
+	char	*wordptr;
+	size_t	wordbufsize;
+
+	int	linenum;
+	int	error;
+	char	errmsg[PCONF_ERR_LEN];
+
+	void	(*errhandler)(const char *);
+
+	int	magic;
+
+	size_t	arg_limit;
+	size_t	wordlen_limit;
+}	OLD_CTX_t;
+
+#define STATE_FINDWORDSTART	1
+#define STATE_FINDEOL		2
+#define STATE_QUOTECOLLECT	3
+#define STATE_QC_LITERAL	4
+#define STATE_COLLECT		5
+#define STATE_COLLECTLITERAL	6
+#define STATE_ENDOFLINE		7
+#define STATE_PARSEERR		8
+
+static void old_pconf_fatal(OLD_CTX_t *ctx, const char *errtxt)
+	__attribute__((noreturn));
+
+static void old_pconf_fatal(OLD_CTX_t *ctx, const char *errtxt)
+{
+	if (ctx->errhandler)
+		ctx->errhandler(errtxt);
+	else
+		fprintf(stderr, "parseconf: fatal error: %s\n", errtxt);
+
+	exit(EXIT_FAILURE);
+}
+
+static void old_add_arg_word(OLD_CTX_t *ctx)
+{
+	size_t	argpos;
+	size_t	wbuflen;
+
+	/* this is where the new value goes */
+	argpos = ctx->numargs;
+
+	ctx->numargs++;
+
+	/* when facing more args than ever before, expand the list */
+	if (ctx->numargs > ctx->maxargs) {
+		ctx->maxargs = ctx->numargs;
+
+		/* resize the lists */
+		ctx->arglist = realloc(ctx->arglist,
+			sizeof(char *) * ctx->numargs);
+
+		if (!ctx->arglist)
+			old_pconf_fatal(ctx, "realloc arglist failed");
+
+		ctx->argsize = realloc(ctx->argsize,
+			sizeof(size_t) * ctx->numargs);
+
+		if (!ctx->argsize)
+			old_pconf_fatal(ctx, "realloc argsize failed");
+
+		/* ensure sane starting values */
+		ctx->arglist[argpos] = NULL;
+		ctx->argsize[argpos] = 0;
+	}
+
+	wbuflen = strlen(ctx->wordbuf);
+
+	/* now see if the string itself grew compared to last time */
+	if (wbuflen >= ctx->argsize[argpos]) {
+		size_t	newlen;
+
+		/* allow for the trailing NULL */
+		newlen = wbuflen + 1;
+
+		/* expand the string storage */
+		ctx->arglist[argpos] = realloc(ctx->arglist[argpos], newlen);
+
+		if (!ctx->arglist[argpos])
+			old_pconf_fatal(ctx, "realloc arglist member failed");
+
+		/* remember the new size */
+		ctx->argsize[argpos] = newlen;
+	}
+
+	/* strncpy doesn't give us a trailing NULL, so prep the space */
+	memset(ctx->arglist[argpos], '\0', ctx->argsize[argpos]);
+
+	/* finally copy the new value into the provided space */
+	strncpy(ctx->arglist[argpos], ctx->wordbuf, wbuflen);
+}
+
+static void old_addchar(OLD_CTX_t *ctx)
+{
+	size_t	wbuflen;
+
+	wbuflen = strlen(ctx->wordbuf);
+
+	/* CVE-2012-2944: only allow the subset of ASCII charset from Space to ~ */
+	if ((ctx->ch < 0x20) || (ctx->ch > 0x7f)) {
+		fprintf(stderr, "addchar: discarding invalid character (0x%02x)!\n",
+				ctx->ch);
+		return;
+	}
+
+	if (ctx->wordlen_limit != 0) {
+		if (wbuflen >= ctx->wordlen_limit) {
+
+			/* limit reached: don't append any more */
+			return;
+		}
+	}
+
+	/* allow for the null */
+	if (wbuflen >= (ctx->wordbufsize - 1)) {
+		ctx->wordbufsize += 8;
+
+		ctx->wordbuf = realloc(ctx->wordbuf, ctx->wordbufsize);
+
+		if (!ctx->wordbuf)
+			old_pconf_fatal(ctx, "realloc wordbuf failed");
+
+		/* repoint as wordbuf may have moved */
+		ctx->wordptr = &ctx->wordbuf[wbuflen];
+	}
+
+	*ctx->wordptr++ = (char)ctx->ch;
+	*ctx->wordptr = '\0';
+}
+
+static void old_endofword(OLD_CTX_t *ctx)
+{
+	if (ctx->arg_limit != 0) {
+		if (ctx->numargs >= ctx->arg_limit) {
+
+			/* don't accept this word - just drop it */
+			ctx->wordptr = ctx->wordbuf;
+			*ctx->wordptr = '\0';
+
+			return;
+		}
+	}
+
+	old_add_arg_word(ctx);
+
+	ctx->wordptr = ctx->wordbuf;
+	*ctx->wordptr = '\0';
+}
+
+/* look for the beginning of a word */
+static int old_findwordstart(OLD_CTX_t *ctx)
+{
+	/* newline = the physical line is over, so the logical one is too */
+	if (ctx->ch == 10)
+		return STATE_ENDOFLINE;
+
+	/* the rest of the line is a comment */
+	if (ctx->ch == '#')
+		return STATE_FINDEOL;
+
+	/* space = not in a word yet, so loop back */
+	if (isspace(ctx->ch))
+		return STATE_FINDWORDSTART;
+
+	/* \ = literal = accept the next char blindly */
+	if (ctx->ch == '\\')
+		return STATE_COLLECTLITERAL;
+
+	/* " = begin word bounded by quotes */
+	if (ctx->ch == '"')
+		return STATE_QUOTECOLLECT;
+
+	/* at this point the word just started */
+	old_addchar(ctx);
+
+	/* if the first character is a '=' this is considered a whole word */
+	if (ctx->ch == '=') {
+		old_endofword(ctx);
+		return STATE_FINDWORDSTART;
+	}
+
+	return STATE_COLLECT;
+}
+
+/* eat characters until the end of the line is found */
+static int old_findeol(OLD_CTX_t *ctx)
+{
+	/* newline = found it, so start a new line */
+	if (ctx->ch == 10)
+		return STATE_ENDOFLINE;
+
+	/* come back here */
+	return STATE_FINDEOL;
+}
+
+/* set up the error reporting details */
+static void old_pconf_seterr(OLD_CTX_t *ctx, const char *errmsg)
+{
+	snprintf(ctx->errmsg, PCONF_ERR_LEN, "%s", errmsg);
+
+	ctx->error = 1;
+}
+
+/* quote characters inside a word bounded by "quotes" */
+static int old_quotecollect(OLD_CTX_t *ctx)
+{
+	/* user is trying to break us */
+	if (ctx->ch == '#') {
+		old_pconf_seterr(ctx, "Unbalanced word due to unescaped # in quotes");
+		old_endofword(ctx);
+
+		/* this makes us drop all the way out of the caller */
+		return STATE_PARSEERR;
+	}
+
+	/* another " means we're done with this word */
+	if (ctx->ch == '"') {
+		old_endofword(ctx);
+
+		return STATE_FINDWORDSTART;
+	}
+
+	/* literal - special case since it needs to return here */
+	if (ctx->ch == '\\')
+		return STATE_QC_LITERAL;
+
+	/* otherwise save it and loop back */
+	old_addchar(ctx);
+
+	return STATE_QUOTECOLLECT;
+}
+
+/* take almost anything literally, but return to quotecollect */
+static int old_qc_literal(OLD_CTX_t *ctx)
+{
+	/* continue onto the next line of the file */
+	if (ctx->ch == 10)
+		return STATE_QUOTECOLLECT;
+
+	old_addchar(ctx);
+	return STATE_QUOTECOLLECT;
+}
+
+/* collect characters inside a word */
+static int old_collect(OLD_CTX_t *ctx)
+{
+	/* comment means the word is done, and skip to the end of the line */
+	if (ctx->ch == '#') {
+		old_endofword(ctx);
+
+		return STATE_FINDEOL;
+	}
+
+	/* newline means the word is done, and the line is done */
+	if (ctx->ch == 10) {
+		old_endofword(ctx);
+
+		return STATE_ENDOFLINE;
+	}
+
+	/* space means the word is done */
+	if (isspace(ctx->ch)) {
+		old_endofword(ctx);
+
+		return STATE_FINDWORDSTART;
+	}
+
+	/* '=' means the word is done and the = is a single char word*/
+	if (ctx->ch == '=') {
+		old_endofword(ctx);
+		old_findwordstart(ctx);
+
+		return STATE_FINDWORDSTART;
+	}
+
+	/* \ = literal = accept the next char blindly */
+	if (ctx->ch == '\\')
+		return STATE_COLLECTLITERAL;
+
+	/* otherwise store it and come back for more */
+	old_addchar(ctx);
+	return STATE_COLLECT;
+}
+
+/* take almost anything literally */
+static int old_collectliteral(OLD_CTX_t *ctx)
+{
+	/* continue to the next line */
+	if (ctx->ch == 10)
+		return STATE_COLLECT;
+
+	old_addchar(ctx);
+	return STATE_COLLECT;
+}
+
+/* clean up memory before going back to the user */
+static void old_free_storage(OLD_CTX_t *ctx)
+{
+	unsigned int	i;
+
+	free(ctx->wordbuf);
+
+	/* clear out the individual words first */
+	for (i = 0; i < ctx->maxargs; i++)
+		free(ctx->arglist[i]);
+
+	free(ctx->arglist);
+	free(ctx->argsize);
+
+	/* put things back to the initial state */
+	ctx->arglist = NULL;
+	ctx->argsize = NULL;
+	ctx->numargs = 0;
+	ctx->maxargs = 0;
+}
+
+static int old_pconf_init(OLD_CTX_t *ctx, void errhandler(const char *))
+{
+	/* set up the ctx elements */
+
+	ctx->f = NULL;
+	ctx->state = STATE_FINDWORDSTART;
+	ctx->numargs = 0;
+	ctx->maxargs = 0;
+	ctx->arg_limit = PCONF_DEFAULT_ARG_LIMIT;
+	ctx->wordlen_limit = PCONF_DEFAULT_WORDLEN_LIMIT;
+	ctx->linenum = 0;
+	ctx->error = 0;
+	ctx->arglist = NULL;
+	ctx->argsize = NULL;
+
+	ctx->wordbufsize = 16;
+	ctx->wordbuf = calloc(1, ctx->wordbufsize);
+
+	if (!ctx->wordbuf)
+		old_pconf_fatal(ctx, "malloc wordbuf failed");
+	ctx->wordptr = ctx->wordbuf;
+
+	ctx->errhandler = errhandler;
+	ctx->magic = PCONF_CTX_t_MAGIC;
+
+	return 1;
+}
+
+static void old_parse_char(OLD_CTX_t *ctx)
+{
+	switch(ctx->state) {
+		case STATE_FINDWORDSTART:
+			ctx->state = old_findwordstart(ctx);
+			break;
+
+		case STATE_FINDEOL:
+			ctx->state = old_findeol(ctx);
+			break;
+
+		case STATE_QUOTECOLLECT:
+			ctx->state = old_quotecollect(ctx);
+			break;
+
+		case STATE_QC_LITERAL:
+			ctx->state = old_qc_literal(ctx);
+			break;
+
+		case STATE_COLLECT:
+			ctx->state = old_collect(ctx);
+			break;
+
+		case STATE_COLLECTLITERAL:
+			ctx->state = old_collectliteral(ctx);
+			break;
+	}	/* switch */
+}
+
+/* clean up the ctx space */
+static void old_pconf_finish(OLD_CTX_t *ctx)
+{
+	if (ctx->f)
+		fclose(ctx->f);
+
+	old_free_storage(ctx);
+
+	ctx->magic = 0;
+}
+
+/* parse a provided line */
+static int old_pconf_line(OLD_CTX_t *ctx, const char *line)
+{
+	size_t	i, linelen;
+
+	ctx->linenum++;
+
+	/* start over for the new line */
+	ctx->numargs = 0;
+	ctx->state = STATE_FINDWORDSTART;
+
+	linelen = strlen(line);
+
+	for (i = 0; i < linelen; i++) {
+		ctx->ch = line[i];
+
+		old_parse_char(ctx);
+
+		if (ctx->state == STATE_PARSEERR)
+			return 1;
+
+		if (ctx->state == STATE_ENDOFLINE)
+			return 1;
+	}
+
+	/* deal with any lingering characters */
+
+	/* still building a word? */
+	if (ctx->wordptr != ctx->wordbuf)
+		old_endofword(ctx);		/* tie it off */
+
+	return 1;
+}
+
+/* parse input a character at a time */
+static int old_pconf_char(OLD_CTX_t *ctx, char ch)
+{
+	/* if the last call finished a line, clean stuff up for another */
+	if ((ctx->state == STATE_ENDOFLINE) || (ctx->state == STATE_PARSEERR)) {
+		ctx->numargs = 0;
+		ctx->state = STATE_FINDWORDSTART;
+	}
+
+	ctx->ch = ch;
+	old_parse_char(ctx);
+
+	if (ctx->state == STATE_ENDOFLINE)
+		return 1;
+
+	if (ctx->state == STATE_PARSEERR)
+		return -1;
+
+	return 0;
+}
+
+/* end of the former code */
+
+/* both parsers have the same line */
+static int same_args(const OLD_CTX_t *o, const PCONF_CTX_t *n)
+{
+	size_t	i;
+
+	if (o->numargs != n->numargs)
+		return 0;
+
+	for (i = 0; i < o->numargs; i++) {
+		if (strcmp(o->arglist[i], n->arglist[i]) != 0)
+			return 0;
+	}
+
+	return 1;
+}
+
+static int same_error(const OLD_CTX_t *o, const PCONF_CTX_t *n)
+{
+	return (o->error == n->error) && (!o->error || !strcmp(o->errmsg, n->errmsg));
+}
+
+/* mostly word characters, then everything the state machine cares for */
+static const char	alphabet[] = "abcdefXYZ0189._-+/:"
+	"      \t\r\n\n\"\"\"\\\\\\##==\001\013\177\200\351\377";
+
+static size_t random_input(char *buf, size_t maxlen)
+{
+	size_t	i, len = rand() % maxlen;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+	}
+
+	buf[len] = '\0';
+
+	return len;
+}
+
+static void set_limits(OLD_CTX_t *o, PCONF_CTX_t *n, int small)
+{
+	o->arg_limit = n->arg_limit = small ? 3 : PCONF_DEFAULT_ARG_LIMIT;
+	o->wordlen_limit = n->wordlen_limit = small ? 5 : PCONF_DEFAULT_WORDLEN_LIMIT;
+}
+
+/* the same input split at random for pconf_buf(), a character at a time
+ * for the former pconf_char() and the current one */
+static int compare_stream(OLD_CTX_t *o, PCONF_CTX_t *n, PCONF_CTX_t *c, const char *in, size_t len)
+{
+	size_t	pos = 0, chunk, used, j;
+	int	ret, oret = 0, cret;
+
+	while (pos < len) {
+		chunk = 1 + rand() % (len - pos);
+		ret = pconf_buf(n, in + pos, chunk, &used);
+
+		if ((used == 0) || (used > chunk) || ((ret == 0) && (used != chunk)))
+			return 0;
+
+		for (j = 0; j < used; j++) {
+			oret = old_pconf_char(o, in[pos + j]);
+			cret = pconf_char(c, in[pos + j]);
+
+			if (oret != cret)
+				return 0;
+
+			/* the line must end where pconf_buf() stopped */
+			if ((oret != 0) && (j < used - 1))
+				return 0;
+
+			if ((oret == 1) && !same_args(o, c))
+				return 0;
+		}
+
+		if (ret != oret)
+			return 0;
+
+		if ((ret == 1) && !same_args(o, n))
+			return 0;
+
+		if (!same_error(o, n) || !same_error(o, c))
+			return 0;
+
+		pos += used;
+	}
+
+	return 1;
+}
+
+static int compare_line(OLD_CTX_t *o, PCONF_CTX_t *n, const char *line)
+{
+	if (old_pconf_line(o, line) != pconf_line(n, line))
+		return 0;
+
+	return same_args(o, n) && same_error(o, n);
+}
+
+static void check_known(void)
+{
+	PCONF_CTX_t	ctx;
+	size_t	used;
+
+	pconf_init(&ctx, NULL);
+
+	pconf_line(&ctx, "this \"is also\" a line");
+	CHECK((ctx.numargs == 4) && !strcmp(ctx.arglist[1], "is also"), "quoted word");
+
+	pconf_line(&ctx, "embedded\\ space embedded\\\\backslash");
+	CHECK((ctx.numargs == 2) && !strcmp(ctx.arglist[0], "embedded space") &&
+		!strcmp(ctx.arglist[1], "embedded\\backslash"), "escapes");
+
+	pconf_line(&ctx, "var=value # comment");
+	CHECK((ctx.numargs == 3) && !strcmp(ctx.arglist[1], "="), "= and comment");
+
+	pconf_finish(&ctx);
+	pconf_init(&ctx, NULL);
+
+	/* two lines and half of one in a buffer */
+	CHECK(pconf_buf(&ctx, "GET VAR ups x\nLIST UPS\nSET", 27, &used) == 1, "first line");
+	CHECK((used == 14) && (ctx.numargs == 4), "first line: %d bytes, %d words", (int)used, (int)ctx.numargs);
+	CHECK(pconf_buf(&ctx, "LIST UPS\nSET", 12, &used) == 1, "second line");
+	CHECK((used == 9) && (ctx.numargs == 2), "second line");
+	CHECK(pconf_buf(&ctx, "SET", 3, &used) == 0, "partial line");
+	CHECK(pconf_buf(&ctx, " VAR \"x\"\n", 10, &used) == 1, "rest of the line");
+	CHECK((ctx.numargs == 3) && !strcmp(ctx.arglist[0], "SET") && !strcmp(ctx.arglist[2], "x"),
+		"line across buffers");
+
+	/* a word longer than the initial buffer, words moving with it */
+	pconf_line(&ctx, "a b c \"0123456789012345678901234567890123456789012345678901234567890123456789\" d");
+	CHECK((ctx.numargs == 5) && !strcmp(ctx.arglist[0], "a") && !strcmp(ctx.arglist[4], "d") &&
+		(strlen(ctx.arglist[3]) == 70), "words after growth");
+
+	pconf_finish(&ctx);
+}
+
+static void bench(void)
+{
+	OLD_CTX_t	o;
+	PCONF_CTX_t	n;
+	char	*in, value[400];
+	size_t	len = 0, size, i, used, lines[2] = { 0, 0 };
+	double	start, t[2];
+
+	/* what a driver sends upsd, with a few long values */
+	size = BENCHLINES * 512;
+	in = xmalloc(size);
+
+	memset(value, 'x', sizeof(value) - 1);
+	value[sizeof(value) - 1] = '\0';
+
+	for (i = 0; i < BENCHLINES; i++) {
+		len += snprintf(in + len, size - len, (i % 10) ?
+			"SETINFO battery.charge.%d \"%d\"\n" : "SETINFO ups.serial.%d \"%d %s\"\n",
+			(int)(i % 50), (int)i, value);
+	}
+
+	old_pconf_init(&o, NULL);
+	start = now();
+
+	for (i = 0; i < len; i++) {
+		lines[0] += (old_pconf_char(&o, in[i]) == 1);
+	}
+
+	t[0] = now() - start;
+	old_pconf_finish(&o);
+
+	pconf_init(&n, NULL);
+	start = now();
+
+	/* as read() hands it out */
+	for (i = 0; i < len; i += used) {
+		size_t	chunk = ((i / SMALLBUF + 1) * SMALLBUF) - i;
+
+		lines[1] += (pconf_buf(&n, in + i, (chunk < len - i) ? chunk : len - i, &used) == 1);
+	}
+
+	t[1] = now() - start;
+	pconf_finish(&n);
+
+	CHECK((lines[0] == BENCHLINES) && (lines[1] == BENCHLINES), "timed lines: %d and %d",
+		(int)lines[0], (int)lines[1]);
+
+	printf("%d lines, %d bytes: pconf_char() before %.1f ns/byte, pconf_buf() %.1f ns/byte\n",
+		BENCHLINES, (int)len, t[0] * 1e9 / len, t[1] * 1e9 / len);
+
+	free(in);
+}
+
+int main(void)
+{
+	OLD_CTX_t	o, ol;
+	PCONF_CTX_t	n, c, nl;
+	char	in[512];
+	size_t	len;
+	int	r, err, quiet, bad_stream = -1, bad_line = -1;
+
+	check_known();
+
+	/* both complain on stderr about each byte they filter out */
+	fflush(stderr);
+	err = dup(STDERR_FILENO);
+	quiet = open("/dev/null", O_WRONLY);
+	dup2(quiet, STDERR_FILENO);
+
+	srand(2944);
+
+	old_pconf_init(&o, NULL);
+	pconf_init(&n, NULL);
+	pconf_init(&c, NULL);
+
+	/* lines on their own: pconf_line() after a stream that stopped in
+	 * the middle of a word used to start with what was collected */
+	old_pconf_init(&ol, NULL);
+	pconf_init(&nl, NULL);
+
+	for (r = 0; r < ROUNDS; r++) {
+		set_limits(&o, &n, (r % 4) == 3);
+		set_limits(&ol, &nl, (r % 4) == 3);
+		c.arg_limit = n.arg_limit;
+		c.wordlen_limit = n.wordlen_limit;
+
+		len = random_input(in, sizeof(in) - 1);
+
+		if (!compare_stream(&o, &n, &c, in, len) && (bad_stream < 0)) {
+			bad_stream = r;
+		}
+
+		len = random_input(in, 80);
+
+		if (!compare_line(&ol, &nl, in) && (bad_line < 0)) {
+			bad_line = r;
+		}
+	}
+
+	old_pconf_finish(&o);
+	pconf_finish(&n);
+	pconf_finish(&c);
+	old_pconf_finish(&ol);
+	pconf_finish(&nl);
+
+	fflush(stderr);
+	dup2(err, STDERR_FILENO);
+	close(quiet);
+	close(err);
+
+	CHECK(bad_stream < 0, "stream %d differs", bad_stream);
+	CHECK(bad_line < 0, "line %d differs", bad_line);
+
+	if (bench_wanted()) {
+		bench();
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
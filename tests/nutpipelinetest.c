@@ -0,0 +1,302 @@
+/* nutpipelinetest - checks the pipelined GETs of libupsclient
+ * (upscli_pipeline_get() and friends, clients/upsclient.c) and counts the
+ * round trips they save.
+ *
+ * A child process stands in for upsd: it answers GET VAR with a made up
+ * value, or an error for variables named "bad.*", and hangs up on
+ * "drop.now". Each batch of answers is held back for LATENCY to play a
+ * network round trip, and the number of batches is reported back when
+ * the client disconnects. The times taken are printed when NUT_TEST_BENCH
+ * is set.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common.h"
+#include "nuttest.h"
+#include "upsclient.h"
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define NUMVARS	50
+#define LATENCY	1000	/* us */
+
+/* the answer to one request line, 0 to hang up */
+static int answer_line(const char *line, char *out, size_t outlen)
+{
+	char	ups[SMALLBUF], var[SMALLBUF];
+
+	if (!strncmp(line, "LOGOUT", 6)) {
+		out[0] = '\0';
+		return 1;
+	}
+
+	if (sscanf(line, "GET VAR %127s %127s", ups, var) != 2) {
+		snprintf(out, outlen, "ERR UNKNOWN-COMMAND\n");
+		return 1;
+	}
+
+	if (!strcmp(var, "drop.now")) {
+		return 0;
+	}
+
+	if (!strncmp(var, "bad.", 4)) {
+		snprintf(out, outlen, "ERR VAR-NOT-SUPPORTED\n");
+		return 1;
+	}
+
+	snprintf(out, outlen, "VAR %s %s \"%s value\"\n", ups, var, var);
+	return 1;
+}
+
+/* the fake upsd: one client at a time, reporting its round trips */
+static void standin(int lfd, int report)
+{
+	char	in[65536], out[65536], *line, *eol;
+	size_t	inlen, outlen;
+	ssize_t	len;
+	int	fd, rounds, up;
+
+	for (;;) {
+		fd = accept(lfd, NULL, NULL);
+
+		if (fd < 0) {
+			exit(EXIT_FAILURE);
+		}
+
+		inlen = 0;
+		rounds = 0;
+		up = 1;
+
+		while (up && ((len = read(fd, in + inlen, sizeof(in) - inlen - 1)) > 0)) {
+			inlen += len;
+			in[inlen] = '\0';
+			outlen = 0;
+
+			for (line = in; up && (eol = strchr(line, '\n')) != NULL; line = eol + 1) {
+				*eol = '\0';
+				up = answer_line(line, out + outlen, sizeof(out) - outlen);
+				outlen += strlen(out + outlen);
+			}
+
+			inlen -= line - in;
+			memmove(in, line, inlen);
+
+			if (outlen > 0) {
+				usleep(LATENCY);
+
+				if (write(fd, out, outlen) != (ssize_t)outlen) {
+					break;
+				}
+
+				rounds++;
+			}
+		}
+
+		close(fd);
+
+		if (write(report, &rounds, sizeof(rounds)) != sizeof(rounds)) {
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+static int rounds_of(int report)
+{
+	int	rounds = -1;
+
+	if (read(report, &rounds, sizeof(rounds)) != sizeof(rounds)) {
+		fatal_with_errno(EXIT_FAILURE, "report");
+	}
+
+	return rounds;
+}
+
+static void query_of(const char **query, int i, char *var, size_t varlen)
+{
+	snprintf(var, varlen, "var.%d", i);
+
+	query[0] = "VAR";
+	query[1] = "myups";
+	query[2] = var;
+}
+
+static int check_answer(unsigned int numa, char **answer, const char *var)
+{
+	char	value[SMALLBUF];
+
+	snprintf(value, sizeof(value), "%s value", var);
+
+	return (numa == 4) && !strcmp(answer[2], var) && !strcmp(answer[3], value);
+}
+
+int main(void)
+{
+	UPSCONN_t	conn;
+	struct sockaddr_in	sa;
+	socklen_t	salen = sizeof(sa);
+	const char	*query[3];
+	char	var[NUMVARS][SMALLBUF], **answer;
+	unsigned int	numa;
+	int	lfd, report[2], port, i, ok, rounds[2];
+	double	start, t[2];
+	pid_t	pid;
+
+	signal(SIGPIPE, SIG_IGN);
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((bind(lfd, (struct sockaddr *)&sa, sizeof(sa)) < 0) || (listen(lfd, 1) < 0) ||
+		(getsockname(lfd, (struct sockaddr *)&sa, &salen) < 0) || (pipe(report) < 0)) {
+		fatal_with_errno(EXIT_FAILURE, "listen");
+	}
+
+	port = ntohs(sa.sin_port);
+
+	if ((pid = fork()) < 0) {
+		fatal_with_errno(EXIT_FAILURE, "fork");
+	}
+
+	if (pid == 0) {
+		close(report[0]);
+		standin(lfd, report[1]);
+	}
+
+	close(report[1]);
+
+	/* one at a time, as upslog and upsstats used to */
+	CHECK(upscli_connect(&conn, "127.0.0.1", port, UPSCLI_CONN_INET) == 0,
+		"connect: %s", upscli_strerror(&conn));
+
+	ok = 0;
+	start = now();
+
+	for (i = 0; i < NUMVARS; i++) {
+		query_of(query, i, var[i], sizeof(var[i]));
+
+		if (upscli_get(&conn, 3, query, &numa, &answer) == 0) {
+			ok += check_answer(numa, answer, var[i]);
+		}
+	}
+
+	t[0] = now() - start;
+	upscli_disconnect(&conn);
+	rounds[0] = rounds_of(report[0]);
+	CHECK(ok == NUMVARS, "%d of %d answers one at a time", ok, NUMVARS);
+
+	/* the same, pipelined */
+	CHECK(upscli_connect(&conn, "127.0.0.1", port, UPSCLI_CONN_INET) == 0,
+		"connect: %s", upscli_strerror(&conn));
+
+	ok = 0;
+	start = now();
+
+	for (i = 0; i < NUMVARS; i++) {
+		query_of(query, i, var[i], sizeof(var[i]));
+		CHECK(upscli_pipeline_get(&conn, 3, query) == 0, "queue %d", i);
+	}
+
+	CHECK(upscli_pipeline_send(&conn) == 0, "send: %s", upscli_strerror(&conn));
+
+	for (i = 0; i < NUMVARS; i++) {
+		query_of(query, i, var[i], sizeof(var[i]));
+
+		if (upscli_pipeline_next(&conn, 3, query, &numa, &answer) == 0) {
+			ok += check_answer(numa, answer, var[i]);
+		}
+	}
+
+	t[1] = now() - start;
+	CHECK(ok == NUMVARS, "%d of %d answers pipelined", ok, NUMVARS);
+
+	/* nothing left to read */
+	CHECK(upscli_pipeline_next(&conn, 3, query, &numa, &answer) == -1, "one answer too many");
+	CHECK(upscli_upserror(&conn) == UPSCLI_ERR_INVALIDARG, "error code %d", upscli_upserror(&conn));
+
+	upscli_disconnect(&conn);
+	rounds[1] = rounds_of(report[0]);
+
+	CHECK(rounds[0] == NUMVARS, "%d round trips one at a time", rounds[0]);
+	CHECK(rounds[1] == 1, "%d round trips pipelined", rounds[1]);
+
+	CHECK(upscli_connect(&conn, "127.0.0.1", port, UPSCLI_CONN_INET) == 0,
+		"connect: %s", upscli_strerror(&conn));
+
+	/* an ERR answer fails its own query only */
+	query[2] = "ups.status";
+	upscli_pipeline_get(&conn, 3, query);
+	query[2] = "bad.var";
+	upscli_pipeline_get(&conn, 3, query);
+	query[2] = "ups.load";
+	upscli_pipeline_get(&conn, 3, query);
+	upscli_pipeline_send(&conn);
+
+	query[2] = "ups.status";
+	CHECK(upscli_pipeline_next(&conn, 3, query, &numa, &answer) == 0, "before the error");
+	CHECK(check_answer(numa, answer, "ups.status"), "answer before the error");
+	query[2] = "bad.var";
+	CHECK(upscli_pipeline_next(&conn, 3, query, &numa, &answer) == -1, "error");
+	CHECK(upscli_upserror(&conn) == UPSCLI_ERR_VARNOTSUPP, "error code %d", upscli_upserror(&conn));
+	query[2] = "ups.load";
+	CHECK(upscli_pipeline_next(&conn, 3, query, &numa, &answer) == 0, "after the error");
+	CHECK(check_answer(numa, answer, "ups.load"), "answer after the error");
+	CHECK(upscli_fd(&conn) >= 0, "still connected after an ERR answer");
+
+	/* the server going away fails the queries it did not answer */
+	query[2] = "ups.status";
+	upscli_pipeline_get(&conn, 3, query);
+	query[2] = "drop.now";
+	upscli_pipeline_get(&conn, 3, query);
+	query[2] = "ups.load";
+	upscli_pipeline_get(&conn, 3, query);
+	upscli_pipeline_send(&conn);
+
+	query[2] = "ups.status";
+	CHECK(upscli_pipeline_next(&conn, 3, query, &numa, &answer) == 0, "before the hang up");
+	query[2] = "drop.now";
+	CHECK(upscli_pipeline_next(&conn, 3, query, &numa, &answer) == -1, "hang up");
+	CHECK(upscli_fd(&conn) == -1, "disconnected");
+	query[2] = "ups.load";
+	CHECK(upscli_pipeline_next(&conn, 3, query, &numa, &answer) == -1, "after the hang up");
+	CHECK(rounds_of(report[0]) == 2, "round trips before the hang up");
+
+	/* and so does a connection that is gone already */
+	upscli_pipeline_get(&conn, 3, query);
+	upscli_pipeline_get(&conn, 3, query);
+	CHECK(upscli_pipeline_send(&conn) == -1, "send without a connection");
+	CHECK(upscli_pipeline_next(&conn, 3, query, &numa, &answer) == -1, "first unsent");
+	CHECK(upscli_pipeline_next(&conn, 3, query, &numa, &answer) == -1, "second unsent");
+	CHECK(upscli_upserror(&conn) == UPSCLI_ERR_DRVNOTCONN, "error code %d", upscli_upserror(&conn));
+
+	upscli_disconnect(&conn);
+
+	if (bench_wanted()) {
+		printf("%d variables, %d us per round trip: one at a time %d round trips in %.1f ms, "
+			"pipelined %d in %.1f ms\n", NUMVARS, LATENCY,
+			rounds[0], t[0] * 1e3, rounds[1], t[1] * 1e3);
+	}
+
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	close(lfd);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
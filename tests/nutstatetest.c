@@ -0,0 +1,143 @@
+/* nutstatetest - sanity checks and a lookup microbenchmark for the
+ * common state tree (common/state.c) as used by drivers and upsd.
+ *
+ * Variables are inserted in sorted order (as most drivers publish them),
+ * which used to degenerate the tree into a list. The test verifies the
+ * tree stays balanced and sorted through inserts and deletes, and reports
+ * the average state_tree_find() cost at 10k variables when NUT_TEST_BENCH
+ * is set.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common.h"
+#include "nuttest.h"
+#include "state.h"
+
+#define NUMVARS	10000
+#define ROUNDS	50
+
+/* walk in order, check the ordering and the AVL invariant, count nodes */
+static int check_tree(const st_tree_t *node, const char **last)
+{
+	int	count = 0;
+	int	lh, rh;
+
+	if (!node) {
+		return 0;
+	}
+
+	count += check_tree(node->left, last);
+
+	if (*last) {
+		CHECK(strcasecmp(*last, node->var) < 0, "order: %s >= %s", *last, node->var);
+	}
+	*last = node->var;
+
+	count += 1 + check_tree(node->right, last);
+
+	lh = node->left ? node->left->height : 0;
+	rh = node->right ? node->right->height : 0;
+
+	CHECK(abs(lh - rh) <= 1, "unbalanced at %s (%d/%d)", node->var, lh, rh);
+	CHECK(node->height == ((lh > rh) ? lh : rh) + 1, "bad height at %s", node->var);
+
+	return count;
+}
+
+/* time lookups at full size */
+static void bench(st_tree_t **root)
+{
+	char	var[SMALLBUF];
+	int	i, r;
+	long	found = 0;
+	double	start, elapsed;
+
+	for (i = 0; i < NUMVARS; i++) {
+		snprintf(var, sizeof(var), "outlet.%05d.current", i);
+		state_setinfo(root, var, "0.00");
+	}
+
+	start = now();
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; i < NUMVARS; i++) {
+			snprintf(var, sizeof(var), "outlet.%05d.current", (i * 7919) % NUMVARS);
+			found += (state_tree_find(*root, var) != NULL);
+		}
+	}
+	elapsed = now() - start;
+
+	CHECK(found == (long)NUMVARS * ROUNDS, "timed lookups");
+
+	printf("state_tree_find: %d variables, height %d, %.1f ns/lookup\n",
+		NUMVARS, (*root)->height, elapsed * 1e9 / ((double)NUMVARS * ROUNDS));
+}
+
+int main(void)
+{
+	st_tree_t	*root = NULL;
+	const char	*last = NULL;
+	char	var[SMALLBUF];
+	int	i, maxheight = 0;
+
+	/* sorted insertion, the worst case for a plain BST */
+	for (i = 0; i < NUMVARS; i++) {
+		snprintf(var, sizeof(var), "outlet.%05d.current", i);
+		CHECK(state_setinfo(&root, var, "0.00") == 1, "insert %s", var);
+	}
+
+	CHECK(check_tree(root, &last) == NUMVARS, "node count after insert");
+	/* AVL height bound: 1.44 * log2(n + 2) */
+	for (i = NUMVARS + 2; i > 1; i >>= 1) {
+		maxheight++;
+	}
+	CHECK(root->height <= maxheight * 3 / 2, "height %d", root->height);
+
+	/* updates and lookups are case-insensitive */
+	CHECK(state_setinfo(&root, "OUTLET.00042.CURRENT", "1.50") == 1, "update");
+	CHECK(state_setinfo(&root, "outlet.00042.current", "1.50") == 0, "no-op update");
+	CHECK(!strcmp(state_getinfo(root, "Outlet.00042.Current"), "1.50"), "getinfo");
+	CHECK(state_getinfo(root, "outlet.99999.current") == NULL, "missing var");
+
+	/* immutable variables survive deletion */
+	state_tree_find(root, "outlet.00007.current")->flags |= ST_FLAG_IMMUTABLE;
+	CHECK(state_delinfo(&root, "outlet.00007.current") == 0, "immutable delete");
+
+	/* delete every other variable, including the root several times */
+	for (i = 0; i < NUMVARS; i += 2) {
+		if (i == 6) {
+			continue;
+		}
+		snprintf(var, sizeof(var), "outlet.%05d.current", i + 1);
+		CHECK(state_delinfo(&root, var) == 1, "delete %s", var);
+	}
+	CHECK(state_delinfo(&root, "outlet.00001.current") == 0, "double delete");
+
+	last = NULL;
+	CHECK(check_tree(root, &last) == NUMVARS / 2 + 1, "node count after delete");
+
+	for (i = 0; i < NUMVARS; i += 2) {
+		snprintf(var, sizeof(var), "outlet.%05d.current", i);
+		CHECK(state_tree_find(root, var) != NULL, "find %s", var);
+	}
+
+	if (bench_wanted()) {
+		bench(&root);
+	}
+
+	state_infofree(root);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,303 @@
+/* nutstatstest - checks of the upsd runtime metrics (server/stats.c):
+ * histogram buckets and quantiles, the upsd.* variables of GET VAR and
+ * the Prometheus text served to METRICS clients.
+ *
+ * The answers that stats.c queues with sendback() and sendback_http()
+ * are collected here in a buffer instead of going to a socket.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common.h"
+#include "nuttest.h"
+#include "upsd.h"
+#include "neterr.h"
+#include "stats.h"
+
+upstype_t	*firstups = NULL;
+nut_ctype_t	*firstclient = NULL;
+
+/* what stats.c sent back */
+static char	out[65536];
+static size_t	out_len = 0;
+
+/* NUT answers among those, a scrape must not add to them */
+static int	answers = 0;
+
+int sendback(nut_ctype_t *client, const char *fmt, ...)
+{
+	va_list	ap;
+
+	NUT_UNUSED_VARIABLE(client);
+
+	va_start(ap, fmt);
+	vsnprintf(out + out_len, sizeof(out) - out_len, fmt, ap);
+	va_end(ap);
+
+	out_len += strlen(out + out_len);
+	answers++;
+
+	return 1;
+}
+
+int sendback_http(nut_ctype_t *client, const char *buf, size_t len)
+{
+	NUT_UNUSED_VARIABLE(client);
+
+	if (out_len + len >= sizeof(out)) {
+		len = sizeof(out) - out_len - 1;
+	}
+
+	memcpy(out + out_len, buf, len);
+	out_len += len;
+	out[out_len] = '\0';
+
+	return 1;
+}
+
+int send_err(nut_ctype_t *client, const char *errtype)
+{
+	return sendback(client, "ERR %s\n", errtype);
+}
+
+upstype_t *get_ups_ptr(const char *name)
+{
+	upstype_t	*ups;
+
+	for (ups = firstups; ups; ups = ups->next) {
+		if (!strcasecmp(ups->name, name)) {
+			return ups;
+		}
+	}
+
+	return NULL;
+}
+
+/* the value of a GET VAR answer, or NULL if there was none */
+static const char *get(const char *upsname, const char *var)
+{
+	static char	val[SMALLBUF];
+	char	expect[SMALLBUF];
+	size_t	len;
+
+	out_len = 0;
+	out[0] = '\0';
+
+	if (!stats_get_var(NULL, upsname, var)) {
+		return NULL;
+	}
+
+	snprintf(expect, sizeof(expect), "VAR %s %s \"", upsname, var);
+	len = strlen(expect);
+
+	if (strncmp(out, expect, len)) {
+		snprintf(val, sizeof(val), "%s", out);
+		return val;
+	}
+
+	snprintf(val, sizeof(val), "%s", out + len);
+	val[strcspn(val, "\"")] = '\0';
+
+	return val;
+}
+
+static void check_get(const char *upsname, const char *var, const char *want)
+{
+	const char	*val = get(upsname, var);
+
+	CHECK(val && !strcmp(val, want), "GET VAR %s %s: [%s], expected [%s]",
+		upsname, var, val ? val : "(none)", want);
+}
+
+/* the value of a sample of the Prometheus text */
+static long sample(const char *name)
+{
+	char	*s;
+	size_t	len = strlen(name);
+
+	for (s = out; (s = strstr(s, name)) != NULL; s += len) {
+		if (((s == out) || (s[-1] == '\n')) && (s[len] == ' ')) {
+			return strtol(s + len + 1, NULL, 10);
+		}
+	}
+
+	return -1;
+}
+
+static void check_hist(void)
+{
+	stats_hist_t	hist;
+	int	i;
+
+	memset(&hist, 0, sizeof(hist));
+
+	CHECK(stats_hist_quantile(&hist, 0.5) == 0, "quantile of an empty histogram");
+
+	/* bucket i is up to 2^i us */
+	stats_hist_usec(&hist, 0);
+	stats_hist_usec(&hist, 1);
+	stats_hist_usec(&hist, 2);
+	stats_hist_usec(&hist, 3);
+	stats_hist_usec(&hist, 1024);
+	stats_hist_usec(&hist, 1025);
+	stats_hist_usec(&hist, 100000000UL);
+
+	CHECK(hist.bucket[0] == 2, "bucket 0 has %lu", hist.bucket[0]);
+	CHECK(hist.bucket[1] == 1, "bucket 1 has %lu", hist.bucket[1]);
+	CHECK(hist.bucket[2] == 1, "bucket 2 has %lu", hist.bucket[2]);
+	CHECK(hist.bucket[10] == 1, "bucket 10 has %lu", hist.bucket[10]);
+	CHECK(hist.bucket[11] == 1, "bucket 11 has %lu", hist.bucket[11]);
+	CHECK(hist.bucket[STATS_BUCKETS - 1] == 1, "last bucket has %lu",
+		hist.bucket[STATS_BUCKETS - 1]);
+	CHECK(hist.count == 7, "count is %lu", hist.count);
+	CHECK(hist.max == 100000000UL, "max is %lu", hist.max);
+
+	memset(&hist, 0, sizeof(hist));
+
+	/* 990 quick ones, 9 slower, one slow */
+	for (i = 0; i < 990; i++) {
+		stats_hist_usec(&hist, 10);
+	}
+
+	for (i = 0; i < 9; i++) {
+		stats_hist_usec(&hist, 300);
+	}
+
+	stats_hist_usec(&hist, 5000);
+
+	CHECK(stats_hist_quantile(&hist, 0.5) == 16, "p50 is %lu",
+		stats_hist_quantile(&hist, 0.5));
+	CHECK(stats_hist_quantile(&hist, 0.99) == 16, "p99 is %lu",
+		stats_hist_quantile(&hist, 0.99));
+	CHECK(stats_hist_quantile(&hist, 0.999) == 512, "p999 is %lu",
+		stats_hist_quantile(&hist, 0.999));
+
+	/* the bound of the last bucket reached is above the longest seen */
+	CHECK(stats_hist_quantile(&hist, 1.0) == 5000, "p100 is %lu",
+		stats_hist_quantile(&hist, 1.0));
+}
+
+static void check_vars(void)
+{
+	/* still in the lists for check_http() */
+	static upstype_t	ups;
+	static nut_ctype_t	client;
+
+	memset(&ups, 0, sizeof(ups));
+	ups.name = "pdu";
+	ups.sock_fd = 5;
+	ups.stat_updates = 42;
+	ups.stat_bytes = 4242;
+	ups.stat_connects = 2;
+	firstups = &ups;
+
+	memset(&client, 0, sizeof(client));
+	client.outbuf_len = 100;
+	firstclient = &client;
+
+	stats.accepted = 3;
+	stats.command[NT_GET - NT_VER] = 10;
+	stats.command[NT_LIST - NT_VER] = 5;
+	stats.unknown = 1;
+	stats_hist_usec(&stats.request, 100);
+	stats_hist_usec(&stats.request, 300);
+
+	check_get("pdu", "upsd.clients", "1");
+	check_get("pdu", "upsd.clients.waiting", "1");
+	check_get("pdu", "upsd.clients.watching", "0");
+	check_get("pdu", "upsd.outbuf.bytes", "100");
+	check_get("pdu", "upsd.clients.accepted", "3");
+	check_get("pdu", "upsd.requests", "15");
+	check_get("pdu", "upsd.requests.get", "10");
+	check_get("pdu", "upsd.requests.LIST", "5");
+	check_get("pdu", "upsd.requests.unknown", "1");
+	check_get("pdu", "upsd.request.time.count", "2");
+	check_get("pdu", "upsd.request.time.avg", "200");
+	check_get("pdu", "upsd.request.time.max", "300");
+	check_get("pdu", "upsd.driver.updates", "42");
+	check_get("pdu", "upsd.driver.bytes", "4242");
+	check_get("pdu", "upsd.driver.connects", "2");
+	check_get("pdu", "upsd.driver.connected", "1");
+	check_get("nosuchups", "upsd.driver.updates", "ERR " NUT_ERR_UNKNOWN_UPS "\n");
+
+	/* the server wide ones do not care for the UPS name */
+	check_get("nosuchups", "upsd.requests.get", "10");
+
+	CHECK(get("pdu", "upsd.requests.bogus") == NULL, "upsd.requests.bogus answered");
+	CHECK(get("pdu", "upsd.request.time.p42") == NULL, "upsd.request.time.p42 answered");
+	CHECK(get("pdu", "upsd.driver") == NULL, "upsd.driver answered");
+	CHECK(get("pdu", "upsd.bogus") == NULL, "upsd.bogus answered");
+}
+
+static void check_http(void)
+{
+	nut_ctype_t	client;
+	const char	*req = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	long	count;
+	int	ret;
+
+	memset(&client, 0, sizeof(client));
+	client.addr = "127.0.0.1";
+	out_len = 0;
+	answers = 0;
+
+	/* the request may come in pieces */
+	ret = stats_http_read(&client, req, 20);
+	CHECK(ret == 0, "partial request: %d", ret);
+	CHECK(out_len == 0, "answer to a partial request");
+
+	ret = stats_http_read(&client, req + 20, strlen(req) - 20);
+	CHECK(ret == 1, "complete request: %d", ret);
+	CHECK(!strncmp(out, "HTTP/1.0 200 OK\r\n", 17), "status line [%.20s]", out);
+	CHECK(strstr(out, "\r\n\r\n# HELP nut_upsd_uptime_seconds ") != NULL, "metrics after the headers");
+	CHECK(answers == 0, "scrape sent %d NUT answers", answers);
+
+	CHECK(sample("nut_upsd_clients") == 1, "nut_upsd_clients");
+	CHECK(sample("nut_upsd_requests_total{command=\"get\"}") == 10, "requests of get");
+	CHECK(sample("nut_upsd_driver_updates_total{ups=\"pdu\"}") == 42, "updates of pdu");
+
+	/* buckets are cumulative, +Inf is the count */
+	count = sample("nut_upsd_request_seconds_count");
+	CHECK(count == 2, "request count %ld", count);
+	CHECK(sample("nut_upsd_request_seconds_bucket{le=\"6.4e-05\"}") == 0, "bucket 64us");
+	CHECK(sample("nut_upsd_request_seconds_bucket{le=\"0.000128\"}") == 1, "bucket 128us");
+	CHECK(sample("nut_upsd_request_seconds_bucket{le=\"0.000512\"}") == 2, "bucket 512us");
+	CHECK(sample("nut_upsd_request_seconds_bucket{le=\"+Inf\"}") == count, "bucket +Inf");
+	CHECK(strstr(out, "\nnut_upsd_request_seconds_sum 0.000400\n") != NULL, "request sum");
+
+	free(client.request);
+
+	/* anything but GET */
+	memset(&client, 0, sizeof(client));
+	client.addr = "127.0.0.1";
+	out_len = 0;
+
+	ret = stats_http_read(&client, "POST / HTTP/1.0\n\n", 17);
+	CHECK(ret == 1, "POST request: %d", ret);
+	CHECK(!strncmp(out, "HTTP/1.0 405 ", 13), "POST status line [%.20s]", out);
+
+	free(client.request);
+}
+
+int main(void)
+{
+	stats_init();
+
+	check_hist();
+	check_vars();
+	check_http();
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
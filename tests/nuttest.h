@@ -0,0 +1,57 @@
+/* nuttest.h - what the nut*test programs have in common
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef NUT_NUTTEST_H_SEEN
+#define NUT_NUTTEST_H_SEEN 1
+
+#include "common.h"
+
+#include <sys/time.h>
+
+/* checks that failed, main() ends with
+ *	return failed ? EXIT_FAILURE : EXIT_SUCCESS; */
+static int	failed = 0;
+
+#define CHECK(cond, ...)					\
+	do {							\
+		if (!(cond)) {					\
+			upslogx(LOG_ERR, "FAIL: " __VA_ARGS__);	\
+			failed++;				\
+		}						\
+	} while (0)
+
+/* wall clock in seconds, for the benchmarks */
+static inline double now(void)
+{
+	struct timeval	tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* The timing loops only run on request, as in
+ *	NUT_TEST_BENCH=1 make check
+ * nothing checks their results, they would only slow down the tests. */
+static inline int bench_wanted(void)
+{
+	const char	*s = getenv("NUT_TEST_BENCH");
+
+	return s && *s && strcmp(s, "0");
+}
+
+#endif	/* NUT_NUTTEST_H_SEEN */
@@ -0,0 +1,152 @@
+/* nutupsclitest - checks the split request/response form of upscli_get()
+ * (clients/upsclient.c) that upsmon uses to wait on many upsd at once.
+ *
+ * A local socket stands in for upsd and sends its answers in pieces:
+ * upscli_get_response() must never wait for data, must keep a partial
+ * line until the rest arrives, and must hand out answers that came in
+ * the same read one by one. upscli_watch_next() is held to the same
+ * rules for WATCH notifications.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common.h"
+#include "nuttest.h"
+#include "upsclient.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+static void send_str(int fd, const char *str)
+{
+	if (write(fd, str, strlen(str)) != (ssize_t)strlen(str)) {
+		fatal_with_errno(EXIT_FAILURE, "write");
+	}
+
+	usleep(10000);	/* let it arrive */
+}
+
+int main(void)
+{
+	UPSCONN_t	conn;
+	struct sockaddr_in	sa;
+	socklen_t	salen = sizeof(sa);
+	const char	*query[] = { "VAR", "myups", "ups.status" };
+	unsigned int	numa;
+	char	**answer, line[SMALLBUF];
+	struct timeval	start, end;
+	int	lfd, fd, i;
+	ssize_t	len;
+	long	ms;
+
+	/* like upsmon: a server going away is reported, not fatal */
+	signal(SIGPIPE, SIG_IGN);
+
+	/* a listening socket on any free port plays upsd */
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((bind(lfd, (struct sockaddr *)&sa, sizeof(sa)) < 0) || (listen(lfd, 1) < 0) ||
+		(getsockname(lfd, (struct sockaddr *)&sa, &salen) < 0)) {
+		fatal_with_errno(EXIT_FAILURE, "listen");
+	}
+
+	CHECK(upscli_connect(&conn, "127.0.0.1", ntohs(sa.sin_port), UPSCLI_CONN_INET) == 0,
+		"connect: %s", upscli_strerror(&conn));
+
+	fd = accept(lfd, NULL, NULL);
+	CHECK(fd >= 0, "accept");
+
+	/* each send_str() is a separate piece, right away */
+	i = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &i, sizeof(i));
+
+	CHECK(upscli_get_request(&conn, 3, query) == 0, "request");
+
+	len = read(fd, line, sizeof(line) - 1);
+	line[(len > 0) ? len : 0] = '\0';
+	CHECK(!strcmp(line, "GET VAR myups ups.status\n"), "request sent: %s", line);
+
+	/* nothing there yet: no waiting */
+	gettimeofday(&start, NULL);
+	CHECK(upscli_get_response(&conn, 3, query, &numa, &answer) == 0, "empty");
+	gettimeofday(&end, NULL);
+
+	ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+	CHECK(ms < 100, "waited %ld ms for nothing", ms);
+
+	/* half an answer, longer than the read buffer */
+	send_str(fd, "VAR myups ups.status \"OL CHRG BOOST TRIM OVER BYPASS ");
+	CHECK(upscli_get_response(&conn, 3, query, &numa, &answer) == 0, "partial line");
+
+	send_str(fd, "ALARM\"\n");
+	CHECK(upscli_get_response(&conn, 3, query, &numa, &answer) == 1, "complete line");
+	CHECK((numa == 4) && !strcmp(answer[3], "OL CHRG BOOST TRIM OVER BYPASS ALARM"),
+		"answer: %s", (numa == 4) ? answer[3] : "?");
+
+	/* two answers in one go, then an error */
+	CHECK(upscli_get_request(&conn, 3, query) == 0, "request 2");
+	CHECK(upscli_get_request(&conn, 3, query) == 0, "request 3");
+	CHECK(upscli_get_request(&conn, 3, query) == 0, "request 4");
+	send_str(fd, "VAR myups ups.status \"OB\"\nVAR myups ups.status \"OB LB\"\nERR UNKNOWN-UPS\n");
+
+	CHECK(upscli_get_response(&conn, 3, query, &numa, &answer) == 1, "first of three");
+	CHECK(!strcmp(answer[3], "OB"), "first answer: %s", answer[3]);
+	CHECK(upscli_get_response(&conn, 3, query, &numa, &answer) == 1, "second of three");
+	CHECK(!strcmp(answer[3], "OB LB"), "second answer: %s", answer[3]);
+	CHECK(upscli_get_response(&conn, 3, query, &numa, &answer) == -1, "error answer");
+	CHECK(upscli_upserror(&conn) == UPSCLI_ERR_UNKNOWNUPS, "error code %d", upscli_upserror(&conn));
+	CHECK(upscli_fd(&conn) >= 0, "still connected after an ERR answer");
+
+	/* subscriptions: the OK is skipped, notifications come one by one */
+	len = read(fd, line, sizeof(line) - 1);	/* the three GET above */
+	CHECK(len > 0, "requests 2 to 4");
+
+	CHECK(upscli_watch(&conn, "myups", "battery.*") == 0, "watch");
+
+	len = read(fd, line, sizeof(line) - 1);
+	line[(len > 0) ? len : 0] = '\0';
+	CHECK(!strcmp(line, "WATCH myups battery.*\n"), "watch sent: %s", line);
+
+	CHECK(upscli_watch_next(&conn, &numa, &answer) == 0, "no notification yet");
+
+	send_str(fd, "OK\nNOTIFY VAR myups battery.charge \"42\"\nNOTIFY DATASTALE myups\nNOTIFY VAR");
+	CHECK(upscli_watch_next(&conn, &numa, &answer) == 1, "first notification");
+	CHECK((numa == 4) && !strcmp(answer[0], "VAR") && !strcmp(answer[3], "42"),
+		"notification: %s", (numa == 4) ? answer[3] : "?");
+	CHECK(upscli_watch_next(&conn, &numa, &answer) == 1, "second notification");
+	CHECK((numa == 2) && !strcmp(answer[0], "DATASTALE") && !strcmp(answer[1], "myups"),
+		"event: %s", answer[0]);
+	CHECK(upscli_watch_next(&conn, &numa, &answer) == 0, "partial notification");
+
+	send_str(fd, " myups battery.runtime \"600\"\n");
+	CHECK(upscli_watch_next(&conn, &numa, &answer) == 1, "third notification");
+	CHECK((numa == 4) && !strcmp(answer[2], "battery.runtime"), "variable: %s", answer[2]);
+
+	/* the server going away is an error, not a wait */
+	close(fd);
+	usleep(10000);
+	CHECK(upscli_get_response(&conn, 3, query, &numa, &answer) == -1, "server gone");
+	CHECK(upscli_fd(&conn) == -1, "disconnected");
+
+	upscli_disconnect(&conn);
+	close(lfd);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
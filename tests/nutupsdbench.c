@@ -0,0 +1,788 @@
+/* nutupsdbench - load test of upsd: many clients sending a mix of GET VAR,
+ * LIST VAR, SET VAR and INSTCMD, with the requests per second and the
+ * latency percentiles of each kind.
+ *
+ * Run against a live upsd, for instance with one dummy-ups standing in for
+ * many devices (see "devices" in dummy-ups(8)). nutupsdbench.sh sets that
+ * up and is what "make bench" runs:
+ *
+ *	nutupsdbench -c 1000 -D 100 -t 10 -m get:80,list:10,set:5,cmd:5 \
+ *		-u admin -p secret -w ups.load -x load.off farm@localhost:3493
+ *
+ * Each client has one request in flight at a time, on a device picked at
+ * random among <ups> and <ups>-1 to <ups>-<n>, and sends the next one as
+ * soon as the answer is complete. GET VAR asks for a random variable of
+ * those upsd lists for <ups>. SET VAR and INSTCMD only ever use the
+ * variable and the command given with -w and -x: do not point them at
+ * real hardware.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common.h"
+#include "upsclient.h"
+
+#include <poll.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+enum {
+	REQ_GET = 0,
+	REQ_LIST,
+	REQ_SET,
+	REQ_CMD,
+	NUMREQ
+};
+
+static const char	*reqname[NUMREQ] = { "get", "list", "set", "cmd" };
+
+typedef struct {
+	int	fd;
+#ifdef WITH_OPENSSL
+	SSL	*ssl;
+#endif
+	int	req;		/* kind of the request in flight, -1 if none */
+	struct timeval	start;
+
+	char	out[LARGEBUF];
+	size_t	outlen;
+	size_t	outsent;
+
+	char	in[LARGEBUF];
+	size_t	inlen;
+} client_t;
+
+/* the latencies of one kind of request, in us */
+typedef struct {
+	unsigned long	*usec;
+	size_t	count;
+	size_t	size;
+	long	errors;
+} samples_t;
+
+static char	*upsname = NULL, *hostname = NULL;
+static int	port;
+
+static const char	*user = NULL, *pass = NULL, *setvar = NULL, *cmdname = NULL;
+static int	use_tls = 0, verbose = 0;
+
+static char	**device = NULL;
+static int	numdevices = 0;
+
+static char	**var = NULL;
+static int	numvars = 0;
+
+static int	weight[NUMREQ] = { 90, 10, 0, 0 };
+static int	weights = 100;
+
+static samples_t	sample[NUMREQ];
+static long	setcount = 0;
+
+#ifdef WITH_OPENSSL
+static SSL_CTX	*ssl_ctx = NULL;
+#endif
+
+static void help(const char *prog)
+{
+	printf("usage: %s [options] <ups>@<host>[:<port>]\n", prog);
+	printf("  -c <clients>   concurrent connections (default 100)\n");
+	printf("  -D <n>         also use devices <ups>-1 to <ups>-<n>, as dummy-ups \"devices\" makes\n");
+	printf("  -t <seconds>   duration of the run (default 10)\n");
+	printf("  -m <mix>       weights of each request, default get:90,list:10\n");
+	printf("                 (kinds are get, list, set and cmd)\n");
+	printf("  -u <user>      log in as user, needed by set and cmd\n");
+	printf("  -p <pass>      password of user\n");
+	printf("  -w <var>       variable changed by set\n");
+	printf("  -x <cmd>       instant command sent by cmd\n");
+	printf("  -s             use STARTTLS on each connection\n");
+	printf("  -v             list the variables used\n");
+	exit(EXIT_SUCCESS);
+}
+
+static double elapsed_since(const struct timeval *start)
+{
+	struct timeval	now;
+
+	get_monotonic_time(&now);
+
+	return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1e6;
+}
+
+static void parse_mix(const char *mix)
+{
+	char	*copy, *tok, *last = NULL, *colon;
+	int	i;
+
+	memset(weight, 0, sizeof(weight));
+	weights = 0;
+
+	copy = xstrdup(mix);
+
+	for (tok = strtok_r(copy, ",", &last); tok; tok = strtok_r(NULL, ",", &last)) {
+
+		colon = strchr(tok, ':');
+
+		if (!colon) {
+			fatalx(EXIT_FAILURE, "invalid mix entry %s, expected <kind>:<weight>", tok);
+		}
+
+		*colon = '\0';
+
+		for (i = 0; i < NUMREQ; i++) {
+			if (!strcmp(tok, reqname[i])) {
+				break;
+			}
+		}
+
+		if ((i == NUMREQ) || (atoi(colon + 1) < 0)) {
+			fatalx(EXIT_FAILURE, "invalid mix entry %s:%s", tok, colon + 1);
+		}
+
+		weight[i] = atoi(colon + 1);
+		weights += weight[i];
+	}
+
+	free(copy);
+
+	if (weights < 1) {
+		fatalx(EXIT_FAILURE, "the mix %s has no requests", mix);
+	}
+}
+
+/* >0 bytes, 0 if it would block, -1 on error or end of connection */
+static ssize_t conn_read(client_t *c, char *buf, size_t buflen)
+{
+	ssize_t	ret;
+
+#ifdef WITH_OPENSSL
+	if (c->ssl) {
+		ret = SSL_read(c->ssl, buf, (int)buflen);
+
+		if (ret > 0) {
+			return ret;
+		}
+
+		switch (SSL_get_error(c->ssl, (int)ret))
+		{
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			return 0;
+		default:
+			return -1;
+		}
+	}
+#endif	/* WITH_OPENSSL */
+
+	ret = read(c->fd, buf, buflen);
+
+	if (ret > 0) {
+		return ret;
+	}
+
+	if ((ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))) {
+		return 0;
+	}
+
+	return -1;
+}
+
+static ssize_t conn_write(client_t *c, const char *buf, size_t buflen)
+{
+	ssize_t	ret;
+
+#ifdef WITH_OPENSSL
+	if (c->ssl) {
+		ret = SSL_write(c->ssl, buf, (int)buflen);
+
+		if (ret > 0) {
+			return ret;
+		}
+
+		switch (SSL_get_error(c->ssl, (int)ret))
+		{
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			return 0;
+		default:
+			return -1;
+		}
+	}
+#endif	/* WITH_OPENSSL */
+
+	ret = write(c->fd, buf, buflen);
+
+	if (ret > 0) {
+		return ret;
+	}
+
+	if ((ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))) {
+		return 0;
+	}
+
+	return -1;
+}
+
+/* take the next complete line out of what was read, 0 if there is none */
+static int next_line(client_t *c, char *line, size_t linelen)
+{
+	char	*eol;
+	size_t	len;
+
+	eol = memchr(c->in, '\n', c->inlen);
+
+	if (!eol) {
+		/* upsd lines are much shorter than that */
+		if (c->inlen >= sizeof(c->in) - 1) {
+			fatalx(EXIT_FAILURE, "overlong line from upsd");
+		}
+
+		return 0;
+	}
+
+	len = eol - c->in;
+
+	if (len > linelen - 1) {
+		len = linelen - 1;
+	}
+
+	memcpy(line, c->in, len);
+	line[len] = '\0';
+
+	c->inlen -= (eol + 1) - c->in;
+	memmove(c->in, eol + 1, c->inlen);
+
+	return 1;
+}
+
+/* the blocking exchanges of the setup */
+static void setup_send(client_t *c, const char *fmt, ...)
+	__attribute__ ((__format__ (__printf__, 2, 3)));
+
+static void setup_send(client_t *c, const char *fmt, ...)
+{
+	char	buf[LARGEBUF];
+	va_list	ap;
+
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	if (conn_write(c, buf, strlen(buf)) != (ssize_t)strlen(buf)) {
+		fatalx(EXIT_FAILURE, "lost connection to %s:%d", hostname, port);
+	}
+}
+
+static void setup_line(client_t *c, char *line, size_t linelen)
+{
+	ssize_t	ret;
+
+	while (!next_line(c, line, linelen)) {
+		ret = conn_read(c, c->in + c->inlen, sizeof(c->in) - 1 - c->inlen);
+
+		if (ret < 1) {
+			fatalx(EXIT_FAILURE, "lost connection to %s:%d", hostname, port);
+		}
+
+		c->inlen += ret;
+	}
+}
+
+static void setup_ok(client_t *c, const char *what)
+{
+	char	line[LARGEBUF];
+
+	setup_line(c, line, sizeof(line));
+
+	if (strncmp(line, "OK", 2)) {
+		fatalx(EXIT_FAILURE, "%s: %s", what, line);
+	}
+}
+
+static void open_client(client_t *c, const struct addrinfo *ai)
+{
+	int	one = 1;
+
+	memset(c, 0, sizeof(*c));
+	c->req = -1;
+
+	c->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+
+	if (c->fd < 0) {
+		fatal_with_errno(EXIT_FAILURE, "socket");
+	}
+
+	if (connect(c->fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+		fatal_with_errno(EXIT_FAILURE, "connect to %s:%d", hostname, port);
+	}
+
+	/* small writes in a row, as in the TLS handshake, are not to wait
+	 * for the acknowledgement of the previous one */
+	setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	if (use_tls) {
+#ifdef WITH_OPENSSL
+		setup_send(c, "STARTTLS\n");
+		setup_ok(c, "STARTTLS");
+
+		c->ssl = SSL_new(ssl_ctx);
+
+		if ((!c->ssl) || (SSL_set_fd(c->ssl, c->fd) != 1) || (SSL_connect(c->ssl) != 1)) {
+			fatalx(EXIT_FAILURE, "TLS handshake with %s:%d failed", hostname, port);
+		}
+#endif	/* WITH_OPENSSL */
+	}
+
+	if (user) {
+		setup_send(c, "USERNAME %s\n", user);
+		setup_ok(c, "USERNAME");
+		setup_send(c, "PASSWORD %s\n", pass);
+		setup_ok(c, "PASSWORD");
+	}
+
+	if (fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK) < 0) {
+		fatal_with_errno(EXIT_FAILURE, "fcntl");
+	}
+}
+
+static void close_client(client_t *c)
+{
+#ifdef WITH_OPENSSL
+	if (c->ssl) {
+		SSL_free(c->ssl);
+		c->ssl = NULL;
+	}
+#endif	/* WITH_OPENSSL */
+
+	close(c->fd);
+	c->fd = -1;
+}
+
+/* the variables of the first device, asked for on a blocking connection */
+static void list_vars(client_t *c)
+{
+	char	line[LARGEBUF], name[SMALLBUF];
+
+	setup_send(c, "LIST VAR %s\n", upsname);
+	setup_line(c, line, sizeof(line));
+
+	if (strncmp(line, "BEGIN LIST VAR", 14)) {
+		fatalx(EXIT_FAILURE, "LIST VAR %s: %s", upsname, line);
+	}
+
+	for (;;) {
+		setup_line(c, line, sizeof(line));
+
+		if (!strncmp(line, "END LIST", 8)) {
+			break;
+		}
+
+		if (sscanf(line, "VAR %*s %127s", name) != 1) {
+			continue;
+		}
+
+		var = xrealloc(var, (numvars + 1) * sizeof(*var));
+		var[numvars++] = xstrdup(name);
+
+		if (verbose) {
+			printf("variable %s\n", name);
+		}
+	}
+
+	if (numvars < 1) {
+		fatalx(EXIT_FAILURE, "%s has no variables", upsname);
+	}
+}
+
+static void add_sample(samples_t *s, unsigned long usec)
+{
+	if (s->count == s->size) {
+		s->size = s->size ? 2 * s->size : 65536;
+		s->usec = xrealloc(s->usec, s->size * sizeof(*s->usec));
+	}
+
+	s->usec[s->count++] = usec;
+}
+
+/* queue the next request of a client, and send what can be sent */
+static int send_next(client_t *c)
+{
+	const char	*dev = device[random() % numdevices];
+	int	r, req;
+	ssize_t	ret;
+
+	for (r = random() % weights, req = 0; r >= weight[req]; req++) {
+		r -= weight[req];
+	}
+
+	switch (req)
+	{
+	case REQ_GET:
+		snprintf(c->out, sizeof(c->out), "GET VAR %s %s\n", dev, var[random() % numvars]);
+		break;
+	case REQ_LIST:
+		snprintf(c->out, sizeof(c->out), "LIST VAR %s\n", dev);
+		break;
+	case REQ_SET:
+		snprintf(c->out, sizeof(c->out), "SET VAR %s %s \"%ld\"\n", dev, setvar, ++setcount % 100);
+		break;
+	default:
+		snprintf(c->out, sizeof(c->out), "INSTCMD %s %s\n", dev, cmdname);
+		break;
+	}
+
+	c->req = req;
+	c->outlen = strlen(c->out);
+	c->outsent = 0;
+	get_monotonic_time(&c->start);
+
+	ret = conn_write(c, c->out, c->outlen);
+
+	if (ret < 0) {
+		return -1;
+	}
+
+	c->outsent = ret;
+
+	return 0;
+}
+
+/* one line of the answer to the request in flight: 1 once it is complete */
+static int answer_line(client_t *c, const char *line)
+{
+	if (c->req < 0) {
+		fatalx(EXIT_FAILURE, "unexpected line from upsd: %s", line);
+	}
+
+	if (!strncmp(line, "ERR", 3)) {
+		sample[c->req].errors++;
+
+		if (sample[c->req].errors == 1) {
+			upslogx(LOG_WARNING, "%s: %s", reqname[c->req], line);
+		}
+
+		return 1;
+	}
+
+	if (c->req == REQ_LIST) {
+		return !strncmp(line, "END LIST", 8);
+	}
+
+	return 1;
+}
+
+/* read what arrived, and go on with the next request: -1 if disconnected */
+static int client_ready(client_t *c, short revents, int running)
+{
+	char	line[LARGEBUF];
+	ssize_t	ret;
+
+	if ((revents & POLLOUT) && (c->outsent < c->outlen)) {
+		ret = conn_write(c, c->out + c->outsent, c->outlen - c->outsent);
+
+		if (ret < 0) {
+			return -1;
+		}
+
+		c->outsent += ret;
+	}
+
+	if (!(revents & (POLLIN | POLLHUP | POLLERR))) {
+		return 0;
+	}
+
+	while ((ret = conn_read(c, c->in + c->inlen, sizeof(c->in) - 1 - c->inlen)) > 0) {
+
+		c->inlen += ret;
+
+		while (next_line(c, line, sizeof(line))) {
+
+			if (!answer_line(c, line)) {
+				continue;
+			}
+
+			add_sample(&sample[c->req], (unsigned long)(elapsed_since(&c->start) * 1e6));
+			c->req = -1;
+
+			if (running && (send_next(c) < 0)) {
+				return -1;
+			}
+		}
+	}
+
+	return (int)ret;
+}
+
+static int cmp_usec(const void *a, const void *b)
+{
+	unsigned long	x = *(const unsigned long *)a, y = *(const unsigned long *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* the value at or below which a fraction q of the sorted samples fall */
+static unsigned long percentile(const samples_t *s, double q)
+{
+	size_t	i = (size_t)(q * s->count + 0.999999);
+
+	if (s->count < 1) {
+		return 0;
+	}
+
+	return s->usec[(i > 0 ? i : 1) - 1];
+}
+
+static void report(const char *name, samples_t *s, double seconds)
+{
+	qsort(s->usec, s->count, sizeof(*s->usec), cmp_usec);
+
+	printf("%-5s %10lu %10.1f %7ld %8lu %8lu %8lu %8lu\n", name,
+		(unsigned long)s->count, s->count / seconds, s->errors,
+		percentile(s, 0.5), percentile(s, 0.99), percentile(s, 0.999),
+		s->count ? s->usec[s->count - 1] : 0);
+}
+
+static void raise_fd_limit(int clients)
+{
+	struct rlimit	rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) < 0) {
+		return;
+	}
+
+	if (rl.rlim_cur < (rlim_t)clients + 16) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+		getrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	if (rl.rlim_cur < (rlim_t)clients + 16) {
+		fatalx(EXIT_FAILURE, "%d clients need more open files than the limit of %ld",
+			clients, (long)rl.rlim_cur);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	client_t	*client;
+	struct pollfd	*fds;
+	struct addrinfo	hints, *ai;
+	struct timeval	start;
+	char	service[SMALLBUF], name[SMALLBUF];
+	int	i, clients = 100, extra = 0, seconds = 10, dropped = 0, ret;
+	long	errors = 0;
+	double	setup_s, run_s;
+	samples_t	all;
+
+	while ((i = getopt(argc, argv, "+hc:D:t:m:u:p:w:x:sv")) != -1) {
+		switch (i) {
+		case 'c':
+			clients = atoi(optarg);
+			break;
+		case 'D':
+			extra = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'm':
+			parse_mix(optarg);
+			break;
+		case 'u':
+			user = optarg;
+			break;
+		case 'p':
+			pass = optarg;
+			break;
+		case 'w':
+			setvar = optarg;
+			break;
+		case 'x':
+			cmdname = optarg;
+			break;
+		case 's':
+			use_tls = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+		default:
+			help(argv[0]);
+		}
+	}
+
+	if ((argc - optind != 1) || (clients < 1) || (extra < 0) || (seconds < 1) || (!user != !pass)) {
+		help(argv[0]);
+	}
+
+	if ((weight[REQ_SET] > 0) && ((!setvar) || (!user))) {
+		fatalx(EXIT_FAILURE, "set requests need -w <var>, -u and -p");
+	}
+
+	if ((weight[REQ_CMD] > 0) && ((!cmdname) || (!user))) {
+		fatalx(EXIT_FAILURE, "cmd requests need -x <cmd>, -u and -p");
+	}
+
+	if (upscli_splitname(argv[optind], &upsname, &hostname, &port) != 0) {
+		fatalx(EXIT_FAILURE, "invalid UPS definition %s", argv[optind]);
+	}
+
+	if (use_tls) {
+#ifdef WITH_OPENSSL
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+		SSL_load_error_strings();
+		SSL_library_init();
+
+		ssl_ctx = SSL_CTX_new(SSLv23_client_method());
+#else
+		ssl_ctx = SSL_CTX_new(TLS_client_method());
+#endif
+
+		if (!ssl_ctx) {
+			fatalx(EXIT_FAILURE, "Can not initialize SSL context");
+		}
+
+		/* what is measured is upsd, not the certificates */
+		SSL_CTX_set_verify(ssl_ctx, SSL_VERIFY_NONE, NULL);
+#else
+		fatalx(EXIT_FAILURE, "-s needs NUT built with OpenSSL");
+#endif	/* WITH_OPENSSL */
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	raise_fd_limit(clients);
+
+	numdevices = extra + 1;
+	device = xcalloc(numdevices, sizeof(*device));
+	device[0] = upsname;
+
+	for (i = 1; i < numdevices; i++) {
+		snprintf(name, sizeof(name), "%s-%d", upsname, i);
+		device[i] = xstrdup(name);
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(service, sizeof(service), "%d", port);
+
+	if ((ret = getaddrinfo(hostname, service, &hints, &ai)) != 0) {
+		fatalx(EXIT_FAILURE, "%s: %s", hostname, gai_strerror(ret));
+	}
+
+	client = xcalloc(clients, sizeof(*client));
+	fds = xcalloc(clients, sizeof(*fds));
+
+	get_monotonic_time(&start);
+
+	for (i = 0; i < clients; i++) {
+		open_client(&client[i], ai);
+	}
+
+	setup_s = elapsed_since(&start);
+	freeaddrinfo(ai);
+
+	/* the first connection lists the variables, still blocking */
+	fcntl(client[0].fd, F_SETFL, fcntl(client[0].fd, F_GETFL) & ~O_NONBLOCK);
+	list_vars(&client[0]);
+	fcntl(client[0].fd, F_SETFL, fcntl(client[0].fd, F_GETFL) | O_NONBLOCK);
+
+	srandom(1);
+	get_monotonic_time(&start);
+
+	for (i = 0; i < clients; i++) {
+		if (send_next(&client[i]) < 0) {
+			fatalx(EXIT_FAILURE, "lost connection %d to %s:%d", i, hostname, port);
+		}
+	}
+
+	while ((run_s = elapsed_since(&start)) < seconds) {
+
+		for (i = 0; i < clients; i++) {
+			fds[i].fd = client[i].fd;
+			fds[i].events = POLLIN;
+
+			if (client[i].outsent < client[i].outlen) {
+				fds[i].events |= POLLOUT;
+			}
+		}
+
+		if (poll(fds, clients, 100) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			fatal_with_errno(EXIT_FAILURE, "poll");
+		}
+
+		for (i = 0; i < clients; i++) {
+
+			if ((fds[i].fd < 0) || (!fds[i].revents)) {
+				continue;
+			}
+
+			if (client_ready(&client[i], fds[i].revents, 1) < 0) {
+				upslogx(LOG_WARNING, "connection %d closed by upsd", i);
+				close_client(&client[i]);
+				dropped++;
+			}
+		}
+	}
+
+	/* answers still in flight are not counted */
+	for (i = 0; i < clients; i++) {
+		if (client[i].fd >= 0) {
+			close_client(&client[i]);
+		}
+	}
+
+	printf("%d clients%s on %d devices of %s:%d, connected in %.2f s, run of %.1f s\n",
+		clients, use_tls ? " with TLS" : "", numdevices, hostname, port, setup_s, run_s);
+	printf("%-5s %10s %10s %7s %8s %8s %8s %8s\n", "",
+		"requests", "req/s", "errors", "p50 us", "p99 us", "p999 us", "max us");
+
+	memset(&all, 0, sizeof(all));
+
+	for (i = 0; i < NUMREQ; i++) {
+		size_t	j;
+
+		if (weight[i] < 1) {
+			continue;
+		}
+
+		report(reqname[i], &sample[i], run_s);
+
+		for (j = 0; j < sample[i].count; j++) {
+			add_sample(&all, sample[i].usec[j]);
+		}
+
+		all.errors += sample[i].errors;
+		free(sample[i].usec);
+	}
+
+	report("all", &all, run_s);
+	free(all.usec);
+	errors = all.errors;
+
+	if (dropped) {
+		printf("%d connections dropped\n", dropped);
+	}
+
+	return (dropped || errors) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+#!/bin/sh
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+#! \file    nutupsdbench.sh
+#  \brief   Load test of upsd, run by "make bench"
+#  \details Starts a private upsd on the loopback interface, fed by one
+#           dummy-ups simulating BENCH_DEVICES devices, and runs
+#           nutupsdbench against it. The built programs are used, nothing
+#           needs to be installed. Settings, from the environment:
+#             BENCH_CLIENTS   concurrent connections (1000)
+#             BENCH_DEVICES   simulated devices besides the first (100)
+#             BENCH_SECONDS   duration of the run (10)
+#             BENCH_MIX       weights of get, list, set and cmd requests
+#                             (get:80,list:10,set:5,cmd:5)
+#             BENCH_TLS       "yes" to use STARTTLS, needs the openssl tool
+#             BENCH_PORT      port of upsd (34930)
+
+[ -n "${BUILDDIR-}" ] || BUILDDIR="`dirname $0`"
+[ -n "${SRCDIR-}" ] || SRCDIR="`dirname $0`"
+[ -n "${TOP_BUILDDIR-}" ] || TOP_BUILDDIR="$BUILDDIR/.."
+[ -n "${TOP_SRCDIR-}" ] || TOP_SRCDIR="$SRCDIR/.."
+
+CLIENTS="${BENCH_CLIENTS-1000}"
+DEVICES="${BENCH_DEVICES-100}"
+SECONDS_RUN="${BENCH_SECONDS-10}"
+MIX="${BENCH_MIX-get:80,list:10,set:5,cmd:5}"
+PORT="${BENCH_PORT-34930}"
+
+for F in "$TOP_BUILDDIR/drivers/dummy-ups" "$TOP_BUILDDIR/server/upsd" \
+    "$TOP_BUILDDIR/clients/upsc" "$BUILDDIR/nutupsdbench" ; do
+    [ -x "$F" ] || { echo "ERROR: $F is not built" >&2 ; exit 1 ; }
+done
+
+BENCHDIR="`mktemp -d "${TMPDIR:-/tmp}/nutupsdbench.XXXXXX"`" || exit 1
+
+cleanup() {
+    for P in "$BENCHDIR"/state/*.pid ; do
+        [ -s "$P" ] && kill "`cat "$P"`" 2>/dev/null
+    done
+    sleep 1
+    rm -rf "$BENCHDIR"
+}
+trap cleanup EXIT
+trap 'exit 2' INT TERM
+
+mkdir "$BENCHDIR/etc" "$BENCHDIR/state" && chmod 700 "$BENCHDIR/state" || exit 1
+
+NUT_CONFPATH="$BENCHDIR/etc"
+NUT_STATEPATH="$BENCHDIR/state"
+NUT_ALTPIDPATH="$BENCHDIR/state"
+export NUT_CONFPATH NUT_STATEPATH NUT_ALTPIDPATH
+
+# each device has a connection on both sides, each client one in upsd
+ulimit -n `expr $CLIENTS + 2 \* $DEVICES + 64` 2>/dev/null || \
+    echo "WARNING: could not raise the limit of open files to fit $CLIENTS clients and $DEVICES devices" >&2
+
+cp "$TOP_SRCDIR/data/evolution500.seq" "$BENCHDIR/etc/" || exit 1
+
+cat > "$BENCHDIR/etc/ups.conf" <<EOF
+[bench]
+	driver = dummy-ups
+	port = evolution500.seq
+	devices = $DEVICES
+	simvars = 20
+	simrate = 1
+EOF
+
+cat > "$BENCHDIR/etc/upsd.conf" <<EOF
+LISTEN 127.0.0.1 $PORT
+EOF
+
+cat > "$BENCHDIR/etc/upsd.users" <<EOF
+[bench]
+	password = bench
+	actions = SET
+	instcmds = ALL
+EOF
+
+TLS=""
+case "${BENCH_TLS-}" in
+    [Yy]|[Yy][Ee][Ss])
+        openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj "/CN=localhost" \
+            -keyout "$BENCHDIR/etc/key.pem" -out "$BENCHDIR/etc/cert.pem" >/dev/null 2>&1 \
+        || { echo "ERROR: could not make a certificate with the openssl tool" >&2 ; exit 1 ; }
+        cat "$BENCHDIR/etc/cert.pem" "$BENCHDIR/etc/key.pem" > "$BENCHDIR/etc/upsd.pem"
+        echo "CERTFILE $BENCHDIR/etc/upsd.pem" >> "$BENCHDIR/etc/upsd.conf"
+        TLS="-s"
+        ;;
+esac
+
+chmod 600 "$BENCHDIR"/etc/*
+
+RUNAS="`id -un`"
+
+"$TOP_BUILDDIR/drivers/dummy-ups" -a bench -u "$RUNAS" >"$BENCHDIR/driver.log" 2>&1 \
+    || { cat "$BENCHDIR/driver.log" >&2 ; exit 1 ; }
+"$TOP_BUILDDIR/server/upsd" -u "$RUNAS" >"$BENCHDIR/upsd.log" 2>&1 \
+    || { cat "$BENCHDIR/upsd.log" >&2 ; exit 1 ; }
+
+# wait for upsd to have the data of the last device
+LAST="bench"
+[ "$DEVICES" -gt 0 ] && LAST="bench-$DEVICES"
+TRIES=30
+until "$TOP_BUILDDIR/clients/upsc" "$LAST@127.0.0.1:$PORT" ups.status >/dev/null 2>&1 ; do
+    TRIES="`expr $TRIES - 1`"
+    [ "$TRIES" -gt 0 ] || { echo "ERROR: upsd did not come up" >&2 ; cat "$BENCHDIR"/*.log >&2 ; exit 1 ; }
+    sleep 1
+done
+
+[ "$DEVICES" -gt 0 ] || DEVICES=""
+
+"$BUILDDIR/nutupsdbench" -c "$CLIENTS" ${DEVICES:+-D "$DEVICES"} -t "$SECONDS_RUN" -m "$MIX" \
+    -u bench -p bench -w ups.load -x load.off $TLS "bench@127.0.0.1:$PORT"
@@ -0,0 +1,135 @@
+/* nutupsindextest - sanity checks and a lookup benchmark for the upsd
+ * UPS name index (server/upsindex.c), with 1000 configured devices.
+ *
+ * Each network command resolves its UPS name first; with NUT_TEST_BENCH
+ * set, this compares the cost of that step through the index with the
+ * former linear strcasecmp() scan of the firstups list.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common.h"
+#include "nuttest.h"
+#include "upsindex.h"
+
+#define NUMUPS	1000
+#define ROUNDS	200
+
+upstype_t	*firstups = NULL;
+
+/* what get_ups_ptr() used to do */
+static upstype_t *linear_find(const char *name)
+{
+	upstype_t	*tmp;
+
+	for (tmp = firstups; tmp; tmp = tmp->next) {
+		if (!strcasecmp(tmp->name, name)) {
+			return tmp;
+		}
+	}
+
+	return NULL;
+}
+
+/* the lookups of get_ups_ptr() before and after the index */
+static void bench(void)
+{
+	char	name[SMALLBUF];
+	int	i, r;
+	long	found = 0;
+	double	start, t_linear, t_index;
+
+	start = now();
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; i < NUMUPS; i++) {
+			snprintf(name, sizeof(name), "pdu-rack%04d", (i * 7919) % NUMUPS);
+			found += (linear_find(name) != NULL);
+		}
+	}
+	t_linear = now() - start;
+
+	start = now();
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; i < NUMUPS; i++) {
+			snprintf(name, sizeof(name), "pdu-rack%04d", (i * 7919) % NUMUPS);
+			found += (upsindex_find(name) != NULL);
+		}
+	}
+	t_index = now() - start;
+
+	CHECK(found == 2L * NUMUPS * ROUNDS, "timed lookups");
+
+	printf("UPS name lookup with %d devices: linear %.1f ns, index %.1f ns\n", NUMUPS,
+		t_linear * 1e9 / ((double)NUMUPS * ROUNDS), t_index * 1e9 / ((double)NUMUPS * ROUNDS));
+}
+
+int main(void)
+{
+	upstype_t	*ups, *next;
+	char	name[SMALLBUF];
+	int	i;
+
+	for (i = 0; i < NUMUPS; i++) {
+		snprintf(name, sizeof(name), "pdu-rack%04d", i);
+
+		ups = xcalloc(1, sizeof(*ups));
+		ups->name = xstrdup(name);
+		ups->next = firstups;
+		firstups = ups;
+
+		upsindex_add(ups);
+	}
+
+	for (i = 0; i < NUMUPS; i++) {
+		snprintf(name, sizeof(name), "PDU-Rack%04d", i);
+		ups = upsindex_find(name);
+		CHECK(ups && !strcasecmp(ups->name, name), "find %s", name);
+	}
+
+	CHECK(upsindex_find("pdu-rack9999") == NULL, "missing name");
+	CHECK(upsindex_find(NULL) == NULL, "NULL name");
+
+	/* as delete_ups() does on reload */
+	for (ups = firstups; ups; ups = ups->next) {
+		if (atoi(ups->name + 8) % 2) {
+			upsindex_del(ups);
+		}
+	}
+
+	for (i = 0; i < NUMUPS; i++) {
+		snprintf(name, sizeof(name), "pdu-rack%04d", i);
+		CHECK((upsindex_find(name) != NULL) == !(i % 2), "after delete %s", name);
+	}
+
+	for (ups = firstups; ups; ups = ups->next) {
+		if (atoi(ups->name + 8) % 2) {
+			upsindex_add(ups);
+		}
+	}
+
+	if (bench_wanted()) {
+		bench();
+	}
+
+	upsindex_free();
+
+	for (ups = firstups; ups; ups = next) {
+		next = ups->next;
+		free(ups->name);
+		free(ups);
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,263 @@
+/* nutwatchbench - compares how soon a client learns about a changed
+ * variable with WATCH notifications and with GET polling.
+ *
+ * Run against a live upsd, for instance with a dummy-ups driver:
+ *
+ *	nutwatchbench -u admin -p secret -n 50 -i 1000 dummy@localhost ups.test.result
+ *
+ * One connection sets the variable to a new value, one has a WATCH on
+ * it and one polls it with GET every interval. The latency from the SET
+ * to the notification and to the first poll seeing the new value is
+ * reported for both, with the number of queries the poller needed.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common.h"
+#include "upsclient.h"
+
+#include <poll.h>
+
+/* give up on a change after this long */
+#define CHANGE_TIMEOUT	5000
+
+static char	*upsname = NULL, *hostname = NULL;
+static int	port;
+
+static long ms_since(const struct timeval *start)
+{
+	struct timeval	now;
+
+	get_monotonic_time(&now);
+
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_usec - start->tv_usec) / 1000;
+}
+
+static void open_conn(UPSCONN_t *conn, const char *user, const char *pass)
+{
+	char	buf[SMALLBUF];
+
+	if (upscli_connect(conn, hostname, port, UPSCLI_CONN_TRYSSL) < 0) {
+		fatalx(EXIT_FAILURE, "connect to %s:%d: %s", hostname, port, upscli_strerror(conn));
+	}
+
+	if (!user) {
+		return;
+	}
+
+	snprintf(buf, sizeof(buf), "USERNAME %s\n", user);
+
+	if ((upscli_sendline(conn, buf, strlen(buf)) < 0) ||
+		(upscli_readline(conn, buf, sizeof(buf)) < 0)) {
+		fatalx(EXIT_FAILURE, "USERNAME: %s", upscli_strerror(conn));
+	}
+
+	snprintf(buf, sizeof(buf), "PASSWORD %s\n", pass);
+
+	if ((upscli_sendline(conn, buf, strlen(buf)) < 0) ||
+		(upscli_readline(conn, buf, sizeof(buf)) < 0)) {
+		fatalx(EXIT_FAILURE, "PASSWORD: %s", upscli_strerror(conn));
+	}
+}
+
+static void help(const char *prog)
+{
+	printf("usage: %s -u <user> -p <pass> [-n <changes>] [-i <poll ms>] <ups> <var>\n", prog);
+	printf("  <var> must be writable with SET VAR, e.g. any variable of dummy-ups\n");
+	exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv)
+{
+	UPSCONN_t	setter, watcher, poller;
+	const char	*user = NULL, *pass = NULL, *var;
+	const char	*query[3];
+	char	cmd[SMALLBUF], val[SMALLBUF], **answer;
+	struct pollfd	fds[2];
+	struct timeval	start, nextpoll;
+	unsigned int	numa;
+	long	watch_ms, poll_ms, watch_sum = 0, poll_sum = 0, watch_max = 0, poll_max = 0;
+	int	i, ret, changes = 20, interval = 1000, polls = 0, notifies = 0;
+	int	watch_seen = 0, poll_seen = 0, polling;
+
+	while ((i = getopt(argc, argv, "+hu:p:n:i:")) != -1) {
+		switch (i) {
+		case 'u':
+			user = optarg;
+			break;
+		case 'p':
+			pass = optarg;
+			break;
+		case 'n':
+			changes = atoi(optarg);
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			help(argv[0]);
+		}
+	}
+
+	if ((argc - optind != 2) || (!user) || (!pass) || (changes < 1) || (interval < 1)) {
+		help(argv[0]);
+	}
+
+	if (upscli_splitname(argv[optind], &upsname, &hostname, &port) != 0) {
+		fatalx(EXIT_FAILURE, "invalid UPS definition %s", argv[optind]);
+	}
+
+	var = argv[optind + 1];
+
+	query[0] = "VAR";
+	query[1] = upsname;
+	query[2] = var;
+
+	open_conn(&setter, user, pass);
+	open_conn(&watcher, NULL, NULL);
+	open_conn(&poller, NULL, NULL);
+
+	if (upscli_watch(&watcher, upsname, var) < 0) {
+		fatalx(EXIT_FAILURE, "WATCH: %s", upscli_strerror(&watcher));
+	}
+
+	fds[0].fd = upscli_fd(&watcher);
+	fds[1].fd = upscli_fd(&poller);
+	fds[0].events = fds[1].events = POLLIN;
+
+	/* the poller runs on its own clock, out of phase with the changes */
+	get_monotonic_time(&nextpoll);
+	srandom((unsigned int)nextpoll.tv_usec);
+
+	for (i = 0; i < changes; i++) {
+
+		snprintf(val, sizeof(val), "nutwatchbench-%d-%ld", i, (long)getpid());
+		snprintf(cmd, sizeof(cmd), "SET VAR %s %s \"%s\"\n", upsname, var, val);
+
+		get_monotonic_time(&start);
+
+		if ((upscli_sendline(&setter, cmd, strlen(cmd)) < 0) ||
+			(upscli_readline(&setter, cmd, sizeof(cmd)) < 0)) {
+			fatalx(EXIT_FAILURE, "SET VAR: %s", upscli_strerror(&setter));
+		}
+
+		if (strncmp(cmd, "OK", 2)) {
+			fatalx(EXIT_FAILURE, "SET VAR %s: %s", var, cmd);
+		}
+
+		watch_ms = poll_ms = -1;
+		polling = 0;
+
+		while (((watch_ms < 0) || (poll_ms < 0)) && (ms_since(&start) < CHANGE_TIMEOUT)) {
+			long	wait = -ms_since(&nextpoll);
+
+			if ((wait <= 0) && (!polling)) {
+				if (upscli_get_request(&poller, 3, query) < 0) {
+					fatalx(EXIT_FAILURE, "GET: %s", upscli_strerror(&poller));
+				}
+
+				polls++;
+				polling = 1;
+
+				/* stay on the grid, skipping ticks missed meanwhile */
+				while ((wait = -ms_since(&nextpoll)) <= 0) {
+					nextpoll.tv_sec += interval / 1000;
+					nextpoll.tv_usec += (interval % 1000) * 1000;
+
+					if (nextpoll.tv_usec >= 1000000) {
+						nextpoll.tv_sec++;
+						nextpoll.tv_usec -= 1000000;
+					}
+				}
+			}
+
+			if (wait < 0) {
+				wait = 0;
+			}
+
+			if (poll(fds, 2, (int)wait) < 0) {
+				fatal_with_errno(EXIT_FAILURE, "poll");
+			}
+
+			while ((ret = upscli_watch_next(&watcher, &numa, &answer)) == 1) {
+				notifies++;
+
+				if ((watch_ms < 0) && (numa >= 4) && (!strcmp(answer[0], "VAR")) &&
+					(!strcmp(answer[3], val))) {
+					watch_ms = ms_since(&start);
+				}
+			}
+
+			if (ret < 0) {
+				fatalx(EXIT_FAILURE, "WATCH: %s", upscli_strerror(&watcher));
+			}
+
+			if (!polling) {
+				continue;
+			}
+
+			ret = upscli_get_response(&poller, 3, query, &numa, &answer);
+
+			if (ret < 0) {
+				fatalx(EXIT_FAILURE, "GET: %s", upscli_strerror(&poller));
+			}
+
+			if (ret == 1) {
+				polling = 0;
+
+				if ((poll_ms < 0) && (numa >= 4) && (!strcmp(answer[3], val))) {
+					poll_ms = ms_since(&start);
+				}
+			}
+		}
+
+		/* let the next change fall anywhere between two polls */
+		usleep((useconds_t)(random() % interval) * 1000);
+
+		if (watch_ms >= 0) {
+			watch_seen++;
+			watch_sum += watch_ms;
+
+			if (watch_ms > watch_max) {
+				watch_max = watch_ms;
+			}
+		}
+
+		/* a value the driver overwrites again before the next poll is
+		 * simply never seen by the poller */
+		if (poll_ms >= 0) {
+			poll_seen++;
+			poll_sum += poll_ms;
+
+			if (poll_ms > poll_max) {
+				poll_max = poll_ms;
+			}
+		}
+	}
+
+	upscli_disconnect(&setter);
+	upscli_disconnect(&watcher);
+	upscli_disconnect(&poller);
+
+	printf("changes: %d\n", changes);
+	printf("watch: %d seen, mean %ld ms, max %ld ms, %d notifications\n",
+		watch_seen, watch_seen ? watch_sum / watch_seen : 0, watch_max, notifies);
+	printf("poll every %d ms: %d seen, mean %ld ms, max %ld ms, %d queries\n",
+		interval, poll_seen, poll_seen ? poll_sum / poll_seen : 0, poll_max, polls);
+
+	/* every change has to be notified */
+	return (watch_seen == changes) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -40,11 +40,12 @@
 
 #define ERR_BAD_OPTION	(-1)
 
-static const char optstring[] = "?ht:s:e:E:c:l:u:W:X:w:x:p:b:B:d:L:CUSMOAm:NPqIVaD";
+static const char optstring[] = "?ht:T:s:e:E:c:l:u:W:X:w:x:p:b:B:d:L:CUSMOAm:NPqIVaD";
 
 #ifdef HAVE_GETOPT_LONG
 static const struct option longopts[] = {
 	{ "timeout", required_argument, NULL, 't' },
+	{ "thread", required_argument, NULL, 'T' },
 	{ "start_ip", required_argument, NULL, 's' },
 	{ "end_ip", required_argument, NULL, 'e' },
 	{ "eaton_serial", required_argument, NULL, 'E' },
@@ -89,6 +90,23 @@ static char * end_ip = NULL;
 static char * port = NULL;
 static char * serial_ports = NULL;
 
+static void (*display_func)(nutscan_device_t * device);
+
+/* set for the buses whose devices were displayed as they were found */
+static int streamed[TYPE_END];
+
+/* device callback: display each device right away, rather than once all
+ * the scans are done; scans run in parallel, keep their output apart */
+static void display_found(nutscan_device_t * device)
+{
+	flockfile(stdout);
+	display_func(device);
+	fflush(stdout);
+	funlockfile(stdout);
+
+	streamed[device->type] = 1;
+}
+
 #ifdef HAVE_PTHREAD
 static pthread_t thread[TYPE_END];
 
@@ -177,6 +195,7 @@ static void show_usage()
 
 	printf("\nNetwork specific options:\n");
 	printf("  -t, --timeout <timeout in seconds>: network operation timeout (default %d).\n", DEFAULT_NETWORK_TIMEOUT);
+	printf("  -T, --thread <max number of threads>: Maximum number of addresses scanned at once (default %d).\n", DEFAULT_SCAN_THREADS);
 	printf("  -s, --start_ip <IP address>: First IP address to scan.\n");
 	printf("  -e, --end_ip <IP address>: Last IP address to scan.\n");
 	printf("  -m, --mask_cidr <IP address/mask>: Give a range of IP using CIDR notation.\n");
@@ -234,7 +253,6 @@ int main(int argc, char *argv[])
 	int allow_ipmi = 0;
 	int allow_eaton_serial = 0; /* MUST be requested explicitly! */
 	int quiet = 0; /* The debugging level for certain upsdebugx() progress messages; 0 = print always, quiet==1 is to require at least one -D */
-	void (*display_func)(nutscan_device_t * device);
 	int ret_code = EXIT_SUCCESS;
 
 	memset(&snmp_sec, 0, sizeof(snmp_sec));
@@ -281,6 +299,13 @@ int main(int argc, char *argv[])
 					timeout = DEFAULT_NETWORK_TIMEOUT * 1000 * 1000;
 				}
 				break;
+			case 'T':
+				nutscan_max_threads = atoi(optarg);
+				if( nutscan_max_threads < 1 ) {
+					fprintf(stderr,"Illegal number of threads, using default %d\n", DEFAULT_SCAN_THREADS);
+					nutscan_max_threads = DEFAULT_SCAN_THREADS;
+				}
+				break;
 			case 's':
 				start_ip = strdup(optarg);
 				if (end_ip == NULL)
@@ -488,6 +513,9 @@ display_help:
 		/* BEWARE: allow_all does not include allow_eaton_serial! */
 	}
 
+	/* network scans can take long: show their devices as they come */
+	nutscan_set_device_callback(display_found);
+
 /* TODO/discuss : Should the #else...#endif code below for lack of pthreads
  * during build also serve as a fallback for pthread failure at runtime?
  */
@@ -650,37 +678,51 @@ display_help:
 	upsdebugx(1,"SCANS DONE: display results");
 
 	upsdebugx(1,"SCANS DONE: display results: USB");
-	display_func(dev[TYPE_USB]);
+	if( !streamed[TYPE_USB] ) {
+		display_func(dev[TYPE_USB]);
+	}
 	upsdebugx(1,"SCANS DONE: free resources: USB");
 	nutscan_free_device(dev[TYPE_USB]);
 
 	upsdebugx(1,"SCANS DONE: display results: SNMP");
-	display_func(dev[TYPE_SNMP]);
+	if( !streamed[TYPE_SNMP] ) {
+		display_func(dev[TYPE_SNMP]);
+	}
 	upsdebugx(1,"SCANS DONE: free resources: SNMP");
 	nutscan_free_device(dev[TYPE_SNMP]);
 
 	upsdebugx(1,"SCANS DONE: display results: XML/HTTP");
-	display_func(dev[TYPE_XML]);
+	if( !streamed[TYPE_XML] ) {
+		display_func(dev[TYPE_XML]);
+	}
 	upsdebugx(1,"SCANS DONE: free resources: XML/HTTP");
 	nutscan_free_device(dev[TYPE_XML]);
 
 	upsdebugx(1,"SCANS DONE: display results: NUT bus (old)");
-	display_func(dev[TYPE_NUT]);
+	if( !streamed[TYPE_NUT] ) {
+		display_func(dev[TYPE_NUT]);
+	}
 	upsdebugx(1,"SCANS DONE: free resources: NUT bus (old)");
 	nutscan_free_device(dev[TYPE_NUT]);
 
 	upsdebugx(1,"SCANS DONE: display results: NUT bus (avahi)");
-	display_func(dev[TYPE_AVAHI]);
+	if( !streamed[TYPE_AVAHI] ) {
+		display_func(dev[TYPE_AVAHI]);
+	}
 	upsdebugx(1,"SCANS DONE: free resources: NUT bus (avahi)");
 	nutscan_free_device(dev[TYPE_AVAHI]);
 
 	upsdebugx(1,"SCANS DONE: display results: IPMI");
-	display_func(dev[TYPE_IPMI]);
+	if( !streamed[TYPE_IPMI] ) {
+		display_func(dev[TYPE_IPMI]);
+	}
 	upsdebugx(1,"SCANS DONE: free resources: IPMI");
 	nutscan_free_device(dev[TYPE_IPMI]);
 
 	upsdebugx(1,"SCANS DONE: display results: SERIAL");
-	display_func(dev[TYPE_EATON_SERIAL]);
+	if( !streamed[TYPE_EATON_SERIAL] ) {
+		display_func(dev[TYPE_EATON_SERIAL]);
+	}
 	upsdebugx(1,"SCANS DONE: free resources: SERIAL");
 	nutscan_free_device(dev[TYPE_EATON_SERIAL]);
 
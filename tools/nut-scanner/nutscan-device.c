@@ -36,6 +36,20 @@ const char * nutscan_device_type_strings[TYPE_END - 1] = {
 	"serial",
 };
 
+static nutscan_device_cb_t device_cb = NULL;
+
+void nutscan_set_device_callback(nutscan_device_cb_t cb)
+{
+	device_cb = cb;
+}
+
+void nutscan_report_device(nutscan_device_t * device)
+{
+	if( device_cb != NULL && device != NULL ) {
+		device_cb(device);
+	}
+}
+
 nutscan_device_t * nutscan_new_device()
 {
 	nutscan_device_t * device;
@@ -75,6 +75,22 @@ void nutscan_free_device(nutscan_device_t * device);
 void nutscan_add_option_to_device(nutscan_device_t * device,char * option, char * value);
 nutscan_device_t * nutscan_add_device_to_device(nutscan_device_t * first, nutscan_device_t * second);
 
+/**
+ *  \brief  Callback for devices as they are found
+ *
+ *  Called by the network scans with each new device, before it is added
+ *  to the list they return (so the device is alone in its list), with
+ *  the scan's own lock held.  Scans run in parallel: the callback must
+ *  be thread-safe.  NULL (the default) disables it.
+ *
+ *  \param  cb  Callback, the device remains owned by the scan
+ */
+typedef void (*nutscan_device_cb_t)(nutscan_device_t * device);
+void nutscan_set_device_callback(nutscan_device_cb_t cb);
+
+/** Pass a device just found to the callback, if any */
+void nutscan_report_device(nutscan_device_t * device);
+
 /**
  *  \brief  Rewind device list
  *
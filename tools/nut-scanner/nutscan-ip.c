@@ -27,6 +27,22 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+int nutscan_max_threads = DEFAULT_SCAN_THREADS;
+
+/* addresses of a range handed out to the workers of nutscan_ip_range_run() */
+typedef struct ip_pool {
+	nutscan_ip_iter_t	iter;
+	char *	next;	/* NULL once the range is done */
+	void	(*probe)(const char * ip, enum network_type type, void * arg);
+	void *	arg;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_t	mutex;
+#endif
+} ip_pool_t;
 
 static void increment_IPv6(struct in6_addr * addr)
 {
@@ -400,3 +416,103 @@ int nutscan_cidr_to_ip(const char * cidr, char ** start_ip, char ** stop_ip)
 	free(first_ip);
 	return 1;
 }
+
+static char * ip_pool_get(ip_pool_t * pool)
+{
+	char * ip;
+
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&pool->mutex);
+#endif
+	ip = pool->next;
+	if( ip != NULL ) {
+		pool->next = nutscan_ip_iter_inc(&pool->iter);
+	}
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&pool->mutex);
+#endif
+
+	return ip;
+}
+
+static void * ip_pool_worker(void * arg)
+{
+	ip_pool_t * pool = (ip_pool_t *)arg;
+	char * ip;
+
+	while( (ip = ip_pool_get(pool)) != NULL ) {
+		pool->probe(ip, pool->iter.type, pool->arg);
+		free(ip);
+	}
+
+	return NULL;
+}
+
+void nutscan_ip_range_run(const char * startIP, const char * stopIP,
+	void (*probe)(const char * ip, enum network_type type, void * arg),
+	void * arg)
+{
+	ip_pool_t pool;
+#ifdef HAVE_PTHREAD
+	pthread_t * thread_array;
+	int thread_count = 0;
+	int max_threads = nutscan_max_threads;
+	int i, more;
+#endif
+
+	memset(&pool, 0, sizeof(pool));
+	pool.probe = probe;
+	pool.arg = arg;
+	pool.next = nutscan_ip_iter_init(&pool.iter, startIP, stopIP);
+
+	if( pool.next == NULL ) {
+		return;
+	}
+
+#ifdef HAVE_PTHREAD
+	if( max_threads < 1 ) {
+		max_threads = 1;
+	}
+
+	thread_array = calloc((size_t)max_threads, sizeof(pthread_t));
+	if( thread_array == NULL ) {
+		max_threads = 0;
+	}
+
+	pthread_mutex_init(&pool.mutex, NULL);
+
+	/* no more workers than addresses: a single host needs one thread */
+	for( i = 0; i < max_threads; i++ ) {
+		pthread_mutex_lock(&pool.mutex);
+		more = (pool.next != NULL);
+		pthread_mutex_unlock(&pool.mutex);
+
+		if( !more ) {
+			break;
+		}
+
+		if( pthread_create(&thread_array[i], NULL, ip_pool_worker, &pool) != 0 ) {
+			upsdebugx(1, "%s: pthread_create failed, going on with %d threads", __func__, thread_count);
+			break;
+		}
+
+		thread_count++;
+	}
+
+	upsdebugx(2, "%s: %d threads scanning %s to %s", __func__, thread_count, startIP, stopIP ? stopIP : startIP);
+
+	/* without any thread, scan from here */
+	if( thread_count == 0 ) {
+		ip_pool_worker(&pool);
+	}
+
+	for( i = 0; i < thread_count; i++ ) {
+		pthread_join(thread_array[i], NULL);
+	}
+
+	pthread_mutex_destroy(&pool.mutex);
+	free(thread_array);
+#else
+	ip_pool_worker(&pool);
+#endif
+}
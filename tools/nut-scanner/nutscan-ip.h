@@ -50,6 +50,19 @@ char * nutscan_ip_iter_init(nutscan_ip_iter_t *, const char * startIP, const cha
 char * nutscan_ip_iter_inc(nutscan_ip_iter_t *);
 int nutscan_cidr_to_ip(const char * cidr, char ** start_ip, char ** stop_ip);
 
+/* default for nutscan_max_threads */
+#define DEFAULT_SCAN_THREADS	128
+
+/* how many addresses of a range are probed at once */
+extern int nutscan_max_threads;
+
+/* call probe() for each address from startIP to stopIP, with at most
+   nutscan_max_threads calls running at once; the ip string is only
+   valid during the call */
+void nutscan_ip_range_run(const char * startIP, const char * stopIP,
+	void (*probe)(const char * ip, enum network_type type, void * arg),
+	void * arg);
+
 #ifdef __cplusplus
 /* *INDENT-OFF* */
 }
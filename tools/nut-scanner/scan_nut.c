@@ -48,7 +48,7 @@ static pthread_mutex_t dev_mutex;
 #endif
 
 struct scan_nut_arg {
-	char * hostname;
+	const char * port;
 	long timeout;
 };
 
@@ -122,10 +122,10 @@ err:
 }
 
 /* FIXME: SSL support */
-static void * list_nut_devices(void * arg)
+static void list_nut_devices(const char * ip, enum network_type type, void * arg)
 {
 	struct scan_nut_arg * nut_arg = (struct scan_nut_arg*)arg;
-	char *target_hostname = nut_arg->hostname;
+	char target_hostname[SMALLBUF];
 	struct timeval tv;
 	int port;
 	unsigned int numq, numa;
@@ -142,36 +142,44 @@ static void * list_nut_devices(void * arg)
 	query[0] = "UPS";
 	numq = 1;
 
+	if( nut_arg->port ) {
+		if( type == IPv4 ) {
+			snprintf(target_hostname,sizeof(target_hostname),"%s:%s",ip,nut_arg->port);
+		}
+		else {
+			snprintf(target_hostname,sizeof(target_hostname),"[%s]:%s",ip,nut_arg->port);
+		}
+	}
+	else {
+		snprintf(target_hostname,sizeof(target_hostname),"%s",ip);
+	}
+
 	if ((*nut_upscli_splitaddr)(target_hostname, &hostname, &port) != 0) {
-		free(target_hostname);
-		free(nut_arg);
+		free(hostname);
 		free(ups);
-		return NULL;
+		return;
 	}
 
 	if ((*nut_upscli_tryconnect)(ups, hostname, port,UPSCLI_CONN_TRYSSL,&tv) < 0) {
-		free(target_hostname);
-		free(nut_arg);
+		free(hostname);
 		free(ups);
-		return NULL;
+		return;
 	}
 
 	if((*nut_upscli_list_start)(ups, numq, query) < 0) {
 		(*nut_upscli_disconnect)(ups);
-		free(target_hostname);
-		free(nut_arg);
+		free(hostname);
 		free(ups);
-		return NULL;
+		return;
 	}
 
 	while ((*nut_upscli_list_next)(ups,numq, query, &numa, &answer) == 1) {
 		/* UPS <upsname> <description> */
 		if (numa < 3) {
 			(*nut_upscli_disconnect)(ups);
-			free(target_hostname);
-			free(nut_arg);
+			free(hostname);
 			free(ups);
-			return NULL;
+			return;
 		}
 		/* FIXME: check for duplication by getting driver.port and device.serial
 		 * for comparison with other busses results */
@@ -190,6 +198,7 @@ static void * list_nut_devices(void * arg)
 #ifdef HAVE_PTHREAD
 			pthread_mutex_lock(&dev_mutex);
 #endif
+			nutscan_report_device(dev);
 			dev_ret = nutscan_add_device_to_device(dev_ret,dev);
 #ifdef HAVE_PTHREAD
 			pthread_mutex_unlock(&dev_mutex);
@@ -199,29 +208,16 @@ static void * list_nut_devices(void * arg)
 	}
 
 	(*nut_upscli_disconnect)(ups);
-	free(target_hostname);
-	free(nut_arg);
+	free(hostname);
 	free(ups);
-	return NULL;
 }
 
 nutscan_device_t * nutscan_scan_nut(const char* startIP, const char* stopIP, const char* port,long usec_timeout)
 {
-	nutscan_ip_iter_t ip;
-	char * ip_str = NULL;
-	char * ip_dest = NULL;
-	char buf[SMALLBUF];
 	struct sigaction oldact;
 	int change_action_handler = 0;
-	int i;
-	struct scan_nut_arg *nut_arg;
-#ifdef HAVE_PTHREAD
-	pthread_t thread;
-	pthread_t * thread_array = NULL;
-	int thread_count = 0;
-
-	pthread_mutex_init(&dev_mutex,NULL);
-#endif
+	struct scan_nut_arg nut_arg;
+	nutscan_device_t * result;
 
 	if( !nutscan_avail_nut ) {
 		return NULL;
@@ -242,58 +238,17 @@ nutscan_device_t * nutscan_scan_nut(const char* startIP, const char* stopIP, con
 #endif
 	}
 
-	ip_str = nutscan_ip_iter_init(&ip,startIP,stopIP);
+	nut_arg.port = port;
+	nut_arg.timeout = usec_timeout;
 
-	while( ip_str != NULL )
-	{
-		if( port ) {
-			if( ip.type == IPv4 ) {
-				snprintf(buf,sizeof(buf),"%s:%s",ip_str,port);
-			}
-			else {
-				snprintf(buf,sizeof(buf),"[%s]:%s",ip_str,port);
-			}
-
-			ip_dest = strdup(buf);
-		}
-		else {
-			ip_dest = strdup(ip_str);
-		}
-
-		if((nut_arg = malloc(sizeof(struct scan_nut_arg))) == NULL ) {
-			free(ip_dest);
-			break;
-		}
-
-		nut_arg->timeout = usec_timeout;
-		nut_arg->hostname = ip_dest;
 #ifdef HAVE_PTHREAD
-		if (pthread_create(&thread,NULL,list_nut_devices,(void*)nut_arg)==0){
-			thread_count++;
-			pthread_t *new_thread_array = realloc(thread_array,
-						thread_count*sizeof(pthread_t));
-			if (new_thread_array == NULL) {
-				upsdebugx(1, "%s: Failed to realloc thread", __func__);
-				break;
-			}
-			else {
-				thread_array = new_thread_array;
-			}
-			thread_array[thread_count-1] = thread;
-		}
-#else
-		list_nut_devices(nut_arg);
+	pthread_mutex_init(&dev_mutex,NULL);
 #endif
-		free(ip_str);
-		ip_str = nutscan_ip_iter_inc(&ip);
-	}
+
+	nutscan_ip_range_run(startIP, stopIP, list_nut_devices, &nut_arg);
 
 #ifdef HAVE_PTHREAD
-	for ( i=0; i < thread_count ; i++) {
-		pthread_join(thread_array[i],NULL);
-	}
 	pthread_mutex_destroy(&dev_mutex);
-	free(thread_array);
 #endif
 
 	if(change_action_handler) {
@@ -307,5 +262,7 @@ nutscan_device_t * nutscan_scan_nut(const char* startIP, const char* stopIP, con
 #endif
 	}
 
-	return nutscan_rewind_device(dev_ret);
+	result = nutscan_rewind_device(dev_ret);
+	dev_ret = NULL;
+	return result;
 }
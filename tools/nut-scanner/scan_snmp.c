@@ -323,6 +323,7 @@ static void scan_snmp_add_device(nutscan_snmp_t * sec, struct snmp_pdu *response
 #ifdef HAVE_PTHREAD
 	pthread_mutex_lock(&dev_mutex);
 #endif
+	nutscan_report_device(dev);
 	dev_ret = nutscan_add_device_to_device(dev_ret,dev);
 #ifdef HAVE_PTHREAD
 	pthread_mutex_unlock(&dev_mutex);
@@ -689,19 +690,27 @@ try_SysOID_free:
 	return NULL;
 }
 
-nutscan_device_t * nutscan_scan_snmp(const char * start_ip, const char * stop_ip,long usec_timeout, nutscan_snmp_t * sec)
+/* nutscan_ip_range_run() worker: probe one address with a copy of the
+ * caller's settings, which try_SysOID() frees */
+static void try_SysOID_ip(const char * ip, enum network_type type, void * arg)
 {
-	int i;
 	nutscan_snmp_t * tmp_sec;
-	nutscan_ip_iter_t ip;
-	char * ip_str = NULL;
-#ifdef HAVE_PTHREAD
-	pthread_t thread;
-	pthread_t * thread_array = NULL;
-	int thread_count = 0;
 
-	pthread_mutex_init(&dev_mutex,NULL);
-#endif
+	NUT_UNUSED_VARIABLE(type);
+
+	tmp_sec = malloc(sizeof(nutscan_snmp_t));
+	if( tmp_sec == NULL ) {
+		return;
+	}
+
+	memcpy(tmp_sec, arg, sizeof(nutscan_snmp_t));
+	tmp_sec->peername = strdup(ip);
+	try_SysOID((void *)tmp_sec);
+}
+
+nutscan_device_t * nutscan_scan_snmp(const char * start_ip, const char * stop_ip,long usec_timeout, nutscan_snmp_t * sec)
+{
+	nutscan_device_t * result;
 
 	if( !nutscan_avail_snmp ) {
 		return NULL;
@@ -718,41 +727,17 @@ nutscan_device_t * nutscan_scan_snmp(const char * start_ip, const char * stop_ip
 	/* Initialize the SNMP library */
 	(*nut_init_snmp)("nut-scanner");
 
-	ip_str = nutscan_ip_iter_init(&ip, start_ip, stop_ip);
-
-	while(ip_str != NULL) {
-		tmp_sec = malloc(sizeof(nutscan_snmp_t));
-		memcpy(tmp_sec, sec, sizeof(nutscan_snmp_t));
-		tmp_sec->peername = ip_str;
-
 #ifdef HAVE_PTHREAD
-		if (pthread_create(&thread,NULL,try_SysOID,(void*)tmp_sec)==0){
-			thread_count++;
-			pthread_t *new_thread_array = realloc(thread_array,
-						thread_count*sizeof(pthread_t));
-			if (new_thread_array == NULL) {
-				upsdebugx(1, "%s: Failed to realloc thread", __func__);
-				break;
-			}
-			else {
-				thread_array = new_thread_array;
-			}
-			thread_array[thread_count-1] = thread;
-		}
-#else
-		try_SysOID((void *)tmp_sec);
+	pthread_mutex_init(&dev_mutex,NULL);
 #endif
-		ip_str = nutscan_ip_iter_inc(&ip);
-	}
+
+	nutscan_ip_range_run(start_ip, stop_ip, try_SysOID_ip, sec);
 
 #ifdef HAVE_PTHREAD
-	for ( i=0; i < thread_count ; i++) {
-		pthread_join(thread_array[i],NULL);
-	}
 	pthread_mutex_destroy(&dev_mutex);
-	free(thread_array);
 #endif
-	nutscan_device_t * result = nutscan_rewind_device(dev_ret);
+
+	result = nutscan_rewind_device(dev_ret);
 	dev_ret = NULL;
 	return result;
 }
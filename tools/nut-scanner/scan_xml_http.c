@@ -305,6 +305,7 @@ static void * nutscan_scan_xml_http_generic(void * arg)
 					sprintf(buf, "http://%s", string);
 					nut_dev->port = strdup(buf);
 					upsdebugx(3,"nutscan_scan_xml_http_generic(): Adding configuration for driver='%s' port='%s'", nut_dev->driver, nut_dev->port);
+					nutscan_report_device(nut_dev);
 					dev_ret = nutscan_add_device_to_device(
 						dev_ret,nut_dev);
 #ifdef HAVE_PTHREAD
@@ -345,11 +346,22 @@ end:
 	return NULL;
 }
 
+/* nutscan_ip_range_run() worker: query one address */
+static void nutscan_scan_xml_http_ip(const char * ip, enum network_type type, void * arg)
+{
+	nutscan_xml_t tmp_sec;
+
+	NUT_UNUSED_VARIABLE(type);
+
+	memcpy(&tmp_sec, arg, sizeof(nutscan_xml_t));
+	tmp_sec.peername = (char *)ip;
+	nutscan_scan_xml_http_generic((void *)&tmp_sec);
+}
+
 nutscan_device_t * nutscan_scan_xml_http_range(const char * start_ip, const char * end_ip, long usec_timeout, nutscan_xml_t * sec)
 {
 	nutscan_xml_t * tmp_sec = NULL;
 	nutscan_device_t * result = NULL;
-	int i;
 
 	if( !nutscan_avail_xml_http ) {
 		return NULL;
@@ -366,58 +378,18 @@ nutscan_device_t * nutscan_scan_xml_http_range(const char * start_ip, const char
 			upsdebugx(1,"Scanning XML/HTTP bus for single IP (%s).", start_ip);
 		} else {
 			/* Iterate the range of IPs to scan */
-			nutscan_ip_iter_t ip;
-			char * ip_str = NULL;
-#ifdef HAVE_PTHREAD
-			pthread_t thread;
-			pthread_t * thread_array = NULL;
-			int thread_count = 0;
-
-			pthread_mutex_init(&dev_mutex,NULL);
-#endif
-
-			ip_str = nutscan_ip_iter_init(&ip, start_ip, end_ip);
+			nutscan_xml_t range_sec;
 
-			while(ip_str != NULL) {
-				tmp_sec = malloc(sizeof(nutscan_xml_t));
-				if (tmp_sec == NULL) {
-					fprintf(stderr,"Memory allocation \
-						error\n");
-					return NULL;
-				}
-				memcpy(tmp_sec, sec, sizeof(nutscan_xml_t));
-				tmp_sec->peername = ip_str;
-				if (tmp_sec->usec_timeout < 0) tmp_sec->usec_timeout = usec_timeout;
+			memcpy(&range_sec, sec, sizeof(nutscan_xml_t));
+			if (range_sec.usec_timeout < 0) range_sec.usec_timeout = usec_timeout;
 
 #ifdef HAVE_PTHREAD
-				if (pthread_create(&thread,NULL,nutscan_scan_xml_http_generic, (void *)tmp_sec)==0){
-					thread_count++;
-					pthread_t *new_thread_array = realloc(thread_array,
-								thread_count*sizeof(pthread_t));
-					if (new_thread_array == NULL) {
-						upsdebugx(1, "%s: Failed to realloc thread", __func__);
-						break;
-					}
-					else {
-						thread_array = new_thread_array;
-					}
-					thread_array[thread_count-1] = thread;
-				}
-#else
-				nutscan_scan_xml_http_generic((void *)tmp_sec);
+			pthread_mutex_init(&dev_mutex,NULL);
 #endif
-/*				free(ip_str); */ /* One of these free()s seems to cause a double-free */
-				ip_str = nutscan_ip_iter_inc(&ip);
-/*				free(tmp_sec); */
-			}
+
+			nutscan_ip_range_run(start_ip, end_ip, nutscan_scan_xml_http_ip, &range_sec);
 
 #ifdef HAVE_PTHREAD
-			if (thread_array != NULL) {
-				for ( i=0; i < thread_count ; i++) {
-						pthread_join(thread_array[i],NULL);
-				}
-				free(thread_array);
-			}
 			pthread_mutex_destroy(&dev_mutex);
 #endif
 			result = nutscan_rewind_device(dev_ret);